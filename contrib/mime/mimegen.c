@@ -0,0 +1,142 @@
+/* By using this work you agree to the terms and conditions in 'LICENSE.txt' */
+
+/*
+ * Reads a mime.types file from stdin and writes the perfect hash table for
+ * 'src/mime/mime.c' to stdout. See 'make mimetable'.
+ *
+ * Hash and displace: Keys get distributed into buckets by 'mime_hash(0, _)'.
+ * Then, biggest bucket first, each bucket gets the smallest seed which
+ * places all its keys into free slots by 'mime_hash(seed, _)'. A lookup so
+ * costs two hashes and one compare.
+ */
+
+/* Project (first, as it sets up the feature macros) */
+#include "mime.h"
+
+/* System */
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define KEYS_MAX 4096
+
+
+typedef struct Key {
+    char ext[MIME_EXT_MAX+1];
+    const char *type;
+    uint32_t bucket;
+} Key;
+
+
+static Key keys[KEYS_MAX];
+static size_t keys_len;
+
+
+static size_t *bucketSizes;
+
+
+static int cmpBuckets( const void*a_, const void*b_ ){
+    const uint32_t a = *(const uint32_t*)a_, b = *(const uint32_t*)b_;
+    if( bucketSizes[a] != bucketSizes[b] ){
+        return bucketSizes[a] < bucketSizes[b] ? 1 : -1; }
+    return a < b ? -1 : a > b;
+}
+
+
+int main( void ){
+    char line[4096];
+    size_t lineNr = 0;
+    while( fgets(line, sizeof line, stdin) ){
+        lineNr += 1;
+        char *save, *type = strtok_r(line, " \t\r\n", &save);
+        if( type == NULL || type[0] == '#' ){
+            continue; }
+        type = strdup(type);
+        if( type == NULL ){
+            fprintf(stderr, "ENOMEM\n"); return 1; }
+        for( char *ext ; (ext = strtok_r(NULL, " \t\r\n", &save)) ;){
+            if( strlen(ext) > MIME_EXT_MAX || keys_len >= KEYS_MAX ){
+                fprintf(stderr, "%s%zu\n", "EINVAL: Too long or too many at line ", lineNr);
+                return 1;
+            }
+            Key *key = keys + keys_len;
+            for( size_t i=0 ; (key->ext[i] = tolower((unsigned char)ext[i])) ; ++i );
+            for( size_t i=0 ; i<keys_len ; ++i ){
+                if( !strcmp(keys[i].ext, key->ext) ){
+                    fprintf(stderr, "%s%s%s%zu\n", "EINVAL: Duplicate '", key->ext, "' at line ", lineNr);
+                    return 1;
+                }
+            }
+            key->type = type;
+            keys_len += 1;
+        }
+    }
+    if( ferror(stdin) ){
+        fprintf(stderr, "%s%s\n", "fgets(): ", strerror(errno)); return 1; }
+
+    // Load factor below 0.8 keeps the seed search short.
+    size_t numSlots = 1, numBuckets = 1;
+    while( numSlots * 4 < keys_len * 5 ){ numSlots *= 2; }
+    while( numBuckets * 2 < keys_len ){ numBuckets *= 2; }
+    int *slots = malloc(numSlots * sizeof*slots);
+    uint32_t *seeds = calloc(numBuckets, sizeof*seeds);
+    uint32_t *order = malloc(numBuckets * sizeof*order);
+    bucketSizes = calloc(numBuckets, sizeof*bucketSizes);
+    if( !slots || !seeds || !order || !bucketSizes ){
+        fprintf(stderr, "ENOMEM\n"); return 1; }
+    for( size_t i=0 ; i<numSlots ; ++i ){ slots[i] = -1; }
+    for( size_t i=0 ; i<keys_len ; ++i ){
+        keys[i].bucket = mime_hash(0, keys[i].ext, strlen(keys[i].ext)) & (numBuckets-1);
+        bucketSizes[keys[i].bucket] += 1;
+    }
+    for( uint32_t b=0 ; b<numBuckets ; ++b ){ order[b] = b; }
+    qsort(order, numBuckets, sizeof*order, cmpBuckets);
+
+    for( size_t o=0 ; o<numBuckets && bucketSizes[order[o]] ; ++o ){
+        const uint32_t b = order[o];
+        for( uint32_t seed=1 ;; ++seed ){
+            if( seed == 0 ){
+                fprintf(stderr, "%s\n", "No perfect hash found."); return 1; }
+            size_t placed = 0;
+            for( size_t i=0 ; i<keys_len ; ++i ){
+                if( keys[i].bucket != b ){ continue; }
+                const uint32_t s = mime_hash(seed, keys[i].ext, strlen(keys[i].ext)) & (numSlots-1);
+                if( slots[s] >= 0 ){ break; }
+                slots[s] = i;
+                placed += 1;
+            }
+            if( placed == bucketSizes[b] ){
+                seeds[b] = seed; break; }
+            // Undo and try next seed.
+            for( size_t s=0 ; s<numSlots ; ++s ){
+                if( slots[s] >= 0 && keys[slots[s]].bucket == b ){ slots[s] = -1; }
+            }
+        }
+    }
+
+    printf("%s",
+        "/* By using this work you agree to the terms and conditions in 'LICENSE.txt' */\n"
+        "\n"
+        "/* GENERATED by 'contrib/mime/mimegen.c' from 'contrib/mime/mime.types'.\n"
+        " * Do NOT edit. Use 'make mimetable' instead. */\n"
+        "\n"
+        "#ifndef INCGUARD_b7f31e0a5c6d4e2f8a9d03c1e4b56f27\n"
+        "#define INCGUARD_b7f31e0a5c6d4e2f8a9d03c1e4b56f27\n"
+        "\n\n");
+    printf("#define MIME_TABLE_BUCKETS %zu\n", numBuckets);
+    printf("#define MIME_TABLE_SLOTS %zu\n", numSlots);
+    printf("%s", "\n\nstatic const uint32_t mimeTable_seeds[MIME_TABLE_BUCKETS] = {");
+    for( size_t b=0 ; b<numBuckets ; ++b ){
+        printf("%s%u", b == 0 ? "\n    " : b % 12 ? ", " : ",\n    ", seeds[b]); }
+    printf("%s", "\n};\n\n\nstatic const struct MimeTableSlot {\n"
+        "    const char *ext;\n    const char *type;\n} mimeTable_slots[MIME_TABLE_SLOTS] = {\n");
+    for( size_t s=0 ; s<numSlots ; ++s ){
+        if( slots[s] < 0 ){ continue; }
+        printf("    [%zu] = { \"%s\", \"%s\" },\n", s, keys[slots[s]].ext, keys[slots[s]].type);
+    }
+    printf("%s", "};\n\n\n#endif /* INCGUARD_b7f31e0a5c6d4e2f8a9d03c1e4b56f27 */\n");
+    return 0;
+}
@@ -0,0 +1,148 @@
+#!/usr/bin/env python3
+# By using this work you agree to the terms and conditions in 'LICENSE.txt'
+#
+# Re-checks '--pull --source redis://' against a local redis-server.
+#
+# Seeds a few resources the way gateleen's RedisStorage keeps them (plain,
+# gzip'ed, expired, expiring, never expiring, outside the prefix), pulls
+# 'houston' into a tar and compares what came out.
+#
+#   contrib/redis/redis-source-check.py [path/to/gateleen-resclone]
+#
+# Starts its own 'redis-server' on a free port. Set REDIS_PORT (and
+# REDIS_PASSWORD if needed) to use an already running one instead. That one
+# gets a 'FLUSHDB', so do NOT point it at anything you care about.
+
+import gzip, os, shutil, socket, subprocess, sys, tarfile, tempfile, time
+
+PREFIX = 'rest-storage:resources:'
+EXPIRABLE = 'rest-storage:expirable'
+XATTR_EXPIRE = 'SCHILY.xattr.user.gateleen.header.x-expire-after'
+
+
+class Redis:
+
+    def __init__(self, port, password=None):
+        self.sock = socket.create_connection(('127.0.0.1', port))
+        self.file = self.sock.makefile('rb')
+        if password:
+            self.cmd('AUTH', password)
+
+    def cmd(self, *args):
+        args = [a if isinstance(a, bytes) else str(a).encode() for a in args]
+        req = b'*%d\r\n' % len(args)
+        for a in args:
+            req += b'$%d\r\n%s\r\n' % (len(a), a)
+        self.sock.sendall(req)
+        line = self.file.readline()
+        if line[:1] == b'-':
+            raise RuntimeError('redis: ' + line[1:].strip().decode())
+        if line[:1] == b'$' and int(line[1:]) >= 0:
+            return self.file.read(int(line[1:]) + 2)[:-2]
+        return line[1:].strip()
+
+
+def freePort():
+    with socket.socket() as s:
+        s.bind(('127.0.0.1', 0))
+        return s.getsockname()[1]
+
+
+def waitFor(port):
+    for _ in range(100):
+        try:
+            socket.create_connection(('127.0.0.1', port)).close()
+            return
+        except OSError:
+            time.sleep(0.05)
+    raise RuntimeError('redis-server did not come up on port %d' % port)
+
+
+def seed(r):
+    now = int(time.time() * 1000)
+    r.cmd('FLUSHDB')
+    r.cmd('HSET', PREFIX + 'houston:a:x.json', 'resource', '{"a":1}')
+    r.cmd('HSET', PREFIX + 'houston:a:b:deep.txt', 'resource', 'deep\r\nline')
+    r.cmd('HSET', PREFIX + 'houston:gz.json', 'resource',
+          gzip.compress(b'{"zipped":true}' * 1000), 'compressed', '1')
+    r.cmd('HSET', PREFIX + 'houston:empty', 'resource', '')
+    r.cmd('HSET', PREFIX + 'houston:old.txt', 'resource', 'expired')
+    r.cmd('ZADD', EXPIRABLE, now - 1000, PREFIX + 'houston:old.txt')
+    r.cmd('HSET', PREFIX + 'houston:soon.txt', 'resource', 'expires')
+    r.cmd('ZADD', EXPIRABLE, now + 3600 * 1000, PREFIX + 'houston:soon.txt')
+    r.cmd('HSET', PREFIX + 'houston:never.txt', 'resource', 'never')
+    r.cmd('ZADD', EXPIRABLE, 9999999999999, PREFIX + 'houston:never.txt')
+    r.cmd('SET', PREFIX + 'houston:notahash', 'x')
+    r.cmd('ZADD', 'rest-storage:collections:houston', 1, 'a')
+    r.cmd('HSET', PREFIX + 'other:y', 'resource', 'other')
+
+
+EXPECTED = {
+    'a/x.json': b'{"a":1}',
+    'a/b/deep.txt': b'deep\r\nline',
+    'gz.json': b'{"zipped":true}' * 1000,
+    'empty': b'',
+    'soon.txt': b'expires',
+    'never.txt': b'never',
+}
+
+
+def check(tarPath):
+    fails = []
+    got = {}
+    with tarfile.open(tarPath) as tar:
+        for m in tar.getmembers():
+            if m.isfile():
+                got[m.name.lstrip('./')] = (tar.extractfile(m).read(), m.pax_headers)
+    for name, body in EXPECTED.items():
+        if name not in got:
+            fails.append('missing ' + name)
+        elif got[name][0] != body:
+            fails.append('body differs for ' + name)
+    for name in got:
+        if name not in EXPECTED:
+            fails.append('unexpected ' + name)
+    if 'soon.txt' in got:
+        ttl = got['soon.txt'][1].get(XATTR_EXPIRE)
+        if ttl is None or not 3500 <= int(ttl) <= 3601:
+            fails.append('soon.txt: x-expire-after is %r' % ttl)
+    for name in ('never.txt', 'a/x.json'):
+        if name in got and XATTR_EXPIRE in got[name][1]:
+            fails.append(name + ': unexpected x-expire-after')
+    return fails
+
+
+def main():
+    exe = sys.argv[1] if len(sys.argv) > 1 else 'build/bin/gateleen-resclone'
+    port = os.environ.get('REDIS_PORT')
+    password = os.environ.get('REDIS_PASSWORD')
+    tmp = tempfile.mkdtemp()
+    server = None
+    try:
+        if port is None:
+            port = freePort()
+            server = subprocess.Popen(['redis-server', '--port', str(port), '--bind', '127.0.0.1',
+                                       '--save', '', '--appendonly', 'no', '--dir', tmp],
+                                      stdout=subprocess.DEVNULL)
+            waitFor(port)
+        port = int(port)
+        seed(Redis(port, password))
+        auth = ':%s@' % password if password else ''
+        tarPath = os.path.join(tmp, 'out.tar')
+        subprocess.check_call([exe, '--pull', '--source',
+                               'redis://%s127.0.0.1:%d/rest-storage:resources/houston' % (auth, port),
+                               '--file', tarPath])
+        fails = check(tarPath)
+    finally:
+        if server:
+            server.terminate()
+            server.wait()
+        shutil.rmtree(tmp)
+    for f in fails:
+        print('FAIL: ' + f)
+    print('FAIL' if fails else 'PASS')
+    return 1 if fails else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,229 @@
+/* By using this work you agree to the terms and conditions in 'LICENSE.txt' */
+
+/* This */
+#include "arena.h"
+
+/* System */
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Project */
+#include "hash.h"
+
+
+#define ARENA_ALIGN 16
+#define ALIGN_UP( n ) (((n) + (ARENA_ALIGN-1)) & ~((size_t)ARENA_ALIGN-1))
+
+
+typedef struct ArenaChunk {
+    struct ArenaChunk *next;
+    size_t cap;
+    size_t used;
+} ArenaChunk;
+
+#define CHUNK_HDR_SZ ALIGN_UP(sizeof(ArenaChunk))
+#define CHUNK_DATA( c ) (((char*)(c)) + CHUNK_HDR_SZ)
+
+
+struct Arena {
+    /* All chunks in order of use. */
+    ArenaChunk *head;
+    /* Chunk we currently allocate from. NULL if nothing allocated yet. */
+    ArenaChunk *cur;
+    size_t chunkSize;
+    MemBudget *budget;
+};
+
+
+struct StrIntern {
+    Arena *arena;
+    MemBudget *budget;
+    const char **slots;
+    size_t slots_cap; /* <- Always power of two. */
+    size_t count;
+    size_t maxEntries;
+};
+
+
+Arena* arena_alloc( size_t chunkSize , MemBudget*budget )
+{
+    Arena *arena = calloc(1, sizeof*arena);
+    if( arena == NULL ){ return NULL; }
+    arena->chunkSize = chunkSize ? chunkSize : 1<<16;
+    arena->budget = budget;
+    return arena;
+}
+
+
+void arena_free( Arena*arena )
+{
+    if( arena == NULL ){ return; }
+    for( ArenaChunk *c=arena->head, *next ; c ; c=next ){
+        next = c->next;
+        memBudget_release(arena->budget, CHUNK_HDR_SZ + c->cap);
+        free(c);
+    }
+    free(arena);
+}
+
+
+void* arena_malloc( Arena*arena , size_t sz )
+{
+    ArenaChunk *c = arena->cur;
+    sz = ALIGN_UP(sz ? sz : 1);
+    if( c && c->cap - c->used >= sz ){
+        void *ptr = CHUNK_DATA(c) + c->used;
+        c->used += sz;
+        return ptr;
+    }
+    // Reuse the following chunk (left over from an earlier rewind) if it is
+    // large enough. Otherwise insert a fresh one in front of it.
+    ArenaChunk *next = c ? c->next : arena->head;
+    if( next == NULL || next->cap < sz ){
+        size_t cap = sz > arena->chunkSize ? sz : arena->chunkSize;
+        ArenaChunk *fresh = malloc(CHUNK_HDR_SZ + cap);
+        if( fresh == NULL ){ return NULL; }
+        memBudget_charge(arena->budget, CHUNK_HDR_SZ + cap);
+        fresh->cap = cap;
+        fresh->next = next;
+        if( c ){ c->next = fresh; }else{ arena->head = fresh; }
+        next = fresh;
+    }
+    next->used = sz;
+    arena->cur = next;
+    return CHUNK_DATA(next);
+}
+
+
+char* arena_strndup( Arena*arena , const char*str , size_t str_len )
+{
+    char *dup = arena_malloc(arena, str_len +1);
+    if( dup == NULL ){ return NULL; }
+    memcpy(dup, str, str_len);
+    dup[str_len] = '\0';
+    return dup;
+}
+
+
+ArenaMark arena_mark( Arena*arena )
+{
+    ArenaMark mark = { .chunk = arena->cur, .used = arena->cur ? arena->cur->used : 0 };
+    return mark;
+}
+
+
+void arena_rewind( Arena*arena , ArenaMark mark )
+{
+    arena->cur = mark.chunk;
+    if( mark.chunk ){ mark.chunk->used = mark.used; }
+}
+
+
+StrIntern* strIntern_alloc( size_t maxEntries , MemBudget*budget )
+{
+    StrIntern *intern = calloc(1, sizeof*intern);
+    if( intern == NULL ){ goto fail; }
+    intern->budget = budget;
+    intern->maxEntries = maxEntries;
+    // Keep load factor at or below 0.5 so probe sequences stay short.
+    for( intern->slots_cap=16 ; intern->slots_cap < 2*maxEntries ; intern->slots_cap*=2 );
+    intern->slots = calloc(intern->slots_cap, sizeof*intern->slots);
+    if( intern->slots == NULL ){ goto fail; }
+    memBudget_charge(budget, intern->slots_cap * sizeof*intern->slots);
+    intern->arena = arena_alloc(0, budget);
+    if( intern->arena == NULL ){ goto fail; }
+    return intern;
+fail:
+    strIntern_free(intern);
+    return NULL;
+}
+
+
+void strIntern_free( StrIntern*intern )
+{
+    if( intern == NULL ){ return; }
+    arena_free(intern->arena);
+    if( intern->slots ){
+        memBudget_release(intern->budget, intern->slots_cap * sizeof*intern->slots);
+        free(intern->slots);
+    }
+    free(intern);
+}
+
+
+const char* strIntern_get( StrIntern*intern , const char*str , size_t str_len )
+{
+    const size_t mask = intern->slots_cap - 1;
+    for( size_t i = hash_fnv1a64(HASH_FNV1A64_INIT, str, str_len) & mask ;; i = (i+1) & mask ){
+        const char *slot = intern->slots[i];
+        if( slot == NULL ){
+            if( intern->count >= intern->maxEntries ){ return NULL; }
+            char *dup = arena_strndup(intern->arena, str, str_len);
+            if( dup == NULL ){ return NULL; }
+            intern->slots[i] = dup;
+            intern->count += 1;
+            return dup;
+        }
+        if( !strncmp(slot, str, str_len) && slot[str_len] == '\0' ){
+            return slot;
+        }
+    }
+}
+
+
+int memBudget_acquire( MemBudget*budget , size_t sz )
+{
+    if( budget == NULL ){ return 0; }
+    size_t used = __atomic_load_n(&budget->used, __ATOMIC_RELAXED);
+    do{
+        if( budget->limit && used + sz > budget->limit ){ return -ENOMEM; }
+    }while( !__atomic_compare_exchange_n(&budget->used, &used, used + sz, 0,
+        __ATOMIC_RELAXED, __ATOMIC_RELAXED) );
+    used += sz;
+    for( size_t peak = __atomic_load_n(&budget->peak, __ATOMIC_RELAXED) ; used > peak ;){
+        if( __atomic_compare_exchange_n(&budget->peak, &peak, used, 0,
+            __ATOMIC_RELAXED, __ATOMIC_RELAXED) ){ break; }
+    }
+    return 0;
+}
+
+
+void memBudget_charge( MemBudget*budget , size_t sz )
+{
+    if( budget == NULL ){ return; }
+    size_t used = __atomic_add_fetch(&budget->used, sz, __ATOMIC_RELAXED);
+    for( size_t peak = __atomic_load_n(&budget->peak, __ATOMIC_RELAXED) ; used > peak ;){
+        if( __atomic_compare_exchange_n(&budget->peak, &peak, used, 0,
+            __ATOMIC_RELAXED, __ATOMIC_RELAXED) ){ break; }
+    }
+}
+
+
+void memBudget_release( MemBudget*budget , size_t sz )
+{
+    if( budget == NULL ){ return; }
+    __atomic_sub_fetch(&budget->used, sz, __ATOMIC_RELAXED);
+}
+
+
+int memBudget_growBuf( MemBudget*budget , int isBounded , char**buf , size_t*cap , size_t minCap )
+{
+    if( *cap >= minCap && *buf ){ return 0; }
+    size_t newCap = *cap ? *cap : 1024;
+    while( newCap < minCap ){ newCap *= 2; }
+    const size_t delta = newCap - *cap;
+    if( isBounded ){
+        if( memBudget_acquire(budget, delta) ){ return -ENOMEM; }
+    }else{
+        memBudget_charge(budget, delta);
+    }
+    void *tmp = realloc(*buf, newCap);
+    if( tmp == NULL ){
+        memBudget_release(budget, delta);
+        return -ENOMEM;
+    }
+    *buf = tmp;
+    *cap = newCap;
+    return 0;
+}
@@ -0,0 +1,104 @@
+/* By using this work you agree to the terms and conditions in 'LICENSE.txt' */
+
+#ifndef INCGUARD_3f1c0be2a8d44e7f9b0d6c5e21a7f4b9
+#define INCGUARD_3f1c0be2a8d44e7f9b0d6c5e21a7f4b9
+
+#include "commonbase.h"
+
+#include <stdlib.h>
+#include <sys/types.h>
+
+
+/** Accounts bytes held by arenas and buffers against an optional limit.
+ * A zero 'limit' means unlimited. Members are updated atomically so one
+ * budget may be shared between threads. */
+typedef struct MemBudget {
+    size_t limit;
+    size_t used;
+    size_t peak;
+} MemBudget;
+
+
+/** Bump allocator. Allocations are never freed one-by-one. Instead the
+ * arena gets rewound to a previously taken mark, which fits the depth-first
+ * traversal where each directory level drops its stuff in reverse order of
+ * allocation. Chunks stay allocated after a rewind so they get reused by
+ * the next directory. */
+typedef struct Arena Arena;
+
+typedef struct ArenaMark {
+    struct ArenaChunk *chunk;
+    size_t used;
+} ArenaMark;
+
+
+/** String interning table. Lookups for equal strings return the very same
+ * pointer. The table is bounded. As soon it is full, 'strIntern_get'
+ * returns NULL and the caller has to store the string on its own. */
+typedef struct StrIntern StrIntern;
+
+
+/**
+ * @param chunkSize
+ *      Preferred size of the chunks to allocate from the system. Requests
+ *      larger than that get their own chunk.
+ * @param budget
+ *      (optional) Budget where to account allocated chunks to. Arenas
+ *      always charge the budget (they never fail due to it).
+ */
+Arena* arena_alloc( size_t chunkSize , MemBudget*budget );
+
+void arena_free( Arena* );
+
+/** @return Pointer to 'sz' bytes (aligned for any type) or NULL if out of
+ *      memory. */
+void* arena_malloc( Arena* , size_t sz );
+
+/** @return Copy of the first 'str_len' bytes of 'str' (plus terminating
+ *      zero) or NULL if out of memory. */
+char* arena_strndup( Arena* , const char*str , size_t str_len );
+
+ArenaMark arena_mark( Arena* );
+
+/** Releases everything allocated since 'mark' was taken. */
+void arena_rewind( Arena* , ArenaMark mark );
+
+
+/**
+ * @param maxEntries
+ *      Max count of distinct strings to keep.
+ */
+StrIntern* strIntern_alloc( size_t maxEntries , MemBudget*budget );
+
+void strIntern_free( StrIntern* );
+
+/** @return The interned copy of 'str' or NULL if the table is full (or out
+ *      of memory). */
+const char* strIntern_get( StrIntern* , const char*str , size_t str_len );
+
+
+/** @return 0 if 'sz' bytes got accounted. -ENOMEM if that would exceed
+ *      the limit (nothing accounted then). */
+int memBudget_acquire( MemBudget* , size_t sz );
+
+/** Same as 'memBudget_acquire' but always accounts. For allocations which
+ * cannot be avoided nor deferred. */
+void memBudget_charge( MemBudget* , size_t sz );
+
+void memBudget_release( MemBudget* , size_t sz );
+
+/**
+ * Grows '*buf' (geometrically) so it has room for at least 'minCap' bytes.
+ *
+ * @param budget
+ *      (optional) Budget to account the growth to.
+ * @param isBounded
+ *      If non-zero, fails instead of exceeding the budget.
+ * @return
+ *      0 on success. -ENOMEM if allocation failed or budget would be
+ *      exceeded. '*buf' and '*cap' stay untouched on error.
+ */
+int memBudget_growBuf( MemBudget*budget , int isBounded , char**buf , size_t*cap , size_t minCap );
+
+
+#endif /* INCGUARD_3f1c0be2a8d44e7f9b0d6c5e21a7f4b9 */
@@ -0,0 +1,60 @@
+/* By using this work you agree to the terms and conditions in 'LICENSE.txt' */
+
+/* This */
+#include "base64.h"
+
+
+static const char alphabet[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+
+size_t base64_encode( char*dst , const void*src_ , size_t src_len )
+{
+    const unsigned char *src = src_;
+    char *it = dst;
+    size_t i = 0;
+    for( ; i + 3 <= src_len ; i += 3 ){
+        const unsigned long v = (unsigned long)src[i] << 16 | src[i+1] << 8 | src[i+2];
+        *it++ = alphabet[v >> 18 & 63];
+        *it++ = alphabet[v >> 12 & 63];
+        *it++ = alphabet[v >>  6 & 63];
+        *it++ = alphabet[v       & 63];
+    }
+    if( i < src_len ){
+        const unsigned long v = (unsigned long)src[i] << 16 | (i + 1 < src_len ? src[i+1] << 8 : 0);
+        *it++ = alphabet[v >> 18 & 63];
+        *it++ = alphabet[v >> 12 & 63];
+        *it++ = i + 1 < src_len ? alphabet[v >> 6 & 63] : '=';
+        *it++ = '=';
+    }
+    return it - dst;
+}
+
+
+ssize_t base64_decode( void*dst_ , const char*src , size_t src_len )
+{
+    unsigned char *dst = dst_;
+    size_t dst_len = 0;
+    unsigned long v = 0;
+    unsigned bits = 0;
+    for( size_t i=0 ; i<src_len ; ++i ){
+        const char c = src[i];
+        int d;
+        if(      c >= 'A' && c <= 'Z' ){ d = c - 'A'; }
+        else if( c >= 'a' && c <= 'z' ){ d = c - 'a' + 26; }
+        else if( c >= '0' && c <= '9' ){ d = c - '0' + 52; }
+        else if( c == '+' ){ d = 62; }
+        else if( c == '/' ){ d = 63; }
+        else if( c == '\\' ){ continue; }
+        else if( c == '=' ){ break; }
+        else{ return -1; }
+        // Written bytes always lag behind the chars read. So in place works.
+        v = (v << 6 | d) & 0xFFFFFF;
+        bits += 6;
+        if( bits >= 8 ){
+            bits -= 8;
+            dst[dst_len++] = v >> bits & 0xFF;
+        }
+    }
+    return dst_len;
+}
@@ -0,0 +1,38 @@
+/* By using this work you agree to the terms and conditions in 'LICENSE.txt' */
+
+#ifndef INCGUARD_8b83b5b893bf1e900a0c204d7dca4adf
+#define INCGUARD_8b83b5b893bf1e900a0c204d7dca4adf
+
+#include "commonbase.h"
+
+#include <stddef.h>
+#include <sys/types.h>
+
+
+/** Chars 'base64_encode' produces for 'len' bytes (without terminator). */
+#define BASE64_ENCODED_LEN( len ) (((len) + 2) / 3 * 4)
+
+
+/**
+ * Standard alphabet (RFC 4648) with padding.
+ *
+ * @param dst
+ *      Room for BASE64_ENCODED_LEN(src_len) chars. Does not get zero
+ *      terminated.
+ * @return Count of chars written.
+ */
+size_t base64_encode( char*dst , const void*src , size_t src_len );
+
+/**
+ * Reverse of 'base64_encode'. Skips backslashes (so '/' JSON escaped as
+ * "\/" decodes fine) and stops at padding.
+ *
+ * @param dst
+ *      Room for 'src_len / 4 * 3 + 2' bytes. Decoding in place ('dst' ==
+ *      'src') is fine.
+ * @return Count of bytes written. Negative if 'src' contains anything else.
+ */
+ssize_t base64_decode( void*dst , const char*src , size_t src_len );
+
+
+#endif /* INCGUARD_8b83b5b893bf1e900a0c204d7dca4adf */
@@ -0,0 +1,240 @@
+/* By using this work you agree to the terms and conditions in 'LICENSE.txt' */
+
+/* This */
+#include "batch.h"
+
+/* System */
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Libs */
+#include <curl/curl.h>
+
+/* Project */
+#include "arena.h"
+#include "array.h"
+#include "log.h"
+
+
+/** One line of a '--batch' file. */
+typedef struct BatchJob {
+    uint_t lineNo;
+    char *url;
+    char *filter;
+    int isFilterFull;
+    char *file;
+    ssize_t result;
+    GateleenResclone_Stats stats;
+    double seconds;
+} BatchJob;
+
+
+/** Closure for a '--batch' run. */
+typedef struct Batch {
+    const GateleenResclone_Opts *baseOpts;
+    BatchJob *jobs;
+    size_t jobs_len;
+    /** Index of next job to pick. Guarded by 'mutex'. */
+    size_t nextJob;
+    /** Guards job picking and instance (de)allocation. */
+    pthread_mutex_t mutex;
+} Batch;
+
+
+/** @return Content of file (zero terminated) or NULL on error (logged). */
+static char* readWholeFile( const char*path ){
+    char *buf = NULL;
+    size_t buf_len = 0, buf_cap = 0;
+    FILE *file = fopen(path, "rb");
+    if( file == NULL ){
+        log_write(LOG_LVL_ERROR, "%s%s%s%s", "fopen(", path, "): ", strerror(errno));
+        goto fail;
+    }
+    for(;;){
+        if( memBudget_growBuf(NULL, 0, &buf, &buf_cap, buf_len + (1<<12) +1) ){
+            log_write(LOG_LVL_ERROR, "%s", "Out of memory");
+            goto fail;
+        }
+        size_t readLen = fread(buf + buf_len, 1, buf_cap - buf_len -1, file);
+        buf_len += readLen;
+        if( readLen == 0 ){ break; }
+    }
+    if( ferror(file) ){
+        log_write(LOG_LVL_ERROR, "%s%s%s%s", "fread(", path, "): ", strerror(errno));
+        goto fail;
+    }
+    buf[buf_len] = '\0';
+    fclose(file);
+    return buf;
+fail:
+    if( file ){ fclose(file); }
+    free(buf);
+    return NULL;
+}
+
+
+/** Splits a jobs file into jobs. Modifies 'buf' in place and the strings in
+ * the jobs point into it. */
+static ssize_t parseBatchFile( char*buf, BatchJob**jobs, size_t*jobs_len ){
+    size_t jobs_cap = 0;
+    uint_t lineNo = 0;
+    for( char *line=buf, *next ; line ; line=next ){
+        lineNo += 1;
+        next = strchr(line, '\n');
+        if( next ){ *next++ = '\0'; }
+        char *fields[4];
+        uint_t fields_len = 0;
+        for( char *it=line ;; ){
+            it += strspn(it, " \t\r");
+            if( *it == '\0' || (*it == '#' && fields_len == 0) ){ break; }
+            if( fields_len == sizeof fields / sizeof*fields ){ break; }
+            fields[fields_len++] = it;
+            it += strcspn(it, " \t\r");
+            if( *it != '\0' ){ *it++ = '\0'; }
+        }
+        if( fields_len == 0 ){
+            continue; } /* Blank line or comment. */
+        if( fields_len != 3 ){
+            log_write(LOG_LVL_ERROR, "%s%u%s", "Jobs file line ", lineNo,
+                ": Expected '<url> <filter> <file>'.");
+            return -1;
+        }
+        BatchJob job = { .lineNo = lineNo, .url = fields[0], .file = fields[2] };
+        if( strcmp(fields[1], "-") ){
+            static const char fullPrefix[] = "full:";
+            job.isFilterFull = !strncmp(fields[1], fullPrefix, sizeof fullPrefix -1);
+            job.filter = fields[1] + (job.isFilterFull ? sizeof fullPrefix -1 : 0);
+        }
+        if( array_add(jobs, jobs_len, &jobs_cap, &job, sizeof job, 16) ){
+            log_write(LOG_LVL_ERROR, "%s", "Out of memory");
+            return -ENOMEM;
+        }
+    }
+    return 0;
+}
+
+
+static void* runBatchWorker( void*Batch_ ){
+    Batch *batch = Batch_;
+    CURLSH *share = NULL;
+
+    // Transport state lives as long as this worker. So all jobs picked by it
+    // reuse DNS results, connections and TLS sessions. Not shared between
+    // workers as curl does not support sharing connections across threads.
+    share = curl_share_init();
+    if( share == NULL
+        || curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS)
+        || curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION)
+        || curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT) )
+    {
+        log_write(LOG_LVL_WARN, "%s", "Failed to setup shared transport. Jobs will not share connections.");
+        if( share ){ curl_share_cleanup(share); share = NULL; }
+    }
+
+    for(;;){
+        pthread_mutex_lock(&batch->mutex);
+        size_t iJob = batch->nextJob++;
+        pthread_mutex_unlock(&batch->mutex);
+        if( iJob >= batch->jobs_len ){
+            break; }
+        BatchJob *job = batch->jobs + iJob;
+        GateleenResclone_Opts opts = *batch->baseOpts;
+        opts.url = job->url;
+        opts.filter = job->filter;
+        opts.isFilterFull = job->isFilterFull;
+        opts.file = job->file;
+        opts.curlShare = share;
+
+        struct timespec begin, end;
+        clock_gettime(CLOCK_MONOTONIC, &begin);
+        // (De)allocation touches process-wide library state (curl global
+        // init). So serialize those.
+        pthread_mutex_lock(&batch->mutex);
+        GateleenResclone *resclone = gateleenResclone_alloc(&opts);
+        pthread_mutex_unlock(&batch->mutex);
+        if( resclone == NULL ){
+            job->result = -1;
+        }else{
+            job->result = gateleenResclone_pull(resclone);
+            gateleenResclone_getStats(resclone, &job->stats);
+            pthread_mutex_lock(&batch->mutex);
+            gateleenResclone_free(resclone);
+            pthread_mutex_unlock(&batch->mutex);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        job->seconds = (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9;
+    }
+
+    if( share ){ curl_share_cleanup(share); }
+    return NULL;
+}
+
+
+ssize_t batch_run( const char*jobsFile, const GateleenResclone_Opts*baseOpts ){
+    ssize_t err;
+    char *buf = NULL;
+    pthread_t *threads = NULL;
+    uint_t threads_len = 0;
+    int isCurlInit = 0, isMutexInit = 0;
+    Batch batch = { .baseOpts = baseOpts };
+
+    // Init once for all jobs. The instances only bump the refcount then.
+    if( curl_global_init(CURL_GLOBAL_ALL) ){
+        log_write(LOG_LVL_ERROR, "%s", "curl_global_init() failed");
+        err = -1; goto endFn;
+    }
+    isCurlInit = !0;
+
+    buf = readWholeFile(jobsFile);
+    if( buf == NULL ){
+        err = -1; goto endFn; }
+    err = parseBatchFile(buf, &batch.jobs, &batch.jobs_len);
+    if( err ){
+        err = -1; goto endFn; }
+
+    if( pthread_mutex_init(&batch.mutex, NULL) ){
+        err = -1; goto endFn; }
+    isMutexInit = !0;
+
+    uint_t threads_cap = baseOpts->parallel < batch.jobs_len ? baseOpts->parallel : batch.jobs_len;
+    threads = calloc(threads_cap ? threads_cap : 1, sizeof*threads);
+    if( threads == NULL ){
+        err = -ENOMEM; goto endFn; }
+    for( ; threads_len < threads_cap ; ++threads_len ){
+        if( pthread_create(threads + threads_len, NULL, runBatchWorker, &batch) ){
+            log_write(LOG_LVL_WARN, "%s%u%s", "Only got ", threads_len, " worker threads.");
+            break;
+        }
+    }
+    if( threads_len == 0 ){
+        runBatchWorker(&batch); /* Do it ourself then. */
+    }
+    for( uint_t i=0 ; i<threads_len ; ++i ){
+        pthread_join(threads[i], NULL);
+    }
+
+    size_t jobsFailed = 0;
+    for( size_t i=0 ; i<batch.jobs_len ; ++i ){
+        const BatchJob *job = batch.jobs + i;
+        if( job->result ){ jobsFailed += 1; }
+        printf("%u %s "FMT_SIZE_T" "FMT_SIZE_T" "FMT_SIZE_T" %.3f %s\n", job->lineNo,
+            job->result ? "FAIL" : "OK", job->stats.entries, job->stats.bytes, job->stats.failed,
+            job->seconds, job->url);
+    }
+    log_write(LOG_LVL_INFO, "%s"FMT_SIZE_T"%s"FMT_SIZE_T"%s", "Batch done. ", batch.jobs_len,
+        " jobs, ", jobsFailed, " failed.");
+
+    err = jobsFailed ? -1 : 0;
+endFn:
+    free(threads);
+    if( isMutexInit ){ pthread_mutex_destroy(&batch.mutex); }
+    free(batch.jobs);
+    free(buf);
+    if( isCurlInit ){ curl_global_cleanup(); }
+    return err;
+}
+
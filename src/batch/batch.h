@@ -0,0 +1,21 @@
+/* By using this work you agree to the terms and conditions in 'LICENSE.txt' */
+
+#ifndef INCGUARD_6e2551119b1a4639aa5569ac4cc9a161
+#define INCGUARD_6e2551119b1a4639aa5569ac4cc9a161
+
+#include "commonbase.h"
+
+#include <sys/types.h>
+
+#include "gateleen_resclone.h"
+
+
+/** Pulls every job of 'jobsFile' (one '<url> <filter> <file>' per line, '-'
+ * for no filter, 'full:' prefixed for a full filter, '#' comments) with
+ * 'baseOpts->parallel' jobs at once. Each job uses 'baseOpts' with its own
+ * url, filter and file. Prints one result line per job to stdout.
+ * @return 0 if all jobs succeeded, negative otherwise. */
+ssize_t batch_run( const char*jobsFile , const GateleenResclone_Opts*baseOpts );
+
+
+#endif /* INCGUARD_6e2551119b1a4639aa5569ac4cc9a161 */
@@ -0,0 +1,498 @@
+/* By using this work you agree to the terms and conditions in 'LICENSE.txt' */
+
+/* This */
+#include "cache.h"
+
+/* System */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef _WIN32
+#   include <io.h> /* <- mkdir */
+#endif
+
+/* Project */
+#include "hash.h"
+
+
+#define CACHE_MAGIC "GRCACHE1"
+/* Seed of the second hash of the key. Both together make accidental matches
+ * of different keys practically impossible. */
+#define CACHE_CHECK_INIT 0x84222325cbf29ce4ULL
+#define CACHE_META_MAX 112
+#define CACHE_RECS_MIN 1024
+
+
+/* Begin of the index file. Followed by 'recs_cap' records. Byte order and
+ * layout are the ones of the host. Other ones get rejected by 'recSize' or
+ * 'magic' and the cache starts over empty. */
+typedef struct CacheHdr {
+    char magic[8];
+    uint32_t recSize;
+    uint32_t reserved;
+    uint64_t recs_cap;
+    uint64_t recs_len;
+    uint64_t clock;
+    char pad_[24];
+} CacheHdr;
+
+
+typedef struct CacheRec {
+    uint64_t keyHash; /* <- Zero marks a free slot. */
+    uint64_t keyCheck;
+    uint64_t bodyHash;
+    uint64_t size;
+    /* Value of 'clock' when last used. */
+    uint64_t lastUse;
+    int64_t lastModified;
+    char etag[CACHE_ETAG_MAX +1];
+    /* Content-Type, then the headers. Each zero terminated. An empty string
+     * ends the list. */
+    char meta[CACHE_META_MAX];
+} CacheRec;
+
+
+struct Cache {
+    char *dir;
+    size_t dir_len;
+    uint64_t maxSize;
+    CacheRec *recs;
+    size_t recs_cap; /* <- Always power of two (or zero). */
+    size_t recs_len;
+    /* Counts up on every use. Orders entries for eviction. */
+    uint64_t clock;
+    int isDirty;
+    /* Scratch for file names below 'dir'. */
+    char *path;
+    uint_t tmpSeq;
+    /* Headers of the last lookup. */
+    const char *headers[CACHE_HEADERS_MAX];
+};
+
+
+/* An entry to evict, ordered by last use. */
+typedef struct CacheVictim {
+    uint64_t lastUse;
+    size_t idx;
+} CacheVictim;
+
+
+static void keyHashes( const char*key, uint64_t*hash, uint64_t*check ){
+    const size_t key_len = strlen(key);
+    *hash = hash_fnv1a64(HASH_FNV1A64_INIT, key, key_len);
+    if( *hash == 0 ){ *hash = 1; }
+    *check = hash_fnv1a64(CACHE_CHECK_INIT, key, key_len);
+}
+
+
+/* @return Slot of the key (being its own or a free one where it belongs). */
+static CacheRec* cache_slot( const Cache*cache, uint64_t hash, uint64_t check ){
+    const size_t mask = cache->recs_cap - 1;
+    for( size_t i = hash & mask ;; i = (i+1) & mask ){
+        CacheRec *rec = cache->recs + i;
+        if( rec->keyHash == 0 || (rec->keyHash == hash && rec->keyCheck == check) ){
+            return rec; }
+    }
+}
+
+
+static CacheRec* cache_find( const Cache*cache, const char*key ){
+    if( cache->recs_cap == 0 ){
+        return NULL; }
+    uint64_t hash, check;
+    keyHashes(key, &hash, &check);
+    CacheRec *rec = cache_slot(cache, hash, check);
+    return rec->keyHash ? rec : NULL;
+}
+
+
+/* Moves the records into a fresh table of 'cap' slots. Drops those with a
+ * zero 'lastUse' (marked by eviction). */
+static int cache_rehash( Cache*cache, size_t cap ){
+    CacheRec *old = cache->recs;
+    const size_t old_cap = cache->recs_cap;
+    CacheRec *recs = calloc(cap, sizeof*recs);
+    if( recs == NULL ){
+        return -ENOMEM; }
+    cache->recs = recs;
+    cache->recs_cap = cap;
+    cache->recs_len = 0;
+    for( size_t i=0 ; i<old_cap ; ++i ){
+        if( old[i].keyHash == 0 || old[i].lastUse == 0 ){ continue; }
+        *cache_slot(cache, old[i].keyHash, old[i].keyCheck) = old[i];
+        cache->recs_len += 1;
+    }
+    free(old);
+    return 0;
+}
+
+
+/* Removes 'rec' from the table. Shifts back the records probed past it, so
+ * no tombstones are needed. */
+static void cache_removeRec( Cache*cache, CacheRec*rec ){
+    const size_t mask = cache->recs_cap - 1;
+    size_t i = rec - cache->recs;
+    for( size_t j=i ;; ){
+        j = (j+1) & mask;
+        if( cache->recs[j].keyHash == 0 ){ break; }
+        const size_t home = cache->recs[j].keyHash & mask;
+        // Can j move to i? Only if its home is not within (i, j] (cyclic).
+        const int isHomeBetween = (i <= j) ? (i < home && home <= j) : (i < home || home <= j);
+        if( ! isHomeBetween ){
+            cache->recs[i] = cache->recs[j];
+            i = j;
+        }
+    }
+    memset(cache->recs + i, 0, sizeof*cache->recs);
+    cache->recs_len -= 1;
+    cache->isDirty = !0;
+}
+
+
+static int makeDir( const char*path ){
+#ifdef _WIN32
+    const int err = mkdir(path);
+#else
+    const int err = mkdir(path, 0777);
+#endif
+    return (err && errno != EEXIST) ? -errno : 0;
+}
+
+
+/* @return File name of a body in 'cache->path'. */
+static const char* cache_bodyPath( Cache*cache, uint64_t bodyHash, uint64_t size ){
+    sprintf(cache->path, "%s/objects/%02x/%016llx-%llu", cache->dir, (unsigned)(bodyHash >> 56),
+        (unsigned long long)bodyHash, (unsigned long long)size);
+    return cache->path;
+}
+
+
+Cache* cache_open( const char*dir , uint64_t maxSize )
+{
+    int err;
+    FILE *f = NULL;
+    Cache *cache = calloc(1, sizeof*cache);
+    if( cache == NULL ){ goto fail; }
+    cache->maxSize = maxSize;
+    cache->dir_len = strlen(dir);
+    while( cache->dir_len > 1 && dir[cache->dir_len-1] == '/' ){ cache->dir_len -= 1; }
+    cache->dir = malloc(cache->dir_len +1);
+    cache->path = malloc(cache->dir_len + 64);
+    if( cache->dir == NULL || cache->path == NULL ){ goto fail; }
+    memcpy(cache->dir, dir, cache->dir_len);
+    cache->dir[cache->dir_len] = '\0';
+    sprintf(cache->path, "%s/objects", cache->dir);
+    if( makeDir(cache->dir) || makeDir(cache->path) ){ goto fail; }
+
+    sprintf(cache->path, "%s/index", cache->dir);
+    f = fopen(cache->path, "rb");
+    if( f == NULL ){
+        if( errno == ENOENT ){ return cache; } /* New cache. */
+        goto fail;
+    }
+    CacheHdr hdr;
+    if( fread(&hdr, sizeof hdr, 1, f) != 1 || memcmp(hdr.magic, CACHE_MAGIC, sizeof hdr.magic)
+        || hdr.recSize != sizeof(CacheRec) || (hdr.recs_cap & (hdr.recs_cap-1))
+        || hdr.recs_len > hdr.recs_cap || hdr.recs_cap > SIZE_MAX / sizeof(CacheRec) )
+    {
+        fclose(f);
+        return cache; /* Unknown layout. Start over. */
+    }
+    if( hdr.recs_cap ){
+        cache->recs = malloc(hdr.recs_cap * sizeof*cache->recs);
+        if( cache->recs == NULL ){ goto fail; }
+        if( fread(cache->recs, sizeof*cache->recs, hdr.recs_cap, f) != hdr.recs_cap ){
+            free(cache->recs); cache->recs = NULL;
+            fclose(f);
+            return cache; /* Truncated. Start over. */
+        }
+    }
+    cache->recs_cap = hdr.recs_cap;
+    cache->recs_len = hdr.recs_len;
+    cache->clock = hdr.clock;
+    fclose(f);
+    return cache;
+fail:
+    err = errno;
+    if( f ){ fclose(f); }
+    if( cache ){
+        free(cache->recs);
+        free(cache->path);
+        free(cache->dir);
+        free(cache);
+    }
+    errno = err ? err : ENOMEM;
+    return NULL;
+}
+
+
+static int cmpVictims( const void*a_, const void*b_ ){
+    const CacheVictim *a = a_, *b = b_;
+    return a->lastUse < b->lastUse ? -1 : a->lastUse > b->lastUse;
+}
+
+
+static int cmpU64( const void*a_, const void*b_ ){
+    const uint64_t a = *(const uint64_t*)a_, b = *(const uint64_t*)b_;
+    return a < b ? -1 : a > b;
+}
+
+
+/* Drops least recently used entries until the bodies fit into 'maxSize'.
+ * Sizes get summed per entry. Shared bodies thus get counted more than once,
+ * which evicts early rather than late. */
+static int cache_evict( Cache*cache ){
+    int err;
+    CacheVictim *victims = NULL;
+    uint64_t *kept = NULL;
+    uint64_t total = 0;
+    size_t victims_len = 0, kept_len = 0, evicted_len = 0;
+    for( size_t i=0 ; i<cache->recs_cap ; ++i ){
+        if( cache->recs[i].keyHash ){ total += cache->recs[i].size; }
+    }
+    if( total <= cache->maxSize ){
+        err = 0; goto endFn; }
+
+    victims = malloc(cache->recs_len * sizeof*victims);
+    kept = malloc(cache->recs_len * sizeof*kept);
+    if( victims == NULL || kept == NULL ){
+        err = -ENOMEM; goto endFn; }
+    for( size_t i=0 ; i<cache->recs_cap ; ++i ){
+        if( cache->recs[i].keyHash == 0 ){ continue; }
+        victims[victims_len].lastUse = cache->recs[i].lastUse;
+        victims[victims_len].idx = i;
+        victims_len += 1;
+    }
+    qsort(victims, victims_len, sizeof*victims, cmpVictims);
+    for( ; evicted_len < victims_len && total > cache->maxSize ; ++evicted_len ){
+        CacheRec *rec = cache->recs + victims[evicted_len].idx;
+        total -= rec->size;
+        rec->lastUse = 0; /* <- Mark. Rehash drops it. */
+    }
+    for( size_t i=evicted_len ; i<victims_len ; ++i ){
+        kept[kept_len++] = cache->recs[victims[i].idx].bodyHash; }
+    qsort(kept, kept_len, sizeof*kept, cmpU64);
+    // Bodies still referenced by kept entries have to stay.
+    for( size_t i=0 ; i<evicted_len ; ++i ){
+        const CacheRec *rec = cache->recs + victims[i].idx;
+        if( bsearch(&rec->bodyHash, kept, kept_len, sizeof*kept, cmpU64) ){ continue; }
+        remove(cache_bodyPath(cache, rec->bodyHash, rec->size));
+    }
+    err = cache_rehash(cache, cache->recs_cap);
+    if( err ){ goto endFn; }
+    cache->isDirty = !0;
+
+    err = 0;
+endFn:
+    free(victims);
+    free(kept);
+    return err;
+}
+
+
+ssize_t cache_close( Cache*cache )
+{
+    int err = 0;
+    FILE *f = NULL;
+    char *tmpPath = NULL;
+    if( cache == NULL ){ return 0; }
+    if( cache->maxSize && cache->recs_len ){
+        err = cache_evict(cache);
+        if( err ){ goto endFn; }
+    }
+    if( ! cache->isDirty ){
+        err = 0; goto endFn; }
+
+    // Write aside and rename. So readers never see a partial index.
+    tmpPath = malloc(cache->dir_len + 64);
+    if( tmpPath == NULL ){
+        err = -ENOMEM; goto endFn; }
+    sprintf(cache->path, "%s/index", cache->dir);
+    sprintf(tmpPath, "%s/index.%ld.tmp", cache->dir, (long)getpid());
+    f = fopen(tmpPath, "wb");
+    if( f == NULL ){
+        err = -errno; goto endFn; }
+    CacheHdr hdr = { .recSize = sizeof(CacheRec) };
+    memcpy(hdr.magic, CACHE_MAGIC, sizeof hdr.magic);
+    hdr.recs_cap = cache->recs_cap;
+    hdr.recs_len = cache->recs_len;
+    hdr.clock = cache->clock;
+    if( fwrite(&hdr, sizeof hdr, 1, f) != 1
+        || fwrite(cache->recs, sizeof*cache->recs, cache->recs_cap, f) != cache->recs_cap )
+    {
+        err = -errno; goto endFn;
+    }
+    err = fclose(f); f = NULL;
+    if( err ){
+        err = -errno; goto endFn; }
+    if( rename(tmpPath, cache->path) ){
+        err = -errno; remove(tmpPath); goto endFn; }
+
+    err = 0;
+endFn:
+    if( f ){ fclose(f); remove(tmpPath); }
+    free(tmpPath);
+    free(cache->recs);
+    free(cache->path);
+    free(cache->dir);
+    free(cache);
+    return err;
+}
+
+
+int cache_lookup( Cache*cache , const char*key , CacheMeta*dst )
+{
+    CacheRec *rec = cache_find(cache, key);
+    if( rec == NULL ){
+        return 0; }
+    rec->lastUse = ++cache->clock;
+    cache->isDirty = !0;
+    dst->etag = rec->etag[0] ? rec->etag : NULL;
+    dst->lastModified = rec->lastModified;
+    dst->contentType = rec->meta[0] ? rec->meta : NULL;
+    dst->headers_len = 0;
+    for( const char *it = rec->meta + strlen(rec->meta) +1 ; *it ; it += strlen(it) +1 ){
+        cache->headers[dst->headers_len++] = it; }
+    dst->headers = cache->headers;
+    dst->size = rec->size;
+    return 1;
+}
+
+
+FILE* cache_openBody( Cache*cache , const char*key )
+{
+    const CacheRec *rec = cache_find(cache, key);
+    if( rec == NULL ){
+        return NULL; }
+    FILE *f = fopen(cache_bodyPath(cache, rec->bodyHash, rec->size), "rb");
+    if( f == NULL ){
+        return NULL; }
+    // Someone may have truncated (or cleaned) the dir meanwhile.
+    if( fseeko(f, 0, SEEK_END) || ftello(f) != (off_t)rec->size || fseeko(f, 0, SEEK_SET) ){
+        fclose(f);
+        return NULL;
+    }
+    return f;
+}
+
+
+/* Writes the body to a temporary file while hashing it. Then moves it to
+ * its content address (unless there is that body already). */
+static int cache_putBody( Cache*cache, const char*buf, FILE*src, uint64_t size, uint64_t*bodyHash ){
+    int err;
+    FILE *dst = NULL;
+    char *tmpPath = NULL;
+    uint64_t hash = HASH_FNV1A64_INIT;
+
+    tmpPath = malloc(cache->dir_len + 64);
+    if( tmpPath == NULL ){
+        err = -ENOMEM; goto endFn; }
+    sprintf(tmpPath, "%s/objects/tmp.%ld.%u", cache->dir, (long)getpid(), cache->tmpSeq++);
+    dst = fopen(tmpPath, "wb");
+    if( dst == NULL ){
+        err = -errno; goto endFn; }
+    if( src ){
+        char chunk[1<<14];
+        rewind(src);
+        for( uint64_t left=size ; left ; ){
+            const size_t chunk_len = fread(chunk, 1, left < sizeof chunk ? left : sizeof chunk, src);
+            if( chunk_len == 0 ){
+                err = -EIO; goto endFn; } /* <- Error or shorter than told. */
+            hash = hash_fnv1a64(hash, chunk, chunk_len);
+            if( fwrite(chunk, 1, chunk_len, dst) != chunk_len ){
+                err = -errno; goto endFn; }
+            left -= chunk_len;
+        }
+    }else if( size ){
+        hash = hash_fnv1a64(hash, buf, size);
+        if( fwrite(buf, 1, size, dst) != size ){
+            err = -errno; goto endFn; }
+    }
+    err = fclose(dst); dst = NULL;
+    if( err ){
+        err = -errno; goto endFn; }
+
+    const char *path = cache_bodyPath(cache, hash, size);
+    struct stat st;
+    if( stat(path, &st) == 0 && (uint64_t)st.st_size == size ){
+        remove(tmpPath); /* Have that body already. */
+    }else{
+        char *slash = strrchr(cache->path, '/');
+        *slash = '\0';
+        err = makeDir(cache->path);
+        *slash = '/';
+        if( err ){ goto endFn; }
+        if( rename(tmpPath, path) ){
+            err = -errno; goto endFn; }
+    }
+    *bodyHash = hash;
+
+    err = 0;
+endFn:
+    if( dst ){ fclose(dst); }
+    if( err && tmpPath ){ remove(tmpPath); }
+    free(tmpPath);
+    return err;
+}
+
+
+ssize_t cache_put( Cache*cache , const char*key , const CacheMeta*meta , const char*buf , FILE*src )
+{
+    int err;
+    char packed[CACHE_META_MAX];
+    size_t packed_len = 0;
+
+    // Pack metadata first. No need to store the body if that does not fit.
+    const char *contentType = meta->contentType ? meta->contentType : "";
+    if( meta->headers_len > CACHE_HEADERS_MAX ){
+        return -ENOBUFS; }
+    for( size_t i=0 ; i <= meta->headers_len ; ++i ){
+        const char *str = i ? meta->headers[i-1] : contentType;
+        const size_t str_len = strlen(str);
+        if( (i && str_len == 0) || packed_len + str_len +1 >= sizeof packed ){
+            return -ENOBUFS; }
+        memcpy(packed + packed_len, str, str_len +1);
+        packed_len += str_len +1;
+    }
+    packed[packed_len++] = '\0';
+    const int hasEtag = meta->etag && strlen(meta->etag) <= CACHE_ETAG_MAX;
+    if( ! hasEtag && meta->lastModified <= 0 ){
+        return 0; } /* Nothing to revalidate with. Would never be used. */
+
+    uint64_t bodyHash;
+    err = cache_putBody(cache, buf, src, meta->size, &bodyHash);
+    if( err ){
+        return err; }
+
+    if( 4*(cache->recs_len +1) > 3*cache->recs_cap ){
+        err = cache_rehash(cache, cache->recs_cap ? 2*cache->recs_cap : CACHE_RECS_MIN);
+        if( err ){
+            return err; }
+    }
+    uint64_t hash, check;
+    keyHashes(key, &hash, &check);
+    CacheRec *rec = cache_slot(cache, hash, check);
+    if( rec->keyHash == 0 ){
+        cache->recs_len += 1; }
+    memset(rec, 0, sizeof*rec);
+    rec->keyHash = hash;
+    rec->keyCheck = check;
+    rec->bodyHash = bodyHash;
+    rec->size = meta->size;
+    rec->lastUse = ++cache->clock;
+    rec->lastModified = meta->lastModified > 0 ? meta->lastModified : 0;
+    if( hasEtag ){
+        strcpy(rec->etag, meta->etag); }
+    memcpy(rec->meta, packed, packed_len);
+    cache->isDirty = !0;
+    return 0;
+}
+
+
+void cache_forget( Cache*cache , const char*key )
+{
+    CacheRec *rec = cache_find(cache, key);
+    if( rec ){ cache_removeRec(cache, rec); }
+}
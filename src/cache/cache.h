@@ -0,0 +1,87 @@
+/* By using this work you agree to the terms and conditions in 'LICENSE.txt' */
+
+#ifndef INCGUARD_5b7e21d9c4a04f6e8d3a0f19c6e2b874
+#define INCGUARD_5b7e21d9c4a04f6e8d3a0f19c6e2b874
+
+#include "commonbase.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+
+/* Longest ETag to remember. Longer ones get dropped (entry still can be
+ * revalidated by its Last-Modified). */
+#define CACHE_ETAG_MAX 95
+/* Max count of headers kept per entry besides Content-Type. */
+#define CACHE_HEADERS_MAX 8
+
+
+/**
+ * On-disk cache of resource bodies, for revalidation against the server.
+ *
+ * Bodies get stored content-addressed (named by their hash), so equal
+ * bodies at different URLs take the space only once. The index maps a URL
+ * to the body plus what is needed to revalidate it (ETag, Last-Modified).
+ * It is an array of fixed size records, probed by the hash of the URL. So
+ * the file could be mapped and probed in place. We read it as a whole on
+ * open and write it back on close.
+ *
+ * Not thread safe. Concurrent processes using the same dir may lose each
+ * others index updates. They do not corrupt it.
+ */
+typedef struct Cache Cache;
+
+
+/** What the cache knows about an URL. */
+typedef struct CacheMeta {
+    /** NULL if none. */
+    const char *etag;
+    /** Unix time. Zero if unknown. */
+    int64_t lastModified;
+    /** NULL if none. */
+    const char *contentType;
+    /** Further headers as "Name: value". */
+    const char *const*headers;
+    size_t headers_len;
+    /** Of the body. */
+    uint64_t size;
+} CacheMeta;
+
+
+/**
+ * @param dir
+ *      Gets created if missing.
+ * @param maxSize
+ *      Least recently used entries get evicted by 'cache_close' as long the
+ *      bodies take more bytes. Zero means unlimited.
+ * @return
+ *      NULL on error (errno set).
+ */
+Cache* cache_open( const char*dir , uint64_t maxSize );
+
+/** Evicts, writes back the index and frees the handle.
+ * @return 0 on success, negative errno on error (handle freed anyway). */
+ssize_t cache_close( Cache* );
+
+/** Looks up 'key' and marks it as recently used.
+ * @return 1 if found, 0 if not. Strings in 'dst' stay valid until the next
+ *      call on the cache. */
+int cache_lookup( Cache* , const char*key , CacheMeta*dst );
+
+/** @return Body of 'key' opened for reading or NULL if not (or no longer)
+ *      available. */
+FILE* cache_openBody( Cache* , const char*key );
+
+/** Adds or replaces 'key'. The body is 'buf' or, if 'src' is set, read
+ * from the start of 'src'. Both are 'meta->size' bytes.
+ * @return 0 on success, -ENOBUFS if meta does not fit into an entry, other
+ *      negative errno on error. */
+ssize_t cache_put( Cache* , const char*key , const CacheMeta*meta , const char*buf , FILE*src );
+
+/** Removes 'key' (its body stays until no other key refers to it). */
+void cache_forget( Cache* , const char*key );
+
+
+#endif /* INCGUARD_5b7e21d9c4a04f6e8d3a0f19c6e2b874 */
@@ -17,4 +17,11 @@
 typedef  unsigned int  uint_t;
 
 
+#if __WIN32
+#   define FMT_SIZE_T "%llu"
+#else
+#   define FMT_SIZE_T "%lu"
+#endif
+
+
 #endif /* INCGUARD_0835dec38b8927b0daeba484a1eb21e7 */
@@ -0,0 +1,384 @@
+/* By using this work you agree to the terms and conditions in 'LICENSE.txt' */
+
+/* This */
+#include "diff.h"
+
+/* System */
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Libs */
+#include "archive.h"
+#include "archive_entry.h"
+
+/* Project */
+#include "arena.h"
+#include "hash.h"
+#include "log.h"
+#include "merge.h"
+
+
+/** Entry of the first input of '--diff'. */
+typedef struct DiffItem {
+    /** Of 'path'. */
+    uint64_t pathHash;
+    /** Without leading "./" or "/". */
+    const char *path;
+    uint64_t size;
+    /** Of the body in the second input. Only valid in DIFF_PENDING. */
+    uint64_t hashB;
+    /** Position among the entries of the first input. */
+    size_t ordinal;
+    /** One of DIFF_*. */
+    unsigned char state;
+} DiffItem;
+
+enum {
+    /** Not (yet) seen in the second input. */
+    DIFF_UNSEEN  = 0,
+    /** Compared (and reported if it differs). */
+    DIFF_DONE    = 1,
+    /** Same size on both sides. First input's body still is to be hashed. */
+    DIFF_PENDING = 2
+};
+
+
+/** Closure for a '--diff' run. Also serves as the sink of the second input
+ * when it is an url. */
+typedef struct Diff {
+    /** Entries of the first input, ordered by (pathHash, path). */
+    DiffItem *items;
+    size_t items_len;
+    size_t items_cap;
+    /** Same items in archive order. NULL where shadowed by a later entry of
+     * the same path. */
+    DiffItem **inOrder;
+    size_t inOrder_len;
+    /** Holds the paths. */
+    Arena *arena;
+    /** Names of the inputs (for messages). */
+    const char *from;
+    const char *to;
+    /** Item whose counterpart currently gets hashed. NULL while bodies of
+     * the second input are not of interest. */
+    DiffItem *cur;
+    uint64_t curHash;
+    size_t pending;
+    size_t added, removed, changed, unchanged;
+} Diff;
+
+
+
+/** @return 'path' without leading "./" or "/". */
+static const char* normPath( const char*path ){
+    for(;;){
+        if( path[0] == '.' && path[1] == '/' ){ path += 2; }
+        else if( path[0] == '/' ){ path += 1; }
+        else{ return path; }
+    }
+}
+
+
+/** Orders by (pathHash, path). */
+static int cmpDiffPaths( const void*a_, const void*b_ ){
+    const DiffItem *a = a_, *b = b_;
+    if( a->pathHash != b->pathHash ){
+        return a->pathHash < b->pathHash ? -1 : 1; }
+    return strcmp(a->path, b->path);
+}
+
+
+/** Orders by (pathHash, path, ordinal). */
+static int cmpDiffItems( const void*a_, const void*b_ ){
+    const DiffItem *a = a_, *b = b_;
+    int cmp = cmpDiffPaths(a, b);
+    if( cmp ){
+        return cmp; }
+    return a->ordinal < b->ordinal ? -1 : a->ordinal > b->ordinal;
+}
+
+
+/** Writes 'str' as a JSON string literal. */
+static void printJsonString( FILE*dst, const char*str ){
+    putc('"', dst);
+    for( const unsigned char*it=(const unsigned char*)str ; *it ; ++it ){
+        if( *it == '"' || *it == '\\' ){
+            putc('\\', dst); putc(*it, dst);
+        }else if( *it < 0x20 ){
+            fprintf(dst, "\\u%04x", *it);
+        }else{
+            putc(*it, dst);
+        }
+    }
+    putc('"', dst);
+}
+
+
+/** Prints one NDJSON line to stdout. Negative sizes get omitted. */
+static void diffReport( const char*op, const char*path, int64_t sizeA, int64_t sizeB ){
+    printf("%s%s%s", "{\"op\":\"", op, "\",\"path\":");
+    printJsonString(stdout, path);
+    if( sizeA >= 0 ){ printf("%s%lld", ",\"sizeA\":", (long long)sizeA); }
+    if( sizeB >= 0 ){ printf("%s%lld", ",\"sizeB\":", (long long)sizeB); }
+    printf("%s", "}\n");
+}
+
+
+/** Indexes path and size of each entry of the first input. Bodies get
+ * skipped (which for a plain tar file is a seek). */
+static ssize_t Diff_indexFirst( Diff*diff ){
+    ssize_t err;
+    MergeInput input = { .file = diff->from };
+
+    err = mergeInput_open(&input);
+    if( err ){
+        err = -1; goto endFn; }
+    for( size_t ordinal=0 ;; ++ordinal ){
+        if( mergeInput_next(&input) ){
+            err = -1; goto endFn; }
+        if( input.entry == NULL ){
+            break; }
+        if( diff->items_len >= diff->items_cap ){
+            const size_t cap = diff->items_cap ? diff->items_cap * 2 : 1024;
+            DiffItem *tmp = realloc(diff->items, cap * sizeof*tmp);
+            if( tmp == NULL ){
+                err = -ENOMEM; goto endFn; }
+            diff->items = tmp;
+            diff->items_cap = cap;
+        }
+        const char *path = normPath(archive_entry_pathname(input.entry));
+        const size_t path_len = strlen(path);
+        DiffItem *item = diff->items + diff->items_len;
+        item->path = arena_strndup(diff->arena, path, path_len);
+        if( item->path == NULL ){
+            err = -ENOMEM; goto endFn; }
+        item->pathHash = hash_fnv1a64(HASH_FNV1A64_INIT, path, path_len);
+        item->size = archive_entry_size(input.entry);
+        item->hashB = 0;
+        item->ordinal = ordinal;
+        item->state = DIFF_UNSEEN;
+        diff->items_len += 1;
+    }
+    diff->inOrder_len = diff->items_len;
+
+    if( diff->items_len ){
+        qsort(diff->items, diff->items_len, sizeof*diff->items, cmpDiffItems); }
+    // Of equal paths the last one wins (as it would on extraction).
+    size_t kept = 0;
+    for( size_t i=0 ; i<diff->items_len ; ++i ){
+        if( i+1 < diff->items_len && !cmpDiffPaths(diff->items + i, diff->items + i+1) ){
+            log_write(LOG_LVL_WARN, "%s%s%s%s%s", "'", diff->items[i].path, "' is in '", diff->from,
+                "' more than once. Only the last one gets compared.");
+            continue;
+        }
+        diff->items[kept++] = diff->items[i];
+    }
+    diff->items_len = kept;
+
+    diff->inOrder = calloc(diff->inOrder_len +1, sizeof*diff->inOrder);
+    if( diff->inOrder == NULL ){
+        err = -ENOMEM; goto endFn; }
+    for( size_t i=0 ; i<diff->items_len ; ++i ){
+        diff->inOrder[diff->items[i].ordinal] = diff->items + i; }
+
+    err = 0;
+endFn:
+    archive_read_free(input.archive);
+    return err;
+}
+
+
+static DiffItem* Diff_find( Diff*diff, const char*path ){
+    DiffItem key = { .path = path };
+    key.pathHash = hash_fnv1a64(HASH_FNV1A64_INIT, path, strlen(path));
+    if( diff->items_len == 0 ){
+        return NULL; }
+    return bsearch(&key, diff->items, diff->items_len, sizeof key, cmpDiffPaths);
+}
+
+
+/** Decides what it can from path and size alone. Only where sizes match,
+ * the body is of interest ('cur' gets set then). */
+static ssize_t Diff_onEntryBegin( void*Diff_, const GateleenResclone_Entry*entry ){
+    Diff *diff = Diff_;
+    const char *path = normPath(entry->path);
+    DiffItem *item = Diff_find(diff, path);
+    diff->cur = NULL;
+    if( item == NULL ){
+        diff->added += 1;
+        diffReport("added", path, -1, entry->size);
+    }else if( item->state != DIFF_UNSEEN ){
+        log_write(LOG_LVL_WARN, "%s%s%s%s%s", "'", path, "' is in '", diff->to,
+            "' more than once. Only the first one gets compared.");
+    }else if( item->size != entry->size ){
+        item->state = DIFF_DONE;
+        diff->changed += 1;
+        diffReport("changed", path, item->size, entry->size);
+    }else if( item->size == 0 ){
+        item->state = DIFF_DONE;
+        diff->unchanged += 1;
+    }else{
+        diff->cur = item;
+        diff->curHash = HASH_FNV1A64_INIT;
+    }
+    return 0;
+}
+
+
+static ssize_t Diff_onEntryData( void*Diff_, const char*buf, size_t buf_len ){
+    Diff *diff = Diff_;
+    if( diff->cur ){
+        diff->curHash = hash_fnv1a64(diff->curHash, buf, buf_len); }
+    return 0;
+}
+
+
+static ssize_t Diff_onEntryEnd( void*Diff_ ){
+    Diff *diff = Diff_;
+    if( diff->cur ){
+        diff->cur->hashB = diff->curHash;
+        diff->cur->state = DIFF_PENDING;
+        diff->pending += 1;
+        diff->cur = NULL;
+    }
+    return 0;
+}
+
+
+/** Streams the second input when it is an archive. Reads only those bodies
+ * which match an entry of the first input in size. */
+static ssize_t Diff_readSecond( Diff*diff ){
+    ssize_t err;
+    MergeInput input = { .file = diff->to };
+
+    err = mergeInput_open(&input);
+    if( err ){
+        err = -1; goto endFn; }
+    for(;;){
+        if( mergeInput_next(&input) ){
+            err = -1; goto endFn; }
+        if( input.entry == NULL ){
+            break; }
+        GateleenResclone_Entry entry = {
+            .path = archive_entry_pathname(input.entry),
+            .size = archive_entry_size(input.entry),
+        };
+        Diff_onEntryBegin(diff, &entry);
+        if( diff->cur && mergeInput_hashBody(&input, &diff->curHash) ){
+            err = -1; goto endFn; }
+        Diff_onEntryEnd(diff);
+    }
+
+    err = 0;
+endFn:
+    archive_read_free(input.archive);
+    return err;
+}
+
+
+/** Reads the first input a second time to hash the bodies of those entries
+ * which have a same sized counterpart. Stops as soon all got compared. */
+static ssize_t Diff_comparePending( Diff*diff ){
+    ssize_t err;
+    MergeInput input = { .file = diff->from };
+
+    if( diff->pending == 0 ){
+        return 0; }
+    err = mergeInput_open(&input);
+    if( err ){
+        err = -1; goto endFn; }
+    for( size_t ordinal=0 ; diff->pending ; ++ordinal ){
+        if( mergeInput_next(&input) ){
+            err = -1; goto endFn; }
+        if( input.entry == NULL || ordinal >= diff->inOrder_len ){
+            log_write(LOG_LVL_ERROR, "%s%s%s", "'", diff->from, "' changed while comparing.");
+            err = -1; goto endFn;
+        }
+        DiffItem *item = diff->inOrder[ordinal];
+        if( item == NULL || item->state != DIFF_PENDING ){
+            continue; }
+        uint64_t hash = HASH_FNV1A64_INIT;
+        if( mergeInput_hashBody(&input, &hash) ){
+            err = -1; goto endFn; }
+        item->state = DIFF_DONE;
+        diff->pending -= 1;
+        if( hash == item->hashB ){
+            diff->unchanged += 1;
+        }else{
+            diff->changed += 1;
+            diffReport("changed", item->path, item->size, item->size);
+        }
+    }
+
+    err = 0;
+endFn:
+    archive_read_free(input.archive);
+    return err;
+}
+
+
+ssize_t diff_run( const char*from, const char*to, const GateleenResclone_Opts*opts ){
+    ssize_t err;
+    GateleenResclone *resclone = NULL;
+    GateleenResclone_Opts pullOpts;
+    Diff diff = { .from = from, .to = to };
+    GateleenResclone_Sink sink = {
+        .cls = &diff,
+        .onEntryBegin = Diff_onEntryBegin,
+        .onEntryData = Diff_onEntryData,
+        .onEntryEnd = Diff_onEntryEnd,
+    };
+
+    diff.arena = arena_alloc(0, NULL);
+    if( diff.arena == NULL ){
+        err = -ENOMEM; goto endFn; }
+
+    err = Diff_indexFirst(&diff);
+    if( err ){
+        err = -1; goto endFn; }
+
+    if( opts->url ){
+        // Same traversal as '--pull' (so same options apply).
+        pullOpts = *opts;
+        pullOpts.sink = &sink;
+        resclone = gateleenResclone_alloc(&pullOpts);
+        if( resclone == NULL ){
+            err = -1; goto endFn; }
+        err = gateleenResclone_pull(resclone);
+    }else{
+        err = Diff_readSecond(&diff);
+    }
+    if( err ){
+        err = -1; goto endFn; }
+
+    err = Diff_comparePending(&diff);
+    if( err ){
+        err = -1; goto endFn; }
+
+    for( size_t i=0 ; i<diff.inOrder_len ; ++i ){
+        DiffItem *item = diff.inOrder[i];
+        if( item == NULL || item->state != DIFF_UNSEEN ){
+            continue; }
+        diff.removed += 1;
+        diffReport("removed", item->path, item->size, -1);
+    }
+    if( fflush(stdout) ){
+        log_write(LOG_LVL_ERROR, "%s%s", "Failed to write diff: ", strerror(errno));
+        err = -1; goto endFn;
+    }
+    log_write(LOG_LVL_INFO, "%s"FMT_SIZE_T"%s"FMT_SIZE_T"%s"FMT_SIZE_T"%s"FMT_SIZE_T"%s", "Diff done. ",
+        diff.added, " added, ", diff.removed, " removed, ", diff.changed, " changed, ", diff.unchanged,
+        " unchanged.");
+
+    err = 0;
+endFn:
+    gateleenResclone_free(resclone);
+    free(diff.items);
+    free(diff.inOrder);
+    arena_free(diff.arena);
+    return err;
+}
+
@@ -0,0 +1,20 @@
+/* By using this work you agree to the terms and conditions in 'LICENSE.txt' */
+
+#ifndef INCGUARD_7b13a62419d54d9ea95bd20ce6f74ac2
+#define INCGUARD_7b13a62419d54d9ea95bd20ce6f74ac2
+
+#include "commonbase.h"
+
+#include <sys/types.h>
+
+#include "gateleen_resclone.h"
+
+
+/** Compares archive 'from' with archive 'to'. Or, if 'opts->url' is set, with
+ * the tree there (pulled as '--pull' with 'opts' would). Prints one NDJSON
+ * line per added, removed or changed path to stdout.
+ * @return 0 on success, negative on error (logged). */
+ssize_t diff_run( const char*from , const char*to , const GateleenResclone_Opts*opts );
+
+
+#endif /* INCGUARD_7b13a62419d54d9ea95bd20ce6f74ac2 */
@@ -0,0 +1,164 @@
+/* By using this work you agree to the terms and conditions in 'LICENSE.txt' */
+
+/* This */
+#include "endpoints.h"
+
+/* System */
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+/* Consecutive failures after which an endpoint gets ejected. */
+#define EJECT_AFTER_FAILS 3
+/* First ejection lasts that long. Each further one (without a success in
+ * between) twice as long as the previous. */
+#define EJECT_BASE_MS 2000
+#define EJECT_MAX_MS 60000
+
+
+typedef struct Endpoint {
+    char *url;
+    uint_t inFlight;
+    uint_t failsInRow;
+    /* Ejections since the last success. */
+    uint_t ejectsInRow;
+    /* Monotonic millis. Ejected while now is before. */
+    uint64_t ejectedUntil;
+    EndpointStats stats;
+} Endpoint;
+
+
+struct Endpoints {
+    Endpoint *list;
+    size_t list_len;
+    pthread_mutex_t mutex;
+};
+
+
+static uint64_t nowMs( void ){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+
+Endpoints* endpoints_alloc( const char*const*urls, size_t urls_len ){
+    Endpoints *endpoints = calloc(1, sizeof*endpoints);
+    if( endpoints == NULL ){
+        goto fail; }
+    endpoints->list = calloc(urls_len, sizeof*endpoints->list);
+    if( endpoints->list == NULL ){
+        goto fail; }
+    pthread_mutex_init(&endpoints->mutex, NULL);
+    for( ; endpoints->list_len<urls_len ; ++endpoints->list_len ){
+        Endpoint *ep = endpoints->list + endpoints->list_len;
+        const char *url = urls[endpoints->list_len];
+        size_t url_len = strlen(url);
+        ep->url = malloc(url_len +2);
+        if( ep->url == NULL ){
+            goto fail; }
+        memcpy(ep->url, url, url_len);
+        if( url_len == 0 || url[url_len-1] != '/' ){
+            ep->url[url_len++] = '/'; }
+        ep->url[url_len] = '\0';
+    }
+    return endpoints;
+fail:
+    endpoints_free(endpoints);
+    return NULL;
+}
+
+
+void endpoints_free( Endpoints*endpoints ){
+    if( endpoints == NULL ){
+        return; }
+    if( endpoints->list ){
+        for( size_t i=0 ; i<endpoints->list_len ; ++i ){
+            free(endpoints->list[i].url); }
+        free(endpoints->list);
+        pthread_mutex_destroy(&endpoints->mutex);
+    }
+    free(endpoints);
+}
+
+
+size_t endpoints_count( const Endpoints*endpoints ){
+    return endpoints->list_len;
+}
+
+
+const char* endpoints_url( const Endpoints*endpoints, size_t idx ){
+    return endpoints->list[idx].url;
+}
+
+
+size_t endpoints_acquire( Endpoints*endpoints, uint64_t avoid ){
+    const uint64_t now = nowMs();
+    size_t best = SIZE_MAX;
+    uint64_t bestCost = 0;
+    pthread_mutex_lock(&endpoints->mutex);
+    // Pass 0 skips ejected and avoided ones, pass 1 only ejected ones.
+    for( int pass=0 ; pass<2 && best == SIZE_MAX ; ++pass ){
+        for( size_t i=0 ; i<endpoints->list_len ; ++i ){
+            const Endpoint *ep = endpoints->list + i;
+            if( now < ep->ejectedUntil || (pass == 0 && i < 64 && (avoid >> i & 1)) ){
+                continue; }
+            // Unknown latency counts as cheap, so fresh endpoints get probed.
+            const uint64_t latency = ep->stats.latencyUs ? ep->stats.latencyUs : 1;
+            const uint64_t cost = latency * (ep->inFlight + 1);
+            if( best == SIZE_MAX || cost < bestCost ){
+                best = i; bestCost = cost; }
+        }
+    }
+    if( best == SIZE_MAX ){
+        // All ejected. Probe the one which gets back first.
+        best = 0;
+        for( size_t i=1 ; i<endpoints->list_len ; ++i ){
+            if( endpoints->list[i].ejectedUntil < endpoints->list[best].ejectedUntil ){
+                best = i; }
+        }
+    }
+    endpoints->list[best].inFlight += 1;
+    endpoints->list[best].stats.requests += 1;
+    pthread_mutex_unlock(&endpoints->mutex);
+    return best;
+}
+
+
+void endpoints_release( Endpoints*endpoints, size_t idx, EndpointOutcome outcome, uint64_t micros ){
+    pthread_mutex_lock(&endpoints->mutex);
+    Endpoint *ep = endpoints->list + idx;
+    if( ep->inFlight ){
+        ep->inFlight -= 1; }
+    if( outcome == ENDPOINT_OK ){
+        ep->failsInRow = 0;
+        ep->ejectsInRow = 0;
+        ep->ejectedUntil = 0;
+        ep->stats.latencyUs = ep->stats.latencyUs ? (ep->stats.latencyUs * 7 + micros) / 8 : micros +1;
+    }else if( outcome == ENDPOINT_FAILED ){
+        ep->stats.failed += 1;
+        ep->failsInRow += 1;
+        if( ep->failsInRow >= EJECT_AFTER_FAILS ){
+            uint64_t ms = EJECT_BASE_MS;
+            for( uint_t i=0 ; i<ep->ejectsInRow && ms < EJECT_MAX_MS ; ++i ){
+                ms *= 2; }
+            if( ms > EJECT_MAX_MS ){
+                ms = EJECT_MAX_MS; }
+            ep->ejectedUntil = nowMs() + ms;
+            ep->ejectsInRow += 1;
+            // Once back, a single failure ejects it again.
+            ep->failsInRow = EJECT_AFTER_FAILS -1;
+            ep->stats.ejections += 1;
+        }
+    }
+    pthread_mutex_unlock(&endpoints->mutex);
+}
+
+
+void endpoints_getStats( Endpoints*endpoints, size_t idx, EndpointStats*dst ){
+    pthread_mutex_lock(&endpoints->mutex);
+    *dst = endpoints->list[idx].stats;
+    pthread_mutex_unlock(&endpoints->mutex);
+}
@@ -0,0 +1,78 @@
+/* By using this work you agree to the terms and conditions in 'LICENSE.txt' */
+
+#ifndef INCGUARD_e3a9c4710b5d4e28a6f1d07c92b8e5a3
+#define INCGUARD_e3a9c4710b5d4e28a6f1d07c92b8e5a3
+
+#include "commonbase.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/** How a request sent to an endpoint ended. */
+typedef enum EndpointOutcome {
+    ENDPOINT_OK       = 0,
+    /** Transport error or 5xx. */
+    ENDPOINT_FAILED   = 1,
+    /** We dropped it ourself. Says nothing about the endpoint. */
+    ENDPOINT_CANCELED = 2
+} EndpointOutcome;
+
+
+/**
+ * Set of equivalent base urls (eg the replicas of a read scaled gateleen)
+ * requests get spread over.
+ *
+ * Each request goes to the endpoint with the lowest cost, which is its
+ * smoothed latency times its requests in flight (plus one). So a slow node
+ * gets fewer requests and an idle one gets probed. Endpoints failing a few
+ * times in a row get ejected for a while. The ejection doubles each time it
+ * happens again (up to a minute) and ends with the first success.
+ *
+ * Thread safe.
+ */
+typedef struct Endpoints Endpoints;
+
+
+/**
+ * @param urls
+ *      Base urls. Get copied. A missing trailing slash gets added.
+ * @return
+ *      NULL if out of memory.
+ */
+Endpoints* endpoints_alloc( const char*const*urls , size_t urls_len );
+
+void endpoints_free( Endpoints* );
+
+size_t endpoints_count( const Endpoints* );
+
+/** @return Base url of endpoint 'idx' (with trailing slash). */
+const char* endpoints_url( const Endpoints* , size_t idx );
+
+/** Picks the endpoint for the next request and counts the request as in
+ * flight on it until 'endpoints_release'.
+ * @param avoid
+ *      Bit i set means not to pick endpoint i (eg as a retry of a request
+ *      which failed there already) unless there is no other one. Endpoints
+ *      beyond the 64th cannot be avoided.
+ * @return Index of the endpoint. */
+size_t endpoints_acquire( Endpoints* , uint64_t avoid );
+
+/** Ends a request started by 'endpoints_acquire'.
+ * @param micros
+ *      Time the request took. Ignored unless ENDPOINT_OK. */
+void endpoints_release( Endpoints* , size_t idx , EndpointOutcome outcome , uint64_t micros );
+
+/** Per endpoint counters. */
+typedef struct EndpointStats {
+    uint64_t requests;
+    uint64_t failed;
+    uint64_t ejections;
+    /** Smoothed latency in microseconds. Zero if unknown yet. */
+    uint64_t latencyUs;
+} EndpointStats;
+
+void endpoints_getStats( Endpoints* , size_t idx , EndpointStats*dst );
+
+
+#endif /* INCGUARD_e3a9c4710b5d4e28a6f1d07c92b8e5a3 */
@@ -6,28 +6,97 @@
 /* System */
 #include <assert.h>
 #include <errno.h>
+#include <fnmatch.h>
 #include <libgen.h>
+#include <limits.h>
+#include <pthread.h>
 #include <regex.h>
+#include <sched.h>
+#include <stdint.h>
 #include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
 
 /* Libs */
 #include "archive.h"
 #include "archive_entry.h"
 #include <curl/curl.h>
 #include <cJSON.h>
+#include <zlib.h>
 
 /* Project */
+#include "arena.h"
 #include "array.h"
+#include "batch.h"
+#include "cache.h"
+#include "diff.h"
+#include "endpoints.h"
+#include "hash.h"
+#include "log.h"
+#include "merge.h"
 #include "mime.h"
+#include "ndjson.h"
+#include "probe.h"
+#include "redis.h"
+#include "replica.h"
+#include "ring.h"
 #include "util_string.h"
+#include "zstdseek.h"
 
 
-#if __WIN32
-#   define FMT_SIZE_T "%llu"
-#else
-#   define FMT_SIZE_T "%lu"
-#endif
 #define ERR_PARSE_DIR_LIST -2
+/* Resource buffers larger than this get released after use instead of being
+ * kept around for the next resource. */
+#define RESOURCE_BUF_KEEP_MAX (1<<20)
+/* Max count of distinct directory names to intern. */
+#define DIR_NAMES_MAX 4096
+/* Min millis between two progress lines. */
+#define PROGRESS_INTERVAL_MS 5000
+/* Count of rejected expands (without any success) until we give up on it. */
+#define EXPAND_REJECTS_MAX 4
+/* Max count of headers an entry carries besides Content-Type. */
+#define ENTRY_HEADERS_MAX 8
+/* Extended attribute keeping the Content-Type (freedesktop.org convention). */
+#define XATTR_MIME_TYPE "user.mime_type"
+/* Prefix of extended attributes keeping other headers. */
+#define XATTR_HEADER_PREFIX "user.gateleen.header."
+/* Smallest write queue. Still takes a message of a quarter of it, which
+ * is way more than what a long path with all its headers needs. */
+#define WRITE_QUEUE_MIN (64<<10)
+/* Yields before a side of the write queue parks. */
+#define ASYNC_SPINS 64
+/* Upper limit for '--range-segments'. */
+#define RANGE_SEGMENTS_MAX 64
+/* Longer ETags are not remembered. Those resources then get copied every
+ * replication cycle. */
+#define ETAG_MAX 127
+/* A tar.zst frame ends at the first entry after it got this large
+ * (uncompressed). Smaller frames spread better over push threads but
+ * compress worse. */
+#define ZSTD_FRAME_BYTES (4<<20)
+/* Probe profiles in 'tuneCacheDir' older than this get probed again. */
+#define TUNE_MAX_AGE_S (24*3600)
+/* Auto-tune splits resources one stream needs longer than a second for, but
+ * never below that size. */
+#define TUNE_RANGE_THRESHOLD_MIN (4<<20)
+/* Options auto-tune may pick (see 'GateleenResclone.tunable'). */
+#define TUNE_RANGE_THRESHOLD  (1<<0)
+#define TUNE_RANGE_SEGMENTS   (1<<1)
+#define TUNE_WRITE_QUEUE      (1<<2)
+#define TUNE_MIRROR_PARALLEL  (1<<3)
+/* Keys to ask redis for per round trip. Each costs a HMGET and a ZSCORE. */
+#define REDIS_BATCH_KEYS 128
+/* Key prefixes of gateleen's redis storage (its defaults). */
+#define REDIS_RESOURCES_PREFIX "rest-storage:resources"
+#define REDIS_EXPIRABLE_KEY "rest-storage:expirable"
+/* Expiries beyond this (millis) are gateleen's way to say 'never'. */
+#define REDIS_EXPIRE_NEVER_MS 9999999999999.0
+/* Paths left out by a deadline to log if there is no list file for them. */
+#define MISSING_LOG_MAX 32
+#define QUEUE_COUNT_MAX 1024
+/* Millis between two polls of the queues to drain. */
+#define QUEUE_POLL_MS 500
 
 
 
@@ -35,13 +104,42 @@
 typedef enum OpMode {
     MODE_NULL =0,
     MODE_FETCH=1,
-    MODE_PUSH =2
+    MODE_PUSH =2,
+    MODE_BATCH=3,
+    MODE_MERGE=4,
+    MODE_REPLICATE=5,
+    MODE_DIFF =6
 } OpMode;
 
 
-/** Main module handle representing an instance. */
-typedef struct Resclone {
+/** What we got from commandline. */
+typedef struct CliArgs {
     enum OpMode mode;
+    /** Strings point into argv. */
+    GateleenResclone_Opts opts;
+    /** Jobs file for '--batch'. */
+    const char *batchFile;
+    /** Archives to combine in '--merge' mode. */
+    char **mergeInputs;
+    size_t mergeInputs_len;
+    size_t mergeInputs_cap;
+    /** (optional) Where '--merge' writes its manifest to. */
+    const char *manifestFile;
+    /** Further '--url's (and '--endpoints'). */
+    char **endpoints;
+    size_t endpoints_len;
+    size_t endpoints_cap;
+    /** Inputs of '--diff'. Second one is either an archive or an url. */
+    const char *diffFrom;
+    const char *diffTo;
+    /** Default of '--tune-cache'. */
+    char tuneCacheDir[PATH_MAX];
+    LogOpts log;
+} CliArgs;
+
+
+/** Main module handle representing an instance. */
+struct GateleenResclone {
     /** Base URL where to upload to / download from. */
     char *url;
     /** Array of regex patterns to use per segment. */
@@ -51,17 +149,341 @@ typedef struct Resclone {
     int isFilterFull;
     /* Path to archive file to use. Using stdin/stdout if NULL. */
     char *file;
-} Resclone;
+    /** Max bytes to use for buffers. Zero means unlimited. */
+    size_t maxMemory;
+    /** Where to put pulled entries. NULL means default tar. */
+    GateleenResclone_Sink *sink;
+    /** Where to take pushed entries from. NULL means default tar. */
+    GateleenResclone_Source *source;
+    GateleenResclone_Stats stats;
+    uint_t shardIdx;
+    /** Zero if not sharded. */
+    uint_t shardCount;
+    uint_t shardDepth;
+    /** Zero means no sampling by count. */
+    size_t samplePerCollection;
+    /** Zero means no sampling by ratio. */
+    double sampleRatio;
+    uint_t sampleSeed;
+    /** Zero means unlimited. Same for both budgets. */
+    uint_t maxDepth;
+    size_t maxBytes;
+    size_t maxEntries;
+    /** Patterns of 'priority', each as its segments (NUL separated, ending
+     * with an empty one). */
+    char **priority;
+    uint_t priority_len;
+    /** Zero means no deadline. */
+    uint_t deadline;
+    /** Monotonic millis the running pull has to end by. Zero if none. */
+    int64_t deadlineAt;
+    /** NULL means no list (the first few get logged). */
+    char *missingFile;
+    int isLargestFirst;
+    /** Zero means no volumes. */
+    size_t volumeSize;
+    /** Of the default sink. */
+    GateleenResclone_Format format;
+    /** Zero means do not expand. */
+    uint_t expandLevels;
+    /** Zero means listings are not paged. */
+    size_t pageSize;
+    int isExpandZip;
+    /** Zero means no segmented downloads. */
+    size_t rangeThreshold;
+    uint_t rangeSegments;
+    /** Zero means the sink gets called by the transfers directly. */
+    size_t writeQueueSize;
+    /** (optional) Extends the built-in mime types. */
+    MimeMap *mimeMap;
+    /** NULL means no cache. */
+    char *cacheDir;
+    size_t cacheSize;
+    int isVerifyAfterPush;
+    uint_t verifyParallel;
+    int isMirror;
+    uint_t mirrorParallel;
+    int isDryRun;
+    /** Probe the server before the first pull. Cleared once done. */
+    int isAutoTune;
+    /** Of the TUNE_* options, those left zero. Only those get picked. */
+    uint_t tunable;
+    /** NULL probes every time. */
+    char *tuneCacheDir;
+    /** 'x-queue' headers (like "x-queue: name") of '--via-queue'. NULL pushes
+     * directly. */
+    char **queueHdrs;
+    uint_t queueHdrs_len;
+    /** Zero means do not wait for the queues to drain. */
+    uint_t queueWait;
+    /** Including trailing slash. Only set with 'queueHdrs'. */
+    char *queueApiUrl;
+    /** Paths pushed so far. Only set while pushing with 'isMirror'. */
+    struct PathIndex *mirrorIndex;
+    /** Target of '--replicate' (including trailing slash). NULL otherwise. */
+    char *replicaUrl;
+    uint_t replicaInterval;
+    uint_t replicaCycles;
+    char *metricsFile;
+    /** Only set while a replication cycle pulls. */
+    struct Replica *replica;
+    uint_t parallel;
+    /** (optional) Borrowed transport state shared with other instances. */
+    CURLSH *share;
+    /** (optional) Pull from gateleen's redis storage instead of 'url'. */
+    char *redisUrl;
+    /** (optional) 'url' plus its equivalents. Reads of a pull get spread
+     * over those. NULL if there is only 'url'. */
+    Endpoints *endpoints;
+};
+typedef struct GateleenResclone Resclone;
+
+
+/** Response headers (besides Content-Type) to keep in the archive, so push
+ * can restore them. Lower case. */
+static const char *const recordedHeaders[] = {
+    "x-expire-after",
+    "cache-control",
+    "content-language",
+};
+
+
+/** Headers of an entry as "Name: value" strings. */
+typedef struct EntryHeaders {
+    const char *list[ENTRY_HEADERS_MAX];
+    size_t list_len;
+    char buf[2048];
+    size_t buf_len;
+} EntryHeaders;
+
+
+/** Default sink. Writes a pax tar. */
+typedef struct TarSink {
+    const char *file;
+    GateleenResclone_Format format;
+    struct archive *archive;
+    struct archive_entry *entry;
+    /** Set while writing a seekable tar.zst. Gets the tar from 'archive'. */
+    ZstdSeekWriter *zstd;
+    /** Zero if not writing volumes. */
+    size_t volumeSize;
+    uint_t volumeIdx;
+    /** Count of entries in current volume. */
+    size_t volumeEntries;
+} TarSink;
+
+
+/** Sink wrapper which hands the entries over to a dedicated writer thread
+ * through a bounded queue, so transfers do not stall on archive I/O. */
+typedef struct AsyncSink {
+    GateleenResclone_Sink *inner;
+    Ring *ring;
+    pthread_t thread;
+    int isThreadRunning;
+    /** Set by the writer once 'inner' failed. */
+    int isFailed;
+    /** Tells the writer to quit without draining the queue. */
+    int isStop;
+    /** Where a side parks while the queue is empty (writer) or full
+     * (producer). The ring itself stays lock-free. The mutex only guards
+     * parking and waking. */
+    pthread_mutex_t mutex;
+    pthread_cond_t notEmpty;
+    pthread_cond_t notFull;
+    int isLockInit;
+    int isWriterParked;
+    int isProducerParked;
+    /** Where to report queue depth. Only touched by the producer. */
+    GateleenResclone_Stats *stats;
+    MemBudget *budget;
+    /** Headers of the entry the writer currently begins. */
+    const char *headers[ENTRY_HEADERS_MAX];
+} AsyncSink;
+
+
+typedef enum AsyncMsgType {
+    ASYNC_MSG_BEGIN,
+    ASYNC_MSG_DATA,
+    ASYNC_MSG_END,
+    ASYNC_MSG_CLOSE
+} AsyncMsgType;
+
+
+/** One sink call travelling through the queue. */
+typedef struct AsyncMsg {
+    AsyncMsgType type;
+    int hasContentType;
+    /** BEGIN: Count of headers following the content type. */
+    uint_t headers_len;
+    /** BEGIN: Entry size. DATA: Count of bytes in 'data'. */
+    size_t size;
+    /** BEGIN: Path, content type (if any) and headers, each zero
+     * terminated. DATA: Body bytes. */
+    char data[];
+} AsyncMsg;
+
+
+/** Default source. Reads any archive format libarchive knows about. */
+typedef struct TarSource {
+    const char *file;
+    struct archive *archive;
+    /** (optional) Only yield every 'partCount'th entry, starting with entry
+     * 'partIdx'. For concurrent pushes of one (seekable) archive. */
+    uint_t partIdx;
+    uint_t partCount;
+    size_t ordinal;
+    /** Set if the part gets read as a range of frames of a seekable
+     * tar.zst. Nothing to skip then. */
+    int isRange;
+    /** NULL if the range is empty. */
+    ZstdSeekReader *zstd;
+    char *zstdBuf;
+    /** Of current entry. */
+    char *contentType;
+    EntryHeaders headers;
+} TarSource;
+
+
+/** Closure for a file download. */
+typedef struct ResourceFile {
+    struct ClsDload *dload;
+    size_t srcChunkIdx;
+    char *url;
+    size_t url_cap;
+    char *buf;
+    size_t buf_len;
+    size_t buf_cap;
+    /** Takes the body as soon it no longer fits into the memory budget. */
+    FILE *spool;
+    size_t spool_len;
+    /** As reported by the server. Owned by curl. */
+    const char *contentType;
+    /** Server announced 'Accept-Ranges: bytes'. */
+    int isRangeable;
+    /** Size of the body if it is to be fetched in ranges instead. */
+    size_t rangeLen;
+    /** Those of 'recordedHeaders' the server sent. */
+    EntryHeaders headers;
+    /** (optional) Make the GET conditional. Kept by 'resetResourceFile'. */
+    const char *ifNoneMatch;
+    int64_t ifModifiedSince;
+    long rspCode;
+    /** As reported by the server. Empty if none (or too long). */
+    char etag[ETAG_MAX +1];
+} ResourceFile;
+
+
+/** Rate limits the progress lines of a pull or push. */
+typedef struct Progress {
+    struct timespec begin;
+    LogRate rate;
+} Progress;
+
+
+/** A transfer driven by the multi handle of a download. Referenced by the
+ * easy handles CURLOPT_PRIVATE. */
+typedef struct Transfer {
+    int isRunning;
+    CURLcode result;
+    /** (optional) Where 'transferBegin' sent it to. Released once done. */
+    Endpoints *endpoints;
+    size_t endpoint;
+    struct timespec begin;
+} Transfer;
+
+
+/** One 'Range' request of a segmented resource download. */
+typedef struct RangeSeg {
+    Transfer transfer; /* <- MUST be first. */
+    CURL *curl;
+    FILE *spool;
+    /** Byte range (inclusive) this segment covers. */
+    size_t beg, end;
+    /** Count of bytes received so far. */
+    size_t off;
+    /** Server answered with the whole body instead of the range. */
+    int isRangeIgnored;
+} RangeSeg;
+
+
+/** Fetches pages of a collection listing in background. One per depth, so
+ * each level of the traversal can prefetch its next page. */
+typedef struct Pager {
+    Transfer transfer; /* <- MUST be first. */
+    struct ClsDload *dload;
+    CURL *curl;
+    char *url;
+    size_t url_cap;
+    char *buf;
+    size_t buf_len;
+    size_t buf_cap;
+    /** Endpoints the current page failed on (see 'endpoints_acquire'). */
+    uint64_t tried;
+    uint_t attempt;
+} Pager;
+
+
+/** Sort key of an entry when reordering by 'priority' and 'isLargestFirst'. */
+typedef struct SchedKey {
+    uint_t rank;
+    /** Of the body if known. Zero otherwise. */
+    uint64_t size;
+    /** Position in path order. Breaks ties, as qsort is not stable. */
+    size_t idx;
+    const void *item;
+} SchedKey;
 
 
 /** Closure for a download instructed by external caller. */
 typedef struct ClsDload {
-    struct Resclone *resclone;
+    struct GateleenResclone *resclone;
     char *rootUrl;
-    struct archive *dstArchive;
-    struct archive_entry *tmpEntry;
-    char *archiveFile;
+    size_t rootUrl_len;
+    GateleenResclone_Sink *sink;
     CURL *curl;
+    MemBudget memBudget;
+    /** Per-directory allocations (urls, parsed listings). Rewound as soon
+     * the directory is done. */
+    Arena *arena;
+    StrIntern *dirNames;
+    /** Listing response buffer. Lent to the directory currently fetched. */
+    char *dirBuf;
+    size_t dirBuf_cap;
+    /** Reused for every file to download. */
+    struct ResourceFile resourceFile;
+    uint_t expandAccepts;
+    uint_t expandRejects;
+    /** Set once server looks like it does not support expand at all. */
+    int isExpandOff;
+    /** Only set when paging or after the first segmented download. Drives
+     * all transfers then, so page prefetches progress while we download
+     * resources. */
+    CURLM *multi;
+    /** Easy handles for segmented downloads. Reused from one to the next. */
+    RangeSeg *rangeSegs;
+    /** Set once server ignored a 'Range' header. */
+    int isRangeOff;
+    /** Only passes paths to the sink. No resource gets fetched. */
+    int isListOnly;
+    /** Set once 'maxBytes', 'maxEntries' or the deadline got reached. The
+     * traversal then unwinds without further requests. */
+    int isBudgetSpent;
+    int isDeadlineHit;
+    /** (optional) Lists what the traversal left out when it stopped early. */
+    FILE *missing;
+    /** Index of the 'priority' pattern whose subtree the traversal pulls.
+     * 'priority_len' for the rest of the tree. */
+    uint_t pass;
+    /** (optional) Fetches resources conditionally against what the previous
+     * replication cycle saw. */
+    struct Replica *replica;
+    /** (optional) Fetches resources conditionally against what earlier
+     * pulls stored there. */
+    Cache *cache;
+    /** Indexed by depth. */
+    Pager **pagers;
+    size_t pagers_len;
+    Progress progress;
 } ClsDload;
 
 
@@ -74,36 +496,124 @@ typedef struct ResourceDir {
     size_t rspBody_len;
     size_t rspBody_cap;
     short rspCode;
-    char *name;
-} ResourceDir;
-
-
-/** Closure for a file download. */
-typedef struct ResourceFile {
-    struct ClsDload *dload;
-    size_t srcChunkIdx;
+    const char *name;
+    /** Full URL of this directory (including trailing slash). */
     char *url;
-    char *buf;
-    int buf_len;
-    int buf_memSz;
-} ResourceFile;
+    size_t url_len;
+    /** Count of parent dirs. Zero for root. */
+    uint_t depth;
+} ResourceDir;
 
 
 /** Closure for an upload instructed by external caller. */
 typedef struct Upload {
-    struct Resclone *resclone;
+    struct GateleenResclone *resclone;
     char *rootUrl;
-    char *archiveFile;
-    struct archive *srcArchive;
+    GateleenResclone_Source *source;
     CURL *curl;
+    /** What this upload did. Added to the instance stats when done. */
+    GateleenResclone_Stats stats;
+    Progress progress;
 } Upload;
 
 
+/** Set of paths kept as sorted hashes. Eight bytes per path however long
+ * they are. A collision only makes '--mirror' keep a resource it should
+ * have deleted. */
+typedef struct PathIndex {
+    uint64_t *hashes;
+    size_t hashes_len;
+    size_t hashes_cap;
+    /** Volumes get pushed concurrently. */
+    pthread_mutex_t mutex;
+} PathIndex;
+
+
+/** Collects paths of the target which are not in the archive. */
+typedef struct MirrorSink {
+    const PathIndex *index;
+    /** Zero separated paths. */
+    char *extras;
+    size_t extras_len;
+    size_t extras_cap;
+} MirrorSink;
+
+
+/** One DELETE of '--mirror'. */
+typedef struct MirrorSlot {
+    Transfer transfer; /* <- MUST be first. */
+    CURL *curl;
+    int isBusy;
+    const char *path;
+    char *url;
+    size_t url_cap;
+} MirrorSlot;
+
+
+/** Sink of '--replicate'. PUTs the changed resources to the target. */
+typedef struct ReplicaCopy {
+    Replica *replica;
+    GateleenResclone_Sink sink;
+    GateleenResclone_Source source;
+    Upload upload;
+    /** Entry passed through currently. */
+    char *path;
+    size_t path_cap;
+    char *contentType;
+    size_t contentType_cap;
+    EntryHeaders headers;
+    char *body;
+    size_t body_len;
+    size_t body_cap;
+    size_t body_off;
+} ReplicaCopy;
+
+
+/** One GET of the verification after a push. */
+typedef struct VerifySlot {
+    Transfer transfer; /* <- MUST be first. */
+    CURL *curl;
+    /** Set while 'transfer' is in use (even if it is done already). */
+    int isBusy;
+    char *path;
+    size_t path_cap;
+    char *url;
+    size_t url_cap;
+    /** As found in the archive. */
+    size_t expectSize;
+    uint64_t expectHash;
+    /** As received from the target. */
+    size_t gotSize;
+    uint64_t gotHash;
+} VerifySlot;
+
+
+/** Closure for a push of a volume set. */
+typedef struct PushVolumes {
+    struct GateleenResclone *resclone;
+    uint_t volumes_len;
+    /** Push 'volumes_len' parts of the single archive 'file' instead of
+     * volumes (see 'TarSource.partCount'). */
+    int isParts;
+    /** Index of next volume to pick. Guarded by 'mutex'. */
+    uint_t nextVolume;
+    /** Guarded by 'mutex'. */
+    ssize_t result;
+    pthread_mutex_t mutex;
+} PushVolumes;
+
+
 /** Closure for a PUT of a single resource. */
 typedef struct Put {
     struct Upload *upload;
     /* Path (relative to rootUrl) of the resource to be uploaded. */
-    char *name;
+    const char *name;
+    /* Content-Type to upload with. NULL to guess from name. */
+    const char *contentType;
+    /* Further headers to upload with ("Name: value"). */
+    const char *const*headers;
+    size_t headers_len;
+    size_t size;
 } Put;
 
 
@@ -121,11 +631,41 @@ static void printHelp( void ){
         "  \n"
         "  Options:\n"
         "  \n"
+        "    -q, -v\n"
+        "        (optional) Only log warnings and errors (-q) or also log every\n"
+        "        single entry (-v). Default is a progress summary every few\n"
+        "        seconds.\n"
+        "  \n"
+        "    --log-level error|warn|info|debug\n"
+        "        (optional) Same as above. Last one wins.\n"
+        "  \n"
+        "    --log-format text|json\n"
+        "        (optional) 'json' writes one object per line with 'time',\n"
+        "        'level' and 'msg'. Defaults to text.\n"
+        "  \n"
         "    --pull|--push\n"
         "        Choose to download or upload.\n"
         "  \n"
         "    --url <url>\n"
-        "        Root node of remote tre\n"
+        "        Root node of remote tre. Repeat it to name the same tree on\n"
+        "        further nodes (eg replicas). Then the requests of '--pull' (and\n"
+        "        '--replicate') get spread over all of them. Each request goes to\n"
+        "        the node with the least requests in flight, weighted by its\n"
+        "        latency. Nodes failing three times in a row get ejected for a\n"
+        "        while. Failed requests (transport error or 5xx) get retried on\n"
+        "        another node. Push only uses the first url.\n"
+        "  \n"
+        "    --endpoints <url>,<url>...\n"
+        "        (optional) Same as repeating '--url'.\n"
+        "  \n"
+        "    --source redis://[[user]:password@]host[:port][/prefix]\n"
+        "        (optional) With '--pull', reads gateleen's redis storage directly\n"
+        "        instead of '--url' (SCAN for the keys, then pipelined batches of\n"
+        "        HMGET). Way faster for whole storage backups. prefix defaults to\n"
+        "        'rest-storage:resources' (everything). A longer one like\n"
+        "        'rest-storage:resources/houston' only pulls that subtree. Append\n"
+        "        '?expirable=<key>' if the expiry set is not named\n"
+        "        'rest-storage:expirable'. Expired resources get skipped.\n"
         "  \n"
         "    --filter-part <path-filter>\n"
         "        Regex pattern applied as predicate to the path starting after\n"
@@ -143,787 +683,5553 @@ static void printHelp( void ){
         "        (optional) Path to the archive file to read/write. Defaults to\n"
         "        stdin/stdout if ommitted.\n"
         "  \n"
+        "    --format tar|tar.zst|zip|ndjson\n"
+        "        (optional) With '--pull', the archive format to write. 'tar.zst'\n"
+        "        compresses the tar as independent zstd frames (of about 4 MiB)\n"
+        "        each starting at an entry, plus a seek table. '--push --parallel\n"
+        "        <n>' then decompresses it with n threads. Any zstd still reads it\n"
+        "        as a plain tar.zst. 'zip'\n"
+        "        deflates each entry on its own and ends with a central directory.\n"
+        "        So single resources can be extracted without reading the others.\n"
+        "        Zip does not keep Content-Type nor headers. 'ndjson' writes one\n"
+        "        line per resource with \"path\", \"contentType\", \"headers\", \"size\"\n"
+        "        and the body. JSON bodies on one single line get inlined as\n"
+        "        \"json\" (verbatim), others go as \"base64\". Push detects the\n"
+        "        format by itself. Only ndjson from stdin needs '--push --format\n"
+        "        ndjson'.\n"
+        "        Defaults to tar.\n"
+        "  \n"
+        "    --max-memory <bytes>\n"
+        "        (optional) Upper limit for memory used to buffer resources.\n"
+        "        Bodies not fitting into it get spooled to a temporary file.\n"
+        "        Accepts suffixes k, M, G. Defaults to unlimited.\n"
+        "  \n"
+        "    --volume-size <bytes>\n"
+        "        (optional) With '--pull', splits the archive into volumes of\n"
+        "        about that size. For '--file foo.tar' they are named\n"
+        "        'foo.000.tar', 'foo.001.tar', ... Volumes get cut at entry\n"
+        "        boundaries, so each is a complete archive on its own. An entry\n"
+        "        larger than the volume size gets a volume of its own. '--push'\n"
+        "        with '--file foo.tar' picks up such a volume set if 'foo.tar'\n"
+        "        itself does not exist. With tar.zst the size counts uncompressed\n"
+        "        bytes. Accepts suffixes k, M, G.\n"
+        "  \n"
+        "    --write-queue <bytes>\n"
+        "        (optional) With '--pull', archive writing happens on a thread of\n"
+        "        its own which gets fed through a queue of that size. Transfers\n"
+        "        only wait for it once the queue is full. Zero writes directly\n"
+        "        from the transfers. Accepts suffixes k, M, G. Defaults to 4M\n"
+        "        (see '--no-auto-tune'). At least 64k.\n"
+        "  \n"
+        "    --range-threshold <bytes>\n"
+        "        (optional) With '--pull', resources at least that large get\n"
+        "        fetched as concurrent 'Range' requests into a temporary file,\n"
+        "        provided the server announces 'Accept-Ranges: bytes'. Falls back\n"
+        "        to one request per resource if the server ignores ranges. Zero\n"
+        "        disables it. Accepts suffixes k, M, G. Defaults to 64M (see\n"
+        "        '--no-auto-tune').\n"
+        "  \n"
+        "    --range-segments <n>\n"
+        "        (optional) Count of concurrent ranges per large resource.\n"
+        "        Defaults to 4.\n"
+        "  \n"
+        "    --no-auto-tune\n"
+        "        (optional) By default, pull and replicate first probe the server\n"
+        "        behind '--url' (HTTP version, keepalive, 'Range', round trip and\n"
+        "        throughput) and pick '--range-threshold', '--range-segments' and\n"
+        "        '--write-queue' from it. Options given explicitly (other than\n"
+        "        zero) are kept. '--expand' never gets picked, as it changes what\n"
+        "        gets archived. With '--page-size' the probe gets skipped, as it\n"
+        "        would list the collection unpaged. This switches the probe off\n"
+        "        and uses the plain defaults.\n"
+        "  \n"
+        "    --tune-cache <dir>\n"
+        "        (optional) Where to remember the probe results per url, so\n"
+        "        runs within a day skip the probe. Defaults to\n"
+        "        '$XDG_CACHE_HOME/gateleen-resclone/probe' (or\n"
+        "        '~/.cache/gateleen-resclone/probe').\n"
+        "  \n"
+        "    --cache-dir <dir>\n"
+        "        (optional) With '--pull', keeps the bodies of pulled resources\n"
+        "        in dir (content-addressed, so equal bodies take the space once).\n"
+        "        Later pulls ask the server with 'If-None-Match' (or\n"
+        "        'If-Modified-Since') and take the body from dir if it did not\n"
+        "        change. Not used for bodies embedded by '--expand'.\n"
+        "  \n"
+        "    --cache-size <bytes>\n"
+        "        (optional) Bodies in '--cache-dir' may take that much. Least\n"
+        "        recently used ones get evicted at the end of each pull.\n"
+        "        Accepts suffixes k, M, G. Defaults to unlimited.\n"
+        "  \n"
+        "    --mime-types <file>\n"
+        "        (optional) With '--push', extends the built-in mapping of file\n"
+        "        extensions to Content-Type (same format as '/etc/mime.types').\n"
+        "        Only used for entries which carry no Content-Type of their own.\n"
+        "  \n"
+        "    --expand <levels>\n"
+        "        (optional) With '--pull', fetches collections together with the\n"
+        "        content of their children up to given depth (gateleen\n"
+        "        'expand'). Saves one request per resource. Falls back to\n"
+        "        fetching one by one where the server rejects it.\n"
+        "        NOTE: Changes what gets archived. Resources got this way are\n"
+        "        stored re-serialized as compact JSON (formatting gets lost, like\n"
+        "        '1.0' becoming '1') with content type 'application/json' and\n"
+        "        without their other headers (like 'x-expire-after'). Resources\n"
+        "        holding integers too large for a double get fetched one by one.\n"
+        "        Use '--expand-zip' to archive the bodies as they are.\n"
+        "  \n"
+        "    --expand-zip\n"
+        "        (optional) Asks for expanded collections as zip ('zip=true').\n"
+        "        Cannot be combined with filters or '--shard'. Entries get\n"
+        "        archived in the order the server zipped them.\n"
+        "  \n"
+        "    --page-size <n>\n"
+        "        (optional) With '--pull', lists collections in pages of n\n"
+        "        entries ('limit'/'offset'). The next page gets fetched while\n"
+        "        the entries of the current one get downloaded. Entries are\n"
+        "        sorted per page only. Cannot be combined with '--expand'.\n"
+        "  \n"
+        "    --verify-after-push\n"
+        "        (optional) With '--push', fetches every entry back once the push\n"
+        "        is done and compares size and hash with the archive. Prints one\n"
+        "        'MISMATCH <path> <reason>' line (tab separated) per differing or\n"
+        "        missing entry to stdout and fails if there is any. Needs\n"
+        "        '--file'.\n"
+        "  \n"
+        "    --verify-parallel <n>\n"
+        "        (optional) Count of concurrent requests of the verification.\n"
+        "        Defaults to 8.\n"
+        "  \n"
+        "    --mirror\n"
+        "        (optional) With '--push', deletes resources below url which are\n"
+        "        not in the archive once the push is done. So the target ends up\n"
+        "        holding exactly what the archive holds. Prints one\n"
+        "        'DELETE <path>' line (tab separated) per deleted resource to\n"
+        "        stdout.\n"
+        "  \n"
+        "    --mirror-parallel <n>\n"
+        "        (optional) Count of concurrent DELETEs of '--mirror'. Defaults\n"
+        "        to 8.\n"
+        "  \n"
+        "    --dry-run\n"
+        "        (optional) With '--push', reads the archive but neither uploads\n"
+        "        nor deletes anything. Combined with '--mirror' prints what would\n"
+        "        get deleted.\n"
+        "  \n"
+        "    --via-queue <name>\n"
+        "        (optional) With '--push', submits the PUTs to gateleen's queues\n"
+        "        (header 'x-queue') so each one returns as soon it got queued.\n"
+        "        The target writes them asynchronously. '*' in name gets replaced\n"
+        "        by the index of the queue (like 'resclone-*'). Without '*' the\n"
+        "        index gets appended behind a '-'. Each path sticks to one queue,\n"
+        "        so updates of it stay in order.\n"
+        "  \n"
+        "    --queue-count <n>\n"
+        "        (optional) Count of queues '--via-queue' spreads the PUTs over,\n"
+        "        so the target works them off in parallel. Defaults to 4.\n"
+        "  \n"
+        "    --queue-wait <duration>\n"
+        "        (optional) Once all PUTs got queued, polls the queues until they\n"
+        "        are empty. Fails if they are not within duration (like '90s',\n"
+        "        '15m'). Without it, push is done as soon everything got queued.\n"
+        "        Needed by '--verify-after-push'.\n"
+        "  \n"
+        "    --queue-api <url>\n"
+        "        (optional) Collection of gateleen's queue monitoring API to poll\n"
+        "        for '--queue-wait'. Defaults to '/queuing/queues/' on the host\n"
+        "        of url.\n"
+        "  \n"
+        "    --replicate --from <url> --to <url>\n"
+        "        Keeps the tree at '--to' in sync with the one at '--from' (same\n"
+        "        as '--url'). Runs in cycles. Each cycle traverses the source and\n"
+        "        fetches resources conditionally ('If-None-Match') against the\n"
+        "        ETags seen by the previous cycle. Only changed resources get\n"
+        "        PUT to the target. Resources gone on the source get deleted on\n"
+        "        the target. Only by cycles which got every listing. A failed\n"
+        "        listing fails the cycle. State is kept in memory. So the first\n"
+        "        cycle after a start copies everything. Cannot be combined with\n"
+        "        '--expand'.\n"
+        "  \n"
+        "    --interval <duration>\n"
+        "        (optional) With '--replicate', time from the begin of one cycle\n"
+        "        to the begin of the next. Accepts suffixes s, m, h, d. Defaults\n"
+        "        to 0 (next cycle starts right away).\n"
+        "  \n"
+        "    --cycles <n>\n"
+        "        (optional) With '--replicate', stop after n cycles. Defaults to\n"
+        "        0 (run forever).\n"
+        "  \n"
+        "    --metrics <path>\n"
+        "        (optional) With '--replicate', replaces path after each cycle\n"
+        "        with metrics in prometheus text format. Among them the lag\n"
+        "        (age of the source state the target is known to hold) and the\n"
+        "        counts of changed, unchanged, deleted and failed resources.\n"
+        "  \n"
+        "    --batch <jobs-file>\n"
+        "        Pulls many trees in one process sharing DNS cache, connections\n"
+        "        and TLS sessions. Each line in jobs-file describes one job as\n"
+        "        whitespace separated '<url> <filter> <file>'. Use '-' as filter\n"
+        "        to not filter. Prefix filter with 'full:' to get '--filter-full'\n"
+        "        behavior. Empty lines and lines starting with '#' are ignored.\n"
+        "        Prints one result line per job to stdout as\n"
+        "        '<line> <OK|FAIL> <entries> <bytes> <failed> <seconds> <url>'.\n"
+        "  \n"
+        "    --parallel <n>\n"
+        "        (optional) Count of jobs (or volumes on push) to process\n"
+        "        concurrently. A single zip gets pushed by n readers, each taking\n"
+        "        every n-th entry through the central directory. A single seekable\n"
+        "        tar.zst gets split into n ranges of frames. Defaults to 1.\n"
+        "  \n"
+        "    --shard <i>/<n>\n"
+        "        (optional) Only pull shard i (zero based) of n shards. Paths get\n"
+        "        assigned to shards by a hash of their first '--shard-depth'\n"
+        "        segments. Running all n shards yields the whole tree.\n"
+        "  \n"
+        "    --shard-depth <d>\n"
+        "        (optional) Count of leading path segments to partition by.\n"
+        "        Defaults to 1.\n"
+        "  \n"
+        "    --sample-per-collection <n>\n"
+        "        (optional) Pull a sample only. Keeps at most n entries\n"
+        "        (resources and collections) of each collection (or page of it\n"
+        "        with '--page-size'). Skipped collections do not get listed at all.\n"
+        "  \n"
+        "    --sample-ratio <r>\n"
+        "        (optional) Pull only about that fraction (eg 0.01) of the\n"
+        "        resources. Collections still get listed.\n"
+        "  \n"
+        "    --sample-seed <s>\n"
+        "        (optional) Picks which entries make it into a sample. Same seed\n"
+        "        and same tree yield the same sample. Defaults to 0.\n"
+        "  \n"
+        "    --max-depth <d>\n"
+        "        (optional) Do not descend deeper than d path segments below\n"
+        "        '--url'. 1 only pulls the resources directly in it.\n"
+        "  \n"
+        "    --max-bytes <bytes>\n"
+        "    --max-entries <n>\n"
+        "        (optional) Stop the traversal once that many bytes or entries\n"
+        "        got pulled. The archive gets completed normally. Accepts\n"
+        "        suffixes k, M, G for bytes.\n"
+        "  \n"
+        "    --priority <pattern>[,<pattern>...]\n"
+        "        (optional) Pull the subtrees matching one of the patterns first\n"
+        "        (those of the first pattern first), then the rest. Patterns are\n"
+        "        paths relative to '--url', each segment a shell wildcard (eg\n"
+        "        'houston/server/logs,houston/state-*'). Takes one traversal per\n"
+        "        pattern plus one for the rest. The archive is not in path order\n"
+        "        then (as '--merge' expects).\n"
+        "  \n"
+        "    --deadline <duration>\n"
+        "        (optional) Stop the traversal after that long (like '90s', '15m',\n"
+        "        '2h'). Transfers still running get cut. The archive gets\n"
+        "        completed normally with what got pulled by then.\n"
+        "  \n"
+        "    --missing <path>\n"
+        "        (optional) With '--pull', list what '--deadline' (or a budget)\n"
+        "        left out to path, one per line. Collections (ending with '/')\n"
+        "        are missing with (some of) their content. Without it, the first\n"
+        "        few get logged if the deadline hits.\n"
+        "  \n"
+        "    --largest-first\n"
+        "        (optional) Within each collection, fetch the resources whose size\n"
+        "        is known from '--cache-dir' largest first. So large transfers do\n"
+        "        not end up at the tail. Needs '--cache-dir'. The archive is not\n"
+        "        in path order then.\n"
+        "  \n"
+        "    --merge <archive>...\n"
+        "        Combines (shard) archives into one archive written to '--file'.\n"
+        "        Inputs MUST be in path order as produced by '--pull'. Paths\n"
+        "        present in more than one input are rejected.\n"
+        "  \n"
+        "    --manifest <path>\n"
+        "        (optional) With '--merge', writes one line per merged entry as\n"
+        "        '<path> TAB <size> TAB <input>' to path.\n"
+        "  \n"
+        "    --diff <a.tar> <b.tar|url>\n"
+        "        Compares archive a with archive b (or the tree at url) and prints\n"
+        "        one JSON object per differing path to stdout, like\n"
+        "        '{\"op\":\"changed\",\"path\":\"x\",\"sizeA\":3,\"sizeB\":4}'. 'op' is one of\n"
+        "        'added' (only in b), 'removed' (only in a) or 'changed'. Paths\n"
+        "        get matched through an index, so order does not matter. Bodies\n"
+        "        only get read (and hashed) where sizes are equal. An url gets\n"
+        "        traversed as '--pull' would, so its options (eg '--filter-*',\n"
+        "        '--expand') apply.\n"
+        "  \n"
         "  \n"
     );
 }
 
 
-static int parseArgs( int argc, char**argv, OpMode*mode, char**url, regex_t**filter, size_t*filter_cnt, int*isFilterFull, char**file ){
-    ssize_t err;
-    char *filterRaw = NULL;
-    if( argc == -1 ){ // -1 indicates the call to free our resources. So simply jump
-        goto fail;    // to 'fail' because that has the same effect.
+/** Parses sizes like '4096', '512k', '64M' or '2G' (binary multiples).
+ * @return 0 on success, -1 if malformed. */
+static int parseByteSize( const char*str, size_t*dst ){
+    char *end;
+    if( *str < '0' || *str > '9' ){ return -1; }
+    errno = 0;
+    unsigned long long val = strtoull(str, &end, 10);
+    if( errno ){ return -1; }
+    uint_t shift;
+    switch( *end ){
+    case '\0': shift = 0; break;
+    case 'k': case 'K': shift = 10; ++end; break;
+    case 'm': case 'M': shift = 20; ++end; break;
+    case 'g': case 'G': shift = 30; ++end; break;
+    case 't': case 'T': shift = 40; ++end; break;
+    default: return -1;
     }
-    *mode = 0;
-    *url = NULL;
-    *filter = NULL;
-    *filter_cnt = 0;
-    *isFilterFull = 0;
-    *file = NULL;
+    if( *end != '\0' || val > (SIZE_MAX >> shift) ){ return -1; }
+    *dst = val << shift;
+    return 0;
+}
+
+
+/** Parses durations like '90', '90s', '15m', '2h' or '1d' (seconds if no
+ * unit given).
+ * @return 0 on success, -1 if malformed. */
+static int parseDuration( const char*str, uint_t*dst ){
+    char *end;
+    if( *str < '0' || *str > '9' ){ return -1; }
+    errno = 0;
+    unsigned long val = strtoul(str, &end, 10);
+    if( errno ){ return -1; }
+    unsigned long mult;
+    switch( *end ){
+    case '\0': mult = 1; break;
+    case 's': mult = 1; ++end; break;
+    case 'm': mult = 60; ++end; break;
+    case 'h': mult = 3600; ++end; break;
+    case 'd': mult = 86400; ++end; break;
+    default: return -1;
+    }
+    if( *end != '\0' || val > UINT_MAX / mult ){ return -1; }
+    *dst = val * mult;
+    return 0;
+}
+
+
+/** Fills 'cli' from commandline. Strings in there point into 'argv'. */
+static int parseArgs( int argc, char**argv, CliArgs*cli ){
+    ssize_t err;
+    GateleenResclone_Opts *opts = &cli->opts;
+    memset(cli, 0, sizeof*cli);
+    cli->log.level = LOG_LVL_INFO;
+    cli->log.isAsync = !0;
+    opts->parallel = 1;
+    // Unset until known whether auto-tune picks them.
+    opts->writeQueueSize = SIZE_MAX;
+    opts->rangeThreshold = SIZE_MAX;
+    int isAutoTune = !0;
 
     for( int i=1 ; i<argc ; ++i ){
         char *arg = argv[i];
         if( !strcmp(arg,"--help") ){
             printHelp();
             err = -1; goto fail;
+        }else if( !strcmp(arg,"-q") ){
+            cli->log.level = LOG_LVL_WARN;
+        }else if( !strcmp(arg,"-v") ){
+            cli->log.level = LOG_LVL_DEBUG;
+        }else if( !strcmp(arg,"--log-level") ){
+            if(!( arg=argv[++i]) ){
+                fprintf(stderr,"%s\n","EINVAL: Arg '--log-level' needs a value.");
+                err = -1; goto fail;
+            }
+            if( !strcmp(arg,"error") ){ cli->log.level = LOG_LVL_ERROR; }
+            else if( !strcmp(arg,"warn") ){ cli->log.level = LOG_LVL_WARN; }
+            else if( !strcmp(arg,"info") ){ cli->log.level = LOG_LVL_INFO; }
+            else if( !strcmp(arg,"debug") ){ cli->log.level = LOG_LVL_DEBUG; }
+            else{
+                fprintf(stderr,"%s%s\n","EINVAL: Expected '--log-level error|warn|info|debug' but got ",arg);
+                err = -1; goto fail;
+            }
+        }else if( !strcmp(arg,"--log-format") ){
+            if(!( arg=argv[++i]) ){
+                fprintf(stderr,"%s\n","EINVAL: Arg '--log-format' needs a value.");
+                err = -1; goto fail;
+            }
+            if( !strcmp(arg,"text") ){ cli->log.isJson = 0; }
+            else if( !strcmp(arg,"json") ){ cli->log.isJson = !0; }
+            else{
+                fprintf(stderr,"%s%s\n","EINVAL: Expected '--log-format text|json' but got ",arg);
+                err = -1; goto fail;
+            }
         }else if( !strcmp(arg,"--pull") ){
-            if( *mode ){
+            if( cli->mode ){
                 fprintf(stderr,"%s\n","EINVAL: Mode already specified. Won't set '--pull'.");
                 err = -1; goto fail;
             }
-            *mode = MODE_FETCH;
+            cli->mode = MODE_FETCH;
         }else if( !strcmp(arg,"--push") ){
-            if( *mode ){
+            if( cli->mode ){
                 fprintf(stderr,"%s\n","EINVAL: Mode already specified. Won't set '--push'.");
                 err = -1; goto fail;
             }
-            *mode = MODE_PUSH;
-        }else if( !strcmp(arg,"--url") ){
+            cli->mode = MODE_PUSH;
+        }else if( !strcmp(arg,"--replicate") ){
+            if( cli->mode ){
+                fprintf(stderr,"%s\n","EINVAL: Mode already specified. Won't set '--replicate'.");
+                err = -1; goto fail;
+            }
+            cli->mode = MODE_REPLICATE;
+        }else if( !strcmp(arg,"--url") || !strcmp(arg,"--from") ){
+            if(!( arg=argv[++i]) ){
+                fprintf(stderr,"%s%s%s\n","EINVAL: Arg '", argv[i-1], "' needs a value.");
+                err = -1; goto fail;
+            }
+            if( opts->url == NULL ){
+                opts->url = arg;
+            }else if( array_add_str(&cli->endpoints, &cli->endpoints_len, &cli->endpoints_cap, arg) ){
+                err = -ENOMEM; goto fail;
+            }
+        }else if( !strcmp(arg,"--source") ){
+            if(!( arg=argv[++i]) ){
+                fprintf(stderr,"%s\n","EINVAL: Arg '--source' needs a value.");
+                err = -1; goto fail;
+            }
+            if( strncmp(arg, "redis://", 8) ){
+                fprintf(stderr,"%s%s\n","EINVAL: Expected '--source redis://...' but got ",arg);
+                err = -1; goto fail;
+            }
+            opts->redisUrl = arg;
+        }else if( !strcmp(arg,"--endpoints") ){
+            if(!( arg=argv[++i]) ){
+                fprintf(stderr,"%s\n","EINVAL: Arg '--endpoints' needs a value.");
+                err = -1; goto fail;
+            }
+            for( char *next ; arg ; arg = next ){
+                next = strchr(arg, ',');
+                if( next ){ *next++ = '\0'; }
+                if( arg[0] == '\0' ){
+                    continue; }
+                if( opts->url == NULL ){
+                    opts->url = arg;
+                }else if( array_add_str(&cli->endpoints, &cli->endpoints_len, &cli->endpoints_cap, arg) ){
+                    err = -ENOMEM; goto fail;
+                }
+            }
+        }else if( !strcmp(arg,"--to") ){
+            if(!( arg=argv[++i]) ){
+                fprintf(stderr,"%s\n","EINVAL: Arg '--to' needs a value.");
+                err = -1; goto fail;
+            }
+            opts->replicaUrl = arg;
+        }else if( !strcmp(arg,"--interval") ){
+            if(!( arg=argv[++i]) ){
+                fprintf(stderr,"%s\n","EINVAL: Arg '--interval' needs a value.");
+                err = -1; goto fail;
+            }
+            if( parseDuration(arg, &opts->replicaInterval) ){
+                fprintf(stderr,"%s%s\n","EINVAL: Cannot parse '--interval ",arg);
+                err = -1; goto fail;
+            }
+        }else if( !strcmp(arg,"--cycles") ){
+            if(!( arg=argv[++i]) ){
+                fprintf(stderr,"%s\n","EINVAL: Arg '--cycles' needs a value.");
+                err = -1; goto fail;
+            }
+            char *end;
+            opts->replicaCycles = strtoul(arg, &end, 10);
+            if( *end != '\0' || arg[0] < '0' || arg[0] > '9' ){
+                fprintf(stderr,"%s%s\n","EINVAL: Cannot parse '--cycles ",arg);
+                err = -1; goto fail;
+            }
+        }else if( !strcmp(arg,"--metrics") ){
             if(!( arg=argv[++i]) ){
-                fprintf(stderr,"%s\n","EINVAL: Arg '--url' needs a value.");
+                fprintf(stderr,"%s\n","EINVAL: Arg '--metrics' needs a value.");
                 err = -1; goto fail;
             }
-            *url = arg;
+            opts->metricsFile = arg;
         }else if( !strcmp(arg,"--filter-full") ){
             if(!( arg=argv[++i] )){
                 fprintf(stderr,"%s\n","EINVAL: Arg '--filter-full' needs a value.");
                 err = -1; goto fail; }
-            if( filterRaw ){
+            if( opts->filter ){
                 fprintf(stderr,"%s\n","EINVAL: Cannot use '--filter-full' because a filter is already set.");
                 err=-1; goto fail; }
-            filterRaw = arg;
-            *isFilterFull = !0;
+            opts->filter = arg;
+            opts->isFilterFull = !0;
         }else if( !strcmp(arg,"--filter-part") ){
             if(!( arg=argv[++i] )){
                 fprintf(stderr,"%s\n","EINVAL: Arg '--filter-part' needs a value.");
                 err = -1; goto fail; }
-            if( filterRaw ){
+            if( opts->filter ){
                 fprintf(stderr,"%s\n","EINVAL: Cannot use '--filter-part' because a filter is already set.");
                 err = -1; goto fail; }
-            filterRaw = arg;
-            *isFilterFull = 0;
+            opts->filter = arg;
+            opts->isFilterFull = 0;
         }else if( !strcmp(arg,"--file") ){
             if(!( arg=argv[++i]) ){
                 fprintf(stderr,"%s\n","EINVAL: Arg '--file' needs a value.");
                 err = -1; goto fail;
             }
-            *file = arg;
-        }else{
-            fprintf(stderr,"%s%s\n", "EINVAL: Unknown arg ",arg);
-            err = -1; goto fail;
-        }
-    }
-
-    if( *mode == 0 ){
-        fprintf(stderr,"EINVAL: One of --push or --pull required.\n");
-        err = -1; goto fail;
-    }
-
-    if( *url==NULL ){
-        fprintf(stderr,"EINVAL: Arg --url missing.\n");
-        err = -1; goto fail;
-    }
-    uint_t urlFromArgs_len = strlen(*url);
-    if( ((*url)[urlFromArgs_len-1]) != '/' ){
-        char *urlFromArgs = *url;
-        uint_t url_len = urlFromArgs_len + 1;
-        *url = malloc(url_len+1); /* TODO: Should we free this? */
-        memcpy(*url, urlFromArgs, urlFromArgs_len);
-        (*url)[url_len-1] = '/';
-        (*url)[url_len] = '\0';
-    }else{
-        *url = strdup(*url);
-    }
-
-    if( filterRaw ){
-        uint_t buf_len = strlen(filterRaw);
-        char *buf = malloc(1 + buf_len + 2);
-        buf[0] = '_'; // <- Match whole segment.
-        memcpy(buf+1, filterRaw, buf_len+1);
-        char *beg, *end;
-        size_t filter_cap = 0;
-        end = buf+1; // <- Initialize at begin for 1st iteration.
-        for( uint_t iSegm=0 ;; ++iSegm ){
-            for( beg=end ; *beg=='/' ; ++beg ); // <- Search for begin and ..
-            for( end=beg ; *end!='/' && *end!='\0' ; ++end ); // <- .. end of current segment.
-            char origBeg = beg[-1];
-            char origSep = *end;
-            char origNext = end[1];
-            beg[-1] = '^'; // <- Add 'match-start' so we MUST match whole segment.
-            *end = '$';    // <- Add 'match-end' so we must match whole segment.
-            end[1] = '\0'; // <- Temporary terminate to compile segment only.
-            if( iSegm >= filter_cap ){
-                filter_cap += 8;
-                void *tmp = realloc(*filter, filter_cap*sizeof**filter);
-                //fprintf(stderr, "%s%u%s%p\n",
-                //    "[DEBUG] realloc(NULL, ", filter_cap*sizeof**filter," ) -> ", tmp);
-                if( tmp == NULL ){
-                    fprintf(stderr, "realloc("FMT_SIZE_T"): %s\n", filter_cap*sizeof**filter, strerror(errno));
-                    err = -ENOMEM; goto fail; }
-                *filter = tmp;
-            }
-            //fprintf(stderr, "%s%d%s%s%s\n", "[DEBUG] filter[", iSegm, "] -> '", beg-1, "'");
-            err = regcomp((*filter)+iSegm, beg-1, REG_EXTENDED);
-            if( err ){
-                fprintf(stderr, "regcomp(%s): "FMT_SIZE_T"\n", beg, err);
-                err = -1; goto fail; }
-            /* Restore surrounding stuff. */
-            beg[-1] = origBeg;
-            *end = origSep; /* <- Restore tmp 'end-of-match' ($) */
-            end[1] = origNext; /* <- Restore tmp termination. */
-            if( *end == '\0' ){ /* EOF */
-                *filter_cnt = iSegm +1;
-                *filter = realloc(*filter, *filter_cnt *sizeof(**filter)); /* Trim result. */
-                assert(*filter != NULL);
-                free(buf); buf = NULL;
-                break;
+            opts->file = arg;
+        }else if( !strcmp(arg,"--format") ){
+            if(!( arg=argv[++i]) ){
+                fprintf(stderr,"%s\n","EINVAL: Arg '--format' needs a value.");
+                err = -1; goto fail;
             }
-        }
-    }
-
-    if( *mode == MODE_PUSH && *filter ){
-        fprintf(stderr, "%s\n", "EINVAL: Filtering not supported for push mode.");
-        err = -1; goto fail;
-    }
-
-    return 0;
-fail:
-    free(*url); *url = NULL;
-    for( uint_t i=0 ; i<*filter_cnt ; ++i ){
-        regfree(&(filter[0][i]));
-    }
-    *filter_cnt = 0;
-    free(*filter); *filter = NULL;
-    return err;
-}
-
-
-static size_t onCurlDirRsp( char*buf, size_t size, size_t nmemb, void*ResourceDir_ ){
-    int err;
-    //fprintf(stderr, "%s%s%s%p%s"FMT_SIZE_T"%s"FMT_SIZE_T"%s%p%s\n", "[TRACE] ", __func__, "( buf=", buf,
-    //    ", size=", size, ", nmemb=", nmemb, ", cls=", ResourceDir_, " )");
-    ResourceDir *resourceDir = ResourceDir_;
-    ClsDload *dload = resourceDir->dload;
-    CURL *curl = dload->curl;
-    const size_t buf_len = size * nmemb;
-
-    long rspCode;
-    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &rspCode);
-    resourceDir->rspCode = rspCode;
-    if( rspCode != 200 ){
-        return size * nmemb; }
-
-    // Collect whole response body into one buf (as cJSON seems unable to parse
-    // partially)
-    if( resourceDir->rspBody_cap < resourceDir->rspBody_len + buf_len +1 ){
-        /* Enlarge buf */
-        resourceDir->rspBody_cap = resourceDir->rspBody_len + buf_len + 1024;
-        void *tmp = realloc(resourceDir->rspBody, resourceDir->rspBody_cap);
-        if( tmp == NULL ){
-            err = size * nmemb/*TODO could we return anything better here?*/; goto endFn; }
-        resourceDir->rspBody = tmp;
-    }
-    memcpy(resourceDir->rspBody+resourceDir->rspBody_len, buf, buf_len);
-    resourceDir->rspBody_len += buf_len;
-    resourceDir->rspBody[resourceDir->rspBody_len] = '\0';
-
-    // Parsing occurs in the caller, as soon we processed whole response.
-
-    err = size * nmemb;
-endFn:
-    return err;
-}
-
-
-static size_t onResourceChunk( char*buf, size_t size, size_t nmemb, void*ResourceFile_ ){
-    const int buf_len = size * nmemb;
-    ResourceFile *resourceFile = ResourceFile_;
-
-    const int avail = resourceFile->buf_memSz - resourceFile->buf_len;
-    if( avail <= buf_len ){
-        resourceFile->buf_memSz += buf_len - avail +1;
-        void *tmp = realloc(resourceFile->buf , resourceFile->buf_memSz);
-        assert(tmp != NULL); /* TODO error handling */
-        resourceFile->buf = tmp;
-    }
-    char *it = resourceFile->buf + resourceFile->buf_len;
-    memcpy(it, buf, buf_len); it += buf_len;
-    *it = '\0';
-    resourceFile->buf_len = it - resourceFile->buf;
-
-    return buf_len;
-}
-
-
-static ssize_t collectResourceIntoMemory( ResourceFile*resourceFile, char*url ){
-    ssize_t err;
-    ClsDload *dload = resourceFile->dload;
-    CURL *curl = dload->curl;
-
-    err =  CURLE_OK!= curl_easy_setopt(curl, CURLOPT_URL, url)
-        || CURLE_OK!= curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 0L )
-        || CURLE_OK!= curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, onResourceChunk)
-        || CURLE_OK!= curl_easy_setopt(curl, CURLOPT_WRITEDATA, resourceFile)
-        ;
-    if( err ){ assert(!err); err = -1; goto endFn; }
-
-    err = curl_easy_perform(curl);
-    if( err != CURLE_OK ){
-        fprintf(stderr, "%s%s%s%s%s"FMT_SIZE_T"%s%s\n", "[ERROR] ", __func__, "(): '",
-            url, "' (code ", err, "): ", curl_easy_strerror(err));
-        err = -1; goto endFn;
+            if( !strcmp(arg,"tar") ){ opts->format = GATELEEN_RESCLONE_FORMAT_TAR; }
+            else if( !strcmp(arg,"zip") ){ opts->format = GATELEEN_RESCLONE_FORMAT_ZIP; }
+            else if( !strcmp(arg,"ndjson") ){ opts->format = GATELEEN_RESCLONE_FORMAT_NDJSON; }
+            else if( !strcmp(arg,"tar.zst") ){ opts->format = GATELEEN_RESCLONE_FORMAT_TAR_ZSTD; }
+            else{
+                fprintf(stderr,"%s%s\n","EINVAL: Expected '--format tar|tar.zst|zip|ndjson' but got ",arg);
+                err = -1; goto fail;
+            }
+        }else if( !strcmp(arg,"--max-memory") ){
+            if(!( arg=argv[++i]) ){
+                fprintf(stderr,"%s\n","EINVAL: Arg '--max-memory' needs a value.");
+                err = -1; goto fail;
+            }
+            if( parseByteSize(arg, &opts->maxMemory) ){
+                fprintf(stderr,"%s%s\n","EINVAL: Cannot parse '--max-memory ",arg);
+                err = -1; goto fail;
+            }
+        }else if( !strcmp(arg,"--volume-size") ){
+            if(!( arg=argv[++i]) ){
+                fprintf(stderr,"%s\n","EINVAL: Arg '--volume-size' needs a value.");
+                err = -1; goto fail;
+            }
+            if( parseByteSize(arg, &opts->volumeSize) || opts->volumeSize == 0 ){
+                fprintf(stderr,"%s%s\n","EINVAL: Cannot parse '--volume-size ",arg);
+                err = -1; goto fail;
+            }
+        }else if( !strcmp(arg,"--write-queue") ){
+            if(!( arg=argv[++i]) ){
+                fprintf(stderr,"%s\n","EINVAL: Arg '--write-queue' needs a value.");
+                err = -1; goto fail;
+            }
+            if( parseByteSize(arg, &opts->writeQueueSize)
+                || (opts->writeQueueSize && opts->writeQueueSize < WRITE_QUEUE_MIN) )
+            {
+                fprintf(stderr,"%s%s%s\n","EINVAL: Cannot parse '--write-queue ",arg,"' (zero or at least 64k)");
+                err = -1; goto fail;
+            }
+        }else if( !strcmp(arg,"--range-threshold") ){
+            if(!( arg=argv[++i]) ){
+                fprintf(stderr,"%s\n","EINVAL: Arg '--range-threshold' needs a value.");
+                err = -1; goto fail;
+            }
+            if( parseByteSize(arg, &opts->rangeThreshold) ){
+                fprintf(stderr,"%s%s\n","EINVAL: Cannot parse '--range-threshold ",arg);
+                err = -1; goto fail;
+            }
+        }else if( !strcmp(arg,"--range-segments") ){
+            if(!( arg=argv[++i]) ){
+                fprintf(stderr,"%s\n","EINVAL: Arg '--range-segments' needs a value.");
+                err = -1; goto fail;
+            }
+            char *end;
+            opts->rangeSegments = strtoul(arg, &end, 10);
+            if( *end != '\0' || opts->rangeSegments < 1 || opts->rangeSegments > RANGE_SEGMENTS_MAX ){
+                fprintf(stderr,"%s%s\n","EINVAL: Cannot parse '--range-segments ",arg);
+                err = -1; goto fail;
+            }
+        }else if( !strcmp(arg,"--cache-dir") ){
+            if(!( opts->cacheDir=argv[++i]) ){
+                fprintf(stderr,"%s\n","EINVAL: Arg '--cache-dir' needs a value.");
+                err = -1; goto fail;
+            }
+        }else if( !strcmp(arg,"--cache-size") ){
+            if(!( arg=argv[++i]) ){
+                fprintf(stderr,"%s\n","EINVAL: Arg '--cache-size' needs a value.");
+                err = -1; goto fail;
+            }
+            if( parseByteSize(arg, &opts->cacheSize) ){
+                fprintf(stderr,"%s%s\n","EINVAL: Cannot parse '--cache-size ",arg);
+                err = -1; goto fail;
+            }
+        }else if( !strcmp(arg,"--mime-types") ){
+            if(!( opts->mimeTypesFile=argv[++i]) ){
+                fprintf(stderr,"%s\n","EINVAL: Arg '--mime-types' needs a value.");
+                err = -1; goto fail;
+            }
+        }else if( !strcmp(arg,"--expand") ){
+            if(!( arg=argv[++i]) ){
+                fprintf(stderr,"%s\n","EINVAL: Arg '--expand' needs a value.");
+                err = -1; goto fail;
+            }
+            char *end;
+            opts->expandLevels = strtoul(arg, &end, 10);
+            if( *end != '\0' || opts->expandLevels < 1 || opts->expandLevels > 99 ){
+                fprintf(stderr,"%s%s\n","EINVAL: Cannot parse '--expand ",arg);
+                err = -1; goto fail;
+            }
+        }else if( !strcmp(arg,"--page-size") ){
+            if(!( arg=argv[++i]) ){
+                fprintf(stderr,"%s\n","EINVAL: Arg '--page-size' needs a value.");
+                err = -1; goto fail;
+            }
+            char *end;
+            opts->pageSize = strtoul(arg, &end, 10);
+            if( *end != '\0' || opts->pageSize < 1 ){
+                fprintf(stderr,"%s%s\n","EINVAL: Cannot parse '--page-size ",arg);
+                err = -1; goto fail;
+            }
+        }else if( !strcmp(arg,"--expand-zip") ){
+            opts->isExpandZip = !0;
+        }else if( !strcmp(arg,"--shard") ){
+            if(!( arg=argv[++i]) ){
+                fprintf(stderr,"%s\n","EINVAL: Arg '--shard' needs a value.");
+                err = -1; goto fail;
+            }
+            char *end;
+            opts->shardIdx = strtoul(arg, &end, 10);
+            if( end == arg || *end != '/' ){
+                end = NULL; }
+            else{
+                const char *cnt = end +1;
+                opts->shardCount = strtoul(cnt, &end, 10);
+                if( end == cnt ){ end = NULL; }
+            }
+            if( end == NULL || *end != '\0' || opts->shardCount < 1 || opts->shardIdx >= opts->shardCount ){
+                fprintf(stderr,"%s%s%s\n","EINVAL: Expected '--shard <i>/<n>' with i < n but got '",arg,"'");
+                err = -1; goto fail;
+            }
+        }else if( !strcmp(arg,"--shard-depth") ){
+            if(!( arg=argv[++i]) ){
+                fprintf(stderr,"%s\n","EINVAL: Arg '--shard-depth' needs a value.");
+                err = -1; goto fail;
+            }
+            char *end;
+            opts->shardDepth = strtoul(arg, &end, 10);
+            if( *end != '\0' || opts->shardDepth < 1 ){
+                fprintf(stderr,"%s%s\n","EINVAL: Cannot parse '--shard-depth ",arg);
+                err = -1; goto fail;
+            }
+        }else if( !strcmp(arg,"--sample-per-collection") ){
+            if(!( arg=argv[++i]) ){
+                fprintf(stderr,"%s\n","EINVAL: Arg '--sample-per-collection' needs a value.");
+                err = -1; goto fail;
+            }
+            char *end;
+            opts->samplePerCollection = strtoul(arg, &end, 10);
+            if( *end != '\0' || opts->samplePerCollection < 1 ){
+                fprintf(stderr,"%s%s\n","EINVAL: Cannot parse '--sample-per-collection ",arg);
+                err = -1; goto fail;
+            }
+        }else if( !strcmp(arg,"--sample-ratio") ){
+            if(!( arg=argv[++i]) ){
+                fprintf(stderr,"%s\n","EINVAL: Arg '--sample-ratio' needs a value.");
+                err = -1; goto fail;
+            }
+            char *end;
+            opts->sampleRatio = strtod(arg, &end);
+            if( *end != '\0' || !(opts->sampleRatio > 0 && opts->sampleRatio <= 1) ){
+                fprintf(stderr,"%s%s\n","EINVAL: Expected '--sample-ratio' within (0,1] but got ",arg);
+                err = -1; goto fail;
+            }
+        }else if( !strcmp(arg,"--sample-seed") ){
+            if(!( arg=argv[++i]) ){
+                fprintf(stderr,"%s\n","EINVAL: Arg '--sample-seed' needs a value.");
+                err = -1; goto fail;
+            }
+            char *end;
+            opts->sampleSeed = strtoul(arg, &end, 10);
+            if( *end != '\0' ){
+                fprintf(stderr,"%s%s\n","EINVAL: Cannot parse '--sample-seed ",arg);
+                err = -1; goto fail;
+            }
+        }else if( !strcmp(arg,"--max-depth") ){
+            if(!( arg=argv[++i]) ){
+                fprintf(stderr,"%s\n","EINVAL: Arg '--max-depth' needs a value.");
+                err = -1; goto fail;
+            }
+            char *end;
+            opts->maxDepth = strtoul(arg, &end, 10);
+            if( *end != '\0' || opts->maxDepth < 1 ){
+                fprintf(stderr,"%s%s\n","EINVAL: Cannot parse '--max-depth ",arg);
+                err = -1; goto fail;
+            }
+        }else if( !strcmp(arg,"--max-bytes") ){
+            if(!( arg=argv[++i]) ){
+                fprintf(stderr,"%s\n","EINVAL: Arg '--max-bytes' needs a value.");
+                err = -1; goto fail;
+            }
+            if( parseByteSize(arg, &opts->maxBytes) || opts->maxBytes == 0 ){
+                fprintf(stderr,"%s%s\n","EINVAL: Cannot parse '--max-bytes ",arg);
+                err = -1; goto fail;
+            }
+        }else if( !strcmp(arg,"--max-entries") ){
+            if(!( arg=argv[++i]) ){
+                fprintf(stderr,"%s\n","EINVAL: Arg '--max-entries' needs a value.");
+                err = -1; goto fail;
+            }
+            char *end;
+            opts->maxEntries = strtoul(arg, &end, 10);
+            if( *end != '\0' || opts->maxEntries < 1 ){
+                fprintf(stderr,"%s%s\n","EINVAL: Cannot parse '--max-entries ",arg);
+                err = -1; goto fail;
+            }
+        }else if( !strcmp(arg,"--priority") ){
+            if(!( arg=argv[++i]) ){
+                fprintf(stderr,"%s\n","EINVAL: Arg '--priority' needs a value.");
+                err = -1; goto fail;
+            }
+            opts->priority = arg;
+        }else if( !strcmp(arg,"--deadline") ){
+            if(!( arg=argv[++i]) ){
+                fprintf(stderr,"%s\n","EINVAL: Arg '--deadline' needs a value.");
+                err = -1; goto fail;
+            }
+            if( parseDuration(arg, &opts->deadline) || opts->deadline == 0 ){
+                fprintf(stderr,"%s%s\n","EINVAL: Cannot parse '--deadline ",arg);
+                err = -1; goto fail;
+            }
+        }else if( !strcmp(arg,"--missing") ){
+            if(!( arg=argv[++i]) ){
+                fprintf(stderr,"%s\n","EINVAL: Arg '--missing' needs a value.");
+                err = -1; goto fail;
+            }
+            opts->missingFile = arg;
+        }else if( !strcmp(arg,"--largest-first") ){
+            opts->isLargestFirst = !0;
+        }else if( !strcmp(arg,"--merge") ){
+            if( cli->mode ){
+                fprintf(stderr,"%s\n","EINVAL: Mode already specified. Won't set '--merge'.");
+                err = -1; goto fail;
+            }
+            cli->mode = MODE_MERGE;
+        }else if( !strcmp(arg,"--diff") ){
+            if( cli->mode ){
+                fprintf(stderr,"%s\n","EINVAL: Mode already specified. Won't set '--diff'.");
+                err = -1; goto fail;
+            }
+            if( argv[i+1] == NULL || argv[i+2] == NULL ){
+                fprintf(stderr,"%s\n","EINVAL: Arg '--diff' needs two values.");
+                err = -1; goto fail;
+            }
+            cli->mode = MODE_DIFF;
+            cli->diffFrom = argv[++i];
+            cli->diffTo = argv[++i];
+        }else if( !strcmp(arg,"--manifest") ){
+            if(!( arg=argv[++i]) ){
+                fprintf(stderr,"%s\n","EINVAL: Arg '--manifest' needs a value.");
+                err = -1; goto fail;
+            }
+            cli->manifestFile = arg;
+        }else if( cli->mode == MODE_MERGE && arg[0] != '-' ){
+            if( array_add_str(&cli->mergeInputs, &cli->mergeInputs_len, &cli->mergeInputs_cap, arg) ){
+                err = -ENOMEM; goto fail; }
+        }else if( !strcmp(arg,"--batch") ){
+            if(!( arg=argv[++i]) ){
+                fprintf(stderr,"%s\n","EINVAL: Arg '--batch' needs a value.");
+                err = -1; goto fail;
+            }
+            if( cli->mode ){
+                fprintf(stderr,"%s\n","EINVAL: Mode already specified. Won't set '--batch'.");
+                err = -1; goto fail;
+            }
+            cli->mode = MODE_BATCH;
+            cli->batchFile = arg;
+        }else if( !strcmp(arg,"--verify-after-push") ){
+            opts->isVerifyAfterPush = !0;
+        }else if( !strcmp(arg,"--verify-parallel") ){
+            if(!( arg=argv[++i]) ){
+                fprintf(stderr,"%s\n","EINVAL: Arg '--verify-parallel' needs a value.");
+                err = -1; goto fail;
+            }
+            char *end;
+            opts->verifyParallel = strtoul(arg, &end, 10);
+            if( *end != '\0' || opts->verifyParallel < 1 || opts->verifyParallel > 1024 ){
+                fprintf(stderr,"%s%s\n","EINVAL: Cannot parse '--verify-parallel ",arg);
+                err = -1; goto fail;
+            }
+        }else if( !strcmp(arg,"--mirror") ){
+            opts->isMirror = !0;
+        }else if( !strcmp(arg,"--mirror-parallel") ){
+            if(!( arg=argv[++i]) ){
+                fprintf(stderr,"%s\n","EINVAL: Arg '--mirror-parallel' needs a value.");
+                err = -1; goto fail;
+            }
+            char *end;
+            opts->mirrorParallel = strtoul(arg, &end, 10);
+            if( *end != '\0' || opts->mirrorParallel < 1 || opts->mirrorParallel > 1024 ){
+                fprintf(stderr,"%s%s\n","EINVAL: Cannot parse '--mirror-parallel ",arg);
+                err = -1; goto fail;
+            }
+        }else if( !strcmp(arg,"--dry-run") ){
+            opts->isDryRun = !0;
+        }else if( !strcmp(arg,"--via-queue") ){
+            if(!( arg=argv[++i]) ){
+                fprintf(stderr,"%s\n","EINVAL: Arg '--via-queue' needs a value.");
+                err = -1; goto fail;
+            }
+            opts->viaQueue = arg;
+        }else if( !strcmp(arg,"--queue-count") ){
+            if(!( arg=argv[++i]) ){
+                fprintf(stderr,"%s\n","EINVAL: Arg '--queue-count' needs a value.");
+                err = -1; goto fail;
+            }
+            char *end;
+            opts->queueCount = strtoul(arg, &end, 10);
+            if( *end != '\0' || opts->queueCount < 1 || opts->queueCount > QUEUE_COUNT_MAX ){
+                fprintf(stderr,"%s%s\n","EINVAL: Cannot parse '--queue-count ",arg);
+                err = -1; goto fail;
+            }
+        }else if( !strcmp(arg,"--queue-wait") ){
+            if(!( arg=argv[++i]) ){
+                fprintf(stderr,"%s\n","EINVAL: Arg '--queue-wait' needs a value.");
+                err = -1; goto fail;
+            }
+            if( parseDuration(arg, &opts->queueWait) || opts->queueWait == 0 ){
+                fprintf(stderr,"%s%s\n","EINVAL: Cannot parse '--queue-wait ",arg);
+                err = -1; goto fail;
+            }
+        }else if( !strcmp(arg,"--queue-api") ){
+            if(!( arg=argv[++i]) ){
+                fprintf(stderr,"%s\n","EINVAL: Arg '--queue-api' needs a value.");
+                err = -1; goto fail;
+            }
+            opts->queueApiUrl = arg;
+        }else if( !strcmp(arg,"--parallel") ){
+            if(!( arg=argv[++i]) ){
+                fprintf(stderr,"%s\n","EINVAL: Arg '--parallel' needs a value.");
+                err = -1; goto fail;
+            }
+            char *end;
+            opts->parallel = strtoul(arg, &end, 10);
+            if( *end != '\0' || opts->parallel < 1 || opts->parallel > 1024 ){
+                fprintf(stderr,"%s%s\n","EINVAL: Cannot parse '--parallel ",arg);
+                err = -1; goto fail;
+            }
+        }else if( !strcmp(arg,"--no-auto-tune") ){
+            isAutoTune = 0;
+        }else if( !strcmp(arg,"--tune-cache") ){
+            if(!( arg=argv[++i]) ){
+                fprintf(stderr,"%s\n","EINVAL: Arg '--tune-cache' needs a value.");
+                err = -1; goto fail;
+            }
+            opts->tuneCacheDir = arg;
+        }else{
+            fprintf(stderr,"%s%s\n", "EINVAL: Unknown arg ",arg);
+            err = -1; goto fail;
+        }
+    }
+
+    if( cli->mode == 0 ){
+        fprintf(stderr,"EINVAL: One of --push or --pull required.\n");
+        err = -1; goto fail;
+    }
+
+    // Push only would learn about its own target. That tells nothing about
+    // what later pulls from it can expect.
+    opts->isAutoTune = isAutoTune && (cli->mode == MODE_FETCH
+        || cli->mode == MODE_BATCH || cli->mode == MODE_REPLICATE);
+    if( opts->writeQueueSize == SIZE_MAX ){
+        opts->writeQueueSize = opts->isAutoTune ? 0 : 4<<20; }
+    if( opts->rangeThreshold == SIZE_MAX ){
+        opts->rangeThreshold = opts->isAutoTune ? 0 : 64<<20; }
+    if( opts->isAutoTune && opts->tuneCacheDir == NULL ){
+        const char *xdg = getenv("XDG_CACHE_HOME"), *home = getenv("HOME");
+        if( xdg && xdg[0] != '\0' ){
+            snprintf(cli->tuneCacheDir, sizeof cli->tuneCacheDir, "%s%s", xdg, "/gateleen-resclone/probe");
+        }else if( home && home[0] != '\0' ){
+            snprintf(cli->tuneCacheDir, sizeof cli->tuneCacheDir, "%s%s", home, "/.cache/gateleen-resclone/probe");
+        }
+        // Else probe every time.
+        if( cli->tuneCacheDir[0] != '\0' ){
+            opts->tuneCacheDir = cli->tuneCacheDir; }
+    }
+
+    if( cli->mode == MODE_MERGE ){
+        if( cli->mergeInputs_len == 0 ){
+            fprintf(stderr,"EINVAL: --merge needs at least one input archive.\n");
+            err = -1; goto fail;
+        }
+        return 0;
+    }
+
+    if( opts->format != GATELEEN_RESCLONE_FORMAT_TAR && cli->mode != MODE_FETCH && cli->mode != MODE_BATCH
+        && !(opts->format == GATELEEN_RESCLONE_FORMAT_NDJSON && cli->mode == MODE_PUSH) )
+    {
+        fprintf(stderr,"EINVAL: --format only applies to --pull and --batch. Push detects the format"
+            " (only '--format ndjson' from stdin needs to be told).\n");
+        err = -1; goto fail;
+    }
+
+    if( (opts->samplePerCollection || opts->sampleRatio || opts->maxDepth || opts->maxBytes || opts->maxEntries
+            || opts->priority || opts->deadline || opts->isLargestFirst)
+        && cli->mode != MODE_FETCH && cli->mode != MODE_BATCH )
+    {
+        fprintf(stderr,"EINVAL: Sampling, budgets, priority and deadline only apply to --pull and --batch.\n");
+        err = -1; goto fail;
+    }
+
+    if( opts->missingFile && cli->mode != MODE_FETCH ){
+        // Jobs of a batch would all write the same list.
+        fprintf(stderr,"EINVAL: --missing needs --pull.\n");
+        err = -1; goto fail;
+    }
+
+    if( opts->isLargestFirst && opts->cacheDir == NULL ){
+        fprintf(stderr,"EINVAL: --largest-first needs --cache-dir. Sizes are only known from earlier pulls.\n");
+        err = -1; goto fail;
+    }
+
+    if( cli->mode == MODE_BATCH ){
+        if( opts->url || opts->filter || opts->file ){
+            fprintf(stderr,"EINVAL: --url, --filter-* and --file are taken from jobs file in --batch mode.\n");
+            err = -1; goto fail;
+        }
+        return 0;
+    }
+
+    if( cli->mode == MODE_DIFF ){
+        if( opts->url || opts->file ){
+            fprintf(stderr,"EINVAL: --diff takes its inputs as args. Neither --url nor --file apply.\n");
+            err = -1; goto fail;
+        }
+        if( !strncasecmp(cli->diffTo, "http://", 7) || !strncasecmp(cli->diffTo, "https://", 8) ){
+            opts->url = cli->diffTo; }
+    }
+
+    if( opts->redisUrl && (cli->mode != MODE_FETCH || opts->url || cli->endpoints_len) ){
+        fprintf(stderr,"EINVAL: --source only applies to --pull and replaces --url.\n");
+        err = -1; goto fail;
+    }
+
+    if( opts->url==NULL && opts->redisUrl == NULL && cli->mode != MODE_DIFF ){
+        fprintf(stderr,"EINVAL: Arg --url missing.\n");
+        err = -1; goto fail;
+    }
+
+    if( opts->volumeSize && (cli->mode != MODE_FETCH || opts->file == NULL) ){
+        fprintf(stderr, "%s\n", "EINVAL: --volume-size needs --pull and --file.");
+        err = -1; goto fail;
+    }
+
+    if( opts->isExpandZip && opts->expandLevels == 0 ){
+        fprintf(stderr, "%s\n", "EINVAL: --expand-zip needs --expand.");
+        err = -1; goto fail;
+    }
+
+    if( opts->isVerifyAfterPush && (cli->mode != MODE_PUSH || opts->file == NULL) ){
+        // Stdin cannot be read a second time.
+        fprintf(stderr, "%s\n", "EINVAL: --verify-after-push needs --push and --file.");
+        err = -1; goto fail;
+    }
+
+    if( (opts->isMirror || opts->isDryRun) && cli->mode != MODE_PUSH ){
+        fprintf(stderr, "%s\n", "EINVAL: --mirror and --dry-run need --push.");
+        err = -1; goto fail;
+    }
+
+    if( opts->viaQueue && cli->mode != MODE_PUSH ){
+        fprintf(stderr, "%s\n", "EINVAL: --via-queue needs --push.");
+        err = -1; goto fail;
+    }
+
+    if( (opts->queueCount || opts->queueWait || opts->queueApiUrl) && opts->viaQueue == NULL ){
+        fprintf(stderr, "%s\n", "EINVAL: --queue-count, --queue-wait and --queue-api need --via-queue.");
+        err = -1; goto fail;
+    }
+
+    if( opts->viaQueue && opts->isVerifyAfterPush && opts->queueWait == 0 ){
+        // Queued PUTs are not written yet when the push is done.
+        fprintf(stderr, "%s\n", "EINVAL: --verify-after-push with --via-queue needs --queue-wait.");
+        err = -1; goto fail;
+    }
+
+    if( (cli->mode == MODE_REPLICATE) != (opts->replicaUrl != NULL) ){
+        fprintf(stderr, "%s\n", "EINVAL: --replicate and --to go together.");
+        err = -1; goto fail;
+    }
+
+    if( cli->mode == MODE_REPLICATE && (opts->expandLevels || opts->file || opts->volumeSize) ){
+        // Embedded bodies cannot be fetched conditionally.
+        fprintf(stderr, "%s\n", "EINVAL: --replicate cannot be combined with --expand, --file nor --volume-size.");
+        err = -1; goto fail;
+    }
+
+    if( (opts->cacheDir || opts->cacheSize) && cli->mode != MODE_FETCH ){
+        fprintf(stderr, "%s\n", "EINVAL: --cache-dir and --cache-size need --pull.");
+        err = -1; goto fail;
+    }
+
+    if( cli->mode == MODE_PUSH && opts->filter ){
+        fprintf(stderr, "%s\n", "EINVAL: Filtering not supported for push mode.");
+        err = -1; goto fail;
+    }
+
+    if( cli->endpoints_len && cli->mode != MODE_FETCH && cli->mode != MODE_REPLICATE ){
+        fprintf(stderr, "%s\n", "EINVAL: Multiple endpoints only apply to --pull and --replicate.");
+        err = -1; goto fail;
+    }
+    opts->endpoints = (const char*const*)cli->endpoints;
+    opts->endpoints_len = cli->endpoints_len;
+
+    return 0;
+fail:
+    free(cli->mergeInputs); cli->mergeInputs = NULL;
+    cli->mergeInputs_len = 0;
+    free(cli->endpoints); cli->endpoints = NULL;
+    cli->endpoints_len = 0;
+    return err;
+}
+
+
+/** Compiles a path filter as described in '--filter-part' into one regex
+ * per segment. */
+static ssize_t compileFilter( const char*filterRaw, regex_t**filter, size_t*filter_cnt ){
+    ssize_t err;
+    size_t filter_cap = 0;
+    *filter = NULL;
+    *filter_cnt = 0;
+
+    uint_t buf_len = strlen(filterRaw);
+    char *buf = malloc(1 + buf_len + 2);
+    if( buf == NULL ){
+        err = -ENOMEM; goto fail; }
+    buf[0] = '_'; // <- Match whole segment.
+    memcpy(buf+1, filterRaw, buf_len+1);
+    char *beg, *end;
+    end = buf+1; // <- Initialize at begin for 1st iteration.
+    for( uint_t iSegm=0 ;; ++iSegm ){
+        for( beg=end ; *beg=='/' ; ++beg ); // <- Search for begin and ..
+        for( end=beg ; *end!='/' && *end!='\0' ; ++end ); // <- .. end of current segment.
+        char origBeg = beg[-1];
+        char origSep = *end;
+        char origNext = end[1];
+        beg[-1] = '^'; // <- Add 'match-start' so we MUST match whole segment.
+        *end = '$';    // <- Add 'match-end' so we must match whole segment.
+        end[1] = '\0'; // <- Temporary terminate to compile segment only.
+        if( iSegm >= filter_cap ){
+            filter_cap += 8;
+            void *tmp = realloc(*filter, filter_cap*sizeof**filter);
+            //fprintf(stderr, "%s%u%s%p\n",
+            //    "[DEBUG] realloc(NULL, ", filter_cap*sizeof**filter," ) -> ", tmp);
+            if( tmp == NULL ){
+                log_write(LOG_LVL_ERROR, "realloc("FMT_SIZE_T"): %s", filter_cap*sizeof**filter, strerror(errno));
+                err = -ENOMEM; goto fail; }
+            *filter = tmp;
+        }
+        //fprintf(stderr, "%s%d%s%s%s\n", "[DEBUG] filter[", iSegm, "] -> '", beg-1, "'");
+        err = regcomp((*filter)+iSegm, beg-1, REG_EXTENDED);
+        if( err ){
+            log_write(LOG_LVL_ERROR, "regcomp(%s): "FMT_SIZE_T, beg, err);
+            err = -1; goto fail; }
+        *filter_cnt = iSegm +1;
+        /* Restore surrounding stuff. */
+        beg[-1] = origBeg;
+        *end = origSep; /* <- Restore tmp 'end-of-match' ($) */
+        end[1] = origNext; /* <- Restore tmp termination. */
+        if( *end == '\0' ){ /* EOF */
+            *filter = realloc(*filter, *filter_cnt *sizeof(**filter)); /* Trim result. */
+            assert(*filter != NULL);
+            free(buf); buf = NULL;
+            break;
+        }
+    }
+
+    return 0;
+fail:
+    free(buf);
+    for( uint_t i=0 ; i<*filter_cnt ; ++i ){
+        regfree(&(filter[0][i]));
+    }
+    *filter_cnt = 0;
+    free(*filter); *filter = NULL;
+    return err;
+}
+
+
+/** Splits the comma separated patterns of '--priority' into their segments
+ * (see 'priority'). */
+static ssize_t compilePriority( const char*raw, char***priority, uint_t*priority_len ){
+    ssize_t err;
+    uint_t cap = 1;
+    for( const char *it = raw ; *it ; ++it ){
+        if( *it == ',' ){ cap += 1; } }
+    *priority_len = 0;
+    *priority = calloc(cap, sizeof**priority);
+    if( *priority == NULL ){
+        err = -ENOMEM; goto fail; }
+    for( const char *beg = raw ;; ){
+        const char *end = strchr(beg, ',');
+        if( end == NULL ){ end = beg + strlen(beg); }
+        // One more NUL than segments, as the list of them ends with an empty one.
+        char *segs = malloc(end - beg + 2);
+        if( segs == NULL ){
+            err = -ENOMEM; goto fail; }
+        (*priority)[(*priority_len)++] = segs;
+        char *it = segs;
+        for( const char *c = beg ; c < end ; ++c ){
+            if( *c != '/' ){ *it++ = *c; continue; }
+            if( it > segs && it[-1] != '\0' ){ *it++ = '\0'; } /* <- Drop empty segments. */
+        }
+        if( it > segs && it[-1] != '\0' ){ *it++ = '\0'; }
+        *it = '\0';
+        if( segs[0] == '\0' ){
+            log_write(LOG_LVL_ERROR, "%s%s%s", "EINVAL: Empty pattern in priority '", raw, "'");
+            err = -1; goto fail;
+        }
+        if( *end == '\0' ){
+            break; }
+        beg = end +1;
+    }
+
+    return 0;
+fail:
+    for( uint_t i=0 ; *priority && i<*priority_len ; ++i ){
+        free((*priority)[i]); }
+    free(*priority); *priority = NULL;
+    *priority_len = 0;
+    return err;
+}
+
+
+/** Builds the 'x-queue' headers of '--via-queue' and the URL to monitor
+ * the queues at. */
+static ssize_t setupQueues( Resclone*resclone, const GateleenResclone_Opts*opts ){
+    ssize_t err;
+    const char *pattern = opts->viaQueue;
+    const uint_t count = opts->queueCount ? opts->queueCount : 4;
+    if( pattern[0] == '\0' || strpbrk(pattern, "/\r\n") || count > QUEUE_COUNT_MAX ){
+        log_write(LOG_LVL_ERROR, "%s%s%s", "EINVAL: Bad queue '", pattern, "'");
+        err = -1; goto fail;
+    }
+    if( opts->replicaUrl ){
+        log_write(LOG_LVL_ERROR, "%s", "EINVAL: Queued PUTs only apply to push.");
+        err = -1; goto fail;
+    }
+    resclone->queueHdrs = calloc(count, sizeof*resclone->queueHdrs);
+    if( resclone->queueHdrs == NULL ){
+        err = -ENOMEM; goto fail; }
+    static const char prefix[] = "x-queue: ";
+    const char *star = strchr(pattern, '*');
+    const int prefix_len = star ? star - pattern : (int)strlen(pattern);
+    const char *suffix = star ? star + 1 : "";
+    for( uint_t i=0 ; i<count ; ++i ){
+        char *hdr = malloc(sizeof prefix + strlen(pattern) + 12);
+        if( hdr == NULL ){
+            err = -ENOMEM; goto fail; }
+        resclone->queueHdrs[resclone->queueHdrs_len++] = hdr;
+        if( star ){
+            sprintf(hdr, "%s%.*s%u%s", prefix, prefix_len, pattern, i, suffix);
+        }else if( count > 1 ){
+            sprintf(hdr, "%s%s-%u", prefix, pattern, i);
+        }else{
+            sprintf(hdr, "%s%s", prefix, pattern);
+        }
+    }
+    resclone->queueWait = opts->queueWait;
+    if( opts->queueApiUrl ){
+        const size_t apiUrl_len = strlen(opts->queueApiUrl);
+        resclone->queueApiUrl = malloc(apiUrl_len +2);
+        if( resclone->queueApiUrl == NULL ){
+            err = -ENOMEM; goto fail; }
+        memcpy(resclone->queueApiUrl, opts->queueApiUrl, apiUrl_len +1);
+        if( apiUrl_len == 0 || resclone->queueApiUrl[apiUrl_len-1] != '/' ){
+            memcpy(resclone->queueApiUrl + apiUrl_len, "/", 2); }
+    }else{
+        // Gateleen serves the queuing API from the root of the host.
+        static const char apiPath[] = "/queuing/queues/";
+        const char *host = opts->url ? strstr(opts->url, "://") : NULL;
+        if( host == NULL ){
+            log_write(LOG_LVL_ERROR, "%s", "EINVAL: Cannot tell the host to monitor the queues at.");
+            err = -1; goto fail;
+        }
+        const char *hostEnd = strchr(host + 3, '/');
+        const size_t origin_len = hostEnd ? (size_t)(hostEnd - opts->url) : strlen(opts->url);
+        resclone->queueApiUrl = malloc(origin_len + sizeof apiPath);
+        if( resclone->queueApiUrl == NULL ){
+            err = -ENOMEM; goto fail; }
+        memcpy(resclone->queueApiUrl, opts->url, origin_len);
+        memcpy(resclone->queueApiUrl + origin_len, apiPath, sizeof apiPath);
+    }
+
+    return 0;
+fail:
+    if( err == -ENOMEM ){
+        log_write(LOG_LVL_ERROR, "%s", "Out of memory"); }
+    return err;
+}
+
+
+static void progressBegin( Progress*progress ){
+    memset(progress, 0, sizeof*progress);
+    clock_gettime(CLOCK_MONOTONIC, &progress->begin);
+    log_rateLimit(&progress->rate, PROGRESS_INTERVAL_MS); /* <- Nothing to tell right at begin. */
+}
+
+
+/** Logs a summary of 'stats'. Rate limited to one line per
+ * PROGRESS_INTERVAL_MS unless 'isFinal'. Replaces per-entry lines which do
+ * not scale to large trees. */
+static void logProgress( const char*what, const GateleenResclone_Stats*stats, Progress*progress, int isFinal ){
+    if( ! log_isEnabled(LOG_LVL_INFO) ){
+        return; }
+    if( ! log_rateLimit(&progress->rate, PROGRESS_INTERVAL_MS) && ! isFinal ){
+        return; }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double seconds = (now.tv_sec - progress->begin.tv_sec) + (now.tv_nsec - progress->begin.tv_nsec) / 1e9;
+    if( seconds <= 0 ){ seconds = 1e-3; }
+    log_write(LOG_LVL_INFO, "%s%s"FMT_SIZE_T"%s%.1f%s"FMT_SIZE_T"%s%.0f%s%.1f%s", what, isFinal ? " done. " : ": ",
+        stats->entries, " entries (", stats->bytes / 1048576.0, " MiB), ", stats->failed, " failed, ",
+        stats->entries / seconds, " entries/s, ", seconds, "s");
+}
+
+
+static size_t onCurlDirRsp( char*buf, size_t size, size_t nmemb, void*ResourceDir_ ){
+    //fprintf(stderr, "%s%s%s%p%s"FMT_SIZE_T"%s"FMT_SIZE_T"%s%p%s\n", "[TRACE] ", __func__, "( buf=", buf,
+    //    ", size=", size, ", nmemb=", nmemb, ", cls=", ResourceDir_, " )");
+    ResourceDir *resourceDir = ResourceDir_;
+    ClsDload *dload = resourceDir->dload;
+    CURL *curl = dload->curl;
+    const size_t buf_len = size * nmemb;
+
+    long rspCode;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &rspCode);
+    resourceDir->rspCode = rspCode;
+    if( rspCode != 200 ){
+        return size * nmemb; }
+
+    // Collect whole response body into one buf (as cJSON seems unable to parse
+    // partially). Listings cannot be spooled, so they're charged to the
+    // budget unconditionally.
+    if( memBudget_growBuf(&dload->memBudget, 0, &resourceDir->rspBody, &resourceDir->rspBody_cap,
+        resourceDir->rspBody_len + buf_len +1) )
+    {
+        log_write(LOG_LVL_ERROR, "%s"FMT_SIZE_T"%s", "Out of memory for listing of ",
+            resourceDir->rspBody_len + buf_len, " bytes.");
+        return 0; /* <- Makes curl abort the transfer. */
+    }
+    memcpy(resourceDir->rspBody+resourceDir->rspBody_len, buf, buf_len);
+    resourceDir->rspBody_len += buf_len;
+    resourceDir->rspBody[resourceDir->rspBody_len] = '\0';
+
+    // Parsing occurs in the caller, as soon we processed whole response.
+
+    return size * nmemb;
+}
+
+
+static size_t onResourceChunk( char*buf, size_t size, size_t nmemb, void*ResourceFile_ ){
+    const size_t buf_len = size * nmemb;
+    ResourceFile *resourceFile = ResourceFile_;
+    ClsDload *dload = resourceFile->dload;
+    MemBudget *budget = &dload->memBudget;
+
+    if( resourceFile->buf_len == 0 && resourceFile->spool == NULL && resourceFile->isRangeable
+        && dload->resclone->rangeThreshold && !dload->isRangeOff )
+    {
+        // First chunk of a large body. Better fetch it in segments.
+        long rspCode;
+        curl_off_t contentLength = -1;
+        curl_easy_getinfo(dload->curl, CURLINFO_RESPONSE_CODE, &rspCode);
+        curl_easy_getinfo(dload->curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &contentLength);
+        if( rspCode == 200 && contentLength > 0
+            && (size_t)contentLength >= dload->resclone->rangeThreshold )
+        {
+            resourceFile->rangeLen = contentLength;
+            return 0; /* <- Aborts this transfer. */
+        }
+    }
+    if( resourceFile->spool == NULL ){
+        if( !memBudget_growBuf(budget, !0, &resourceFile->buf, &resourceFile->buf_cap,
+            resourceFile->buf_len + buf_len +1) )
+        {
+            char *it = resourceFile->buf + resourceFile->buf_len;
+            memcpy(it, buf, buf_len); it += buf_len;
+            *it = '\0';
+            resourceFile->buf_len = it - resourceFile->buf;
+            return buf_len;
+        }
+        // Body no longer fits into our budget. Apply backpressure by moving it
+        // out to a spool file instead of growing further.
+        resourceFile->spool = tmpfile();
+        if( resourceFile->spool == NULL ){
+            log_write(LOG_LVL_ERROR, "%s%s", "tmpfile(): ", strerror(errno));
+            return 0;
+        }
+        if( resourceFile->buf_len > 0
+            && fwrite(resourceFile->buf, 1, resourceFile->buf_len, resourceFile->spool) != resourceFile->buf_len )
+        {
+            log_write(LOG_LVL_ERROR, "%s%s", "fwrite(spool): ", strerror(errno));
+            return 0;
+        }
+        resourceFile->spool_len = resourceFile->buf_len;
+        resourceFile->buf_len = 0;
+    }
+    if( fwrite(buf, 1, buf_len, resourceFile->spool) != buf_len ){
+        log_write(LOG_LVL_ERROR, "%s%s", "fwrite(spool): ", strerror(errno));
+        return 0;
+    }
+    resourceFile->spool_len += buf_len;
+
+    return buf_len;
+}
+
+
+/** Prepares resourceFile to take the next body. */
+static void resetResourceFile( ResourceFile*resourceFile ){
+    MemBudget *budget = &resourceFile->dload->memBudget;
+    resourceFile->buf_len = 0;
+    if( resourceFile->spool ){
+        fclose(resourceFile->spool); resourceFile->spool = NULL; }
+    resourceFile->spool_len = 0;
+    resourceFile->contentType = NULL;
+    resourceFile->isRangeable = 0;
+    resourceFile->rangeLen = 0;
+    resourceFile->headers.list_len = 0;
+    resourceFile->headers.buf_len = 0;
+    resourceFile->rspCode = 0;
+    resourceFile->etag[0] = '\0';
+    if( resourceFile->buf_cap > RESOURCE_BUF_KEEP_MAX ){
+        /* Do not pin memory of an exceptionally large resource. */
+        memBudget_release(budget, resourceFile->buf_cap);
+        free(resourceFile->buf); resourceFile->buf = NULL;
+        resourceFile->buf_cap = 0;
+    }
+}
+
+
+static int64_t monotonicMs( void ){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+
+/** Points 'curl' at 'url'. With endpoints configured, the request goes to
+ * the one picked for it instead ('url' is below the first one). 'avoid' is
+ * as for 'endpoints_acquire'. With a deadline, the transfer gets cut there. */
+static ssize_t transferBegin( Transfer*transfer, Resclone*resclone, CURL*curl, const char*url, uint64_t avoid ){
+    const size_t rootUrl_len = strlen(resclone->url);
+    if( resclone->deadlineAt ){
+        // The traversal lists it as missing once cut.
+        const int64_t left = resclone->deadlineAt - monotonicMs();
+        if( curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, (long)(left > 0 ? left : 1)) ){
+            return -1; }
+    }
+    if( resclone->endpoints == NULL || strncmp(url, resclone->url, rootUrl_len) ){
+        return curl_easy_setopt(curl, CURLOPT_URL, url) ? -1 : 0; }
+    assert(transfer->endpoints == NULL);
+    const size_t idx = endpoints_acquire(resclone->endpoints, avoid);
+    const char *base = endpoints_url(resclone->endpoints, idx);
+    const size_t base_len = strlen(base);
+    const size_t tail_len = strlen(url + rootUrl_len);
+    char *epUrl = malloc(base_len + tail_len +1);
+    if( epUrl == NULL ){
+        endpoints_release(resclone->endpoints, idx, ENDPOINT_CANCELED, 0);
+        return -ENOMEM;
+    }
+    memcpy(epUrl, base, base_len);
+    memcpy(epUrl + base_len, url + rootUrl_len, tail_len +1);
+    const CURLcode cErr = curl_easy_setopt(curl, CURLOPT_URL, epUrl); /* <- curl copies it. */
+    free(epUrl);
+    if( cErr ){
+        endpoints_release(resclone->endpoints, idx, ENDPOINT_CANCELED, 0);
+        return -1;
+    }
+    transfer->endpoints = resclone->endpoints;
+    transfer->endpoint = idx;
+    clock_gettime(CLOCK_MONOTONIC, &transfer->begin);
+    return 0;
+}
+
+
+/** Reports the outcome of a transfer begun by 'transferBegin' to its
+ * endpoint. 'curl' NULL means it got canceled. */
+static void transferEnd( Transfer*transfer, CURL*curl ){
+    if( transfer->endpoints == NULL ){
+        return; }
+    EndpointOutcome outcome = ENDPOINT_CANCELED;
+    uint64_t micros = 0;
+    if( curl ){
+        long rspCode = 0;
+        struct timespec now;
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &rspCode);
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        micros = (now.tv_sec - transfer->begin.tv_sec) * 1000000LL
+            + (now.tv_nsec - transfer->begin.tv_nsec) / 1000;
+        // A write error is us aborting it (see 'onResourceChunk').
+        outcome = (transfer->result == CURLE_OK || transfer->result == CURLE_WRITE_ERROR) && rspCode < 500
+            ? ENDPOINT_OK : ENDPOINT_FAILED;
+    }
+    endpoints_release(transfer->endpoints, transfer->endpoint, outcome, micros);
+    transfer->endpoints = NULL;
+}
+
+
+/** @return Non-zero if 'transfer' failed in a way another endpoint might
+ *      not (transport error or 5xx) and there is another one to try. */
+static int isRetryElsewhere( Resclone*resclone, const Transfer*transfer, CURL*curl, uint_t attempt ){
+    if( resclone->endpoints == NULL || attempt +1 >= endpoints_count(resclone->endpoints) ){
+        return 0; }
+    if( transfer->result == CURLE_WRITE_ERROR ){
+        return 0; } /* <- Aborted by us. */
+    if( transfer->result != CURLE_OK ){
+        return !0; }
+    long rspCode = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &rspCode);
+    return rspCode >= 500;
+}
+
+
+/** Lets the transfers of 'multi' progress and marks those which completed.
+ * Waits (a second at most) for activity if none completed. */
+static ssize_t pumpMulti( CURLM*multi ){
+    int running, isAnyDone = 0;
+    CURLMcode mErr = curl_multi_perform(multi, &running);
+    if( mErr != CURLM_OK ){
+        log_write(LOG_LVL_ERROR, "%s%s", "curl_multi_perform(): ", curl_multi_strerror(mErr));
+        return -1;
+    }
+    for( CURLMsg *msg ; (msg=curl_multi_info_read(multi, &running)) ;){
+        if( msg->msg != CURLMSG_DONE ){ continue; }
+        Transfer *done = NULL;
+        CURL *easy = msg->easy_handle;
+        curl_easy_getinfo(easy, CURLINFO_PRIVATE, (char**)&done);
+        done->result = msg->data.result;
+        done->isRunning = 0;
+        transferEnd(done, easy);
+        curl_multi_remove_handle(multi, easy);
+        isAnyDone = !0;
+    }
+    if( ! isAnyDone ){
+        mErr = curl_multi_wait(multi, NULL, 0, 1000, NULL);
+        if( mErr != CURLM_OK ){
+            log_write(LOG_LVL_ERROR, "%s%s", "curl_multi_wait(): ", curl_multi_strerror(mErr));
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+/** Drives all transfers of 'dload->multi' until 'transfer' is done. */
+static ssize_t pumpUntilDone( ClsDload*dload, Transfer*transfer ){
+    while( transfer->isRunning ){
+        if( pumpMulti(dload->multi) ){
+            return -1; }
+    }
+    return 0;
+}
+
+
+/** Same as curl_easy_perform. But keeps background transfers (if any)
+ * going meanwhile. 'transfer' is the one 'transferBegin' prepared. */
+static CURLcode dloadPerform( ClsDload*dload, CURL*curl, Transfer*transfer ){
+    if( dload->multi == NULL ){
+        transfer->result = curl_easy_perform(curl);
+        transferEnd(transfer, curl);
+        return transfer->result;
+    }
+    transfer->isRunning = !0;
+    if(    curl_easy_setopt(curl, CURLOPT_PRIVATE, transfer)
+        || curl_multi_add_handle(dload->multi, curl) )
+    {
+        transfer->isRunning = 0;
+        transferEnd(transfer, NULL);
+        return CURLE_FAILED_INIT;
+    }
+    if( pumpUntilDone(dload, transfer) ){
+        curl_multi_remove_handle(dload->multi, curl);
+        transfer->isRunning = 0;
+        transferEnd(transfer, NULL);
+        return CURLE_FAILED_INIT;
+    }
+    return transfer->result;
+}
+
+
+/** Adds "name: val" to 'headers'.
+ * @return 0 on success, -ENOBUFS if there's no more room. */
+static ssize_t entryHeaders_add( EntryHeaders*headers, const char*name, size_t name_len,
+    const char*val, size_t val_len )
+{
+    const size_t len = name_len + 2 + val_len +1;
+    if( headers->list_len >= ENTRY_HEADERS_MAX || headers->buf_len + len > sizeof headers->buf ){
+        return -ENOBUFS; }
+    char *it = headers->buf + headers->buf_len;
+    headers->list[headers->list_len++] = it;
+    sprintf(it, "%.*s: %.*s", (int)name_len, name, (int)val_len, val);
+    headers->buf_len += len;
+    return 0;
+}
+
+
+/** Replaces 'dst' with a copy of 'src' ("Name: value" each).
+ * @return 0 on success, -ENOBUFS if not all of them fit. */
+static ssize_t entryHeaders_copy( EntryHeaders*dst, const char*const*src, size_t src_len ){
+    dst->list_len = 0;
+    dst->buf_len = 0;
+    for( size_t i=0 ; i<src_len ; ++i ){
+        const size_t hdr_len = strlen(src[i]);
+        if( dst->list_len >= ENTRY_HEADERS_MAX || dst->buf_len + hdr_len +1 > sizeof dst->buf ){
+            return -ENOBUFS; }
+        char *it = dst->buf + dst->buf_len;
+        memcpy(it, src[i], hdr_len +1);
+        dst->list[dst->list_len++] = it;
+        dst->buf_len += hdr_len +1;
+    }
+    return 0;
+}
+
+
+static size_t onResourceHeader( char*buf, size_t size, size_t nmemb, void*ResourceFile_ ){
+    ResourceFile *resourceFile = ResourceFile_;
+    const size_t buf_len = size * nmemb;
+    const char *colon = memchr(buf, ':', buf_len);
+    if( colon == NULL ){
+        return buf_len; } /* <- Status line or end of headers. */
+    const size_t name_len = colon - buf;
+    const char *val = colon + 1, *end = buf + buf_len;
+    while( val < end && (*val == ' ' || *val == '\t') ){ ++val; }
+    while( end > val && (end[-1] == '\r' || end[-1] == '\n' || end[-1] == ' ') ){ --end; }
+    if( name_len == 13 && !strncasecmp(buf, "accept-ranges", 13) ){
+        resourceFile->isRangeable = (end - val == 5 && !strncasecmp(val, "bytes", 5));
+        return buf_len;
+    }
+    if( name_len == 4 && !strncasecmp(buf, "etag", 4) ){
+        const size_t etag_len = end - val;
+        resourceFile->etag[0] = '\0';
+        if( etag_len <= ETAG_MAX ){
+            memcpy(resourceFile->etag, val, etag_len);
+            resourceFile->etag[etag_len] = '\0';
+        }
+        return buf_len;
+    }
+    for( size_t i=0 ; i<sizeof recordedHeaders / sizeof*recordedHeaders ; ++i ){
+        if( strlen(recordedHeaders[i]) != name_len || strncasecmp(buf, recordedHeaders[i], name_len) ){
+            continue; }
+        if( entryHeaders_add(&resourceFile->headers, recordedHeaders[i], name_len, val, end - val) ){
+            log_write(LOG_LVL_WARN, "%s%s%s", "Header '", recordedHeaders[i], "' dropped. Too many headers.");
+        }
+        break;
+    }
+    return buf_len;
+}
+
+
+static size_t onRangeChunk( char*buf, size_t size, size_t nmemb, void*RangeSeg_ ){
+    RangeSeg *seg = RangeSeg_;
+    const size_t buf_len = size * nmemb;
+    if( seg->off == 0 ){
+        long rspCode;
+        curl_easy_getinfo(seg->curl, CURLINFO_RESPONSE_CODE, &rspCode);
+        if( rspCode != 206 ){
+            seg->isRangeIgnored = (rspCode == 200);
+            return 0;
+        }
+    }
+    if( seg->off + buf_len > seg->end - seg->beg +1 ){
+        log_write(LOG_LVL_ERROR, "%s", "Server sent more than the requested range.");
+        return 0;
+    }
+    // All segments are driven by the same thread. So they can share the
+    // spool as long each one seeks to its own position first.
+    if(    fseeko(seg->spool, seg->beg + seg->off, SEEK_SET)
+        || fwrite(buf, 1, buf_len, seg->spool) != buf_len )
+    {
+        log_write(LOG_LVL_ERROR, "%s%s", "fwrite(spool): ", strerror(errno));
+        return 0;
+    }
+    seg->off += buf_len;
+    return buf_len;
+}
+
+
+/** Fetches the 'resourceFile->rangeLen' bytes large body at 'url' as
+ * concurrent 'Range' requests into a preallocated spool file.
+ * @return 0 on success, 1 if the server does not honor ranges, negative
+ *      on error. */
+static ssize_t collectResourceInRanges( ResourceFile*resourceFile, const char*url ){
+    ssize_t err;
+    ClsDload *dload = resourceFile->dload;
+    const size_t len = resourceFile->rangeLen;
+    uint_t numSegs = dload->resclone->rangeSegments;
+    const size_t segLen = (len + numSegs -1) / numSegs;
+    numSegs = (len + segLen -1) / segLen;
+
+    if( dload->multi == NULL ){
+        dload->multi = curl_multi_init();
+        if( dload->multi == NULL ){
+            log_write(LOG_LVL_ERROR, "%s", "curl_multi_init() -> NULL");
+            err = -1; goto endFn;
+        }
+    }
+    if( dload->rangeSegs == NULL ){
+        dload->rangeSegs = calloc(RANGE_SEGMENTS_MAX, sizeof*dload->rangeSegs);
+        if( dload->rangeSegs == NULL ){
+            err = -ENOMEM; goto endFn; }
+    }
+    resourceFile->spool = tmpfile();
+    if( resourceFile->spool == NULL ){
+        log_write(LOG_LVL_ERROR, "%s%s", "tmpfile(): ", strerror(errno));
+        err = -1; goto endFn;
+    }
+    // Allocate the whole file upfront. Segments then only fill it in.
+    if(    fseeko(resourceFile->spool, len -1, SEEK_SET)
+        || fputc('\0', resourceFile->spool) == EOF )
+    {
+        log_write(LOG_LVL_ERROR, "%s%s", "fwrite(spool): ", strerror(errno));
+        err = -1; goto endFn;
+    }
+    log_write(LOG_LVL_DEBUG, "%s"FMT_SIZE_T"%s%u%s", "Fetch ", len, " bytes in ", numSegs, " ranges");
+
+    for( uint_t i=0 ; i<numSegs ; ++i ){
+        RangeSeg *seg = dload->rangeSegs + i;
+        char range[48];
+        seg->spool = resourceFile->spool;
+        seg->beg = i * segLen;
+        seg->end = (seg->beg + segLen < len ? seg->beg + segLen : len) -1;
+        seg->off = 0;
+        seg->isRangeIgnored = 0;
+        sprintf(range, FMT_SIZE_T"-"FMT_SIZE_T, seg->beg, seg->end);
+        if( seg->curl == NULL ){
+            seg->curl = curl_easy_init();
+            if( seg->curl == NULL ){
+                log_write(LOG_LVL_ERROR, "%s", "curl_easy_init() -> NULL");
+                err = -1; goto endFn;
+            }
+            if( dload->resclone->share && curl_easy_setopt(seg->curl, CURLOPT_SHARE, dload->resclone->share) ){
+                assert(!"CURLOPT_SHARE"); err = -1; goto endFn; }
+        }
+        err =  transferBegin(&seg->transfer, dload->resclone, seg->curl, url, 0)
+            || CURLE_OK!= curl_easy_setopt(seg->curl, CURLOPT_FOLLOWLOCATION, 0L)
+            || CURLE_OK!= curl_easy_setopt(seg->curl, CURLOPT_RANGE, range)
+            || CURLE_OK!= curl_easy_setopt(seg->curl, CURLOPT_WRITEFUNCTION, onRangeChunk)
+            || CURLE_OK!= curl_easy_setopt(seg->curl, CURLOPT_WRITEDATA, seg)
+            || CURLE_OK!= curl_easy_setopt(seg->curl, CURLOPT_PRIVATE, &seg->transfer)
+            ;
+        if( err ){ transferEnd(&seg->transfer, NULL); err = -1; goto endFn; }
+        if( curl_multi_add_handle(dload->multi, seg->curl) ){
+            transferEnd(&seg->transfer, NULL); err = -1; goto endFn; }
+        seg->transfer.isRunning = !0;
+    }
+    for( uint_t i=0 ; i<numSegs ; ++i ){
+        if( pumpUntilDone(dload, &dload->rangeSegs[i].transfer) ){
+            err = -1; goto endFn; }
+    }
+
+    for( uint_t i=0 ; i<numSegs ; ++i ){
+        RangeSeg *seg = dload->rangeSegs + i;
+        if( seg->isRangeIgnored ){
+            err = 1; goto endFn; }
+        if( seg->transfer.result != CURLE_OK || seg->off != seg->end - seg->beg +1 ){
+            log_write(LOG_LVL_ERROR, "%s%s%s%s%u%s", __func__, "(): '", url, "' range ", i, " failed");
+            err = -1; goto endFn;
+        }
+    }
+    resourceFile->spool_len = len;
+
+    err = 0;
+endFn:
+    for( uint_t i=0 ; dload->rangeSegs && i<numSegs ; ++i ){
+        RangeSeg *seg = dload->rangeSegs + i;
+        if( seg->transfer.isRunning ){
+            curl_multi_remove_handle(dload->multi, seg->curl);
+            seg->transfer.isRunning = 0;
+            transferEnd(&seg->transfer, NULL);
+        }
+    }
+    if( err && resourceFile->spool ){
+        fclose(resourceFile->spool); resourceFile->spool = NULL; }
+    return err;
+}
+
+
+static ssize_t collectResourceIntoMemory( ResourceFile*resourceFile, char*url ){
+    ssize_t err;
+    ClsDload *dload = resourceFile->dload;
+    CURL *curl = dload->curl;
+    struct curl_slist *reqHdrs = NULL;
+
+    if( resourceFile->ifNoneMatch ){
+        char hdr[sizeof "If-None-Match: " + ETAG_MAX];
+        snprintf(hdr, sizeof hdr, "%s%s", "If-None-Match: ", resourceFile->ifNoneMatch);
+        reqHdrs = curl_slist_append(NULL, hdr);
+        if( reqHdrs == NULL ){
+            err = -ENOMEM; goto endFn; }
+    }
+    err =  CURLE_OK!= curl_easy_setopt(curl, CURLOPT_HTTPHEADER, reqHdrs)
+        || CURLE_OK!= curl_easy_setopt(curl, CURLOPT_TIMECONDITION, (long)(resourceFile->ifModifiedSince > 0
+            ? CURL_TIMECOND_IFMODSINCE : CURL_TIMECOND_NONE))
+        || CURLE_OK!= curl_easy_setopt(curl, CURLOPT_TIMEVALUE_LARGE, (curl_off_t)resourceFile->ifModifiedSince)
+        || CURLE_OK!= curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 0L )
+        || CURLE_OK!= curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, onResourceChunk)
+        || CURLE_OK!= curl_easy_setopt(curl, CURLOPT_WRITEDATA, resourceFile)
+        || CURLE_OK!= curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, onResourceHeader)
+        || CURLE_OK!= curl_easy_setopt(curl, CURLOPT_HEADERDATA, resourceFile)
+        ;
+    if( err ){ assert(!err); err = -1; goto endFn; }
+
+    Transfer transfer = {0};
+    uint64_t tried = 0;
+    for( uint_t attempt=0 ;; ++attempt ){
+        if( transferBegin(&transfer, dload->resclone, curl, url, tried) ){
+            err = -1; goto endFn; }
+        err = dloadPerform(dload, curl, &transfer);
+        if( ! isRetryElsewhere(dload->resclone, &transfer, curl, attempt) ){
+            break; }
+        if( transfer.endpoint < 64 ){ tried |= 1ULL << transfer.endpoint; }
+        log_write(LOG_LVL_DEBUG, "%s%s%s", "Retry '", url, "' on another endpoint");
+        resetResourceFile(resourceFile);
+    }
+    if( err == CURLE_WRITE_ERROR && resourceFile->rangeLen ){
+        // We aborted it ourself as the body is large enough to be fetched in
+        // segments.
+        err = collectResourceInRanges(resourceFile, url);
+        if( err < 0 ){
+            err = -1; goto endFn; }
+        if( err > 0 ){
+            log_write(LOG_LVL_WARN, "%s", "Server ignores 'Range'. Fetch large resources in one piece.");
+            dload->isRangeOff = !0;
+            resetResourceFile(resourceFile);
+            err = collectResourceIntoMemory(resourceFile, url);
+            goto endFn;
+        }
+    }else if( err != CURLE_OK ){
+        // Those the deadline cut get listed as missing instead.
+        log_write(err == CURLE_OPERATION_TIMEDOUT && dload->resclone->deadlineAt ? LOG_LVL_DEBUG : LOG_LVL_ERROR,
+            "%s%s%s%s"FMT_SIZE_T"%s%s", __func__, "(): '", url, "' (code ", err, "): ", curl_easy_strerror(err));
+        err = -1; goto endFn;
+    }
+    char *contentType = NULL;
+    curl_easy_getinfo(curl, CURLINFO_CONTENT_TYPE, &contentType);
+    resourceFile->contentType = contentType;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &resourceFile->rspCode);
+
+    err = 0;
+endFn:
+    // Same handle fetches the listings. Those must not be conditional.
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, NULL);
+    curl_easy_setopt(curl, CURLOPT_TIMECONDITION, (long)CURL_TIMECOND_NONE);
+    curl_slist_free_all(reqHdrs);
+    return err;
+}
+
+
+/** @return Name of volume 'idx' of 'file' ("foo.tar" -> "foo.<idx>.tar",
+ *      same for ".zip" and ".tar.zst") or NULL if out of memory. Caller owns
+ *      it. */
+static char* volumeFileName( const char*file, uint_t idx ){
+    static const char *const exts[] = { ".tar", ".zip", ".tar.zst" };
+    const char *ext = exts[0];
+    size_t base_len = strlen(file);
+    for( size_t i=0 ; i<sizeof exts/sizeof*exts ; ++i ){
+        const size_t ext_len = strlen(exts[i]);
+        if( base_len >= ext_len && !strcmp(file + base_len - ext_len, exts[i]) ){
+            ext = exts[i]; base_len -= ext_len; break; }
+    }
+    char *name = malloc(base_len + 16 + strlen(ext) +1);
+    if( name == NULL ){
+        return NULL; }
+    sprintf(name, "%.*s.%03u%s", (int)base_len, file, idx, ext);
+    return name;
+}
+
+
+static la_ssize_t TarSink_zstdWrite( struct archive*archive, void*TarSink_, const void*buf, size_t buf_len ){
+    (void)archive;
+    TarSink *tarSink = TarSink_;
+    return zstdseek_write(tarSink->zstd, buf, buf_len) ? -1 : (la_ssize_t)buf_len;
+}
+
+
+static int TarSink_zstdClose( struct archive*archive, void*TarSink_ ){
+    (void)archive;
+    TarSink *tarSink = TarSink_;
+    const ssize_t err = zstdseek_writerClose(tarSink->zstd);
+    tarSink->zstd = NULL;
+    return err ? ARCHIVE_FATAL : ARCHIVE_OK;
+}
+
+
+/** Sets up the archive (or the current volume) if not setup yet. */
+static ssize_t TarSink_open( TarSink*tarSink ){
+    ssize_t err;
+    char *volumeFile = NULL;
+    if( tarSink->archive ){
+        return 0; }
+    tarSink->archive = archive_write_new();
+    if( tarSink->archive == NULL ){
+        err = -ENOMEM; goto endFn; }
+    if( tarSink->volumeSize ){
+        volumeFile = volumeFileName(tarSink->file, tarSink->volumeIdx);
+        if( volumeFile == NULL ){
+            err = -ENOMEM; goto endFn; }
+        log_write(LOG_LVL_INFO, "%s%s%s", "Write volume '", volumeFile, "'");
+    }
+    if( tarSink->format == GATELEEN_RESCLONE_FORMAT_ZIP ){
+        // Each entry gets deflated on its own and is listed in the central
+        // directory. So single entries can be extracted without reading the
+        // others.
+        err = archive_write_set_format_zip(tarSink->archive)
+           || archive_write_set_options(tarSink->archive, "zip:compression=deflate");
+    }else{
+        err = archive_write_set_format_pax_restricted(tarSink->archive);
+    }
+    if( !err && tarSink->format == GATELEEN_RESCLONE_FORMAT_TAR_ZSTD ){
+        tarSink->zstd = zstdseek_writerOpen(volumeFile ? volumeFile : tarSink->file, 3);
+        if( tarSink->zstd == NULL ){
+            err = -1; goto endFn; }
+        // No blocking, so each entry reaches the compressor before the
+        // next one begins.
+        err = archive_write_set_bytes_per_block(tarSink->archive, 0)
+           || archive_write_open(tarSink->archive, tarSink, NULL, TarSink_zstdWrite, TarSink_zstdClose);
+    }else if( !err ){
+        // Padding to full blocks would only waste space in every volume.
+        err = (volumeFile && archive_write_set_bytes_in_last_block(tarSink->archive, 1))
+           || archive_write_open_filename(tarSink->archive, volumeFile ? volumeFile : tarSink->file);
+    }
+    if( err ){
+        log_write(LOG_LVL_ERROR, "%s%s", "Failed to setup tar output: ",
+            archive_error_string(tarSink->archive));
+        err = -1; goto endFn;
+    }
+    tarSink->volumeEntries = 0;
+    err = 0;
+endFn:
+    free(volumeFile);
+    return err;
+}
+
+
+/** Closes current volume if 'entry' would not fit into it anymore. */
+static ssize_t TarSink_rollVolume( TarSink*tarSink, const GateleenResclone_Entry*entry ){
+    if( tarSink->volumeSize == 0 || tarSink->archive == NULL || tarSink->volumeEntries == 0 ){
+        return 0; }
+    // Approximation. Ignores pax extension headers and the end-of-archive
+    // marker. So volumes may exceed the limit by that.
+    const size_t entryBytes = 512 + ((entry->size + 511) & ~(size_t)511);
+    const size_t used = archive_filter_bytes(tarSink->archive, 0);
+    if( used + entryBytes <= tarSink->volumeSize ){
+        return 0; }
+    if( archive_write_close(tarSink->archive) ){
+        log_write(LOG_LVL_ERROR, "%s%s", "archive_write_close failed: ",
+            archive_error_string(tarSink->archive));
+        return -1;
+    }
+    archive_write_free(tarSink->archive); tarSink->archive = NULL;
+    tarSink->volumeIdx += 1;
+    return 0;
+}
+
+
+static ssize_t TarSink_onEntryBegin( void*TarSink_, const GateleenResclone_Entry*entry ){
+    ssize_t err;
+    TarSink *tarSink = TarSink_;
+
+    err = TarSink_rollVolume(tarSink, entry)
+        || TarSink_open(tarSink);
+    if( err ){
+        err = -1; goto endFn; }
+    tarSink->volumeEntries += 1;
+    if( tarSink->zstd ){
+        // Completes the previous entry (padding included), so a new frame
+        // can start right at this one.
+        err = archive_write_finish_entry(tarSink->archive) != ARCHIVE_OK
+           || zstdseek_cut(tarSink->zstd, ZSTD_FRAME_BYTES);
+        if( err ){
+            err = -1; goto endFn; }
+    }
+
+    if( tarSink->entry == NULL ){
+        tarSink->entry = archive_entry_new();
+    }else{
+        tarSink->entry = archive_entry_clear(tarSink->entry);
+    }
+    archive_entry_set_pathname(tarSink->entry, entry->path);
+    archive_entry_set_filetype(tarSink->entry, AE_IFREG);
+    archive_entry_set_size(tarSink->entry, entry->size);
+    archive_entry_set_perm(tarSink->entry, 0644);
+    // pax keeps these as 'SCHILY.xattr.*' records, so push can restore them.
+    if( entry->contentType ){
+        archive_entry_xattr_add_entry(tarSink->entry, XATTR_MIME_TYPE, entry->contentType,
+            strlen(entry->contentType));
+    }
+    for( size_t i=0 ; i<entry->headers_len ; ++i ){
+        char key[128];
+        const char *hdr = entry->headers[i], *colon = strchr(hdr, ':');
+        if( colon == NULL || colon - hdr > 64 ){
+            continue; }
+        sprintf(key, "%s%.*s", XATTR_HEADER_PREFIX, (int)(colon - hdr), hdr);
+        const char *val = colon + 1 + (colon[1] == ' ');
+        archive_entry_xattr_add_entry(tarSink->entry, key, val, strlen(val));
+    }
+    err = archive_write_header(tarSink->archive, tarSink->entry);
+    if( err ){
+        log_write(LOG_LVL_ERROR, "%s%s", "Failed to archive_write_header: ",
+            archive_error_string(tarSink->archive));
+        err = -1; goto endFn;
+    }
+
+    err = 0;
+endFn:
+    return err;
+}
+
+
+static ssize_t TarSink_onEntryData( void*TarSink_, const char*buf, size_t buf_len ){
+    TarSink *tarSink = TarSink_;
+    ssize_t written = archive_write_data(tarSink->archive, buf, buf_len);
+    if( written < 0 ){
+        log_write(LOG_LVL_ERROR, "%s%s", "Failed to archive_write_data: ",
+            archive_error_string(tarSink->archive));
+        return -1;
+    }else if( (size_t)written != buf_len ){
+        log_write(LOG_LVL_ERROR, "%s"FMT_SIZE_T"%s"FMT_SIZE_T, "archive_write_data failed to write all ",
+            buf_len, " bytes. Instead it wrote ", written);
+        return -1;
+    }
+    return 0;
+}
+
+
+static ssize_t TarSink_onEntryEnd( void*TarSink_ ){
+    (void)TarSink_; /* libarchive pads the entry by itself. */
+    return 0;
+}
+
+
+static ssize_t TarSink_onClose( void*TarSink_ ){
+    TarSink *tarSink = TarSink_;
+    // Even an empty pull (eg an empty shard) yields a valid archive.
+    if( TarSink_open(tarSink) ){
+        return -1; }
+    if( archive_write_close(tarSink->archive) ){
+        log_write(LOG_LVL_ERROR, "%s%s", "archive_write_close failed: ",
+            archive_error_string(tarSink->archive));
+        return -1;
+    }
+    return 0;
+}
+
+
+static void TarSink_cleanup( TarSink*tarSink ){
+    archive_entry_free(tarSink->entry); tarSink->entry = NULL;
+    archive_write_free(tarSink->archive); tarSink->archive = NULL;
+    zstdseek_writerClose(tarSink->zstd); tarSink->zstd = NULL;
+}
+
+
+/** Wakes the other side of the write queue if it is parked on 'cond'.
+ * Called after each commit (release) as the other side may just have found
+ * the queue empty (full). */
+static void AsyncSink_wake( AsyncSink*async, int*isParked, pthread_cond_t*cond ){
+    // Read-modify-write, same as the parking side sets the flag. Either
+    // that reads from us (and then sees our change to the ring) or we see it
+    // parked.
+    if( ! __atomic_fetch_or(isParked, 0, __ATOMIC_ACQ_REL) ){
+        return; }
+    pthread_mutex_lock(&async->mutex);
+    pthread_cond_signal(cond);
+    pthread_mutex_unlock(&async->mutex);
+}
+
+
+/** Waits for room to enqueue a 'len' bytes message.
+ * @return Message or NULL if writer failed already or the message can
+ *      never fit. */
+static AsyncMsg* AsyncSink_reserve( AsyncSink*async, size_t len ){
+    uint_t spins = 0;
+    if( sizeof(AsyncMsg) + len > ring_maxMsgLen(async->ring) ){
+        // Waiting would not help. Only DATA gets chunked to fit.
+        log_write(LOG_LVL_ERROR, "%s"FMT_SIZE_T"%s", "Entry header of ", len,
+            " bytes too large for write queue. Use a larger '--write-queue'.");
+        return NULL;
+    }
+    for(;;){
+        if( __atomic_load_n(&async->isFailed, __ATOMIC_ACQUIRE) ){
+            return NULL; }
+        AsyncMsg *msg = ring_reserve(async->ring, sizeof*msg + len);
+        if( msg ){
+            return msg; }
+        if( spins == 0 ){ async->stats->writeQueueWaits += 1; }
+        // Yield first as the writer usually is just about to make room.
+        if( spins < ASYNC_SPINS ){
+            spins += 1;
+            sched_yield();
+            continue;
+        }
+        pthread_mutex_lock(&async->mutex);
+        __atomic_exchange_n(&async->isProducerParked, 1, __ATOMIC_ACQ_REL);
+        while( ! __atomic_load_n(&async->isFailed, __ATOMIC_ACQUIRE)
+            && (msg = ring_reserve(async->ring, sizeof*msg + len)) == NULL )
+        {
+            pthread_cond_wait(&async->notFull, &async->mutex);
+        }
+        __atomic_store_n(&async->isProducerParked, 0, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&async->mutex);
+        if( msg ){
+            return msg; }
+    }
+}
+
+
+static void AsyncSink_commit( AsyncSink*async ){
+    ring_commit(async->ring);
+    AsyncSink_wake(async, &async->isWriterParked, &async->notEmpty);
+    const size_t used = ring_used(async->ring);
+    if( used > async->stats->writeQueuePeak ){
+        async->stats->writeQueuePeak = used; }
+}
+
+
+static ssize_t AsyncSink_onEntryBegin( void*AsyncSink_, const GateleenResclone_Entry*entry ){
+    AsyncSink *async = AsyncSink_;
+    const size_t path_len = strlen(entry->path);
+    const size_t contentType_len = entry->contentType ? strlen(entry->contentType) : 0;
+    const size_t headers_len = entry->headers_len < ENTRY_HEADERS_MAX ? entry->headers_len : ENTRY_HEADERS_MAX;
+    size_t len = path_len+1 + contentType_len+1;
+    for( size_t i=0 ; i<headers_len ; ++i ){
+        len += strlen(entry->headers[i]) +1; }
+    AsyncMsg *msg = AsyncSink_reserve(async, len);
+    if( msg == NULL ){
+        return -1; }
+    msg->type = ASYNC_MSG_BEGIN;
+    msg->size = entry->size;
+    msg->hasContentType = (entry->contentType != NULL);
+    msg->headers_len = headers_len;
+    char *it = msg->data;
+    memcpy(it, entry->path, path_len +1); it += path_len +1;
+    if( entry->contentType ){
+        memcpy(it, entry->contentType, contentType_len +1); }
+    it += contentType_len +1;
+    for( size_t i=0 ; i<headers_len ; ++i ){
+        const size_t hdr_len = strlen(entry->headers[i]);
+        memcpy(it, entry->headers[i], hdr_len +1); it += hdr_len +1;
+    }
+    AsyncSink_commit(async);
+    return 0;
+}
+
+
+static ssize_t AsyncSink_onEntryData( void*AsyncSink_, const char*buf, size_t buf_len ){
+    AsyncSink *async = AsyncSink_;
+    // Large bodies get split as a message must not exceed a fraction of the
+    // queue.
+    const size_t chunkMax = ring_maxMsgLen(async->ring) - sizeof(AsyncMsg);
+    while( buf_len > 0 ){
+        const size_t chunk_len = buf_len < chunkMax ? buf_len : chunkMax;
+        AsyncMsg *msg = AsyncSink_reserve(async, chunk_len);
+        if( msg == NULL ){
+            return -1; }
+        msg->type = ASYNC_MSG_DATA;
+        msg->size = chunk_len;
+        memcpy(msg->data, buf, chunk_len);
+        AsyncSink_commit(async);
+        buf += chunk_len;
+        buf_len -= chunk_len;
+    }
+    return 0;
+}
+
+
+static ssize_t AsyncSink_onEntryEnd( void*AsyncSink_ ){
+    AsyncSink *async = AsyncSink_;
+    AsyncMsg *msg = AsyncSink_reserve(async, 0);
+    if( msg == NULL ){
+        return -1; }
+    msg->type = ASYNC_MSG_END;
+    AsyncSink_commit(async);
+    return 0;
+}
+
+
+/** Flushes the queue and waits for the writer to close the wrapped sink. */
+static ssize_t AsyncSink_onClose( void*AsyncSink_ ){
+    AsyncSink *async = AsyncSink_;
+    AsyncMsg *msg = AsyncSink_reserve(async, 0);
+    if( msg != NULL ){
+        msg->type = ASYNC_MSG_CLOSE;
+        AsyncSink_commit(async);
+    }
+    pthread_join(async->thread, NULL);
+    async->isThreadRunning = 0;
+    return async->isFailed ? -1 : 0;
+}
+
+
+/** Writer thread. Feeds queued messages to the wrapped sink until it got
+ * closed, failed or got told to stop. */
+static void* AsyncSink_writer( void*AsyncSink_ ){
+    AsyncSink *async = AsyncSink_;
+    GateleenResclone_Sink *inner = async->inner;
+    ssize_t err = 0;
+    for(;;){
+        size_t msg_len;
+        uint_t spins = 0;
+        AsyncMsg *msg;
+        while( (msg = ring_peek(async->ring, &msg_len)) == NULL ){
+            if( __atomic_load_n(&async->isStop, __ATOMIC_ACQUIRE) ){
+                goto endFn; }
+            if( spins < ASYNC_SPINS ){
+                spins += 1;
+                sched_yield();
+                continue;
+            }
+            // Idle. Transfers are network bound, so this is the usual case.
+            pthread_mutex_lock(&async->mutex);
+            __atomic_exchange_n(&async->isWriterParked, 1, __ATOMIC_ACQ_REL);
+            while( ! __atomic_load_n(&async->isStop, __ATOMIC_ACQUIRE)
+                && ring_peek(async->ring, &msg_len) == NULL )
+            {
+                pthread_cond_wait(&async->notEmpty, &async->mutex);
+            }
+            __atomic_store_n(&async->isWriterParked, 0, __ATOMIC_RELAXED);
+            pthread_mutex_unlock(&async->mutex);
+        }
+        switch( msg->type ){
+        case ASYNC_MSG_BEGIN:;
+            const char *contentType = msg->data + strlen(msg->data) +1;
+            const char *hdr = contentType + strlen(contentType) +1;
+            for( uint_t i=0 ; i<msg->headers_len ; ++i ){
+                async->headers[i] = hdr;
+                hdr += strlen(hdr) +1;
+            }
+            const GateleenResclone_Entry entry = {
+                .path = msg->data,
+                .size = msg->size,
+                .contentType = msg->hasContentType ? contentType : NULL,
+                .headers = async->headers,
+                .headers_len = msg->headers_len,
+            };
+            err = inner->onEntryBegin(inner->cls, &entry);
+            break;
+        case ASYNC_MSG_DATA:
+            err = inner->onEntryData(inner->cls, msg->data, msg->size);
+            break;
+        case ASYNC_MSG_END:
+            err = inner->onEntryEnd(inner->cls);
+            break;
+        case ASYNC_MSG_CLOSE:
+            err = inner->onClose ? inner->onClose(inner->cls) : 0;
+            ring_release(async->ring);
+            goto endFn;
+        }
+        ring_release(async->ring);
+        AsyncSink_wake(async, &async->isProducerParked, &async->notFull);
+        if( err ){
+            goto endFn; }
+    }
+endFn:
+    if( err ){
+        __atomic_store_n(&async->isFailed, 1, __ATOMIC_RELEASE);
+        // Producer may wait for room we never make.
+        pthread_mutex_lock(&async->mutex);
+        pthread_cond_signal(&async->notFull);
+        pthread_mutex_unlock(&async->mutex);
+    }
+    return NULL;
+}
+
+
+/** Starts a writer thread in front of 'inner'. 'iface' then is to be used
+ * in place of 'inner'. */
+static ssize_t AsyncSink_start( AsyncSink*async, GateleenResclone_Sink*inner, size_t queueSize,
+    GateleenResclone_Stats*stats, MemBudget*budget, GateleenResclone_Sink*iface )
+{
+    async->inner = inner;
+    async->stats = stats;
+    async->budget = budget;
+    pthread_mutex_init(&async->mutex, NULL);
+    pthread_cond_init(&async->notEmpty, NULL);
+    pthread_cond_init(&async->notFull, NULL);
+    async->isLockInit = !0;
+    async->ring = ring_alloc(queueSize);
+    if( async->ring == NULL ){
+        log_write(LOG_LVL_ERROR, "%s", "Out of memory for write queue");
+        return -1;
+    }
+    memBudget_charge(budget, ring_cap(async->ring));
+    if( pthread_create(&async->thread, NULL, AsyncSink_writer, async) ){
+        log_write(LOG_LVL_ERROR, "%s%s", "pthread_create(): ", strerror(errno));
+        return -1;
+    }
+    async->isThreadRunning = !0;
+    iface->cls = async;
+    iface->onEntryBegin = AsyncSink_onEntryBegin;
+    iface->onEntryData = AsyncSink_onEntryData;
+    iface->onEntryEnd = AsyncSink_onEntryEnd;
+    iface->onClose = AsyncSink_onClose;
+    return 0;
+}
+
+
+/** Stops the writer (dropping whatever is still queued) and frees the
+ * queue. */
+static void AsyncSink_cleanup( AsyncSink*async ){
+    if( async->isThreadRunning ){
+        __atomic_store_n(&async->isStop, 1, __ATOMIC_RELEASE);
+        pthread_mutex_lock(&async->mutex);
+        pthread_cond_signal(&async->notEmpty);
+        pthread_mutex_unlock(&async->mutex);
+        pthread_join(async->thread, NULL);
+        async->isThreadRunning = 0;
+    }
+    if( async->isLockInit ){
+        pthread_cond_destroy(&async->notFull);
+        pthread_cond_destroy(&async->notEmpty);
+        pthread_mutex_destroy(&async->mutex);
+        async->isLockInit = 0;
+    }
+    if( async->ring ){
+        memBudget_release(async->budget, ring_cap(async->ring));
+        ring_free(async->ring); async->ring = NULL;
+    }
+}
+
+
+/** Passes the collected resource on to the sink. */
+static ssize_t copyBufToArchive( ResourceFile*resourceFile ){
+    ssize_t err;
+    ClsDload *dload = resourceFile->dload;
+    GateleenResclone_Sink *sink = dload->sink;
+    const GateleenResclone_Entry entry = {
+        .path = resourceFile->url + strlen(dload->rootUrl),
+        .size = resourceFile->spool ? resourceFile->spool_len : resourceFile->buf_len,
+        .contentType = resourceFile->contentType,
+        .headers = resourceFile->headers.list,
+        .headers_len = resourceFile->headers.list_len,
+    };
+
+    err = sink->onEntryBegin(sink->cls, &entry);
+    if( err ){ err = -1; goto endFn; }
+
+    if( resourceFile->spool ){
+        char chunk[1<<14];
+        rewind(resourceFile->spool);
+        for( size_t chunk_len ; (chunk_len=fread(chunk, 1, sizeof chunk, resourceFile->spool)) > 0 ;){
+            err = sink->onEntryData(sink->cls, chunk, chunk_len);
+            if( err ){ err = -1; goto endFn; }
+        }
+        if( ferror(resourceFile->spool) ){
+            log_write(LOG_LVL_ERROR, "%s%s", "fread(spool): ", strerror(errno));
+            err = -1; goto endFn;
+        }
+    }else if( resourceFile->buf_len > 0 ){
+        err = sink->onEntryData(sink->cls, resourceFile->buf, resourceFile->buf_len);
+        if( err ){ err = -1; goto endFn; }
+    }
+
+    err = sink->onEntryEnd(sink->cls);
+    if( err ){ err = -1; goto endFn; }
+    dload->resclone->stats.entries += 1;
+    dload->resclone->stats.bytes += entry.size;
+    logProgress("Pull", &dload->resclone->stats, &dload->progress, 0);
+    resetResourceFile(resourceFile);
+
+    err = 0;
+endFn:
+    return err;
+}
+
+
+/** @return 0:Reject, 1:Accept, <0:ERROR */
+static ssize_t pathFilterAcceptsEntry( ClsDload*dload, ResourceDir*resourceDir, char*name ){
+    ssize_t err;
+    uint_t name_len = strlen(name);
+
+    if( dload->resclone->filter ){
+        // Count of parents tells which regex to apply.
+        uint_t idx = resourceDir->depth;
+        // Check if we even have such a long filter at all.
+        if( idx >= dload->resclone->filter_len ){
+            if( dload->resclone->isFilterFull ){
+                //fprintf(stderr, "%s\n", "[DEBUG] Path longer than --filter-full -> reject.");
+                err = 0; goto endFn;
+            }else{
+                //fprintf(stderr, "%s\n", "[DEBUG] Path longer than --filter-part -> accept.");
+                err = 1; goto endFn;
+            }
+        }
+        // We have a regex. Setup the check (in place, name gets restored below).
+        int restoreEndSlash = 0;
+        if( name[name_len-1] == '/' ){
+            restoreEndSlash = !0;
+            name[name_len-1] = '\0';
+        }
+        //fprintf(stderr, "%s%u%s%s%s\n", "[DEBUG] idx=", idx," name='", name, "'");
+        regex_t *filterArr = dload->resclone->filter;
+        regex_t *r = filterArr + idx;
+        err = regexec(r, name, 0, 0, 0);
+        if( !err ){
+            //fprintf(stderr, "%s\n", "[DEBUG] Segment accepted by filter.");
+            err = 1; /* fall to restoreEndSlash */
+        }else if( err == REG_NOMATCH ){
+            //fprintf(stderr, "%s\n", "[DEBUG] Segment rejected by filter.");
+            err = 0; /* fall to restoreEndSlash */
+        }else{
+            log_write(LOG_LVL_ERROR, "%s%.*s%s"FMT_SIZE_T, "regexec(rgx, '", (int)name_len, name,
+                "') -> ", err);
+            err = -1; /* fall to restoreEndSlash */
+        }
+        if( restoreEndSlash ){
+            name[name_len-1] = '/';
+        }
+        goto endFn;
+    }
+
+    err = 1; /* accept by default */
+endFn:
+    return err;
+}
+
+
+/** @return 0:Belongs to another shard, 1:Belongs to ours. */
+static int shardAcceptsEntry( ClsDload*dload, ResourceDir*resourceDir, const char*name, size_t name_len ){
+    Resclone *resclone = dload->resclone;
+    const int isDir = name[name_len-1] == '/';
+    if( resclone->shardCount <= 1 ){
+        return 1; }
+    if( resourceDir->depth >= resclone->shardDepth ){
+        return 1; } /* One of our parents decided already. */
+    if( isDir && resourceDir->depth +1 < resclone->shardDepth ){
+        return 1; } /* Key not complete yet. Decide further down. */
+    // Key is the relative path up to (and including) this segment. Entries
+    // above 'shardDepth' use their whole path.
+    uint64_t hash = hash_fnv1a64(HASH_FNV1A64_INIT, resourceDir->url + dload->rootUrl_len,
+        resourceDir->url_len - dload->rootUrl_len);
+    hash = hash_fnv1a64(hash, name, isDir ? name_len -1 : name_len);
+    return (hash % resclone->shardCount) == resclone->shardIdx;
+}
+
+
+/** @return Pseudo random but stable (for a seed) key of an entry. Sampling
+ *      keeps the entries with the lowest keys. */
+static uint64_t sampleKey( ClsDload*dload, ResourceDir*resourceDir, const char*name ){
+    const uint_t seed = dload->resclone->sampleSeed;
+    uint64_t key = hash_fnv1a64(HASH_FNV1A64_INIT, &seed, sizeof seed);
+    key = hash_fnv1a64(key, resourceDir->url + dload->rootUrl_len, resourceDir->url_len - dload->rootUrl_len);
+    key = hash_fnv1a64(key, name, strlen(name));
+    // FNV leaves similar names with similar high bits. Mix them (splitmix64
+    // finalizer), so ratios and rankings are fair.
+    key = (key ^ (key >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    key = (key ^ (key >> 27)) * 0x94d049bb133111ebULL;
+    return key ^ (key >> 31);
+}
+
+
+/** @return Non-zero if 'sampleRatio' leaves out resource 'name'. */
+static int isSampledOut( ClsDload*dload, ResourceDir*resourceDir, const char*name ){
+    // Top 53 bits as a fraction in [0,1).
+    return dload->resclone->sampleRatio
+        && (sampleKey(dload, resourceDir, name) >> 11) / 9007199254740992.0 >= dload->resclone->sampleRatio;
+}
+
+
+static int isBudgetSpent( ClsDload*dload ){
+    const Resclone *resclone = dload->resclone;
+    if( dload->isBudgetSpent ){
+        return !0; }
+    if(    (resclone->maxEntries && resclone->stats.entries >= resclone->maxEntries)
+        || (resclone->maxBytes && resclone->stats.bytes >= resclone->maxBytes) )
+    {
+        log_write(LOG_LVL_INFO, "%s", "Budget reached. Stop traversal.");
+        dload->isBudgetSpent = !0;
+    }else if( resclone->deadlineAt && monotonicMs() >= resclone->deadlineAt ){
+        log_write(LOG_LVL_WARN, "%s", "Deadline reached. Stop traversal.");
+        dload->isBudgetSpent = !0;
+        dload->isDeadlineHit = !0;
+    }
+    return dload->isBudgetSpent;
+}
+
+
+/** Records that the traversal stopped before it pulled 'dir' + 'name'
+ * (relative to the root, collections with trailing slash). Plain budgets
+ * only get listed if asked to (see 'missingFile').
+ * @return 0 on success, negative if the list could not be written. */
+static ssize_t noteMissing( ClsDload*dload, const char*dir, size_t dir_len, const char*name ){
+    GateleenResclone_Stats *stats = &dload->resclone->stats;
+    if( dload->missing == NULL && ! dload->isDeadlineHit ){
+        return 0; }
+    stats->missing += 1;
+    if( dir_len == 0 && name[0] == '\0' ){
+        name = "/"; } /* <- The root itself. */
+    if( dload->missing ){
+        if( fprintf(dload->missing, "%.*s%s\n", (int)dir_len, dir, name) < 0 ){
+            log_write(LOG_LVL_ERROR, "%s%s%s%s", "Failed to write '", dload->resclone->missingFile, "': ",
+                strerror(errno));
+            return -1;
+        }
+        return 0;
+    }
+    if( stats->missing <= MISSING_LOG_MAX ){
+        log_write(LOG_LVL_WARN, "%s%.*s%s%s", "Missing '", (int)dir_len, dir, name, "'"); }
+    return 0;
+}
+
+
+static int cmpJsonStrings( const void*a_, const void*b_ ){
+    const cJSON *a = *(const cJSON**)a_, *b = *(const cJSON**)b_;
+    return strcmp(a->valuestring, b->valuestring);
+}
+
+
+static int cmpJsonKeys( const void*a_, const void*b_ ){
+    const cJSON *a = *(const cJSON**)a_, *b = *(const cJSON**)b_;
+    return strcmp(a->string, b->string);
+}
+
+
+static int cmpU64( const void*a_, const void*b_ ){
+    const uint64_t a = *(const uint64_t*)a_, b = *(const uint64_t*)b_;
+    return a < b ? -1 : a > b;
+}
+
+
+static int cmpSchedKeys( const void*a_, const void*b_ ){
+    const SchedKey *a = a_, *b = b_;
+    if( a->rank != b->rank ){
+        return a->rank < b->rank ? -1 : 1; }
+    if( a->size != b->size ){
+        return a->size > b->size ? -1 : 1; }
+    return a->idx < b->idx ? -1 : a->idx > b->idx;
+}
+
+
+/** Where relative 'path' lies relative to 'priority' pattern 'idx'.
+ * @return 0:Off it, 1:Above what it matches, 2:At or below what it matches. */
+static int priorityRelation( const Resclone*resclone, uint_t idx, char*path ){
+    const char *pat = resclone->priority[idx];
+    for( char *seg = path ;; ){
+        if( *pat == '\0' ){
+            return 2; }
+        if( *seg == '\0' ){
+            return 1; }
+        char *end = strchr(seg, '/');
+        if( end ){ *end = '\0'; }
+        const int isMatch = fnmatch(pat, seg, 0) == 0;
+        if( end ){ *end = '/'; }
+        if( ! isMatch ){
+            return 0; }
+        pat += strlen(pat) +1;
+        seg = end ? end +1 : seg + strlen(seg);
+    }
+}
+
+
+/** @return Index of the first 'priority' pattern matching relative 'path'
+ *      (or one of its parents). 'priority_len' if none. */
+static uint_t priorityRank( const Resclone*resclone, char*path ){
+    for( uint_t i=0 ; i<resclone->priority_len ; ++i ){
+        if( priorityRelation(resclone, i, path) == 2 ){
+            return i; }
+    }
+    return resclone->priority_len;
+}
+
+
+/** Keeps those of 'entries' (in path order) the current 'pass' is about.
+ * With 'isLargestFirst', moves the resources of known size (in the cache)
+ * to the front, largest first. */
+static ssize_t scheduleEntries( ClsDload*dload, ResourceDir*resourceDir, cJSON**entries, uint_t*entries_len,
+    int isExpanded )
+{
+    const Resclone *resclone = dload->resclone;
+    // Embedded bodies need no transfer. So there is nothing to gain by size.
+    const int isBySize = resclone->isLargestFirst && dload->cache && ! isExpanded;
+    size_t name_max = 0;
+    for( uint_t i=0 ; i<*entries_len ; ++i ){
+        const size_t name_len = strlen(isExpanded ? entries[i]->string : entries[i]->valuestring);
+        if( name_len > name_max ){ name_max = name_len; }
+    }
+    SchedKey *keys = arena_malloc(dload->arena, (*entries_len ? *entries_len : 1) * sizeof*keys);
+    char *url = arena_malloc(dload->arena, resourceDir->url_len + name_max +1);
+    if( keys == NULL || url == NULL ){
+        return -ENOMEM; }
+    memcpy(url, resourceDir->url, resourceDir->url_len);
+    uint_t kept = 0;
+    for( uint_t i=0 ; i<*entries_len ; ++i ){
+        const char *name = isExpanded ? entries[i]->string : entries[i]->valuestring;
+        const size_t name_len = strlen(name);
+        const int isDir = name[name_len-1] == '/';
+        char *path = url + dload->rootUrl_len;
+        memcpy(url + resourceDir->url_len, name, name_len +1);
+        if( resclone->priority_len ){
+            // A pass takes its own subtree (unless an earlier one took it
+            // already) and the collections leading there. The last pass takes
+            // what no pattern matches.
+            const uint_t rank = priorityRank(resclone, path);
+            const int isInPass = dload->pass < resclone->priority_len
+                ? rank == dload->pass || (rank > dload->pass && isDir
+                    && priorityRelation(resclone, dload->pass, path) == 1)
+                : rank == resclone->priority_len;
+            if( ! isInPass ){
+                continue; }
+        }
+        CacheMeta cached;
+        keys[kept].rank = 0;
+        keys[kept].size = isBySize && ! isDir && cache_lookup(dload->cache, url, &cached) ? cached.size : 0;
+        keys[kept].idx = i;
+        keys[kept].item = entries[i];
+        kept += 1;
+    }
+    if( isBySize ){
+        qsort(keys, kept, sizeof*keys, cmpSchedKeys); }
+    for( uint_t i=0 ; i<kept ; ++i ){
+        entries[i] = (cJSON*)keys[i].item; }
+    *entries_len = kept;
+    return 0;
+}
+
+
+/** Hands back the listing buffer in case 'resourceDir' still borrows it. */
+static void returnDirBuf( ResourceDir*resourceDir ){
+    ClsDload *dload = resourceDir->dload;
+    if( resourceDir->rspBody == NULL ){
+        return; }
+    if( dload->dirBuf ){
+        // Sub directories got their own meanwhile (we still used ours). Keep
+        // the larger one only.
+        if( dload->dirBuf_cap >= resourceDir->rspBody_cap ){
+            memBudget_release(&dload->memBudget, resourceDir->rspBody_cap);
+            free(resourceDir->rspBody); resourceDir->rspBody = NULL;
+            resourceDir->rspBody_cap = 0; resourceDir->rspBody_len = 0;
+            return;
+        }
+        memBudget_release(&dload->memBudget, dload->dirBuf_cap);
+        free(dload->dirBuf);
+    }
+    dload->dirBuf = resourceDir->rspBody; resourceDir->rspBody = NULL;
+    dload->dirBuf_cap = resourceDir->rspBody_cap; resourceDir->rspBody_cap = 0;
+    resourceDir->rspBody_len = 0;
+}
+
+
+/** Logs that server did not expand 'url' as asked. Stops trying to expand at
+ * all if it looks like the server does not know about expand. */
+static void onExpandRejected( ClsDload*dload, const char*url, const char*reason ){
+    log_write(LOG_LVL_WARN, "%s%s%s%s%s", "Cannot expand '", url, "' (", reason,
+        "). Fetch its entries one by one.");
+    dload->expandRejects += 1;
+    if( dload->expandAccepts == 0 && dload->expandRejects >= EXPAND_REJECTS_MAX && !dload->isExpandOff ){
+        log_write(LOG_LVL_WARN, "%s", "Server seems not to support expand. Stop trying.");
+        dload->isExpandOff = !0;
+    }
+}
+
+
+/** Sets 'resourceFile->url' to the resource 'name' in collection 'dirUrl'. */
+static ssize_t setResourceUrl( ResourceFile*resourceFile, const char*dirUrl, size_t dirUrl_len, const char*name ){
+    ClsDload *dload = resourceFile->dload;
+    const size_t name_len = strlen(name);
+    if( memBudget_growBuf(&dload->memBudget, 0, &resourceFile->url, &resourceFile->url_cap, dirUrl_len + name_len +1) ){
+        return -ENOMEM; }
+    memcpy(resourceFile->url, dirUrl, dirUrl_len);
+    memcpy(resourceFile->url + dirUrl_len, name, name_len +1);
+    return 0;
+}
+
+
+/** @return Non-zero if serializing 'value' again keeps all its values.
+ *      cJSON holds numbers as double. Integers beyond 2^53 would get
+ *      rounded. */
+static int isExactJson( const cJSON*value ){
+    if( cJSON_IsNumber(value) ){
+        return value->valuedouble < 9007199254740992.0 && value->valuedouble > -9007199254740992.0; }
+    for( const cJSON *it = value->child ; it ; it = it->next ){
+        if( ! isExactJson(it) ){
+            return 0; }
+    }
+    return !0;
+}
+
+
+/** Passes a resource we got embedded in an expanded collection on to the
+ * sink. Its body gets serialized again from the parsed tree. So it ends up
+ * as compact JSON with content type 'application/json' and without any
+ * other header. Callers check 'isExactJson' first. */
+static ssize_t copyExpandedToArchive( ResourceFile*resourceFile, const cJSON*value ){
+    ssize_t err;
+    ClsDload *dload = resourceFile->dload;
+    char *json = NULL;
+
+    resetResourceFile(resourceFile);
+    json = cJSON_PrintUnformatted(value);
+    if( json == NULL ){
+        err = -ENOMEM; goto endFn; }
+    const size_t json_len = strlen(json);
+    if( memBudget_growBuf(&dload->memBudget, 0, &resourceFile->buf, &resourceFile->buf_cap, json_len +1) ){
+        err = -ENOMEM; goto endFn; }
+    memcpy(resourceFile->buf, json, json_len +1);
+    resourceFile->buf_len = json_len;
+    resourceFile->contentType = "application/json";
+
+    err = copyBufToArchive(resourceFile);
+endFn:
+    free(json);
+    return err;
+}
+
+
+/** Stores the collected resource in the cache. Failures only get logged. */
+static void cacheResource( ClsDload*dload, ResourceFile*resourceFile ){
+    curl_off_t lastModified = -1;
+    curl_easy_getinfo(dload->curl, CURLINFO_FILETIME_T, &lastModified);
+    const CacheMeta meta = {
+        .etag = resourceFile->etag[0] ? resourceFile->etag : NULL,
+        .lastModified = lastModified > 0 ? lastModified : 0,
+        .contentType = resourceFile->contentType,
+        .headers = resourceFile->headers.list,
+        .headers_len = resourceFile->headers.list_len,
+        .size = resourceFile->spool ? resourceFile->spool_len : resourceFile->buf_len,
+    };
+    const ssize_t err = cache_put(dload->cache, resourceFile->url, &meta, resourceFile->buf, resourceFile->spool);
+    if( err == -ENOBUFS ){
+        log_write(LOG_LVL_DEBUG, "%s%s%s", "Not cached '", resourceFile->url, "'. Too many headers.");
+    }else if( err ){
+        log_write(LOG_LVL_WARN, "%s%s%s%s", "Failed to cache '", resourceFile->url, "': ", strerror(-err));
+    }
+}
+
+
+/** Fetches the resource at 'resourceFile->url' and passes it on to the
+ * sink. Fetches conditionally where the replication state or the cache
+ * knows a version of it.
+ * @return 0 on success or if only this resource failed (counted). Negative
+ *      values abort the pull. */
+static ssize_t downloadResource( ClsDload*dload, ResourceFile*resourceFile ){
+    ssize_t err;
+    GateleenResclone_Stats *stats = &dload->resclone->stats;
+    CacheMeta cached;
+    int isCached = 0, isReplicated = 0;
+
+    log_write(LOG_LVL_DEBUG, "%s%s%s", "Download '", resourceFile->url, "'");
+    resetResourceFile(resourceFile); // <- Reset before use.
+    if( dload->replica ){
+        if( replica_see(dload->replica, resourceFile->url + dload->rootUrl_len, &resourceFile->ifNoneMatch) ){
+            return -ENOMEM; }
+        isReplicated = !0;
+    }else if( dload->cache ){
+        isCached = cache_lookup(dload->cache, resourceFile->url, &cached);
+        if( isCached ){
+            resourceFile->ifNoneMatch = cached.etag;
+            resourceFile->ifModifiedSince = cached.lastModified;
+        }
+    }
+    err = collectResourceIntoMemory(resourceFile, resourceFile->url);
+    resourceFile->ifNoneMatch = NULL;
+    resourceFile->ifModifiedSince = 0;
+    if( err ){
+        if( isBudgetSpent(dload) && dload->isDeadlineHit ){ /* <- Got cut. */
+            return noteMissing(dload, resourceFile->url + dload->rootUrl_len,
+                strlen(resourceFile->url + dload->rootUrl_len), ""); }
+        stats->failed += 1; /* Already logged. Go on with the others. */
+        return 0;
+    }
+    if( isCached && resourceFile->rspCode == 304 ){
+        resourceFile->spool = cache_openBody(dload->cache, resourceFile->url);
+        if( resourceFile->spool == NULL ){
+            log_write(LOG_LVL_WARN, "%s%s%s", "Cached body of '", resourceFile->url, "' is gone. Fetch it again.");
+            cache_forget(dload->cache, resourceFile->url);
+            return downloadResource(dload, resourceFile);
+        }
+        resourceFile->spool_len = cached.size;
+        resourceFile->contentType = cached.contentType;
+        entryHeaders_copy(&resourceFile->headers, cached.headers, cached.headers_len);
+        stats->cached += 1;
+        return copyBufToArchive(resourceFile);
+    }
+    if( isReplicated && resourceFile->rspCode == 304 ){
+        stats->unchanged += 1;
+        return 0;
+    }
+    if( isReplicated && resourceFile->rspCode != 200 ){
+        log_write(LOG_LVL_WARN, "%s%ld%s%s%s", "Got RspCode ", resourceFile->rspCode,
+            " for 'GET ", resourceFile->url, "'");
+        stats->failed += 1;
+        return 0;
+    }
+    // Assume the copy succeeds. The replica sink forgets it otherwise.
+    if( isReplicated && replica_setEtag(dload->replica, resourceFile->url + dload->rootUrl_len, resourceFile->etag) ){
+        return -ENOMEM; }
+    if( dload->cache && resourceFile->rspCode == 200 ){
+        cacheResource(dload, resourceFile); }
+    return copyBufToArchive(resourceFile);
+}
+
+
+static ssize_t gateleenResclone_download( ClsDload*dload , ResourceDir*parentResourceDir , char*entryName , cJSON*expanded );
+
+
+/** Splits a zipped expand response of 'resourceDir' into entries. */
+static ssize_t processExpandZip( ClsDload*dload, ResourceDir*resourceDir ){
+    ssize_t err;
+    ResourceFile *resourceFile = &dload->resourceFile;
+    struct archive *zip = NULL;
+    char buf[1<<14];
+
+    zip = archive_read_new();
+    if( zip == NULL ){
+        err = -ENOMEM; goto endFn; }
+    if(    archive_read_support_format_zip(zip)
+        || archive_read_open_memory(zip, resourceDir->rspBody, resourceDir->rspBody_len) )
+    {
+        log_write(LOG_LVL_ERROR, "%s%s%s%s", "Cannot read zip of '", resourceDir->url, "': ",
+            archive_error_string(zip));
+        err = -1; goto endFn;
+    }
+    for( struct archive_entry *entry ;; ){
+        err = archive_read_next_header(zip, &entry);
+        if( err == ARCHIVE_EOF ){
+            break; }
+        if( err != ARCHIVE_OK ){
+            log_write(LOG_LVL_ERROR, "%s%s%s%s", "Cannot read zip of '", resourceDir->url, "': ",
+                archive_error_string(zip));
+            err = -1; goto endFn;
+        }
+        const char *path = archive_entry_pathname(entry);
+        if( archive_entry_filetype(entry) == AE_IFDIR ){
+            // Collections as deep as the expansion only got listed but not
+            // expanded. So go fetch them.
+            uint_t depth = 0;
+            for( const char *it=path ; (it=strchr(it, '/')) ; ++it ){ depth += 1; }
+            if( depth == dload->resclone->expandLevels ){
+                err = gateleenResclone_download(dload, resourceDir, (char*)path, NULL);
+                if( err ){
+                    goto endFn; }
+            }
+            continue;
+        }
+        err = setResourceUrl(resourceFile, resourceDir->url, resourceDir->url_len, path);
+        if( err ){
+            goto endFn; }
+        resetResourceFile(resourceFile);
+        for(;;){
+            ssize_t readLen = archive_read_data(zip, buf, sizeof buf);
+            if( readLen < 0 ){
+                log_write(LOG_LVL_ERROR, "%s%s%s%s", "Cannot read zip entry '", resourceFile->url, "': ",
+                    archive_error_string(zip));
+                err = -1; goto endFn;
+            }
+            if( readLen == 0 ){ break; }
+            if( onResourceChunk(buf, 1, readLen, resourceFile) != (size_t)readLen ){
+                err = -1; goto endFn; }
+        }
+        err = copyBufToArchive(resourceFile);
+        if( err ){
+            goto endFn; }
+    }
+
+    err = 0;
+endFn:
+    archive_read_free(zip);
+    return err;
+}
+
+
+/** Processes the entries of one (page of a) collection listing.
+ * @param data
+ *      Listing (array of names) or expanded collection (object).
+ */
+static ssize_t processEntries( ClsDload*dload, ResourceDir*resourceDir, cJSON*data ){
+    ssize_t err;
+    ResourceFile *resourceFile = &dload->resourceFile;
+    char *url = resourceDir->url;
+    const size_t url_len = resourceDir->url_len;
+
+    // An expanded collection is an object. Its keys are the names, values are
+    // the content. Otherwise it is the plain listing of names.
+    const int isExpanded = cJSON_IsObject(data);
+
+    // Process entries in path order. This makes archives deterministic, so
+    // they can be merged and compared.
+    uint_t entries_len = cJSON_GetArraySize(data);
+    cJSON **entries = arena_malloc(dload->arena, (entries_len ? entries_len : 1) * sizeof*entries);
+    if( entries == NULL ){
+        return -ENOMEM; }
+    uint_t iDirEntry = 0;
+    for( cJSON *arrEntry=data->child ; arrEntry!=NULL ; arrEntry=arrEntry->next ){
+        if( isExpanded ? arrEntry->string[0] == '\0'
+            : (! cJSON_IsString(arrEntry) || arrEntry->valuestring[0] == '\0') )
+        {
+            log_write(LOG_LVL_ERROR, "%s%s%u%s", data->string, "['", iDirEntry,
+                "'] expected to be a string. But is not." );
+            return -1;
+        }
+        entries[iDirEntry++] = arrEntry;
+    }
+    qsort(entries, entries_len, sizeof*entries, isExpanded ? cmpJsonKeys : cmpJsonStrings);
+
+    // Drop what filter and shard reject first. So a sample gets picked among
+    // the remaining ones.
+    uint_t kept = 0;
+    for( iDirEntry=0 ; iDirEntry < entries_len ; ++iDirEntry ){
+        //fprintf(stderr, "%s%s%s%u%s%s\n", "[DEBUG] ", data->string, "[", iDirEntry, "] -> ", entries[iDirEntry]->valuestring);
+        char *name = isExpanded ? entries[iDirEntry]->string : entries[iDirEntry]->valuestring;
+
+        err = pathFilterAcceptsEntry(dload, resourceDir, name);
+        if( err < 0 ){ /* ERROR */
+            return err;
+        }else if( err == 0 ){ /* REJECT */
+            log_write(LOG_LVL_DEBUG, "%s%s%s%s", "Skip     '", url, name, "'  (filtered)");
+            continue;
+        }else{ /* ACCEPT */
+            /* Go ahead */
+        }
+        if( ! shardAcceptsEntry(dload, resourceDir, name, strlen(name)) ){
+            continue; } /* Another shard cares about it. */
+        entries[kept++] = entries[iDirEntry];
+    }
+    entries_len = kept;
+
+    // Keep the entries with the lowest sample keys. Path order stays.
+    const size_t samplePerCollection = dload->resclone->samplePerCollection;
+    if( samplePerCollection && entries_len > samplePerCollection ){
+        uint64_t *keys = arena_malloc(dload->arena, 2 * entries_len * sizeof*keys);
+        if( keys == NULL ){
+            return -ENOMEM; }
+        uint64_t *sorted = keys + entries_len;
+        for( iDirEntry=0 ; iDirEntry < entries_len ; ++iDirEntry ){
+            keys[iDirEntry] = sampleKey(dload, resourceDir,
+                isExpanded ? entries[iDirEntry]->string : entries[iDirEntry]->valuestring);
+        }
+        memcpy(sorted, keys, entries_len * sizeof*keys);
+        qsort(sorted, entries_len, sizeof*sorted, cmpU64);
+        const uint64_t threshold = sorted[samplePerCollection -1];
+        kept = 0;
+        for( iDirEntry=0 ; iDirEntry < entries_len && kept < samplePerCollection ; ++iDirEntry ){
+            if( keys[iDirEntry] <= threshold ){
+                entries[kept++] = entries[iDirEntry]; }
+        }
+        entries_len = kept;
+    }
+
+    if( dload->resclone->priority_len || (dload->resclone->isLargestFirst && dload->cache) ){
+        err = scheduleEntries(dload, resourceDir, entries, &entries_len, isExpanded);
+        if( err ){
+            return err; }
+    }
+
+    // Iterate all the entries we have to process.
+    for( iDirEntry=0 ; iDirEntry < entries_len ; ++iDirEntry ){
+        char *name = isExpanded ? entries[iDirEntry]->string : entries[iDirEntry]->valuestring;
+        int name_len = strlen(name);
+        const int isTooDeep = name[name_len-1] == '/'
+            && dload->resclone->maxDepth && resourceDir->depth +1 >= dload->resclone->maxDepth;
+
+        if( isBudgetSpent(dload) ){
+            // Tell what we would have pulled.
+            if( isTooDeep || (name[name_len-1] != '/' && isSampledOut(dload, resourceDir, name)) ){
+                continue; }
+            err = noteMissing(dload, url + dload->rootUrl_len, url_len - dload->rootUrl_len, name);
+            if( err ){
+                return err; }
+            continue;
+        }
+
+        if( name[name_len-1] == '/' ){ /* Gateleen reports a 'directory' */
+            if( isTooDeep ){
+                log_write(LOG_LVL_DEBUG, "%s%s%s%s", "Skip     '", url, name, "'  (too deep)");
+                continue;
+            }
+            //fprintf(stderr, "%s%s%s%s\n", "[DEBUG] Scan     '", url, name,"'");
+            cJSON *childData = NULL;
+            if( isExpanded ){
+                childData = entries[iDirEntry];
+                if( ! cJSON_IsObject(childData) && ! cJSON_IsArray(childData) ){
+                    childData = NULL; } /* Ask server about it then. */
+            }
+            err = gateleenResclone_download(dload, resourceDir, name, childData);
+            if( err ){
+                return err; }
+        }else{ /* Not a 'dir'? Then assume 'file' */
+            if( isSampledOut(dload, resourceDir, name) ){
+                continue; }
+            err = setResourceUrl(resourceFile, url, url_len, name);
+            if( err ){
+                return err; }
+            if( isExpanded && isExactJson(entries[iDirEntry]) ){
+                err = copyExpandedToArchive(resourceFile, entries[iDirEntry]);
+                if( err ){
+                    return err; }
+                continue;
+            }
+            if( dload->isListOnly ){
+                const GateleenResclone_Entry entry = { .path = resourceFile->url + dload->rootUrl_len };
+                if(    dload->sink->onEntryBegin(dload->sink->cls, &entry)
+                    || dload->sink->onEntryEnd(dload->sink->cls) )
+                {
+                    return -1; }
+                continue;
+            }
+            err = downloadResource(dload, resourceFile);
+            if( err ){
+                return err; }
+        }
+    }
+
+    return 0;
+}
+
+
+static size_t onPageChunk( char*buf, size_t size, size_t nmemb, void*Pager_ ){
+    Pager *pager = Pager_;
+    const size_t buf_len = size * nmemb;
+    // A page is bounded by the page size. So charge it unconditionally.
+    if( memBudget_growBuf(&pager->dload->memBudget, 0, &pager->buf, &pager->buf_cap,
+        pager->buf_len + buf_len +1) )
+    {
+        log_write(LOG_LVL_ERROR, "%s", "Out of memory for listing page.");
+        return 0;
+    }
+    memcpy(pager->buf + pager->buf_len, buf, buf_len);
+    pager->buf_len += buf_len;
+    pager->buf[pager->buf_len] = '\0';
+    return buf_len;
+}
+
+
+/** (Re)starts the fetch of 'pager->url'. */
+static ssize_t pagerSubmit( ClsDload*dload, Pager*pager ){
+    pager->buf_len = 0;
+    if( transferBegin(&pager->transfer, dload->resclone, pager->curl, pager->url, pager->tried) ){
+        return -1; }
+    if( curl_multi_add_handle(dload->multi, pager->curl) ){
+        transferEnd(&pager->transfer, NULL);
+        return -1;
+    }
+    pager->transfer.isRunning = !0;
+    return 0;
+}
+
+
+/** Starts fetching page at 'offset' of collection 'url' in background. */
+static Pager* pagerStart( ClsDload*dload, uint_t depth, const char*url, size_t offset ){
+    Pager *pager;
+    const size_t pageSize = dload->resclone->pageSize;
+    if( depth >= dload->pagers_len ){
+        Pager **tmp = realloc(dload->pagers, (depth +1) * sizeof*tmp);
+        if( tmp == NULL ){
+            return NULL; }
+        dload->pagers = tmp;
+        for( ; dload->pagers_len <= depth ; ++dload->pagers_len ){
+            dload->pagers[dload->pagers_len] = NULL; }
+    }
+    pager = dload->pagers[depth];
+    if( pager == NULL ){
+        pager = calloc(1, sizeof*pager);
+        if( pager == NULL ){
+            return NULL; }
+        dload->pagers[depth] = pager;
+        pager->dload = dload;
+        pager->curl = curl_easy_init();
+        if( pager->curl == NULL ){
+            return NULL; }
+        if(    curl_easy_setopt(pager->curl, CURLOPT_FOLLOWLOCATION, 0L)
+            || curl_easy_setopt(pager->curl, CURLOPT_WRITEFUNCTION, onPageChunk)
+            || curl_easy_setopt(pager->curl, CURLOPT_WRITEDATA, pager)
+            || curl_easy_setopt(pager->curl, CURLOPT_PRIVATE, &pager->transfer)
+            || (dload->resclone->share && curl_easy_setopt(pager->curl, CURLOPT_SHARE, dload->resclone->share)) )
+        {
+            assert(!"curl_easy_setopt"); return NULL; }
+    }
+    assert(!pager->transfer.isRunning);
+    if( memBudget_growBuf(NULL, 0, &pager->url, &pager->url_cap, strlen(url) + 64) ){
+        return NULL; }
+    sprintf(pager->url, "%s%s"FMT_SIZE_T"%s"FMT_SIZE_T, url, "?offset=", offset, "&limit=", pageSize);
+    pager->tried = 0;
+    pager->attempt = 0;
+    return pagerSubmit(dload, pager) ? NULL : pager;
+}
+
+
+/** Removes a page fetch we are no longer interested in. */
+static void pagerCancel( ClsDload*dload, Pager*pager ){
+    if( pager && pager->transfer.isRunning ){
+        curl_multi_remove_handle(dload->multi, pager->curl);
+        pager->transfer.isRunning = 0;
+        transferEnd(&pager->transfer, NULL);
+    }
+}
+
+
+/** Pages through the listing of 'resourceDir'. The next page already gets
+ * fetched while the entries of the current one get processed. */
+static ssize_t downloadPaged( ClsDload*dload, ResourceDir*resourceDir ){
+    ssize_t err;
+    const size_t pageSize = dload->resclone->pageSize;
+    Pager *pager = NULL;
+    size_t offset = 0;
+
+    pager = pagerStart(dload, resourceDir->depth, resourceDir->url, offset);
+    if( pager == NULL ){
+        log_write(LOG_LVL_ERROR, "%s", "Failed to setup listing fetch.");
+        err = -1; goto endFn;
+    }
+    for(;;){
+        err = pumpUntilDone(dload, &pager->transfer);
+        if( err ){
+            err = -1; goto endFn; }
+        if( isRetryElsewhere(dload->resclone, &pager->transfer, pager->curl, pager->attempt) ){
+            log_write(LOG_LVL_DEBUG, "%s%s%s", "Retry '", pager->url, "' on another endpoint");
+            if( pager->transfer.endpoint < 64 ){ pager->tried |= 1ULL << pager->transfer.endpoint; }
+            pager->attempt += 1;
+            if( pagerSubmit(dload, pager) ){
+                log_write(LOG_LVL_ERROR, "%s", "Failed to setup listing fetch.");
+                err = -1; goto endFn;
+            }
+            continue;
+        }
+        if( pager->transfer.result == CURLE_OPERATION_TIMEDOUT && isBudgetSpent(dload) && dload->isDeadlineHit ){
+            err = noteMissing(dload, resourceDir->url + dload->rootUrl_len,
+                resourceDir->url_len - dload->rootUrl_len, "");
+            goto endFn;
+        }
+        if( pager->transfer.result != CURLE_OK ){
+            log_write(LOG_LVL_ERROR, "%s%s%s%d%s%s", "'", pager->url, "' (code ", pager->transfer.result,
+                "): ", curl_easy_strerror(pager->transfer.result));
+            err = -1; goto endFn;
+        }
+        long rspCode;
+        curl_easy_getinfo(pager->curl, CURLINFO_RESPONSE_CODE, &rspCode);
+        if( rspCode != 200 ){
+            log_write(LOG_LVL_INFO, "%s%ld%s%s%s", "Skip HTTP ", rspCode, " -> '", pager->url, "'");
+            dload->resclone->stats.skippedListings += 1;
+            err = 0; goto endFn;
+        }
+
+        // What processing the page takes from the arena lives only until its
+        // entries are done.
+        const ArenaMark pageMark = arena_mark(dload->arena);
+        cJSON *jsonRoot = cJSON_Parse(pager->buf);
+        if( ! cJSON_IsObject(jsonRoot) || cJSON_GetArraySize(jsonRoot) != 1
+            || ! cJSON_IsArray(jsonRoot->child) )
+        {
+            log_write(LOG_LVL_ERROR, "%s%s%s", "'", pager->url, "' expected to be a listing. But is not.");
+            cJSON_Delete(jsonRoot);
+            err = -1; goto endFn;
+        }
+        cJSON *data = jsonRoot->child;
+        const int isLastPage = (size_t)cJSON_GetArraySize(data) < pageSize;
+        if( ! isLastPage ){
+            // Page got parsed already. So its buffer is free for the next one.
+            offset += pageSize;
+            if( pagerStart(dload, resourceDir->depth, resourceDir->url, offset) == NULL ){
+                log_write(LOG_LVL_ERROR, "%s", "Failed to setup listing fetch.");
+                cJSON_Delete(jsonRoot);
+                err = -1; goto endFn;
+            }
+        }
+        err = processEntries(dload, resourceDir, data);
+        arena_rewind(dload->arena, pageMark);
+        cJSON_Delete(jsonRoot);
+        if( err ){
+            goto endFn; }
+        if( isLastPage ){
+            break; }
+        if( dload->isBudgetSpent ){
+            // Entries of the pages not fetched are unknown. So list the
+            // collection itself.
+            err = noteMissing(dload, resourceDir->url + dload->rootUrl_len,
+                resourceDir->url_len - dload->rootUrl_len, "");
+            goto endFn;
+        }
+    }
+
+    err = 0;
+endFn:
+    pagerCancel(dload, pager);
+    return err;
+}
+
+
+/** Gets called for every resource to scan/download.
+ * HINT: Gets called recursively.
+ * @param expanded
+ *      (optional) Content of the collection if we got it already as part of
+ *      an expanded parent. Either a listing (array) or an expanded object.
+ */
+static ssize_t gateleenResclone_download( ClsDload*dload , ResourceDir*parentResourceDir , char*entryName , cJSON*expanded ){
+    ssize_t err;
+    cJSON *jsonRoot = NULL;
+    ResourceDir *resourceDir = NULL;
+    Resclone *resclone = dload->resclone;
+    const ArenaMark arenaMark = arena_mark(dload->arena);
+
+    // Stack-Alloc resourceDir-closure.
+    ResourceDir _1 = {0}; resourceDir = &_1;
+    resourceDir->dload = dload;
+    resourceDir->parentDir = parentResourceDir;
+    resourceDir->depth = parentResourceDir ? parentResourceDir->depth +1 : 0;
+
+    if( entryName == NULL ){
+        /* Is the case when its the root call and not a recursive one */
+        resourceDir->name = dload->rootUrl;
+        resourceDir->url = dload->rootUrl;
+        resourceDir->url_len = strlen(dload->rootUrl);
+    }else{
+        const size_t name_len = strlen(entryName);
+        resourceDir->name = strIntern_get(dload->dirNames, entryName, name_len);
+        if( resourceDir->name == NULL ){ /* Intern table full. Keep it for this dir only. */
+            resourceDir->name = arena_strndup(dload->arena, entryName, name_len);
+        }
+        // Our URL is our parents URL plus our name. So no need to walk up the
+        // whole chain again.
+        const size_t skip = strspn(entryName, "/");
+        resourceDir->url_len = parentResourceDir->url_len + name_len - skip;
+        resourceDir->url = arena_malloc(dload->arena, resourceDir->url_len +1);
+        if( resourceDir->name == NULL || resourceDir->url == NULL ){
+            err = -ENOMEM; goto endFn; }
+        memcpy(resourceDir->url, parentResourceDir->url, parentResourceDir->url_len);
+        memcpy(resourceDir->url + parentResourceDir->url_len, entryName + skip, name_len - skip +1);
+    }
+    char *url = resourceDir->url;
+    const size_t url_len = resourceDir->url_len;
+
+    if( resclone->pageSize && expanded == NULL ){
+        err = downloadPaged(dload, resourceDir);
+        goto endFn;
+    }
+
+    // Fetch the collection (unless our parent did already). Try it expanded
+    // first if asked to. Second round then is the plain listing.
+    cJSON *data = expanded;
+    for( int isExpand = resclone->expandLevels && !dload->isExpandOff ; data == NULL ; isExpand = 0 ){
+        char *reqUrl = url;
+        if( isExpand ){
+            reqUrl = arena_malloc(dload->arena, url_len + 48);
+            if( reqUrl == NULL ){
+                err = -ENOMEM; goto endFn; }
+            sprintf(reqUrl, "%s%s%u%s", url, "?expand=", resclone->expandLevels,
+                resclone->isExpandZip ? "&zip=true" : "");
+        }
+
+        // Configure client
+        {
+            //fprintf(stderr, "%s%s%s\n", "[DEBUG] URL '", reqUrl, "'");
+            err =  CURLE_OK != curl_easy_setopt(dload->curl, CURLOPT_FOLLOWLOCATION, 0L)
+                || CURLE_OK != curl_easy_setopt(dload->curl, CURLOPT_WRITEFUNCTION, onCurlDirRsp)
+                || CURLE_OK != curl_easy_setopt(dload->curl, CURLOPT_WRITEDATA, resourceDir)
+                ;
+            if( err ){
+                assert(!err); err = -1; goto endFn; }
+        }
+
+        // Borrow the listing buffer. We only need it until the listing is parsed.
+        resourceDir->rspBody = dload->dirBuf; dload->dirBuf = NULL;
+        resourceDir->rspBody_cap = dload->dirBuf_cap; dload->dirBuf_cap = 0;
+        Transfer transfer = {0};
+        uint64_t tried = 0;
+        for( uint_t attempt=0 ;; ++attempt ){
+            resourceDir->rspBody_len = 0;
+            resourceDir->rspCode = 0;
+            if( transferBegin(&transfer, resclone, dload->curl, reqUrl, tried) ){
+                err = -1; goto endFn; }
+            err = dloadPerform(dload, dload->curl, &transfer);
+            if( ! isRetryElsewhere(resclone, &transfer, dload->curl, attempt) ){
+                break; }
+            if( transfer.endpoint < 64 ){ tried |= 1ULL << transfer.endpoint; }
+            log_write(LOG_LVL_DEBUG, "%s%s%s", "Retry '", reqUrl, "' on another endpoint");
+        }
+        if( err == CURLE_OPERATION_TIMEDOUT && isBudgetSpent(dload) && dload->isDeadlineHit ){
+            err = noteMissing(dload, url + dload->rootUrl_len, url_len - dload->rootUrl_len, "");
+            goto endFn;
+        }
+        if( err != CURLE_OK ){
+            log_write(LOG_LVL_ERROR, "%s%s%s"FMT_SIZE_T"%s%s",
+                "'", reqUrl, "' (code ", err, "): ", curl_easy_strerror(err));
+            err = -1; goto endFn;
+        }
+
+        if( resourceDir->rspCode == ERR_PARSE_DIR_LIST ){
+            resclone->stats.skippedListings += 1;
+            err = 0; goto endFn; /* Already logged by sub-ctxt. Simply skip to next entry. */
+        }
+        if( isExpand && resourceDir->rspCode != 200 && resourceDir->rspCode != 404 ){
+            char reason[32];
+            sprintf(reason, "HTTP %d", resourceDir->rspCode);
+            onExpandRejected(dload, url, reason);
+            returnDirBuf(resourceDir);
+            continue;
+        }
+        if( resourceDir->rspCode != 200 ){
+            // Ugh? Just one request earlier, server said there's a directory on
+            // that URL. Nevermind. Just skip it and at least download the other
+            // stuff.
+            log_write(LOG_LVL_INFO, "%s%d%s%s%s", "Skip HTTP ", resourceDir->rspCode, " -> '", url, "'");
+            resclone->stats.skippedListings += 1;
+            err = 0; goto endFn;
+        }
+
+        if( isExpand && resclone->isExpandZip ){
+            // Zip is binary. So a JSON-looking body means server ignored zip.
+            if( resourceDir->rspBody_len >= 2 && !memcmp(resourceDir->rspBody, "PK", 2) ){
+                dload->expandAccepts += 1;
+                err = processExpandZip(dload, resourceDir);
+                goto endFn;
+            }
+        }
+
+        // Parse the collected response body. Lives until this directory is
+        // done, as expanded sub collections point into it.
+        jsonRoot = cJSON_Parse(resourceDir->rspBody);
+        // Hand back listing buffer so sub directories can reuse it.
+        returnDirBuf(resourceDir);
+        int isPayloadOk = cJSON_IsObject(jsonRoot) && cJSON_GetArraySize(jsonRoot) == 1
+            && (cJSON_IsArray(jsonRoot->child) || (isExpand && cJSON_IsObject(jsonRoot->child)));
+        if( isExpand && ! isPayloadOk ){
+            onExpandRejected(dload, url, "unexpected payload");
+            cJSON_Delete(jsonRoot); jsonRoot = NULL;
+            continue;
+        }
+        if( ! cJSON_IsObject(jsonRoot) ){ // TODO: Handle case
+            log_write(LOG_LVL_ERROR, "%s", "JSON root expected to be object but is not.");
+            err = -1; goto endFn;
+        }
+
+        /* Do some validations to get to the payload we're interested in. */
+        if( cJSON_GetArraySize(jsonRoot) != 1 ){
+            log_write(LOG_LVL_ERROR, "%s%d", "JSON root expected ONE child but got ",
+                cJSON_GetArraySize(jsonRoot));
+            err = -1; goto endFn;
+        }
+        data = jsonRoot->child;
+        //fprintf(stderr, "%s%s%s\n", "[DEBUG] Processing json['", data->string, "']");
+        if( ! isPayloadOk ){
+            log_write(LOG_LVL_ERROR, "%s%s%s", "json['", data->string,
+                "'] expected to be an array. But is not.");
+            err = -1; goto endFn;
+        }
+        if( isExpand && cJSON_IsObject(data) ){
+            dload->expandAccepts += 1; }
+    }
+
+    err = processEntries(dload, resourceDir, data);
+    if( err ){
+        goto endFn; }
+
+    err = 0; /* OK */
+endFn:
+    /* Still borrowed if we bailed out before parsing. */
+    returnDirBuf(resourceDir);
+    cJSON_Delete(jsonRoot);
+    // Releases url, name and alike all at once.
+    arena_rewind(dload->arena, arenaMark);
+    return err;
+}
+
+
+void gateleenResclone_free( GateleenResclone*resclone ){
+    if( resclone == NULL ) return;
+    free(resclone->url); resclone->url = NULL;
+    for( uint_t i=0 ; i<resclone->filter_len ; ++i ){
+        regfree(resclone->filter + i);
+    }
+    free(resclone->filter); resclone->filter = NULL;
+    for( uint_t i=0 ; i<resclone->priority_len ; ++i ){
+        free(resclone->priority[i]);
+    }
+    free(resclone->priority); resclone->priority = NULL;
+    free(resclone->missingFile); resclone->missingFile = NULL;
+    free(resclone->file); resclone->file = NULL;
+    free(resclone->replicaUrl); resclone->replicaUrl = NULL;
+    free(resclone->cacheDir); resclone->cacheDir = NULL;
+    free(resclone->metricsFile); resclone->metricsFile = NULL;
+    free(resclone->redisUrl); resclone->redisUrl = NULL;
+    for( uint_t i=0 ; i<resclone->queueHdrs_len ; ++i ){
+        free(resclone->queueHdrs[i]);
+    }
+    free(resclone->queueHdrs); resclone->queueHdrs = NULL;
+    free(resclone->tuneCacheDir); resclone->tuneCacheDir = NULL;
+    free(resclone->queueApiUrl); resclone->queueApiUrl = NULL;
+    mimeMap_free(resclone->mimeMap); resclone->mimeMap = NULL;
+    endpoints_free(resclone->endpoints); resclone->endpoints = NULL;
+    free(resclone);
+    curl_global_cleanup();
+}
+
+
+/** Picks the options of 'resclone' left zero (see 'tunable') from what the
+ * server behind 'url' supports. See 'isAutoTune'. Runs before the first pull,
+ * not in 'gateleenResclone_alloc'. So instances get set up (and their options
+ * checked) without waiting for the network. */
+static void autoTune( GateleenResclone*resclone ){
+    ssize_t err;
+    ProbeProfile profile;
+    ssize_t isKnown = 0;
+    const char *url = resclone->url;
+    if( resclone->tuneCacheDir ){
+        isKnown = probe_load(resclone->tuneCacheDir, url, TUNE_MAX_AGE_S, &profile);
+        if( isKnown < 0 ){
+            log_write(LOG_LVL_WARN, "%s%s%s%s", "Cannot read probe profile in '", resclone->tuneCacheDir,
+                "': ", strerror(-isKnown));
+            isKnown = 0;
+        }
+    }
+    if( ! isKnown && resclone->pageSize ){
+        // The probe lists 'url' unpaged. Exactly what paging is there to avoid.
+        log_write(LOG_LVL_DEBUG, "%s", "Skip probe of paged listing. Use defaults.");
+        profile = (ProbeProfile){ .isKeepAlive = !0, .isRange = !0 };
+    }else if( ! isKnown ){
+        err = probe_run(url, &profile);
+        if( err ){
+            // What the options default to without auto-tune. The pull still
+            // falls back where the server ignores 'Range'.
+            log_write(LOG_LVL_WARN, "%s", "Probe failed. Use defaults.");
+            profile = (ProbeProfile){ .isKeepAlive = !0, .isRange = !0 };
+        }else if( resclone->tuneCacheDir ){
+            err = probe_store(resclone->tuneCacheDir, url, &profile);
+            if( err ){
+                log_write(LOG_LVL_WARN, "%s%s%s%s", "Cannot store probe profile in '", resclone->tuneCacheDir,
+                    "': ", strerror(-err));
+            }
+        }
+    }
+
+    // Multiplexed streams come cheap. Connections do not. And the longer the
+    // round trip, the more requests it takes in flight to keep the line busy.
+    const int isMux = profile.httpVersion >= 20;
+    uint_t parallel = profile.rttUs >= 20000 ? 16 : 8;
+    if( isMux ){ parallel *= 2; }
+    if( ! profile.isKeepAlive ){ parallel /= 2; }
+    if( resclone->tunable & TUNE_MIRROR_PARALLEL ){
+        resclone->mirrorParallel = parallel; }
+
+    // Never picks expand. Embedded bodies get archived re-serialized, so
+    // it would change what the archive holds.
+
+    if( (resclone->tunable & TUNE_RANGE_THRESHOLD) && profile.isRange ){
+        size_t threshold = profile.bytesPerSec ? profile.bytesPerSec : 64<<20;
+        if( threshold < TUNE_RANGE_THRESHOLD_MIN ){
+            threshold = TUNE_RANGE_THRESHOLD_MIN; }
+        // Without keepalive each segment pays a connect.
+        if( ! profile.isKeepAlive ){
+            threshold *= 4; }
+        resclone->rangeThreshold = threshold;
+        if( resclone->tunable & TUNE_RANGE_SEGMENTS ){
+            resclone->rangeSegments = isMux ? 8 : 4; }
+    }
+
+    // A quarter second of transfer. So a slow disk does not stall the wire.
+    if( resclone->tunable & TUNE_WRITE_QUEUE ){
+        size_t queue = profile.bytesPerSec / 4;
+        resclone->writeQueueSize = queue < (4<<20) ? (4<<20) : queue > (64<<20) ? (64<<20) : queue;
+    }
+
+    if( profile.probedAt == 0 ){
+        return; }
+    log_write(LOG_LVL_INFO, "%s%s%s%u.%u%s%s%s%.1f%s%.1f%s%.1f%s%u%s%.1f%s%u",
+        "Tuned for '", url, "' (HTTP/", profile.httpVersion / 10, profile.httpVersion % 10,
+        profile.isKeepAlive ? ", keepalive" : "", profile.isRange ? ", range" : "", ", rtt ", profile.rttUs / 1000.0, "ms, ",
+        profile.bytesPerSec / 1048576.0, " MiB/s): range-threshold ", resclone->rangeThreshold / 1048576.0, " MiB, range-segments ",
+        resclone->rangeSegments, ", write-queue ", resclone->writeQueueSize / 1048576.0, " MiB, mirror-parallel ",
+        resclone->mirrorParallel);
+}
+
+
+GateleenResclone* gateleenResclone_alloc( const GateleenResclone_Opts*opts ){
+    ssize_t err;
+    Resclone *resclone = NULL;
+
+    if( (opts->url == NULL || opts->url[0] == '\0') && opts->redisUrl == NULL ){
+        log_write(LOG_LVL_ERROR, "%s", "EINVAL: url missing.");
+        return NULL;
+    }
+
+    err = curl_global_init(CURL_GLOBAL_ALL);
+    if( err ){
+        assert(!err); return NULL; }
+
+    resclone = calloc(1, sizeof*resclone);
+    if( resclone == NULL ){
+        curl_global_cleanup();
+        return NULL;
+    }
+
+    // Make sure our root URL ends with a slash. The traversal relies on it.
+    // Without one, entries of a redis pull are named as below the redis url.
+    const char *url = (opts->url && opts->url[0] != '\0') ? opts->url : opts->redisUrl;
+    uint_t url_len = strlen(url);
+    resclone->url = malloc(url_len +2);
+    if( resclone->url == NULL ){
+        err = -ENOMEM; goto fail; }
+    memcpy(resclone->url, url, url_len);
+    if( resclone->url[url_len-1] != '/' ){
+        resclone->url[url_len++] = '/';
+    }
+    resclone->url[url_len] = '\0';
+
+    if( opts->endpoints_len ){
+        const char **urls = malloc((opts->endpoints_len +1) * sizeof*urls);
+        if( urls == NULL ){
+            err = -ENOMEM; goto fail; }
+        urls[0] = resclone->url;
+        for( size_t i=0 ; i<opts->endpoints_len ; ++i ){
+            urls[i+1] = opts->endpoints[i]; }
+        resclone->endpoints = endpoints_alloc(urls, opts->endpoints_len +1);
+        free(urls);
+        if( resclone->endpoints == NULL ){
+            err = -ENOMEM; goto fail; }
+    }
+
+    if( opts->filter ){
+        err = compileFilter(opts->filter, &resclone->filter, &resclone->filter_len);
+        if( err ){ goto fail; }
+        resclone->isFilterFull = opts->isFilterFull;
+    }
+    if( opts->file ){
+        resclone->file = strdup(opts->file);
+        if( resclone->file == NULL ){
+            err = -ENOMEM; goto fail; }
+    }
+    resclone->maxMemory = opts->maxMemory;
+    resclone->sink = opts->sink;
+    resclone->source = opts->source;
+    resclone->shardIdx = opts->shardIdx;
+    resclone->shardCount = opts->shardCount;
+    resclone->shardDepth = opts->shardDepth ? opts->shardDepth : 1;
+    resclone->samplePerCollection = opts->samplePerCollection;
+    resclone->sampleRatio = opts->sampleRatio;
+    resclone->sampleSeed = opts->sampleSeed;
+    resclone->maxDepth = opts->maxDepth;
+    resclone->maxBytes = opts->maxBytes;
+    resclone->maxEntries = opts->maxEntries;
+    if( opts->priority ){
+        err = compilePriority(opts->priority, &resclone->priority, &resclone->priority_len);
+        if( err ){ goto fail; }
+    }
+    resclone->deadline = opts->deadline;
+    if( opts->missingFile ){
+        resclone->missingFile = strdup(opts->missingFile);
+        if( resclone->missingFile == NULL ){
+            err = -ENOMEM; goto fail; }
+    }
+    resclone->isLargestFirst = opts->isLargestFirst;
+    if( resclone->sampleRatio < 0 || resclone->sampleRatio > 1 ){
+        log_write(LOG_LVL_ERROR, "%s", "EINVAL: Sample ratio must be within 0..1.");
+        err = -1; goto fail;
+    }
+    resclone->volumeSize = opts->volumeSize;
+    resclone->format = opts->format;
+    resclone->expandLevels = opts->expandLevels;
+    resclone->pageSize = opts->pageSize;
+    resclone->isExpandZip = opts->isExpandZip;
+    resclone->writeQueueSize = opts->writeQueueSize;
+    if( resclone->writeQueueSize && resclone->writeQueueSize < WRITE_QUEUE_MIN ){
+        resclone->writeQueueSize = WRITE_QUEUE_MIN; }
+    if( opts->cacheDir ){
+        resclone->cacheDir = strdup(opts->cacheDir);
+        if( resclone->cacheDir == NULL ){
+            err = -ENOMEM; goto fail; }
+    }
+    resclone->cacheSize = opts->cacheSize;
+    if( opts->mimeTypesFile ){
+        size_t errLine = 0;
+        resclone->mimeMap = mimeMap_load(opts->mimeTypesFile, &errLine);
+        if( resclone->mimeMap == NULL && errno == EINVAL ){
+            log_write(LOG_LVL_ERROR, "%s%s%s"FMT_SIZE_T, "Malformed mime types '", opts->mimeTypesFile,
+                "' at line ", errLine);
+            err = -1; goto fail;
+        }
+        if( resclone->mimeMap == NULL ){
+            log_write(LOG_LVL_ERROR, "%s%s%s%s", "Failed to load '", opts->mimeTypesFile, "': ",
+                strerror(errno));
+            err = -1; goto fail;
+        }
+    }
+    resclone->rangeThreshold = opts->rangeThreshold;
+    resclone->rangeSegments = opts->rangeSegments ? opts->rangeSegments : 4;
+    if( resclone->rangeSegments > RANGE_SEGMENTS_MAX ){
+        log_write(LOG_LVL_ERROR, "%s", "EINVAL: Too many range segments.");
+        err = -1; goto fail;
+    }
+    if( resclone->pageSize && resclone->expandLevels ){
+        log_write(LOG_LVL_ERROR, "%s", "EINVAL: Paging cannot be combined with expand.");
+        err = -1; goto fail;
+    }
+    if( resclone->isExpandZip && (resclone->filter || resclone->shardCount > 1
+        || resclone->samplePerCollection || resclone->sampleRatio || resclone->maxDepth || resclone->priority_len) )
+    {
+        // Zip entries are full paths. Those bypass the per-segment checks.
+        log_write(LOG_LVL_ERROR, "%s", "EINVAL: Zipped expand cannot be combined with filter, shard, sampling"
+            " nor priority.");
+        err = -1; goto fail;
+    }
+    if( opts->redisUrl ){
+        if( opts->endpoints_len || opts->expandLevels || opts->pageSize || opts->cacheDir
+            || opts->samplePerCollection || opts->sampleRatio || opts->replicaUrl )
+        {
+            log_write(LOG_LVL_ERROR, "%s", "EINVAL: Redis source cannot be combined with endpoints, expand,"
+                " paging, cache, sampling nor replication.");
+            err = -1; goto fail;
+        }
+        resclone->redisUrl = strdup(opts->redisUrl);
+        if( resclone->redisUrl == NULL ){
+            err = -ENOMEM; goto fail; }
+    }
+    resclone->parallel = opts->parallel ? opts->parallel : 1;
+    resclone->share = opts->curlShare;
+    resclone->isVerifyAfterPush = opts->isVerifyAfterPush;
+    resclone->verifyParallel = opts->verifyParallel ? opts->verifyParallel : 8;
+    if( resclone->isVerifyAfterPush && (resclone->source || resclone->file == NULL) ){
+        log_write(LOG_LVL_ERROR, "%s", "EINVAL: Verify needs to read the archive 'file' again.");
+        err = -1; goto fail;
+    }
+    resclone->isMirror = opts->isMirror;
+    resclone->mirrorParallel = opts->mirrorParallel ? opts->mirrorParallel : 8;
+    resclone->isDryRun = opts->isDryRun;
+    if( opts->viaQueue && setupQueues(resclone, opts) ){
+        err = -1; goto fail; }
+    if( opts->replicaUrl && opts->replicaUrl[0] != '\0' ){
+        // Same as 'url'. Uploads rely on the trailing slash.
+        const size_t replicaUrl_len = strlen(opts->replicaUrl);
+        resclone->replicaUrl = malloc(replicaUrl_len +2);
+        if( resclone->replicaUrl == NULL ){
+            err = -ENOMEM; goto fail; }
+        memcpy(resclone->replicaUrl, opts->replicaUrl, replicaUrl_len +1);
+        if( resclone->replicaUrl[replicaUrl_len-1] != '/' ){
+            memcpy(resclone->replicaUrl + replicaUrl_len, "/", 2); }
+    }
+    resclone->replicaInterval = opts->replicaInterval;
+    resclone->replicaCycles = opts->replicaCycles;
+    if( opts->metricsFile ){
+        resclone->metricsFile = strdup(opts->metricsFile);
+        if( resclone->metricsFile == NULL ){
+            err = -ENOMEM; goto fail; }
+    }
+    // Probe waits for the first pull. Redis has no server to probe.
+    resclone->isAutoTune = opts->isAutoTune && opts->redisUrl == NULL;
+    if( resclone->isAutoTune ){
+        resclone->tunable = (opts->rangeThreshold ? 0 : TUNE_RANGE_THRESHOLD)
+            | (opts->rangeSegments ? 0 : TUNE_RANGE_SEGMENTS)
+            | (opts->writeQueueSize ? 0 : TUNE_WRITE_QUEUE)
+            | (opts->mirrorParallel ? 0 : TUNE_MIRROR_PARALLEL);
+        if( opts->tuneCacheDir ){
+            resclone->tuneCacheDir = strdup(opts->tuneCacheDir);
+            if( resclone->tuneCacheDir == NULL ){
+                err = -ENOMEM; goto fail; }
+        }
+    }
+
+    return resclone;
+fail:
+    gateleenResclone_free(resclone);
+    return NULL;
+}
+
+
+static size_t onUploadChunkRequested( char*buf, size_t size, size_t count, void*Put_ ){
+    int err;
+    Put *put = Put_;
+    GateleenResclone_Source *source = put->upload->source;
+    const size_t buf_len = size * count;
+
+    ssize_t readLen = source->read(source->cls, buf, buf_len);
+    //fprintf(stderr, "%s%lu%s\n", "[DEBUG] Cpy ", readLen, " bytes.");
+    if( readLen < 0 ){
+        err = -1; goto endFn; /* Already logged by source. */
+    }else if( readLen > 0 ){
+        // Regular read. Data already written to 'buf'. Only need to adjust
+        // return val.
+        err = readLen; goto endFn;
+    }else{ // EOF
+        assert(readLen == 0);
+        err = 0; goto endFn;
+    }
+
+    assert(!"Unreachable code");
+endFn:
+    //fprintf(stderr, "%s%s%s%ld\n", "[DEBUG] ", __func__, "() -> ", err);
+    return err >= 0 ? err : CURL_READFUNC_ABORT;
+}
+
+
+static ssize_t addContentTypeHeader( Put*put, struct curl_slist**reqHdrs ){
+    ssize_t err;
+    char *contentTypeHdr = NULL;
+    Upload *upload = put->upload;
+    const char *name = put->name;
+
+    const char *mimeType;
+    if( put->contentType ){
+        mimeType = put->contentType; /* Source knows better than we could guess. */
+    }else{
+        uint_t name_len = strlen(put->name);
+        // Find file extension.
+        const char *ext = name + name_len;
+        for(; ext>name && *ext!='.' && *ext!='/' ; --ext );
+        // Convert it to mime type.
+        if( *ext == '.' ){
+            mimeType = mimeMap_lookup(upload->resclone->mimeMap, ext +1); // <- +1, to skip the (useless) dot.
+            if( mimeType ){
+                //fprintf(stderr, "%s%s%s%s%s\n", "[DEBUG] Resolved file ext '", ext+1,"' to mime '", mimeType?mimeType:"<null>", "'.");
+            }
+        }else if( *ext=='/' || ext==name || *ext=='\0' ){ // TODO Explain why 0x00.
+            mimeType = "application/json";
+            //fprintf(stderr, "%s\n", "[DEBUG] No file extension. Fallback to json (gateleen default)");
+        }else{
+            mimeType = NULL;
+        }
+    }
+    if( mimeType == NULL ){
+        //fprintf(stderr, "%s%s%s\n", "[DEBUG] Unknown file extension '", ext+1, "'. Will NOT add Content-Type header.");
+        mimeType = ""; // <- Need to 'remove' header. To do this, pass an empty value to curl.
+    }
+    uint_t mimeType_len = strlen(mimeType);
+    static const char contentTypePrefix[] = "Content-Type: ";
+    static const uint_t contentTypePrefix_len = sizeof(contentTypePrefix)-1;
+    contentTypeHdr = malloc( contentTypePrefix_len + mimeType_len +1 );
+    if( contentTypeHdr == NULL ){
+        err = -ENOMEM; goto endFn; }
+    memcpy(contentTypeHdr , contentTypePrefix , contentTypePrefix_len);
+    memcpy(contentTypeHdr+contentTypePrefix_len , mimeType , mimeType_len+1);
+    *reqHdrs = curl_slist_append(*reqHdrs, contentTypeHdr);
+    err = curl_easy_setopt(upload->curl, CURLOPT_HTTPHEADER, *reqHdrs);
+    if( err ){
+        log_write(LOG_LVL_ERROR, "%s"FMT_SIZE_T, "curl_easy_setopt(_, HTTPHEADER, _): ", err);
+        assert(!err); err = -1; goto endFn; }
+
+    err = 0;
+endFn:
+    free(contentTypeHdr);
+    return err;
+}
+
+
+static ssize_t httpPutEntry( Put*put ){
+    ssize_t err;
+    Upload *upload = put->upload;
+    char *url = NULL;
+    struct curl_slist *reqHdrs = NULL;
+
+    int rootUrl_len = strlen(upload->rootUrl);
+    if( upload->rootUrl[rootUrl_len-1]=='/' ){
+        rootUrl_len -= 1;
+    }
+    int url_len = strlen(upload->rootUrl) + strlen(put->name);
+    url = malloc(url_len +2);
+    if( url == NULL ){
+        err = -ENOMEM; goto endFn; }
+    sprintf(url, "%.*s/%s", rootUrl_len,upload->rootUrl, put->name);
+    for( size_t i=0 ; i<put->headers_len ; ++i ){
+        struct curl_slist *tmp = curl_slist_append(reqHdrs, put->headers[i]);
+        if( tmp == NULL ){
+            err = -ENOMEM; goto endFn; }
+        reqHdrs = tmp;
+    }
+    const Resclone *resclone = upload->resclone;
+    if( resclone->queueHdrs ){
+        // Same path same queue. So a later PUT cannot overtake an earlier one.
+        const uint64_t hash = hash_fnv1a64(HASH_FNV1A64_INIT, put->name, strlen(put->name));
+        struct curl_slist *tmp = curl_slist_append(reqHdrs,
+            resclone->queueHdrs[hash % resclone->queueHdrs_len]);
+        if( tmp == NULL ){
+            err = -ENOMEM; goto endFn; }
+        reqHdrs = tmp;
+    }
+    err =  CURLE_OK != curl_easy_setopt(upload->curl, CURLOPT_URL, url)
+        || addContentTypeHeader(put, &reqHdrs)
+        ;
+    if( err ){
+        assert(!err); err = -1; goto endFn; }
+
+    log_write(LOG_LVL_DEBUG, "%s%s%s", "Upload '", url, "'");
+    err = curl_easy_perform(upload->curl);
+    if( err != CURLE_OK ){
+        log_write(LOG_LVL_ERROR, "%s%s%s"FMT_SIZE_T"%s%s",
+            "PUT '", url, "' (code ", err, "): ", curl_easy_strerror(err));
+        err = -1; goto endFn;
+    }
+    long rspCode;
+    curl_easy_getinfo(upload->curl, CURLINFO_RESPONSE_CODE, &rspCode);
+    if( rspCode <= 199 || rspCode >= 300 ){
+        log_write(LOG_LVL_WARN, "%s%ld%s%s%s",
+            "Got RspCode ", rspCode, " for 'PUT ", url, "'");
+        upload->stats.failed += 1;
+    }else{
+        upload->stats.entries += 1;
+        upload->stats.bytes += put->size;
+        logProgress("Push", &upload->stats, &upload->progress, 0);
+        //fprintf(stderr, "%s%ld%s%s%s\n", "[DEBUG] Got RspCode ", rspCode, " for 'PUT ", url, "'");
+    }
+
+    err = 0;
+endFn:
+    // Header list is still referenced by the handle. Do not leave it dangling.
+    curl_easy_setopt(upload->curl, CURLOPT_HTTPHEADER, NULL);
+    curl_slist_free_all(reqHdrs);
+    free(url);
+    return err;
+}
+
+
+/** Picks up Content-Type and headers recorded by 'TarSink'. */
+static ssize_t TarSource_readXattrs( TarSource*tarSource, struct archive_entry*entry ){
+    static const size_t prefix_len = sizeof XATTR_HEADER_PREFIX -1;
+    free(tarSource->contentType); tarSource->contentType = NULL;
+    tarSource->headers.list_len = 0;
+    tarSource->headers.buf_len = 0;
+    archive_entry_xattr_reset(entry);
+    const char *key;
+    const void *val;
+    size_t val_len;
+    while( archive_entry_xattr_next(entry, &key, &val, &val_len) == ARCHIVE_OK ){
+        if( !strcmp(key, XATTR_MIME_TYPE) ){
+            // Same attribute may show up twice (as 'LIBARCHIVE.xattr' and
+            // 'SCHILY.xattr'). Last one wins.
+            free(tarSource->contentType);
+            tarSource->contentType = malloc(val_len +1);
+            if( tarSource->contentType == NULL ){
+                return -ENOMEM; }
+            memcpy(tarSource->contentType, val, val_len);
+            tarSource->contentType[val_len] = '\0';
+        }else if( !strncmp(key, XATTR_HEADER_PREFIX, prefix_len) ){
+            const char *name = key + prefix_len;
+            int isDup = 0;
+            for( size_t i=0 ; i<tarSource->headers.list_len ; ++i ){
+                const char *hdr = tarSource->headers.list[i];
+                if( !strncmp(hdr, name, strlen(name)) && hdr[strlen(name)] == ':' ){ isDup = !0; break; }
+            }
+            if( isDup ){
+                continue; }
+            if( entryHeaders_add(&tarSource->headers, name, strlen(name), val, val_len) ){
+                log_write(LOG_LVL_WARN, "%s%s%s%s%s", "Header '", name, "' of '",
+                    archive_entry_pathname(entry), "' dropped. Too many headers.");
+            }
+        }
+    }
+    return 0;
+}
+
+
+static la_ssize_t TarSource_zstdRead( struct archive*archive, void*TarSource_, const void**buf ){
+    (void)archive;
+    TarSource *tarSource = TarSource_;
+    *buf = tarSource->zstdBuf;
+    return zstdseek_read(tarSource->zstd, tarSource->zstdBuf, 1<<16);
+}
+
+
+/** Opens the frames of part 'partIdx' if 'file' is a seekable tar.zst.
+ * Parts get about the same count of (uncompressed) bytes.
+ * @return 1 if so (with 'zstd' set up, which stays NULL for an empty part),
+ *      0 if 'file' is no seekable tar.zst, negative on error. */
+static ssize_t TarSource_openZstdPart( TarSource*tarSource ){
+    ssize_t err;
+    ZstdSeekFrame *frames = NULL;
+    size_t frames_len = 0;
+    err = zstdseek_readTable(tarSource->file, &frames, &frames_len);
+    if( err <= 0 ){
+        goto endFn; }
+    uint64_t total = 0;
+    for( size_t i=0 ; i<frames_len ; ++i ){
+        total += frames[i].decompressedSize; }
+    // A frame belongs to the part its first byte falls into.
+    const uint64_t beg = total / tarSource->partCount * tarSource->partIdx;
+    const uint64_t end = tarSource->partIdx +1 == tarSource->partCount ? total
+        : total / tarSource->partCount * (tarSource->partIdx +1);
+    uint64_t pos = 0, offset = 0, length = 0;
+    for( size_t i=0 ; i<frames_len ; pos += frames[i++].decompressedSize ){
+        if( pos < beg || pos >= end ){
+            continue; }
+        if( length == 0 ){
+            offset = frames[i].offset; }
+        length += frames[i].compressedSize;
+    }
+    if( length ){
+        tarSource->zstdBuf = malloc(1<<16);
+        tarSource->zstd = zstdseek_readerOpen(tarSource->file, offset, length);
+        if( tarSource->zstdBuf == NULL || tarSource->zstd == NULL ){
+            err = -1; goto endFn; }
+    }
+    err = 1;
+endFn:
+    free(frames);
+    return err;
+}
+
+
+static ssize_t TarSource_nextEntry( void*TarSource_, GateleenResclone_Entry*dst ){
+    ssize_t err;
+    TarSource *tarSource = TarSource_;
+
+    if( tarSource->isRange && ! tarSource->zstd ){
+        err = 0; goto endFn; } /* <- Got no frames. */
+    if( ! tarSource->archive ){
+        const ssize_t isZstdPart = tarSource->partCount && tarSource->file ? TarSource_openZstdPart(tarSource) : 0;
+        if( isZstdPart < 0 ){
+            err = -1; goto endFn; }
+        // Frames start at entries. So the range is a tar on its own (only
+        // without end marker).
+        tarSource->isRange = isZstdPart;
+        if( isZstdPart && ! tarSource->zstd ){
+            err = 0; goto endFn; }
+        tarSource->archive = archive_read_new();
+        if( ! tarSource->archive ){
+            assert(tarSource->archive); err = -1; goto endFn; }
+        const int blockSize = (1<<14);
+        err = archive_read_support_format_all(tarSource->archive)
+           || archive_read_support_filter_all(tarSource->archive)
+           || (isZstdPart
+               ? archive_read_open(tarSource->archive, tarSource, NULL, TarSource_zstdRead, NULL)
+               : archive_read_open_filename(tarSource->archive, tarSource->file, blockSize))
+           ;
+        if( err ){
+            log_write(LOG_LVL_ERROR, "%s"FMT_SIZE_T"%s%s", "Failed to open src archive (code ", err, "): ",
+                archive_error_string(tarSource->archive));
+            err = -1; goto endFn;
+        }
+    }
+
+    for( struct archive_entry*entry ;; ){
+        err = archive_read_next_header(tarSource->archive, &entry);
+        if( err == ARCHIVE_EOF ){
+            err = 0; goto endFn; }
+        if( err != ARCHIVE_OK ){
+            log_write(LOG_LVL_ERROR, "%s%s", "Failed to read archive: ",
+                archive_error_string(tarSource->archive));
+            err = -1; goto endFn;
+        }
+        const char *name = archive_entry_pathname(entry);
+        int ftype = archive_entry_filetype(entry);
+        if( ftype == AE_IFDIR ){
+            continue; // Ignore dirs because gateleen doesn't know 'dirs' as such.
+        }
+        if( ftype != AE_IFREG ){
+            log_write(LOG_LVL_WARN, "%s%s%s", "Ignore non-regular file '", name, "'");
+            continue;
+        }
+        if(    tarSource->partCount && ! tarSource->isRange
+            && tarSource->ordinal++ % tarSource->partCount != tarSource->partIdx )
+        {
+            continue; } /* <- Another part's. Next header skips its body. */
+        //fprintf(stderr, "%s%s%s\n", "[DEBUG] Reading '",name,"'");
+        dst->path = name;
+        dst->size = archive_entry_size(entry);
+        err = TarSource_readXattrs(tarSource, entry);
+        if( err ){
+            err = -1; goto endFn; }
+        dst->contentType = tarSource->contentType;
+        dst->headers = tarSource->headers.list;
+        dst->headers_len = tarSource->headers.list_len;
+        err = 1; goto endFn;
+    }
+
+endFn:
+    return err;
+}
+
+
+static ssize_t TarSource_read( void*TarSource_, char*buf, size_t buf_cap ){
+    TarSource *tarSource = TarSource_;
+    ssize_t readLen = archive_read_data(tarSource->archive, buf, buf_cap);
+    if( readLen < 0 ){
+        log_write(LOG_LVL_ERROR, "%s"FMT_SIZE_T"%s%s", "Failed to read from archive (code ",
+            readLen, "): ", archive_error_string(tarSource->archive));
+        return -1;
+    }
+    return readLen;
+}
+
+
+static void TarSource_cleanup( TarSource*tarSource ){
+    archive_read_free(tarSource->archive); tarSource->archive = NULL;
+    zstdseek_readerFree(tarSource->zstd); tarSource->zstd = NULL;
+    free(tarSource->zstdBuf); tarSource->zstdBuf = NULL;
+    free(tarSource->contentType); tarSource->contentType = NULL;
+}
+
+
+/** @return Non-zero if the default source shall read 'file' as NDJSON. Files
+ *      get recognized by their first char. stdin only by '--format'. */
+static int isNdjsonInput( GateleenResclone*resclone, const char*file ){
+    if( resclone->format == GATELEEN_RESCLONE_FORMAT_NDJSON ){
+        return !0; }
+    return file && ndjson_isNdjsonFile(file);
+}
+
+
+/** @return 'path' without leading "./" or "/". */
+static const char* normPath( const char*path ){
+    for(;;){
+        if( path[0] == '.' && path[1] == '/' ){ path += 2; }
+        else if( path[0] == '/' ){ path += 1; }
+        else{ return path; }
+    }
+}
+
+
+/** Same path written as "./foo", "/foo" or "foo" hashes the same. */
+static uint64_t pathHash( const char*path ){
+    path = normPath(path);
+    return hash_fnv1a64(HASH_FNV1A64_INIT, path, strlen(path));
+}
+
+
+static ssize_t pathIndex_add( PathIndex*index, const char*path ){
+    ssize_t err = 0;
+    const uint64_t hash = pathHash(path);
+    pthread_mutex_lock(&index->mutex);
+    if( index->hashes_len >= index->hashes_cap ){
+        const size_t cap = index->hashes_cap ? index->hashes_cap * 2 : 1024;
+        uint64_t *tmp = realloc(index->hashes, cap * sizeof*tmp);
+        if( tmp == NULL ){
+            err = -ENOMEM; goto endFn; }
+        index->hashes = tmp;
+        index->hashes_cap = cap;
+    }
+    index->hashes[index->hashes_len++] = hash;
+endFn:
+    pthread_mutex_unlock(&index->mutex);
+    return err;
+}
+
+
+/** Sorts the index. Needed once before the first lookup. */
+static void pathIndex_seal( PathIndex*index ){
+    if( index->hashes_len ){
+        qsort(index->hashes, index->hashes_len, sizeof*index->hashes, cmpU64); }
+}
+
+
+static int pathIndex_contains( const PathIndex*index, const char*path ){
+    const uint64_t hash = pathHash(path);
+    return index->hashes_len
+        && bsearch(&hash, index->hashes, index->hashes_len, sizeof*index->hashes, cmpU64) != NULL;
+}
+
+
+static ssize_t readArchive( Upload*upload ){
+    ssize_t err;
+    Put *put = NULL;
+    GateleenResclone_Source *source = upload->source;
+
+    err = curl_easy_setopt(upload->curl, CURLOPT_UPLOAD, 1L)
+       || curl_easy_setopt(upload->curl, CURLOPT_READFUNCTION, onUploadChunkRequested)
+        ;
+    if( err ){
+        assert(!err); err = -1; goto endFn; }
+    for(;;){
+        GateleenResclone_Entry entry = {0};
+        err = source->nextEntry(source->cls, &entry);
+        if( err < 0 ){
+            err = -1; goto endFn; }
+        if( err == 0 ){
+            break; } /* EOF */
+        if( upload->resclone->mirrorIndex && pathIndex_add(upload->resclone->mirrorIndex, entry.path) ){
+            err = -ENOMEM; goto endFn; }
+        if( upload->resclone->isDryRun ){
+            log_write(LOG_LVL_DEBUG, "%s%s%s", "Would upload '", entry.path, "'");
+            upload->stats.entries += 1;
+            upload->stats.bytes += entry.size;
+            continue;
+        }
+        Put _1 = {
+            .upload = upload,
+            .name = entry.path,
+            .contentType = entry.contentType,
+            .headers = entry.headers,
+            .headers_len = entry.headers_len,
+            .size = entry.size,
+        }; put = &_1;
+        err =  curl_easy_setopt(upload->curl, CURLOPT_READDATA, put)
+            || curl_easy_setopt(upload->curl, CURLOPT_INFILESIZE_LARGE, (curl_off_t)entry.size)
+            || httpPutEntry(put);
+        //curl = upload->curl; // Sync back. TODO: Still needed?
+        if( err ){
+            assert(!err); err = -1; goto endFn; }
+    }
+
+    err = 0;
+endFn:
+    return err;
+}
+
+
+/** Where and as whom to read gateleen's redis storage. Parsed from
+ * 'redis://[[user]:password@]host[:port][/prefix][?expirable=key]'. Slashes
+ * in 'prefix' count as the ':' gateleen joins path segments with. */
+typedef struct RedisAddr {
+    char *buf;
+    const char *user;
+    const char *password;
+    const char *host;
+    const char *port;
+    const char *prefix;
+    const char *expirableKey;
+} RedisAddr;
+
+
+static ssize_t redisAddr_parse( RedisAddr*addr, const char*url ){
+    memset(addr, 0, sizeof*addr);
+    if( strncmp(url, "redis://", 8) ){
+        log_write(LOG_LVL_ERROR, "%s%s%s", "EINVAL: Expected 'redis://...' but got '", url, "'");
+        return -1;
+    }
+    // Room for the parts plus the defaults.
+    addr->buf = malloc(strlen(url) + sizeof REDIS_RESOURCES_PREFIX + sizeof REDIS_EXPIRABLE_KEY + 8);
+    if( addr->buf == NULL ){
+        return -ENOMEM; }
+    char *it = strcpy(addr->buf, url + 8);
+    char *query = strchr(it, '?');
+    if( query ){
+        *query++ = '\0';
+        if( strncmp(query, "expirable=", 10) || query[10] == '\0' ){
+            log_write(LOG_LVL_ERROR, "%s%s%s", "EINVAL: Unknown redis url query '", query, "'");
+            return -1;
+        }
+        addr->expirableKey = query + 10;
+    }
+    char *path = strchr(it, '/');
+    if( path ){
+        *path++ = '\0';
+        for( char *c = path ; *c ; ++c ){
+            if( *c == '/' ){ *c = ':'; } }
+        // Trailing slash names the same subtree as none.
+        const size_t path_len = strlen(path);
+        if( path_len && path[path_len-1] == ':' ){
+            path[path_len-1] = '\0'; }
+        if( path[0] != '\0' ){
+            addr->prefix = path; }
+    }
+    char *at = strrchr(it, '@');
+    if( at ){
+        *at = '\0';
+        char *colon = strchr(it, ':');
+        if( colon ){
+            *colon = '\0';
+            addr->user = it[0] ? it : NULL;
+            addr->password = colon +1;
+        }else{
+            addr->password = it;
+        }
+        it = at +1;
+    }
+    addr->host = it;
+    char *colon = strrchr(it, ':');
+    if( colon && strchr(it, ']') < colon ){ /* <- Not within an IPv6 literal. */
+        *colon = '\0';
+        addr->port = colon +1;
+    }
+    if( addr->host[0] == '[' ){
+        addr->host += 1;
+        char *end = strchr(addr->host, ']');
+        if( end ){ *end = '\0'; }
+    }
+    if( addr->host[0] == '\0' ){
+        log_write(LOG_LVL_ERROR, "%s%s%s", "EINVAL: No host in '", url, "'");
+        return -1;
     }
+    it = addr->buf + strlen(url) +1;
+    if( addr->port == NULL || addr->port[0] == '\0' ){
+        addr->port = strcpy(it, "6379"); it += 5; }
+    if( addr->prefix == NULL ){
+        addr->prefix = strcpy(it, REDIS_RESOURCES_PREFIX); it += sizeof REDIS_RESOURCES_PREFIX; }
+    if( addr->expirableKey == NULL ){
+        addr->expirableKey = strcpy(it, REDIS_EXPIRABLE_KEY); }
+    return 0;
+}
+
+
+/** Same decisions as the traversal takes per segment ('pathFilterAcceptsEntry',
+ * 'shardAcceptsEntry', 'maxDepth'), but for a whole relative path at once.
+ * @return 1 to pull it, 0 to skip it, negative on error. */
+static ssize_t redisAcceptsPath( ClsDload*dload, char*path ){
+    const Resclone *resclone = dload->resclone;
+    size_t depth = 0;
+    const char *shardKeyEnd = NULL;
+    for( char *seg = path ;; ++depth ){
+        char *end = strchr(seg, '/');
+        if( depth +1 == resclone->shardDepth ){
+            shardKeyEnd = end; }
+        if( resclone->filter ){
+            if( depth >= resclone->filter_len ){
+                if( resclone->isFilterFull ){
+                    return 0; }
+            }else{
+                if( end ){ *end = '\0'; }
+                const int err = regexec(resclone->filter + depth, seg, 0, 0, 0);
+                if( end ){ *end = '/'; }
+                if( err == REG_NOMATCH ){
+                    return 0; }
+                if( err ){
+                    log_write(LOG_LVL_ERROR, "%s%s%s%d", "regexec(rgx, '", path, "') -> ", err);
+                    return -1;
+                }
+            }
+        }
+        if( end == NULL ){
+            break; }
+        seg = end +1;
+    }
+    if( resclone->maxDepth && depth +1 > resclone->maxDepth ){
+        return 0; }
+    if( resclone->shardCount > 1 ){
+        const size_t key_len = shardKeyEnd ? (size_t)(shardKeyEnd - path) : strlen(path);
+        const uint64_t hash = hash_fnv1a64(HASH_FNV1A64_INIT, path, key_len);
+        if( hash % resclone->shardCount != resclone->shardIdx ){
+            return 0; }
+    }
+    return 1;
+}
+
+
+static int cmpRedisPaths( const void*a_, const void*b_ ){
+    return strcmp(*(const char*const*)a_, *(const char*const*)b_);
+}
+
 
+/** Appends the gunzipped 'src' to the body of 'resourceFile'. */
+static ssize_t redisInflate( ResourceFile*resourceFile, const char*src, size_t src_len ){
+    ssize_t err;
+    char out[1<<14];
+    z_stream z = { .next_in = (Bytef*)src, .avail_in = src_len };
+    if( inflateInit2(&z, 16 + MAX_WBITS) != Z_OK ){
+        return -ENOMEM; }
+    for(;;){
+        z.next_out = (Bytef*)out;
+        z.avail_out = sizeof out;
+        const int ret = inflate(&z, Z_NO_FLUSH);
+        if( ret != Z_OK && ret != Z_STREAM_END ){
+            err = -EINVAL; goto endFn; }
+        const size_t out_len = sizeof out - z.avail_out;
+        if( out_len && onResourceChunk(out, 1, out_len, resourceFile) != out_len ){
+            err = -1; goto endFn; }
+        if( ret == Z_STREAM_END ){
+            break; }
+        if( out_len == 0 && z.avail_in == 0 ){
+            err = -EINVAL; goto endFn; } /* <- Truncated. */
+    }
     err = 0;
 endFn:
+    inflateEnd(&z);
     return err;
 }
 
 
-static ssize_t copyBufToArchive( ResourceFile*resourceFile ){
+/**
+ * Pulls the tree straight from gateleen's redis storage instead of over
+ * HTTP (see 'redisUrl').
+ *
+ * Each resource is a hash named by its path (segments joined by ':' behind
+ * the resources prefix), with the body in field 'resource' (gzip'ed if
+ * field 'compressed' is set). Expiring ones have their expiry (millis) as
+ * score in the expirable set. Collections are not needed. Their members
+ * show up as keys anyway.
+ *
+ * All keys get SCANned first and sorted. So the archive ends up in path
+ * order (after the 'priority' subtrees), as if pulled over HTTP. Then the
+ * bodies get fetched in pipelined batches.
+ */
+static ssize_t pullRedis( ClsDload*dload ){
     ssize_t err;
-    ClsDload *dload = resourceFile->dload;
-    char *fileName = resourceFile->url + strlen(resourceFile->dload->rootUrl);
+    Resclone *resclone = dload->resclone;
+    RedisAddr addr;
+    Redis *redis = NULL;
+    char *paths = NULL;
+    size_t paths_len = 0, paths_cap = 0;
+    const char **sorted = NULL;
+    size_t sorted_len = 0;
+    SchedKey *keys = NULL;
+    char *keyBuf = NULL;
+    size_t keyBuf_cap = 0;
+    const RedisReply *rsp;
 
-    if( ! dload->dstArchive ){
-        /* Setup archive if not setup yet. */
-        dload->dstArchive = archive_write_new();
-        err =  archive_write_set_format_pax_restricted(dload->dstArchive)
-            || archive_write_open_filename(dload->dstArchive, dload->archiveFile)
-            ;
-        if( err ){
-            fprintf(stderr, "%s%s\n", "[ERROR] Failed to setup tar output: ",
-                archive_error_string(dload->dstArchive));
+    err = redisAddr_parse(&addr, resclone->redisUrl);
+    if( err ){
+        err = -1; goto endFn; }
+    const size_t prefix_len = strlen(addr.prefix);
+    redis = redis_connect(addr.host, addr.port);
+    if( redis == NULL ){
+        err = -1; goto endFn; }
+    if( addr.password ){
+        const char *argv[] = { "AUTH", addr.user ? addr.user : addr.password, addr.password };
+        if( redis_append(redis, addr.user ? 3 : 2, argv, NULL) || redis_flush(redis) || redis_read(redis, &rsp) ){
+            err = -1; goto endFn; }
+        if( rsp->type == REDIS_ERROR ){
+            log_write(LOG_LVL_ERROR, "%s%s", "Redis AUTH: ", rsp->str);
             err = -1; goto endFn;
         }
     }
 
-    if( dload->tmpEntry == NULL ){
-        dload->tmpEntry = archive_entry_new();
-    }else{
-        dload->tmpEntry = archive_entry_clear(dload->tmpEntry);
+    // Collect the paths. Glob chars in the prefix must match literally.
+    if( memBudget_growBuf(&dload->memBudget, 0, &keyBuf, &keyBuf_cap, 2*prefix_len + 3) ){
+        err = -ENOMEM; goto endFn; }
+    char *pattern = keyBuf;
+    for( const char *c = addr.prefix ; *c ; ++c ){
+        if( strchr("*?[]\\", *c) ){ *pattern++ = '\\'; }
+        *pattern++ = *c;
     }
-    archive_entry_set_pathname(dload->tmpEntry, fileName);
-    archive_entry_set_filetype(dload->tmpEntry, AE_IFREG);
-    archive_entry_set_size(dload->tmpEntry, resourceFile->buf_len);
-    archive_entry_set_perm(dload->tmpEntry, 0644);
-    err = archive_write_header(dload->dstArchive, dload->tmpEntry);
-    if( err ){ err = -1; goto endFn; }
+    strcpy(pattern, ":*");
+    char cursor[32] = "0";
+    do{
+        const char *argv[] = { "SCAN", cursor, "MATCH", keyBuf, "COUNT", "1000" };
+        if( redis_append(redis, 6, argv, NULL) || redis_flush(redis) || redis_read(redis, &rsp) ){
+            err = -1; goto endFn; }
+        if( rsp->type != REDIS_ARRAY || rsp->elems_len != 2 || rsp->elems[0].type != REDIS_STRING
+            || rsp->elems[0].str_len >= sizeof cursor || rsp->elems[1].type != REDIS_ARRAY )
+        {
+            log_write(LOG_LVL_ERROR, "%s%s", "Unexpected reply to SCAN: ",
+                rsp->type == REDIS_ERROR ? rsp->str : "(no cursor and keys)");
+            err = -1; goto endFn;
+        }
+        memcpy(cursor, rsp->elems[0].str, rsp->elems[0].str_len +1);
+        for( size_t i=0 ; i<rsp->elems[1].elems_len ; ++i ){
+            const RedisReply *key = rsp->elems[1].elems + i;
+            if( key->type != REDIS_STRING || key->str_len <= prefix_len +1 ){
+                continue; }
+            const size_t path_len = key->str_len - prefix_len -1;
+            if( memBudget_growBuf(&dload->memBudget, 0, &paths, &paths_cap, paths_len + path_len +1) ){
+                log_write(LOG_LVL_ERROR, "%s", "Out of memory");
+                err = -1; goto endFn;
+            }
+            char *path = paths + paths_len;
+            memcpy(path, key->str + prefix_len +1, path_len +1);
+            for( char *c = path ; *c ; ++c ){
+                if( *c == ':' ){ *c = '/'; } }
+            err = redisAcceptsPath(dload, path);
+            if( err < 0 ){
+                err = -1; goto endFn; }
+            if( err ){
+                paths_len += path_len +1;
+                sorted_len += 1;
+            }
+        }
+    }while( strcmp(cursor, "0") );
 
-    ssize_t written = archive_write_data(dload->dstArchive, resourceFile->buf, resourceFile->buf_len);
-    if( written < 0 ){
-        fprintf(stderr, "%s%s\n", "[ERROR] Failed to archive_write_data: ",
-            archive_error_string(dload->dstArchive));
-        err = -1; goto endFn;
-    }else if( written != resourceFile->buf_len ){
-        fprintf(stderr, "%s%u%s"FMT_SIZE_T"\n", "[ERROR] archive_write_data failed to write all ",
-            resourceFile->buf_len, " bytes. Instead it wrote ", written);
-        err = -1; goto endFn;
+    // Pointers only now, as 'paths' moved while growing.
+    sorted = malloc(sorted_len * sizeof*sorted +1);
+    if( sorted == NULL ){
+        err = -ENOMEM; goto endFn; }
+    for( size_t i=0, off=0 ; i<sorted_len ; ++i ){
+        sorted[i] = paths + off;
+        off += strlen(sorted[i]) +1;
+    }
+    // SCAN may return a key more than once. Sorting brings those together.
+    qsort(sorted, sorted_len, sizeof*sorted, cmpRedisPaths);
+    size_t uniq_len = 0;
+    for( size_t i=0 ; i<sorted_len ; ++i ){
+        if( uniq_len == 0 || strcmp(sorted[uniq_len-1], sorted[i]) ){
+            sorted[uniq_len++] = sorted[i]; }
+    }
+    sorted_len = uniq_len;
+    log_write(LOG_LVL_DEBUG, "%s"FMT_SIZE_T"%s%s%s", "Found ", sorted_len, " resources below '", addr.prefix, "'");
+    if( resclone->priority_len ){
+        keys = malloc(sorted_len * sizeof*keys +1);
+        if( keys == NULL ){
+            err = -ENOMEM; goto endFn; }
+        for( size_t i=0 ; i<sorted_len ; ++i ){
+            keys[i] = (SchedKey){ .rank = priorityRank(resclone, (char*)sorted[i]), .idx = i, .item = sorted[i] }; }
+        qsort(keys, sorted_len, sizeof*keys, cmpSchedKeys);
+        for( size_t i=0 ; i<sorted_len ; ++i ){
+            sorted[i] = keys[i].item; }
+    }
+
+    ResourceFile *resourceFile = &dload->resourceFile;
+    const int64_t nowMs = (int64_t)time(NULL) * 1000;
+    size_t begin = 0;
+    for( ; begin < sorted_len && ! isBudgetSpent(dload) ; begin += REDIS_BATCH_KEYS ){
+        const size_t end = begin + REDIS_BATCH_KEYS < sorted_len ? begin + REDIS_BATCH_KEYS : sorted_len;
+        for( size_t i=begin ; i<end ; ++i ){
+            const size_t path_len = strlen(sorted[i]);
+            if( memBudget_growBuf(&dload->memBudget, 0, &keyBuf, &keyBuf_cap, prefix_len + path_len +2) ){
+                err = -ENOMEM; goto endFn; }
+            sprintf(keyBuf, "%s:%s", addr.prefix, sorted[i]);
+            for( char *c = keyBuf + prefix_len ; *c ; ++c ){
+                if( *c == '/' ){ *c = ':'; } }
+            const char *hmget[] = { "HMGET", keyBuf, "resource", "compressed" };
+            const char *zscore[] = { "ZSCORE", addr.expirableKey, keyBuf };
+            if( redis_append(redis, 4, hmget, NULL) || redis_append(redis, 3, zscore, NULL) ){
+                err = -ENOMEM; goto endFn; }
+        }
+        if( redis_flush(redis) ){
+            err = -1; goto endFn; }
+        for( size_t i=begin ; i<end ; ++i ){
+            // ZSCORE comes second. But the body must be taken before reading on.
+            if( redis_read(redis, &rsp) ){
+                err = -1; goto endFn; }
+            const int isResource = rsp->type == REDIS_ARRAY && rsp->elems_len == 2
+                && rsp->elems[0].type == REDIS_STRING;
+            if( rsp->type == REDIS_ERROR ){
+                log_write(LOG_LVL_WARN, "%s%s%s%s", "Skip '", sorted[i], "': ", rsp->str); }
+            if( isResource ){
+                const int isCompressed = rsp->elems[1].type == REDIS_STRING && rsp->elems[1].str_len
+                    && strcmp(rsp->elems[1].str, "0") && strcmp(rsp->elems[1].str, "false");
+                if( setResourceUrl(resourceFile, dload->rootUrl, dload->rootUrl_len, sorted[i]) ){
+                    err = -ENOMEM; goto endFn; }
+                if( isCompressed ){
+                    err = redisInflate(resourceFile, rsp->elems[0].str, rsp->elems[0].str_len);
+                    if( err == -EINVAL ){
+                        log_write(LOG_LVL_ERROR, "%s%s%s", "Corrupt compressed body of '", sorted[i], "'"); }
+                    if( err ){
+                        err = -1; goto endFn; }
+                }else if( rsp->elems[0].str_len && onResourceChunk((char*)rsp->elems[0].str, 1,
+                    rsp->elems[0].str_len, resourceFile) != rsp->elems[0].str_len )
+                {
+                    err = -1; goto endFn;
+                }
+            }else if( rsp->type != REDIS_ERROR ){
+                // Gone since the SCAN (or not one of gateleen's).
+                log_write(LOG_LVL_DEBUG, "%s%s%s", "Skip '", sorted[i], "': No resource");
+            }
+            if( redis_read(redis, &rsp) ){
+                err = -1; goto endFn; }
+            if( ! isResource ){
+                resetResourceFile(resourceFile);
+                continue;
+            }
+            if( rsp->type == REDIS_STRING ){
+                const double expireMs = strtod(rsp->str, NULL);
+                if( expireMs <= nowMs ){
+                    log_write(LOG_LVL_DEBUG, "%s%s%s", "Skip '", sorted[i], "': Expired");
+                    resetResourceFile(resourceFile);
+                    continue;
+                }
+                if( expireMs < REDIS_EXPIRE_NEVER_MS ){
+                    char val[32];
+                    const int val_len = sprintf(val, "%lld", (long long)((expireMs - nowMs + 999) / 1000));
+                    entryHeaders_add(&resourceFile->headers, "x-expire-after", 14, val, val_len);
+                }
+            }
+            err = copyBufToArchive(resourceFile);
+            if( err ){
+                err = -1; goto endFn; }
+        }
+    }
+    for( size_t i=begin ; i<sorted_len ; ++i ){
+        if( noteMissing(dload, sorted[i], strlen(sorted[i]), "") ){
+            err = -1; goto endFn; }
     }
-    resourceFile->buf_len = 0;
 
     err = 0;
 endFn:
+    if( err == -ENOMEM ){
+        log_write(LOG_LVL_ERROR, "%s", "Out of memory"); }
+    redis_close(redis);
+    free(keys);
+    memBudget_release(&dload->memBudget, paths_cap);
+    free(paths);
+    memBudget_release(&dload->memBudget, keyBuf_cap);
+    free(keyBuf);
+    free(sorted);
+    free(addr.buf);
     return err;
 }
 
 
-/** @return 0:Reject, 1:Accept, <0:ERROR */
-static ssize_t pathFilterAcceptsEntry( ClsDload*dload, ResourceDir*resourceDir, const char*nameOrig ){
+/** Traverses the tree below 'url' and feeds its entries into 'sink'.
+ * @param isListOnly
+ *      If set, only passes the paths (with size zero) and does not fetch any
+ *      resource. */
+static ssize_t pullInto( GateleenResclone*resclone, GateleenResclone_Sink*sink, int isListOnly ){
     ssize_t err;
-    char *name = strdup(nameOrig);
-    uint_t name_len = strlen(name);
+    ClsDload *dload = NULL;
+    AsyncSink async = {0};
+    GateleenResclone_Sink asyncIface;
 
-    if( dload->resclone->filter ){
-        // Count parents to find correct regex to apply.
-        uint_t idx = 0;
-        for( ResourceDir*it=resourceDir->parentDir ; it ; it=it->parentDir ){ ++idx; }
-        // Check if we even have such a long filter at all.
-        if( idx >= dload->resclone->filter_len ){
-            if( dload->resclone->isFilterFull ){
-                //fprintf(stderr, "%s\n", "[DEBUG] Path longer than --filter-full -> reject.");
-                err = 0; goto endFn;
-            }else{
-                //fprintf(stderr, "%s\n", "[DEBUG] Path longer than --filter-part -> accept.");
-                err = 1; goto endFn;
-            }
+    if( resclone->isAutoTune ){
+        autoTune(resclone);
+        resclone->isAutoTune = 0;
+    }
+
+    ClsDload _1 = {0}; dload =&_1;
+    progressBegin(&dload->progress);
+    dload->resclone = resclone;
+    dload->rootUrl = resclone->url;
+    dload->rootUrl_len = strlen(resclone->url);
+    dload->sink = sink;
+    dload->memBudget.limit = resclone->maxMemory;
+    dload->resourceFile.dload = dload;
+    dload->isListOnly = isListOnly;
+    dload->replica = resclone->replica;
+    // Expanding would fetch the bodies we are not interested in. Nor can
+    // embedded bodies be fetched conditionally.
+    dload->isExpandOff = isListOnly || dload->replica;
+    // The replica sink touches the replication state. That is not shared
+    // with a writer thread.
+    if( resclone->writeQueueSize && ! isListOnly && ! dload->replica ){
+        err = AsyncSink_start(&async, dload->sink, resclone->writeQueueSize, &resclone->stats,
+            &dload->memBudget, &asyncIface);
+        if( err ){ err = -1; goto endFn; }
+        dload->sink = &asyncIface;
+    }
+    dload->curl = curl_easy_init();
+    if( dload->curl == NULL ){
+        log_write(LOG_LVL_ERROR, "%s", "curl_easy_init() -> NULL");
+        err = -1; goto endFn;
+    }
+    if( resclone->share && curl_easy_setopt(dload->curl, CURLOPT_SHARE, resclone->share) ){
+        assert(!"CURLOPT_SHARE"); err = -1; goto endFn; }
+    if( resclone->cacheDir && ! isListOnly && ! dload->replica ){
+        dload->cache = cache_open(resclone->cacheDir, resclone->cacheSize);
+        if( dload->cache == NULL ){
+            log_write(LOG_LVL_ERROR, "%s%s%s%s", "Cannot open cache '", resclone->cacheDir, "': ", strerror(errno));
+            err = -1; goto endFn;
         }
-        // We have a regex. Setup the check.
-        int restoreEndSlash = 0;
-        if( name[name_len-1] == '/' ){
-            restoreEndSlash = !0;
-            name[name_len-1] = '\0';
+        // Makes curl parse 'Last-Modified'. The cache revalidates by it.
+        if( curl_easy_setopt(dload->curl, CURLOPT_FILETIME, 1L) ){
+            assert(!"CURLOPT_FILETIME"); err = -1; goto endFn; }
+    }
+    if( resclone->pageSize ){
+        dload->multi = curl_multi_init();
+        if( dload->multi == NULL ){
+            log_write(LOG_LVL_ERROR, "%s", "curl_multi_init() -> NULL");
+            err = -1; goto endFn;
         }
-        //fprintf(stderr, "%s%u%s%s%s\n", "[DEBUG] idx=", idx," name='", name, "'");
-        regex_t *filterArr = dload->resclone->filter;
-        regex_t *r = filterArr + idx;
-        err = regexec(r, name, 0, 0, 0);
-        if( !err ){
-            //fprintf(stderr, "%s\n", "[DEBUG] Segment accepted by filter.");
-            err = 1; /* fall to restoreEndSlash */
-        }else if( err == REG_NOMATCH ){
-            //fprintf(stderr, "%s\n", "[DEBUG] Segment rejected by filter.");
-            err = 0; /* fall to restoreEndSlash */
-        }else{
-            fprintf(stderr, "%s%.*s%s"FMT_SIZE_T"\n", "[ERROR] regexec(rgx, '", (int)name_len, name,
-                "') -> ", err);
-            err = -1; /* fall to restoreEndSlash */
+    }
+    dload->arena = arena_alloc(0, &dload->memBudget);
+    dload->dirNames = strIntern_alloc(DIR_NAMES_MAX, &dload->memBudget);
+    if( dload->arena == NULL || dload->dirNames == NULL ){
+        log_write(LOG_LVL_ERROR, "%s", "Out of memory");
+        err = -1; goto endFn;
+    }
+
+    // Listing only is for push. That must see the whole tree.
+    if( resclone->missingFile && ! isListOnly ){
+        dload->missing = fopen(resclone->missingFile, "w");
+        if( dload->missing == NULL ){
+            log_write(LOG_LVL_ERROR, "%s%s%s%s", "Cannot open '", resclone->missingFile, "': ", strerror(errno));
+            err = -1; goto endFn;
         }
-        if( restoreEndSlash ){
-            name[name_len-1] = '/';
+    }
+    if( resclone->deadline && ! isListOnly ){
+        resclone->deadlineAt = monotonicMs() + (int64_t)resclone->deadline * 1000; }
+
+    if( resclone->redisUrl ){
+        err = pullRedis(dload);
+    }else{
+        // One pass per 'priority' pattern, then one for the rest.
+        err = 0;
+        for( dload->pass=0 ; dload->pass <= resclone->priority_len && !err ; ++dload->pass ){
+            if( dload->pass && isBudgetSpent(dload) ){
+                err = noteMissing(dload, "", 0, ""); /* <- Passes left. */
+                break;
+            }
+            err = gateleenResclone_download(dload, NULL, NULL, NULL);
         }
-        goto endFn;
     }
+    if( err ){
+        err = -1; goto endFn; }
 
-    err = 1; /* accept by default */
+    if( dload->missing ){
+        err = fclose(dload->missing);
+        dload->missing = NULL;
+        if( err ){
+            log_write(LOG_LVL_ERROR, "%s%s%s%s", "Failed to write '", resclone->missingFile, "': ", strerror(errno));
+            err = -1; goto endFn;
+        }
+    }
+    if( resclone->stats.missing && resclone->missingFile ){
+        log_write(dload->isDeadlineHit ? LOG_LVL_WARN : LOG_LVL_INFO, "%s"FMT_SIZE_T"%s%s%s", "Left out ",
+            resclone->stats.missing, " entries. Listed in '", resclone->missingFile, "'.");
+    }else if( resclone->stats.missing ){
+        log_write(LOG_LVL_WARN, "%s"FMT_SIZE_T"%s", "Left out ", resclone->stats.missing,
+            " entries. '--missing' lists them all.");
+    }
+    if( resclone->stats.skippedListings && ! dload->replica ){ /* <- Replication logs per cycle. */
+        log_write(LOG_LVL_WARN, "%s"FMT_SIZE_T"%s", "Skipped ", resclone->stats.skippedListings,
+            " collections as their listing failed.");
+    }
+
+    if( dload->sink->onClose && dload->sink->onClose(dload->sink->cls) ){
+        err = -1; goto endFn; }
+    if( ! isListOnly && ! dload->replica ){ /* <- Replication logs per cycle. */
+        logProgress("Pull", &resclone->stats, &dload->progress, !0); }
+    for( size_t i=0 ; resclone->endpoints && i<endpoints_count(resclone->endpoints) ; ++i ){
+        EndpointStats epStats;
+        endpoints_getStats(resclone->endpoints, i, &epStats);
+        log_write(dload->replica ? LOG_LVL_DEBUG : LOG_LVL_INFO, "%s%s%s%llu%s%llu%s%llu%s%llu%s",
+            "Endpoint '", endpoints_url(resclone->endpoints, i), "': ",
+            (unsigned long long)epStats.requests, " requests, ", (unsigned long long)epStats.failed,
+            " failed, ejected ", (unsigned long long)epStats.ejections, " times, latency ",
+            (unsigned long long)epStats.latencyUs / 1000, "ms");
+    }
+    if( dload->cache ){
+        log_write(LOG_LVL_INFO, "%s"FMT_SIZE_T"%s"FMT_SIZE_T"%s", "Cache served ", resclone->stats.cached,
+            " of ", resclone->stats.entries, " entries.");
+    }
+    if( async.ring ){
+        log_write(LOG_LVL_DEBUG, "%s"FMT_SIZE_T"%s"FMT_SIZE_T"%s"FMT_SIZE_T"%s", "Write queue peak ",
+            resclone->stats.writeQueuePeak, " of ", ring_cap(async.ring), " bytes, waited ",
+            resclone->stats.writeQueueWaits, " times.");
+    }
+
+    err = 0;
 endFn:
-    free(name);
+    if( dload ){
+        for( size_t i=0 ; i<dload->pagers_len ; ++i ){
+            Pager *pager = dload->pagers[i];
+            if( pager == NULL ){ continue; }
+            pagerCancel(dload, pager);
+            curl_easy_cleanup(pager->curl);
+            memBudget_release(&dload->memBudget, pager->buf_cap);
+            free(pager->buf);
+            free(pager->url);
+            free(pager);
+        }
+        free(dload->pagers); dload->pagers = NULL;
+        for( size_t i=0 ; dload->rangeSegs && i<RANGE_SEGMENTS_MAX ; ++i ){
+            curl_easy_cleanup(dload->rangeSegs[i].curl); }
+        free(dload->rangeSegs); dload->rangeSegs = NULL;
+        if( dload->multi ){ curl_multi_cleanup(dload->multi); dload->multi = NULL; }
+        if( dload->cache ){
+            const ssize_t cacheErr = cache_close(dload->cache);
+            if( cacheErr ){
+                log_write(LOG_LVL_WARN, "%s%s%s%s", "Failed to write cache '", resclone->cacheDir, "': ",
+                    strerror(-cacheErr));
+            }
+            dload->cache = NULL;
+        }
+        curl_easy_cleanup(dload->curl);
+        if( dload->missing ){ fclose(dload->missing); dload->missing = NULL; }
+        if( dload->resourceFile.spool ){ fclose(dload->resourceFile.spool); }
+        free(dload->resourceFile.buf); dload->resourceFile.buf = NULL;
+        free(dload->resourceFile.url); dload->resourceFile.url = NULL;
+        free(dload->dirBuf); dload->dirBuf = NULL;
+        strIntern_free(dload->dirNames); dload->dirNames = NULL;
+        arena_free(dload->arena); dload->arena = NULL;
+    }
+    resclone->deadlineAt = 0;
+    AsyncSink_cleanup(&async);
     return err;
 }
 
 
-/** Gets called for every resource to scan/download.
- * HINT: Gets called recursively. */
-static ssize_t gateleenResclone_download( ClsDload*dload , ResourceDir*parentResourceDir , char*entryName ){
+ssize_t gateleenResclone_pull( GateleenResclone*resclone ){
     ssize_t err;
-    char *url = NULL;
-    int url_len = 0;
-    cJSON *jsonRoot = NULL;
-    int resUrl_len = 0;
-    ResourceDir *resourceDir = NULL;
-    ResourceFile *resourceFile = NULL;
+    TarSink tarSink = { .file = resclone->file, .format = resclone->format,
+        .volumeSize = resclone->volumeSize };
+    GateleenResclone_Sink tarSinkIface = {
+        .cls = &tarSink,
+        .onEntryBegin = TarSink_onEntryBegin,
+        .onEntryData = TarSink_onEntryData,
+        .onEntryEnd = TarSink_onEntryEnd,
+        .onClose = TarSink_onClose,
+    };
+    NdjsonSink *ndjsonSink = NULL;
+    GateleenResclone_Sink ndjsonSinkIface;
+    const int isNdjson = resclone->format == GATELEEN_RESCLONE_FORMAT_NDJSON;
 
-    if( entryName == NULL ){
-        /* Is the case when its the root call and not a recursive one */
-        entryName = dload->rootUrl;
+    if( resclone->sink == NULL && resclone->file == NULL && isatty(1) && ! isNdjson ){
+        log_write(LOG_LVL_ERROR, "%s",
+            "Are you sure you wanna write binary content to tty?");
+        err = -1; goto endFn;
+    }
+    if( resclone->sink == NULL && resclone->volumeSize && resclone->file == NULL ){
+        log_write(LOG_LVL_ERROR, "%s", "EINVAL: Volumes need a file name.");
+        err = -1; goto endFn;
     }
 
-    // Stack-Alloc resourceDir-closure.
-    ResourceDir _1 = {0}; resourceDir = &_1;
-    resourceDir->dload = dload;
-    resourceDir->parentDir = parentResourceDir;
-    resourceDir->name = strdup(entryName);
+    if( resclone->sink == NULL && resclone->volumeSize && isNdjson ){
+        log_write(LOG_LVL_ERROR, "%s", "EINVAL: Volumes need tar or zip.");
+        err = -1; goto endFn;
+    }
 
-    // Configure client
-    {
-        url_len = 0;
-        for( ResourceDir*d=resourceDir ; d ; d=d->parentDir ){
-            int len = strlen(d->name) - strspn(d->name, "/");
-            url_len += len;
-        }
-        url = malloc(url_len +1 /*MayPreventReallocLaterForName*/+24);
-        char *u = url + url_len;
-        for( ResourceDir*d=resourceDir ; d ; d=d->parentDir ){
-            char *name = d->name + strspn(d->name, "/");
-            int name_len = strlen(name);
-            memcpy(u-name_len, name, name_len); u -= name_len;
-        }
-        url[url_len] = '\0';
-        //fprintf(stderr, "%s%s%s\n", "[DEBUG] URL '", url, "'");
-        err =  CURLE_OK != curl_easy_setopt(dload->curl, CURLOPT_URL, url)
-            || CURLE_OK != curl_easy_setopt(dload->curl, CURLOPT_FOLLOWLOCATION, 0L)
-            || CURLE_OK != curl_easy_setopt(dload->curl, CURLOPT_WRITEFUNCTION, onCurlDirRsp)
-            || CURLE_OK != curl_easy_setopt(dload->curl, CURLOPT_WRITEDATA, resourceDir)
-            ;
-        if( err ){
-            assert(!err); err = -1; goto endFn; }
+    if( resclone->sink == NULL && isNdjson ){
+        ndjsonSink = ndjsonSink_alloc(resclone->file);
+        if( ndjsonSink == NULL ){
+            err = -ENOMEM; goto endFn; }
+        ndjsonSinkIface = ndjsonSink_iface(ndjsonSink);
     }
 
-    err = curl_easy_perform(dload->curl);
-    if( err != CURLE_OK ){
-        fprintf(stderr, "%s%s%s"FMT_SIZE_T"%s%s\n",
-            "[ERROR] '", url, "' (code ", err, "): ", curl_easy_strerror(err));
+    err = pullInto(resclone, resclone->sink ? resclone->sink : isNdjson ? &ndjsonSinkIface : &tarSinkIface, 0);
+    if( err ){
+        err = -1; goto endFn; }
+
+    err = 0;
+endFn:
+    TarSink_cleanup(&tarSink);
+    ndjsonSink_free(ndjsonSink);
+    return err;
+}
+
+
+/** Pushes the archive 'file' (NULL for stdin) or 'source' if set. Adds what
+ * it did to 'stats'. */
+static ssize_t pushOne( GateleenResclone*resclone, const char*file, GateleenResclone_Source*source,
+    CURLSH*share, GateleenResclone_Stats*stats, uint_t partIdx, uint_t partCount )
+{
+    ssize_t err;
+    Upload *upload = NULL;
+    TarSource tarSource = { .file = file, .partIdx = partIdx, .partCount = partCount };
+    GateleenResclone_Source tarSourceIface = {
+        .cls = &tarSource,
+        .nextEntry = TarSource_nextEntry,
+        .read = TarSource_read,
+    };
+    NdjsonSource *ndjsonSource = NULL;
+    GateleenResclone_Source ndjsonSourceIface;
+
+    Upload _1={0}; upload =&_1;
+    progressBegin(&upload->progress);
+    upload->resclone = resclone;
+    if( source == NULL && isNdjsonInput(resclone, file) ){
+        ndjsonSource = ndjsonSource_alloc(file);
+        if( ndjsonSource == NULL ){
+            err = -ENOMEM; goto endFn; }
+        ndjsonSourceIface = ndjsonSource_iface(ndjsonSource);
+        source = &ndjsonSourceIface;
+    }
+    upload->source = source ? source : &tarSourceIface;
+    upload->rootUrl = resclone->url;
+    upload->curl = curl_easy_init();
+    if( ! upload->curl ){
+        log_write(LOG_LVL_ERROR, "%s", "curl_easy_init() -> NULL");
         err = -1; goto endFn;
     }
+    if( share && curl_easy_setopt(upload->curl, CURLOPT_SHARE, share) ){
+        assert(!"CURLOPT_SHARE"); err = -1; goto endFn; }
+
+    err = readArchive(upload);
+    if( err ){
+        err = -1; goto endFn; }
+
+    if( upload->source->onClose && upload->source->onClose(upload->source->cls) ){
+        err = -1; goto endFn; }
 
-    if( resourceDir->rspCode == ERR_PARSE_DIR_LIST ){
-        err = 0; goto endFn; /* Already logged by sub-ctxt. Simply skip to next entry. */
+    err = 0;
+endFn:
+    if( upload ){
+        curl_easy_cleanup(upload->curl);
+        stats->entries += upload->stats.entries;
+        stats->bytes += upload->stats.bytes;
+        stats->failed += upload->stats.failed;
     }
-    if( resourceDir->rspCode != 200 ){
-        // Ugh? Just one request earlier, server said there's a directory on
-        // that URL. Nevermind. Just skip it and at least download the other
-        // stuff.
-        fprintf(stderr, "%s%d%s%s%s\n", "[INFO ] Skip HTTP ", resourceDir->rspCode, " -> '", url, "'");
-        err = 0; goto endFn;
+    TarSource_cleanup(&tarSource);
+    ndjsonSource_free(ndjsonSource);
+    return err;
+}
+
+
+static void* pushVolumesWorker( void*PushVolumes_ ){
+    PushVolumes *push = PushVolumes_;
+    Resclone *resclone = push->resclone;
+    for(;;){
+        pthread_mutex_lock(&push->mutex);
+        uint_t iVolume = push->nextVolume++;
+        const int isDone = iVolume >= push->volumes_len || push->result;
+        pthread_mutex_unlock(&push->mutex);
+        if( isDone ){
+            break; }
+        char *volumeFile = push->isParts ? strdup(resclone->file) : volumeFileName(resclone->file, iVolume);
+        if( volumeFile == NULL ){
+            pthread_mutex_lock(&push->mutex);
+            push->result = -ENOMEM;
+            pthread_mutex_unlock(&push->mutex);
+            break;
+        }
+        GateleenResclone_Stats stats = {0};
+        ssize_t err;
+        if( push->isParts ){
+            log_write(LOG_LVL_DEBUG, "%s%u%s%u%s%s%s", "Push part ", iVolume, " of ", push->volumes_len,
+                " of '", volumeFile, "'");
+            err = pushOne(resclone, volumeFile, NULL, NULL, &stats, iVolume, push->volumes_len);
+        }else{
+            log_write(LOG_LVL_INFO, "%s%s%s", "Push volume '", volumeFile, "'");
+            err = pushOne(resclone, volumeFile, NULL, NULL, &stats, 0, 0);
+        }
+        free(volumeFile);
+        pthread_mutex_lock(&push->mutex);
+        resclone->stats.entries += stats.entries;
+        resclone->stats.bytes += stats.bytes;
+        resclone->stats.failed += stats.failed;
+        if( err && push->result == 0 ){ push->result = err; }
+        pthread_mutex_unlock(&push->mutex);
     }
+    return NULL;
+}
 
-    // Parse the collected response body.
-    jsonRoot = cJSON_Parse(resourceDir->rspBody);
-    if( ! cJSON_IsObject(jsonRoot) ){ // TODO: Handle case
-        fprintf(stderr, "%s\n", "[ERROR] JSON root expected to be object but is not.");
-        err = -1; goto endFn;
+
+/** Pushes all volumes of a volume set, up to 'parallel' at once. Volumes are
+ * independent archives. So their order does not matter. With 'isParts' the
+ * single archive 'file' gets pushed as 'volumes_len' interleaved parts
+ * instead. */
+static ssize_t pushVolumes( GateleenResclone*resclone, uint_t volumes_len, int isParts ){
+    ssize_t err;
+    pthread_t *threads = NULL;
+    uint_t threads_len = 0;
+    int isMutexInit = 0;
+    PushVolumes push = { .resclone = resclone, .volumes_len = volumes_len, .isParts = isParts };
+
+    if( pthread_mutex_init(&push.mutex, NULL) ){
+        err = -1; goto endFn; }
+    isMutexInit = !0;
+
+    uint_t threads_cap = resclone->parallel < volumes_len ? resclone->parallel : volumes_len;
+    threads = calloc(threads_cap ? threads_cap : 1, sizeof*threads);
+    if( threads == NULL ){
+        err = -ENOMEM; goto endFn; }
+    for( ; threads_len < threads_cap ; ++threads_len ){
+        if( pthread_create(threads + threads_len, NULL, pushVolumesWorker, &push) ){
+            log_write(LOG_LVL_WARN, "%s%u%s", "Only got ", threads_len, " worker threads.");
+            break;
+        }
+    }
+    if( threads_len == 0 ){
+        pushVolumesWorker(&push); /* Do it ourself then. */
+    }
+    for( uint_t i=0 ; i<threads_len ; ++i ){
+        pthread_join(threads[i], NULL);
     }
 
-    /* Do some validations to get to the payload we're interested in. */
-    if( cJSON_GetArraySize(jsonRoot) != 1 ){
-        fprintf(stderr, "%s%d\n", "[ERROR] JSON root expected ONE child but got ",
-            cJSON_GetArraySize(jsonRoot));
-        err = -1; goto endFn;
+    err = push.result ? -1 : 0;
+endFn:
+    free(threads);
+    if( isMutexInit ){ pthread_mutex_destroy(&push.mutex); }
+    return err;
+}
+
+
+/** @return Non-zero if 'file' is a zip. Its central directory lets each
+ *      reader skip to the entries it wants. */
+static int isZipFile( const char*file ){
+    char magic[4];
+    FILE *f = fopen(file, "rb");
+    if( f == NULL ){
+        return 0; }
+    const int isZip = fread(magic, 1, sizeof magic, f) == sizeof magic && !memcmp(magic, "PK\3\4", 4);
+    fclose(f);
+    return isZip;
+}
+
+
+/** @return Non-zero if 'file' is a tar.zst with seek table. Its frames can
+ *      be decompressed by several readers independently. */
+static int isSeekableZstdFile( const char*file ){
+    ZstdSeekFrame *frames = NULL;
+    size_t frames_len;
+    const ssize_t isSeekable = zstdseek_readTable(file, &frames, &frames_len) > 0;
+    free(frames);
+    return isSeekable && frames_len > 1;
+}
+
+
+/** @return Count of volumes 'file' got split into by '--volume-size'. Zero
+ *      if 'file' is no volume set. */
+static ssize_t countVolumes( const char*file ){
+    if( file == NULL || access(file, F_OK) == 0 ){
+        return 0; } /* A plain archive. */
+    for( uint_t idx=0 ;; ++idx ){
+        char *volumeFile = volumeFileName(file, idx);
+        if( volumeFile == NULL ){
+            return -ENOMEM; }
+        int isPresent = access(volumeFile, F_OK) == 0;
+        free(volumeFile);
+        if( ! isPresent ){
+            return idx; }
     }
-    cJSON *data = jsonRoot->child;
-    //fprintf(stderr, "%s%s%s\n", "[DEBUG] Processing json['", data->string, "']");
-    if( ! cJSON_IsArray(data) ){
-        fprintf(stderr, "%s%s%s\n", "[ERROR] json['", data->string,
-            "'] expected to be an array. But is not.");
-        err = -1; goto endFn;
+}
+
+
+static size_t onVerifyChunk( char*buf, size_t size, size_t nmemb, void*VerifySlot_ ){
+    VerifySlot *slot = VerifySlot_;
+    const size_t buf_len = size * nmemb;
+    slot->gotHash = hash_fnv1a64(slot->gotHash, buf, buf_len);
+    slot->gotSize += buf_len;
+    return buf_len;
+}
+
+
+/** Compares what 'slot' got with what it expected. Reports a mismatch (if
+ * any) and frees the slot. */
+static void verifyFinish( VerifySlot*slot, GateleenResclone_Stats*stats ){
+    long rspCode = 0;
+    char detail[96];
+    curl_easy_getinfo(slot->curl, CURLINFO_RESPONSE_CODE, &rspCode);
+    detail[0] = '\0';
+    if( slot->transfer.result != CURLE_OK ){
+        snprintf(detail, sizeof detail, "%s%s", "transfer failed: ", curl_easy_strerror(slot->transfer.result));
+    }else if( rspCode != 200 ){
+        snprintf(detail, sizeof detail, "%s%ld", rspCode == 404 ? "missing, HTTP " : "HTTP ", rspCode);
+    }else if( slot->gotSize != slot->expectSize ){
+        snprintf(detail, sizeof detail, "%s"FMT_SIZE_T"%s"FMT_SIZE_T, "size ", slot->gotSize,
+            " instead of ", slot->expectSize);
+    }else if( slot->gotHash != slot->expectHash ){
+        snprintf(detail, sizeof detail, "%s", "content differs");
     }
+    stats->verified += 1;
+    if( detail[0] ){
+        stats->mismatched += 1;
+        printf("%s\t%s\t%s\n", "MISMATCH", slot->path, detail);
+    }
+    slot->isBusy = 0;
+}
 
-    // Iterate all the entries we have to process.
-    ResourceFile _2 = {0}; resourceFile =&_2;
-    resourceFile->dload = dload;
-    uint_t iDirEntry = 0;
-    for( cJSON *arrEntry=data->child ; arrEntry!=NULL ; arrEntry=arrEntry->next ){
-        if( ! cJSON_IsString(arrEntry) ){
-            fprintf(stderr, "%s%s%s%u%s\n", "[ERROR] ", data->string, "['", iDirEntry,
-                "'] expected to be a string. But is not." );
-            err = -1; goto endFn;
-        }
-        //fprintf(stderr, "%s%s%s%u%s%s\n", "[DEBUG] ", data->string, "[", iDirEntry, "] -> ", arrEntry->valuestring);
-        char *name = arrEntry->valuestring;
-        int name_len = strlen(name);
 
-        err = pathFilterAcceptsEntry(dload, resourceDir, name);
-        if( err < 0 ){ /* ERROR */
-            goto endFn;
-        }else if( err == 0 ){ /* REJECT */
-            fprintf(stderr, "%s%s%s%s\n", "[INFO ] Skip     '", url, name, "'  (filtered)");
-            continue;
-        }else{ /* ACCEPT */
-            /* Go ahead */
-        }
+/** Reads archive 'file' once more and compares each entry with what the
+ * target returns for it. Up to 'slots_len' requests run concurrently. */
+static ssize_t verifyOne( GateleenResclone*resclone, const char*file, CURLM*multi,
+    VerifySlot*slots, uint_t slots_len, GateleenResclone_Stats*stats )
+{
+    ssize_t err;
+    TarSource tarSource = { .file = file };
+    GateleenResclone_Source tarSourceIface = {
+        .cls = &tarSource,
+        .nextEntry = TarSource_nextEntry,
+        .read = TarSource_read,
+    };
+    NdjsonSource *ndjsonSource = NULL;
+    GateleenResclone_Source ndjsonSourceIface;
+    GateleenResclone_Source *source = &tarSourceIface;
+    char *buf = NULL;
+    const size_t buf_cap = 1<<16;
+    size_t rootUrl_len = strlen(resclone->url);
+    if( rootUrl_len && resclone->url[rootUrl_len-1] == '/' ){
+        rootUrl_len -= 1; }
 
-        if( name[name_len-1] == '/' ){ /* Gateleen reports a 'directory' */
-            //fprintf(stderr, "%s%s%s%s\n", "[DEBUG] Scan     '", url, name,"'");
-            err = gateleenResclone_download(dload, resourceDir, name);
-            if( err ){
-                goto endFn; }
-        }else{ /* Not a 'dir'? Then assume 'file' */
-            int requiredLen = url_len + 1/*slash*/ + name_len;
-            if( resUrl_len < requiredLen ){
-                void *tmp = realloc(resourceFile->url, requiredLen +1);
-                if( tmp == NULL ){
-                    err = -ENOMEM; goto endFn; }
-                resourceFile->url = tmp;
-                resUrl_len = requiredLen;
+    buf = malloc(buf_cap);
+    if( buf == NULL ){
+        err = -ENOMEM; goto endFn; }
+    if( isNdjsonInput(resclone, file) ){
+        ndjsonSource = ndjsonSource_alloc(file);
+        if( ndjsonSource == NULL ){
+            err = -ENOMEM; goto endFn; }
+        ndjsonSourceIface = ndjsonSource_iface(ndjsonSource);
+        source = &ndjsonSourceIface;
+    }
+    for(;;){
+        GateleenResclone_Entry entry = {0};
+        err = source->nextEntry(source->cls, &entry);
+        if( err < 0 ){
+            err = -1; goto endFn; }
+        if( err == 0 ){
+            break; } /* EOF */
+        // Hash while reading. Bodies never get buffered as a whole.
+        uint64_t hash = HASH_FNV1A64_INIT;
+        size_t size = 0;
+        for( ssize_t readLen ; (readLen = source->read(source->cls, buf, buf_cap)) != 0 ;){
+            if( readLen < 0 ){
+                err = -1; goto endFn; }
+            hash = hash_fnv1a64(hash, buf, readLen);
+            size += readLen;
+        }
+        VerifySlot *slot = NULL;
+        while( slot == NULL ){
+            for( uint_t i=0 ; i<slots_len ; ++i ){
+                if( slots[i].isBusy && ! slots[i].transfer.isRunning ){
+                    verifyFinish(slots + i, stats); }
+                if( ! slots[i].isBusy && slot == NULL ){
+                    slot = slots + i; }
             }
-            sprintf(resourceFile->url, "%s%s", url, name);
-            fprintf(stderr, "%s%s%s\n", "[INFO ] Download '", resourceFile->url, "'");
-            resourceFile->buf_len = 0; // <- Reset before use.
-            collectResourceIntoMemory(resourceFile, resourceFile->url);
-            copyBufToArchive(resourceFile);
+            if( slot == NULL && pumpMulti(multi) ){
+                err = -1; goto endFn; }
         }
+        const size_t path_len = strlen(entry.path);
+        if(    memBudget_growBuf(NULL, 0, &slot->path, &slot->path_cap, path_len +1)
+            || memBudget_growBuf(NULL, 0, &slot->url, &slot->url_cap, rootUrl_len + 1 + path_len +1) )
+        {
+            err = -ENOMEM; goto endFn; }
+        memcpy(slot->path, entry.path, path_len +1);
+        sprintf(slot->url, "%.*s/%s", (int)rootUrl_len, resclone->url, entry.path);
+        slot->expectSize = size;
+        slot->expectHash = hash;
+        slot->gotSize = 0;
+        slot->gotHash = HASH_FNV1A64_INIT;
+        err =  CURLE_OK != curl_easy_setopt(slot->curl, CURLOPT_URL, slot->url)
+            || CURLE_OK != curl_easy_setopt(slot->curl, CURLOPT_FOLLOWLOCATION, 0L)
+            || CURLE_OK != curl_easy_setopt(slot->curl, CURLOPT_WRITEFUNCTION, onVerifyChunk)
+            || CURLE_OK != curl_easy_setopt(slot->curl, CURLOPT_WRITEDATA, slot)
+            || CURLE_OK != curl_easy_setopt(slot->curl, CURLOPT_PRIVATE, &slot->transfer)
+            ;
+        if( err ){
+            assert(!err); err = -1; goto endFn; }
+        if( curl_multi_add_handle(multi, slot->curl) ){
+            err = -1; goto endFn; }
+        slot->transfer.isRunning = !0;
+        slot->isBusy = !0;
+    }
 
-        iDirEntry += 1;
+    // Wait for the requests still in flight.
+    for( uint_t i=0 ; i<slots_len ; ++i ){
+        while( slots[i].transfer.isRunning ){
+            if( pumpMulti(multi) ){
+                err = -1; goto endFn; }
+        }
+        if( slots[i].isBusy ){
+            verifyFinish(slots + i, stats); }
     }
 
-    err = 0; /* OK */
+    err = 0;
 endFn:
-    if( jsonRoot != NULL ){ cJSON_Delete(jsonRoot); }
-    if( resourceFile ){
-        free(resourceFile->buf); resourceFile->buf = NULL;
-        free(resourceFile->url); resourceFile->url = NULL;
+    TarSource_cleanup(&tarSource);
+    ndjsonSource_free(ndjsonSource);
+    free(buf);
+    return err;
+}
+
+
+/** Compares the target with the archive (or each volume of it) just
+ * pushed. */
+static ssize_t verifyPush( GateleenResclone*resclone, ssize_t volumes_len ){
+    ssize_t err;
+    CURLM *multi = NULL;
+    VerifySlot *slots = NULL;
+    const uint_t slots_len = resclone->verifyParallel;
+    char *volumeFile = NULL;
+    GateleenResclone_Stats *stats = &resclone->stats;
+    struct timespec begin;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+
+    multi = curl_multi_init();
+    slots = calloc(slots_len, sizeof*slots);
+    if( multi == NULL || slots == NULL ){
+        log_write(LOG_LVL_ERROR, "%s", "Out of memory");
+        err = -1; goto endFn;
+    }
+    for( uint_t i=0 ; i<slots_len ; ++i ){
+        slots[i].curl = curl_easy_init();
+        if( slots[i].curl == NULL ){
+            log_write(LOG_LVL_ERROR, "%s", "curl_easy_init() -> NULL");
+            err = -1; goto endFn;
+        }
+        if( resclone->share && curl_easy_setopt(slots[i].curl, CURLOPT_SHARE, resclone->share) ){
+            assert(!"CURLOPT_SHARE"); err = -1; goto endFn; }
     }
-    if( resourceDir ){
-        free(resourceDir->name); resourceDir->name = NULL;
-        free(resourceDir->rspBody); resourceDir->rspBody = NULL;
+    stats->verified = 0;
+    stats->mismatched = 0;
+    for( ssize_t iVolume=0 ; iVolume < (volumes_len ? volumes_len : 1) ; ++iVolume ){
+        if( volumes_len ){
+            free(volumeFile);
+            volumeFile = volumeFileName(resclone->file, iVolume);
+            if( volumeFile == NULL ){
+                err = -ENOMEM; goto endFn; }
+        }
+        err = verifyOne(resclone, volumes_len ? volumeFile : resclone->file, multi, slots, slots_len, stats);
+        if( err ){
+            err = -1; goto endFn; }
     }
-    free(url);
+    fflush(stdout);
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    log_write(stats->mismatched ? LOG_LVL_ERROR : LOG_LVL_INFO, "%s"FMT_SIZE_T"%s"FMT_SIZE_T"%s%.1f%s",
+        "Verify done. ", stats->verified, " entries, ", stats->mismatched, " mismatched, ",
+        (now.tv_sec - begin.tv_sec) + (now.tv_nsec - begin.tv_nsec) / 1e9, "s");
+    if( stats->mismatched ){
+        err = -1; goto endFn; }
+
+    err = 0;
+endFn:
+    for( uint_t i=0 ; slots && i<slots_len ; ++i ){
+        if( slots[i].transfer.isRunning ){
+            curl_multi_remove_handle(multi, slots[i].curl); }
+        curl_easy_cleanup(slots[i].curl);
+        free(slots[i].path);
+        free(slots[i].url);
+    }
+    free(slots);
+    if( multi ){ curl_multi_cleanup(multi); }
+    free(volumeFile);
     return err;
 }
 
 
-static void Resclone_free( Resclone*resclone ){
-    if( resclone == NULL ) return;
-    // TODO need free? -> char *url;
-    // TODO need free? -> regex_t *filter;
-    // TODO need free? -> char *file;
-    free(resclone);
+static ssize_t MirrorSink_onEntryBegin( void*MirrorSink_, const GateleenResclone_Entry*entry ){
+    MirrorSink *mirror = MirrorSink_;
+    if( pathIndex_contains(mirror->index, entry->path) ){
+        return 0; }
+    const size_t path_len = strlen(entry->path);
+    if( memBudget_growBuf(NULL, 0, &mirror->extras, &mirror->extras_cap, mirror->extras_len + path_len +1) ){
+        log_write(LOG_LVL_ERROR, "%s", "Out of memory");
+        return -1;
+    }
+    memcpy(mirror->extras + mirror->extras_len, entry->path, path_len +1);
+    mirror->extras_len += path_len +1;
+    return 0;
 }
 
 
-static Resclone* Resclone_alloc(){
-    ssize_t err;
-    Resclone *resclone = NULL;
-
-    err = curl_global_init(CURL_GLOBAL_ALL);
-    if( err ){
-        assert(!err); goto fail; }
+static ssize_t MirrorSink_onEntryData( void*MirrorSink_, const char*buf, size_t buf_len ){
+    (void)MirrorSink_; (void)buf; (void)buf_len;
+    return 0; /* List only. There is no data. */
+}
 
-    resclone = calloc(1, sizeof*resclone);
 
-    return resclone;
-    fail:
-    Resclone_free(resclone);
-    return NULL;
+static ssize_t MirrorSink_onEntryEnd( void*MirrorSink_ ){
+    (void)MirrorSink_;
+    return 0;
 }
 
 
-static size_t onUploadChunkRequested( char*buf, size_t size, size_t count, void*Put_ ){
-    int err;
-    Put *put = Put_;
-    Upload *upload = put->upload;
-    const size_t buf_len = size * count;
+static size_t onMirrorRsp( char*buf, size_t size, size_t nmemb, void*cls ){
+    (void)buf; (void)cls;
+    return size * nmemb;
+}
 
-    ssize_t readLen = archive_read_data(upload->srcArchive, buf, buf_len);
-    //fprintf(stderr, "%s%lu%s\n", "[DEBUG] Cpy ", readLen, " bytes.");
-    if( readLen < 0 ){
-        fprintf(stderr, "%s"FMT_SIZE_T"%s%s\n", "[ERROR] Failed to read from archive (code ",
-            readLen, "): ", archive_error_string(upload->srcArchive));
-        err = -1; goto endFn;
-    }else if( readLen > 0 ){
-        // Regular read. Data already written to 'buf'. Only need to adjust
-        // return val.
-        err = readLen; goto endFn;
-    }else{ // EOF
-        assert(readLen == 0);
-        err = 0; goto endFn;
-    }
 
-    assert(!"Unreachable code");
-endFn:
-    //fprintf(stderr, "%s%s%s%ld\n", "[DEBUG] ", __func__, "() -> ", err);
-    return err >= 0 ? err : CURL_READFUNC_ABORT;
+/** Evaluates a completed DELETE and frees its slot. */
+static void mirrorFinish( MirrorSlot*slot, GateleenResclone_Stats*stats,
+    void(*onDeleted)(void*,const char*), void*cls )
+{
+    long rspCode = 0;
+    curl_easy_getinfo(slot->curl, CURLINFO_RESPONSE_CODE, &rspCode);
+    if( slot->transfer.result != CURLE_OK ){
+        log_write(LOG_LVL_WARN, "%s%s%s%s", "DELETE '", slot->url, "': ", curl_easy_strerror(slot->transfer.result));
+        stats->failed += 1;
+    }else if( (rspCode < 200 || rspCode >= 300) && rspCode != 404 ){
+        // 404 is fine. Someone else was faster.
+        log_write(LOG_LVL_WARN, "%s%ld%s%s%s", "Got RspCode ", rspCode, " for 'DELETE ", slot->url, "'");
+        stats->failed += 1;
+    }else{
+        stats->deleted += 1;
+        if( onDeleted ){ onDeleted(cls, slot->path); }
+    }
+    slot->isBusy = 0;
 }
 
 
-static ssize_t addContentTypeHeader( Put*put, struct curl_slist *reqHdrs ){
+/** DELETEs the zero separated 'paths' below 'rootUrl', up to
+ * 'mirrorParallel' at once. Prints each path to stdout.
+ * @param onDeleted
+ *      (optional) Gets called with each path which is gone now. */
+static ssize_t deletePaths( GateleenResclone*resclone, const char*rootUrl, const char*paths,
+    size_t paths_len, void(*onDeleted)(void*,const char*), void*cls )
+{
     ssize_t err;
-    char *contentTypeHdr = NULL;
-    Upload *upload = put->upload;
-    const char *name = put->name;
+    CURLM *multi = NULL;
+    MirrorSlot *slots = NULL;
+    const uint_t slots_len = resclone->mirrorParallel;
+    GateleenResclone_Stats *stats = &resclone->stats;
+    size_t rootUrl_len = strlen(rootUrl);
+    if( rootUrl_len && rootUrl[rootUrl_len-1] == '/' ){
+        rootUrl_len -= 1; }
 
-    uint_t name_len = strlen(put->name);
-    // Find file extension.
-    const char *ext = name + name_len;
-    for(; ext>name && *ext!='.' && *ext!='/' ; --ext );
-    // Convert it to mime type.
-    const char *mimeType;
-    if( *ext == '.' ){
-        mimeType = fileExtToMime(ext +1); // <- +1, to skip the (useless) dot.
-        if( mimeType ){
-            //fprintf(stderr, "%s%s%s%s%s\n", "[DEBUG] Resolved file ext '", ext+1,"' to mime '", mimeType?mimeType:"<null>", "'.");
-        }
-    }else if( *ext=='/' || ext==name || *ext=='\0' ){ // TODO Explain why 0x00.
-        mimeType = "application/json";
-        //fprintf(stderr, "%s\n", "[DEBUG] No file extension. Fallback to json (gateleen default)");
-    }else{
-        mimeType = NULL;
+    multi = curl_multi_init();
+    slots = calloc(slots_len, sizeof*slots);
+    if( multi == NULL || slots == NULL ){
+        log_write(LOG_LVL_ERROR, "%s", "Out of memory");
+        err = -1; goto endFn;
     }
-    if( mimeType == NULL ){
-        //fprintf(stderr, "%s%s%s\n", "[DEBUG] Unknown file extension '", ext+1, "'. Will NOT add Content-Type header.");
-        mimeType = ""; // <- Need to 'remove' header. To do this, pass an empty value to curl.
+    for( size_t off=0 ; off < paths_len ; ){
+        const char *path = paths + off;
+        off += strlen(path) +1;
+        printf("%s\t%s\n", "DELETE", path);
+        if( resclone->isDryRun ){
+            stats->deleted += 1;
+            continue;
+        }
+        MirrorSlot *slot = NULL;
+        while( slot == NULL ){
+            for( uint_t i=0 ; i<slots_len ; ++i ){
+                if( slots[i].isBusy && ! slots[i].transfer.isRunning ){
+                    mirrorFinish(slots + i, stats, onDeleted, cls); }
+                if( ! slots[i].isBusy && slot == NULL ){
+                    slot = slots + i; }
+            }
+            if( slot == NULL && pumpMulti(multi) ){
+                err = -1; goto endFn; }
+        }
+        if( slot->curl == NULL ){
+            slot->curl = curl_easy_init();
+            if( slot->curl == NULL ){
+                log_write(LOG_LVL_ERROR, "%s", "curl_easy_init() -> NULL");
+                err = -1; goto endFn;
+            }
+            if( resclone->share && curl_easy_setopt(slot->curl, CURLOPT_SHARE, resclone->share) ){
+                assert(!"CURLOPT_SHARE"); err = -1; goto endFn; }
+        }
+        if( memBudget_growBuf(NULL, 0, &slot->url, &slot->url_cap, rootUrl_len + 1 + strlen(path) +1) ){
+            err = -ENOMEM; goto endFn; }
+        sprintf(slot->url, "%.*s/%s", (int)rootUrl_len, rootUrl, path);
+        slot->path = path;
+        log_write(LOG_LVL_DEBUG, "%s%s%s", "Delete '", slot->url, "'");
+        err =  CURLE_OK != curl_easy_setopt(slot->curl, CURLOPT_URL, slot->url)
+            || CURLE_OK != curl_easy_setopt(slot->curl, CURLOPT_CUSTOMREQUEST, "DELETE")
+            || CURLE_OK != curl_easy_setopt(slot->curl, CURLOPT_WRITEFUNCTION, onMirrorRsp)
+            || CURLE_OK != curl_easy_setopt(slot->curl, CURLOPT_PRIVATE, &slot->transfer)
+            ;
+        if( err ){
+            assert(!err); err = -1; goto endFn; }
+        if( curl_multi_add_handle(multi, slot->curl) ){
+            err = -1; goto endFn; }
+        slot->transfer.isRunning = !0;
+        slot->isBusy = !0;
     }
-    uint_t mimeType_len = strlen(mimeType);
-    static const char contentTypePrefix[] = "Content-Type: ";
-    static const uint_t contentTypePrefix_len = sizeof(contentTypePrefix)-1;
-    contentTypeHdr = malloc( contentTypePrefix_len + mimeType_len +1 );
-    memcpy(contentTypeHdr , contentTypePrefix , contentTypePrefix_len);
-    memcpy(contentTypeHdr+contentTypePrefix_len , mimeType , mimeType_len+1);
-    reqHdrs = curl_slist_append(reqHdrs, contentTypeHdr);
-    err = curl_easy_setopt(upload->curl, CURLOPT_HTTPHEADER, reqHdrs);
-    if( err ){
-        fprintf(stderr, "%s"FMT_SIZE_T"\n", "[ERROR] curl_easy_setopt(_, HTTPHEADER, _): ", err);
-        assert(!err); err = -1; goto endFn; }
+    for( uint_t i=0 ; i<slots_len ; ++i ){
+        while( slots[i].transfer.isRunning ){
+            if( pumpMulti(multi) ){
+                err = -1; goto endFn; }
+        }
+        if( slots[i].isBusy ){
+            mirrorFinish(slots + i, stats, onDeleted, cls); }
+    }
+    fflush(stdout);
 
     err = 0;
 endFn:
-    free(contentTypeHdr);
+    for( uint_t i=0 ; slots && i<slots_len ; ++i ){
+        if( slots[i].transfer.isRunning ){
+            curl_multi_remove_handle(multi, slots[i].curl); }
+        curl_easy_cleanup(slots[i].curl);
+        free(slots[i].url);
+    }
+    free(slots);
+    if( multi ){ curl_multi_cleanup(multi); }
     return err;
 }
 
 
-static ssize_t httpPutEntry( Put*put ){
+/** Body of one poll of 'waitQueues'. */
+typedef struct QueuePoll {
+    char *buf;
+    size_t buf_len;
+    size_t buf_cap;
+    /** Body got too large to keep. The queue is far from empty then. */
+    int isTruncated;
+} QueuePoll;
+
+
+static size_t onQueuePollChunk( char*buf, size_t size, size_t nmemb, void*QueuePoll_ ){
+    QueuePoll *poll = QueuePoll_;
+    const size_t buf_len = size * nmemb;
+    if( poll->isTruncated || poll->buf_len + buf_len >= RESOURCE_BUF_KEEP_MAX ){
+        poll->isTruncated = !0;
+        return buf_len;
+    }
+    if( memBudget_growBuf(NULL, 0, &poll->buf, &poll->buf_cap, poll->buf_len + buf_len +1) ){
+        return 0; }
+    memcpy(poll->buf + poll->buf_len, buf, buf_len);
+    poll->buf_len += buf_len;
+    poll->buf[poll->buf_len] = '\0';
+    return buf_len;
+}
+
+
+/** Tells how many requests a queue still holds from what the monitoring
+ * API answered. That is '{"count":n}' for '?count'. Servers ignoring it
+ * list the requests as '{"<name>":[...]}' instead.
+ * @return Count of requests or -1 if malformed. */
+static ssize_t queuePending( const char*body ){
+    ssize_t pending = -1;
+    cJSON *json = cJSON_Parse(body);
+    if( cJSON_IsObject(json) ){
+        const cJSON *count = cJSON_GetObjectItemCaseSensitive(json, "count");
+        if( cJSON_IsNumber(count) && count->valuedouble >= 0 ){
+            pending = count->valuedouble;
+        }else if( json->child && cJSON_IsArray(json->child) ){
+            pending = cJSON_GetArraySize(json->child);
+        }
+    }
+    cJSON_Delete(json);
+    return pending;
+}
+
+
+/** Polls the queues of '--via-queue' until none of them holds a request
+ * anymore. Fails if they still do after 'queueWait' seconds. */
+static ssize_t waitQueues( GateleenResclone*resclone ){
     ssize_t err;
-    Upload *upload = put->upload;
+    CURL *curl = NULL;
     char *url = NULL;
-    struct curl_slist *reqHdrs = NULL;
+    QueuePoll poll = { .buf = NULL };
+    static const size_t hdrPrefix_len = sizeof "x-queue: " -1;
+    const int64_t begin = monotonicMs();
+    const int64_t end = begin + (int64_t)resclone->queueWait * 1000;
+    /* Queues before this one were found empty already. */
+    uint_t drained = 0;
+    size_t pending;
 
-    int rootUrl_len = strlen(upload->rootUrl);
-    if( upload->rootUrl[rootUrl_len-1]=='/' ){
-        rootUrl_len -= 1;
+    size_t url_cap = 0;
+    for( uint_t i=0 ; i<resclone->queueHdrs_len ; ++i ){
+        const size_t len = strlen(resclone->queueHdrs[i]);
+        if( url_cap < len ){ url_cap = len; }
     }
-    int url_len = strlen(upload->rootUrl) + strlen(put->name);
-    url = malloc(url_len +2);
-    if( url == NULL ){
-        err = -ENOMEM; goto endFn; }
-    sprintf(url, "%.*s/%s", rootUrl_len,upload->rootUrl, put->name);
-    err =  CURLE_OK != curl_easy_setopt(upload->curl, CURLOPT_URL, url)
-        || addContentTypeHeader(put, reqHdrs)
+    url_cap += strlen(resclone->queueApiUrl) + sizeof "?count";
+    url = malloc(url_cap);
+    curl = curl_easy_init();
+    if( url == NULL || curl == NULL ){
+        log_write(LOG_LVL_ERROR, "%s", "Out of memory");
+        err = -1; goto endFn;
+    }
+    if( resclone->share && curl_easy_setopt(curl, CURLOPT_SHARE, resclone->share) ){
+        assert(!"CURLOPT_SHARE"); err = -1; goto endFn; }
+    err =  CURLE_OK != curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, onQueuePollChunk)
+        || CURLE_OK != curl_easy_setopt(curl, CURLOPT_WRITEDATA, &poll)
         ;
     if( err ){
         assert(!err); err = -1; goto endFn; }
-
-    fprintf(stderr, "%s%s%s\n", "[INFO ] Upload '", url, "'");
-    err = curl_easy_perform(upload->curl);
-    if( err != CURLE_OK ){
-        fprintf(stderr, "%s%s%s"FMT_SIZE_T"%s%s\n",
-            "[ERROR] PUT '", url, "' (code ", err, "): ", curl_easy_strerror(err));
-        err = -1; goto endFn;
-    }
-    long rspCode;
-    curl_easy_getinfo(upload->curl, CURLINFO_RESPONSE_CODE, &rspCode);
-    if( rspCode <= 199 || rspCode >= 300 ){
-        fprintf(stderr, "%s%ld%s%s%s\n",
-            "[WARN ] Got RspCode ", rspCode, " for 'PUT ", url, "'");
-    }else{
-        //fprintf(stderr, "%s%ld%s%s%s\n", "[DEBUG] Got RspCode ", rspCode, " for 'PUT ", url, "'");
+    for(;;){
+        pending = 0;
+        for( uint_t i=drained ; i<resclone->queueHdrs_len ; ++i ){
+            sprintf(url, "%s%s%s", resclone->queueApiUrl, resclone->queueHdrs[i] + hdrPrefix_len, "?count");
+            poll.buf_len = 0;
+            poll.isTruncated = 0;
+            if( poll.buf ){ poll.buf[0] = '\0'; }
+            if( curl_easy_setopt(curl, CURLOPT_URL, url) ){
+                assert(!"CURLOPT_URL"); err = -1; goto endFn; }
+            err = curl_easy_perform(curl);
+            if( err != CURLE_OK ){
+                log_write(LOG_LVL_ERROR, "%s%s%s"FMT_SIZE_T"%s%s",
+                    "GET '", url, "' (code ", err, "): ", curl_easy_strerror(err));
+                err = -1; goto endFn;
+            }
+            long rspCode;
+            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &rspCode);
+            ssize_t n;
+            if( rspCode == 404 ){
+                n = 0; /* Gateleen drops queues once empty. */
+            }else if( rspCode != 200 ){
+                log_write(LOG_LVL_ERROR, "%s%ld%s%s%s", "Got RspCode ", rspCode, " for 'GET ", url, "'");
+                err = -1; goto endFn;
+            }else if( poll.isTruncated ){
+                n = 1;
+            }else if( (n = queuePending(poll.buf ? poll.buf : "")) < 0 ){
+                log_write(LOG_LVL_ERROR, "%s%s%s", "Cannot tell what queue '", url, "' holds");
+                err = -1; goto endFn;
+            }
+            if( n == 0 && i == drained ){
+                drained += 1; }
+            pending += n;
+        }
+        if( drained == resclone->queueHdrs_len ){
+            break; }
+        if( monotonicMs() >= end ){
+            log_write(LOG_LVL_ERROR, "%s"FMT_SIZE_T"%s%u%s", "Queues still hold ", pending,
+                " requests after ", resclone->queueWait, "s");
+            err = -1; goto endFn;
+        }
+        log_write(LOG_LVL_DEBUG, "%s"FMT_SIZE_T"%s", "Waiting for ", pending, " queued requests");
+        const struct timespec pause = { .tv_sec = QUEUE_POLL_MS / 1000, .tv_nsec = (QUEUE_POLL_MS % 1000) * 1000000L };
+        nanosleep(&pause, NULL);
     }
+    log_write(LOG_LVL_INFO, "%s%.1f%s", "Queues drained after ", (monotonicMs() - begin) / 1e3, "s");
 
     err = 0;
 endFn:
-    curl_slist_free_all(reqHdrs);
+    if( curl ){ curl_easy_cleanup(curl); }
     free(url);
+    free(poll.buf);
     return err;
 }
 
 
-static ssize_t readArchive( Upload*upload ){
+/** Deletes everything below 'url' which is not in 'index' (the paths just
+ * pushed). Lists the whole target first, then deletes. Deleting while
+ * listing would shift the offsets of paged listings. */
+static ssize_t mirrorPush( GateleenResclone*resclone, PathIndex*index ){
     ssize_t err;
-    Put *put = NULL;
+    MirrorSink mirror = { .index = index };
+    GateleenResclone_Sink mirrorIface = {
+        .cls = &mirror,
+        .onEntryBegin = MirrorSink_onEntryBegin,
+        .onEntryData = MirrorSink_onEntryData,
+        .onEntryEnd = MirrorSink_onEntryEnd,
+    };
 
-    upload->srcArchive = archive_read_new();
-    if( ! upload->srcArchive ){
-        assert(upload->srcArchive); err = -1; goto endFn; }
-
-    const int blockSize = (1<<14);
-    err = archive_read_support_format_all(upload->srcArchive)
-       || archive_read_open_filename(upload->srcArchive, upload->archiveFile, blockSize)
-       ;
+    pathIndex_seal(index);
+    err = pullInto(resclone, &mirrorIface, !0);
+    if( err ){
+        err = -1; goto endFn; }
+    err = deletePaths(resclone, resclone->url, mirror.extras, mirror.extras_len, NULL, NULL);
     if( err ){
-        fprintf(stderr, "%s"FMT_SIZE_T"%s%s\n", "[ERROR] Failed to open src archive (code ", err, "): ",
-            curl_easy_strerror(err));
+        err = -1; goto endFn; }
+    log_write(LOG_LVL_INFO, "%s"FMT_SIZE_T"%s", "Mirror done. ", resclone->stats.deleted,
+        resclone->isDryRun ? " resources would be deleted (dry run)" : " resources deleted");
+
+    err = 0;
+endFn:
+    free(mirror.extras);
+    return err;
+}
+
+
+ssize_t gateleenResclone_push( GateleenResclone*resclone ){
+    ssize_t err;
+    Progress progress;
+    PathIndex index = { .hashes = NULL };
+    progressBegin(&progress);
+
+    if( resclone->filter ){
+        log_write(LOG_LVL_ERROR, "%s", "EINVAL: Filtering not supported for push mode.");
         err = -1; goto endFn;
     }
+    if( resclone->isMirror ){
+        pthread_mutex_init(&index.mutex, NULL);
+        resclone->mirrorIndex = &index;
+    }
 
-    err = curl_easy_setopt(upload->curl, CURLOPT_UPLOAD, 1L)
-       || curl_easy_setopt(upload->curl, CURLOPT_READFUNCTION, onUploadChunkRequested)
-        ;
+    ssize_t volumes_len = resclone->source ? 0 : countVolumes(resclone->file);
+    if( volumes_len < 0 ){
+        err = -1; goto endFn; }
+    if( volumes_len > 0 ){
+        err = pushVolumes(resclone, volumes_len, 0);
+    }else if( resclone->source == NULL && resclone->file && resclone->parallel > 1
+        && (isZipFile(resclone->file) || isSeekableZstdFile(resclone->file)) )
+    {
+        err = pushVolumes(resclone, resclone->parallel, !0);
+    }else{
+        err = pushOne(resclone, resclone->file, resclone->source, resclone->share, &resclone->stats, 0, 0);
+    }
     if( err ){
-        assert(!err); err = -1; goto endFn; }
-    for( struct archive_entry*entry ; archive_read_next_header(upload->srcArchive,&entry) == ARCHIVE_OK ;){
-        const char *name = archive_entry_pathname(entry);
-        int ftype = archive_entry_filetype(entry);
-        if( ftype == AE_IFDIR ){
-            continue; // Ignore dirs because gateleen doesn't know 'dirs' as such.
-        }
-        if( ftype != AE_IFREG ){
-            fprintf(stderr, "%s%s%s\n", "[WARN ] Ignore non-regular file '", name, "'");
-            continue;
-        }
-        //fprintf(stderr, "%s%s%s\n", "[DEBUG] Reading '",name,"'");
-        Put _1 = {
-            .upload = upload,
-            .name = (char*)name
-        }; put = &_1;
-        err = curl_easy_setopt(upload->curl, CURLOPT_READDATA, put)
-            || httpPutEntry(put);
-        //curl = upload->curl; // Sync back. TODO: Still needed?
+        err = -1; goto endFn; }
+    logProgress("Push", &resclone->stats, &progress, !0);
+    if( resclone->queueHdrs && resclone->queueWait && ! resclone->isDryRun ){
+        err = waitQueues(resclone);
         if( err ){
-            assert(!err); err = -1; goto endFn; }
+            err = -1; goto endFn; }
+    }
+    if( resclone->isMirror ){
+        err = mirrorPush(resclone, &index);
+        if( err ){
+            err = -1; goto endFn; }
+    }
+    if( resclone->isVerifyAfterPush && ! resclone->isDryRun ){
+        err = verifyPush(resclone, volumes_len);
+        if( err ){
+            err = -1; goto endFn; }
     }
 
     err = 0;
 endFn:
+    if( resclone->mirrorIndex ){
+        resclone->mirrorIndex = NULL;
+        pthread_mutex_destroy(&index.mutex);
+        free(index.hashes);
+    }
     return err;
 }
 
 
-static ssize_t pull( Resclone*resclone ){
-    ssize_t err;
-    ClsDload *dload = NULL;
+/** Takes the entry to copy to the target. Its body gets collected first, as
+ * the PUT pulls it. */
+static ssize_t ReplicaCopy_onEntryBegin( void*ReplicaCopy_, const GateleenResclone_Entry*entry ){
+    ReplicaCopy *copy = ReplicaCopy_;
+    const size_t path_len = strlen(entry->path);
+    if( memBudget_growBuf(NULL, 0, &copy->path, &copy->path_cap, path_len +1) ){
+        goto oom; }
+    memcpy(copy->path, entry->path, path_len +1);
+    if( entry->contentType ){
+        const size_t contentType_len = strlen(entry->contentType);
+        if( memBudget_growBuf(NULL, 0, &copy->contentType, &copy->contentType_cap, contentType_len +1) ){
+            goto oom; }
+        memcpy(copy->contentType, entry->contentType, contentType_len +1);
+    }else if( copy->contentType ){
+        copy->contentType[0] = '\0';
+    }
+    if( entryHeaders_copy(&copy->headers, entry->headers, entry->headers_len) ){
+        log_write(LOG_LVL_WARN, "%s%s%s", "Header dropped for '", entry->path, "'. Too many headers."); }
+    copy->body_len = 0;
+    return 0;
+oom:
+    log_write(LOG_LVL_ERROR, "%s", "Out of memory");
+    return -1;
+}
 
-    if( resclone->file == NULL && isatty(1) ){
-        fprintf(stderr, "%s\n",
-            "[ERROR] Are you sure you wanna write binary content to tty?");
-        err = -1; goto endFn;
+
+static ssize_t ReplicaCopy_onEntryData( void*ReplicaCopy_, const char*buf, size_t buf_len ){
+    ReplicaCopy *copy = ReplicaCopy_;
+    if( memBudget_growBuf(NULL, 0, &copy->body, &copy->body_cap, copy->body_len + buf_len) ){
+        log_write(LOG_LVL_ERROR, "%s", "Out of memory");
+        return -1;
     }
+    memcpy(copy->body + copy->body_len, buf, buf_len);
+    copy->body_len += buf_len;
+    return 0;
+}
 
-    ClsDload _1 = {0}; dload =&_1;
-    dload->resclone = resclone;
-    dload->rootUrl = resclone->url;
-    dload->archiveFile = resclone->file;
-    dload->curl = curl_easy_init();
-    if( dload->curl == NULL ){
-        fprintf(stderr, "%s\n", "[ERROR] curl_easy_init() -> NULL");
-        err = -1; goto endFn;
+
+static ssize_t ReplicaCopy_onEntryEnd( void*ReplicaCopy_ ){
+    ssize_t err;
+    ReplicaCopy *copy = ReplicaCopy_;
+    Upload *upload = &copy->upload;
+    const size_t failed = upload->stats.failed;
+    Put put = {
+        .upload = upload,
+        .name = copy->path,
+        .contentType = copy->contentType && copy->contentType[0] ? copy->contentType : NULL,
+        .headers = copy->headers.list,
+        .headers_len = copy->headers.list_len,
+        .size = copy->body_len,
+    };
+    copy->body_off = 0;
+    err =  curl_easy_setopt(upload->curl, CURLOPT_READDATA, &put)
+        || curl_easy_setopt(upload->curl, CURLOPT_INFILESIZE_LARGE, (curl_off_t)put.size)
+        || httpPutEntry(&put);
+    if( err || upload->stats.failed != failed ){
+        // Target did not get it. So next cycle has to try again.
+        replica_setEtag(copy->replica, copy->path, NULL);
     }
+    if( copy->body_cap > RESOURCE_BUF_KEEP_MAX ){
+        /* Do not pin memory of an exceptionally large resource. */
+        free(copy->body); copy->body = NULL;
+        copy->body_cap = 0;
+    }
+    return err ? -1 : 0;
+}
+
+
+/** Feeds the collected body to the PUT. */
+static ssize_t ReplicaCopy_read( void*ReplicaCopy_, char*buf, size_t buf_cap ){
+    ReplicaCopy *copy = ReplicaCopy_;
+    size_t len = copy->body_len - copy->body_off;
+    if( len > buf_cap ){ len = buf_cap; }
+    memcpy(buf, copy->body + copy->body_off, len);
+    copy->body_off += len;
+    return len;
+}
+
 
-    err = gateleenResclone_download(dload, NULL, NULL);
+static void onReplicaDeleted( void*Replica_, const char*path ){
+    replica_forget(Replica_, path);
+}
+
+
+static void ReplicaCopy_cleanup( ReplicaCopy*copy ){
+    curl_easy_cleanup(copy->upload.curl); copy->upload.curl = NULL;
+    free(copy->path); copy->path = NULL;
+    free(copy->contentType); copy->contentType = NULL;
+    free(copy->body); copy->body = NULL;
+}
+
+
+/** Runs one replication cycle (see 'ReplicaOpts.runCycle'). */
+static ssize_t replicateCycle( void*ReplicaCopy_, Replica*replica, ReplicaCycle*dst ){
+    ssize_t err;
+    ReplicaCopy *copy = ReplicaCopy_;
+    GateleenResclone *resclone = copy->upload.resclone;
+    GateleenResclone_Stats *stats = &resclone->stats;
+    char *gone = NULL;
+    size_t gone_len = 0;
+
+    *stats = (GateleenResclone_Stats){0};
+    copy->upload.stats = (GateleenResclone_Stats){0};
+    resclone->replica = replica;
+    err = pullInto(resclone, &copy->sink, 0);
+    resclone->replica = NULL;
+    stats->entries = copy->upload.stats.entries;
+    stats->bytes = copy->upload.stats.bytes;
+    stats->failed += copy->upload.stats.failed;
     if( err ){
         err = -1; goto endFn; }
 
-    if( dload->dstArchive && archive_write_close(dload->dstArchive) ){
-        fprintf(stderr, "%s"FMT_SIZE_T"%s%s\n", "[ERROR] archive_write_close failed (code ",
-            err, "): ", archive_error_string(dload->dstArchive));
-        err = -1; goto endFn;
+    // Only a complete traversal tells what disappeared on the source. What
+    // is below a skipped listing is not gone, we just did not see it.
+    if( stats->skippedListings ){
+        log_write(LOG_LVL_WARN, "%s"FMT_SIZE_T"%s", "Skipped ", stats->skippedListings,
+            " collections as their listing failed. Deletions wait for a complete cycle.");
+        err = 0; goto endFn;
+    }
+    err = replica_gone(replica, &gone, &gone_len);
+    if( err ){
+        err = -ENOMEM; goto endFn; }
+    if( gone_len ){
+        err = deletePaths(resclone, resclone->replicaUrl, gone, gone_len, onReplicaDeleted, replica);
+        if( err ){
+            err = -1; goto endFn; }
+        err = replica_compact(replica);
+        if( err ){
+            err = -ENOMEM; goto endFn; }
     }
 
     err = 0;
 endFn:
-    if( dload ){
-        curl_easy_cleanup(dload->curl);
-        archive_entry_free(dload->tmpEntry); dload->tmpEntry = NULL;
-        archive_write_free(dload->dstArchive); dload->dstArchive = NULL;
-    }
+    free(gone);
+    *dst = (ReplicaCycle){ .changed = stats->entries, .unchanged = stats->unchanged,
+        .deleted = stats->deleted, .failed = stats->failed, .skippedListings = stats->skippedListings };
     return err;
 }
 
 
-static ssize_t push( Resclone*resclone ){
+ssize_t gateleenResclone_replicate( GateleenResclone*resclone ){
     ssize_t err;
-    Upload *upload = NULL;
+    Replica *replica = NULL;
+    ReplicaCopy copy = {
+        .sink = {
+            .cls = &copy,
+            .onEntryBegin = ReplicaCopy_onEntryBegin,
+            .onEntryData = ReplicaCopy_onEntryData,
+            .onEntryEnd = ReplicaCopy_onEntryEnd,
+        },
+        .source = {
+            .cls = &copy,
+            .read = ReplicaCopy_read,
+        },
+    };
+    const ReplicaOpts replicaOpts = {
+        .interval = resclone->replicaInterval,
+        .cycles = resclone->replicaCycles,
+        .metricsFile = resclone->metricsFile,
+        .runCycle = replicateCycle,
+        .cls = &copy,
+    };
 
-    Upload _1={0}; upload =&_1;
-    upload->resclone = resclone;
-    upload->archiveFile = resclone->file;
-    upload->rootUrl = resclone->url;
-    upload->curl = curl_easy_init();
-    if( ! upload->curl ){
-        fprintf(stderr, "%s\n", "[ERROR] curl_easy_init() -> NULL");
+    if( resclone->replicaUrl == NULL ){
+        log_write(LOG_LVL_ERROR, "%s", "EINVAL: Replication needs 'replicaUrl'.");
         err = -1; goto endFn;
     }
+    if( resclone->samplePerCollection || resclone->sampleRatio || resclone->maxDepth
+        || resclone->maxBytes || resclone->maxEntries || resclone->deadline )
+    {
+        // Would delete everything the traversal skipped from the replica.
+        log_write(LOG_LVL_ERROR, "%s", "EINVAL: Replication cannot be combined with sampling, budgets nor deadline.");
+        err = -1; goto endFn;
+    }
+    replica = copy.replica = replica_alloc();
+    if( replica == NULL ){
+        err = -ENOMEM; goto endFn; }
+    progressBegin(&copy.upload.progress);
+    copy.upload.resclone = resclone;
+    copy.upload.rootUrl = resclone->replicaUrl;
+    copy.upload.source = &copy.source;
+    copy.upload.curl = curl_easy_init();
+    if( copy.upload.curl == NULL ){
+        log_write(LOG_LVL_ERROR, "%s", "curl_easy_init() -> NULL");
+        err = -1; goto endFn;
+    }
+    err =  (resclone->share && curl_easy_setopt(copy.upload.curl, CURLOPT_SHARE, resclone->share))
+        || curl_easy_setopt(copy.upload.curl, CURLOPT_UPLOAD, 1L)
+        || curl_easy_setopt(copy.upload.curl, CURLOPT_READFUNCTION, onUploadChunkRequested)
+        ;
+    if( err ){
+        assert(!err); err = -1; goto endFn; }
 
-    err = readArchive(upload);
+    err = replica_run(replica, &replicaOpts);
     if( err ){
         err = -1; goto endFn; }
 
     err = 0;
 endFn:
-    if( upload ){
-        curl_easy_cleanup(upload->curl);
-        archive_read_free(upload->srcArchive);
-    }
+    ReplicaCopy_cleanup(&copy);
+    replica_free(replica);
     return err;
 }
 
 
+void gateleenResclone_getStats( const GateleenResclone*resclone, GateleenResclone_Stats*dst ){
+    *dst = resclone->stats;
+}
+
+
 ssize_t gateleenResclone_run( int argc, char**argv ){
     ssize_t err;
     Resclone *resclone = NULL;
+    CliArgs cli;
 
-    resclone = Resclone_alloc();
-    if( resclone == NULL ){
+    err = parseArgs(argc, argv, &cli);
+    if( err ){
         err = -1; goto endFn; }
 
-    err = parseArgs(argc, argv, &resclone->mode, &resclone->url, &resclone->filter,
-        &resclone->filter_len, &resclone->isFilterFull, &resclone->file);
-    if( err ){
+    if( log_setup(&cli.log) ){
+        log_write(LOG_LVL_WARN, "%s", "Failed to start log writer. Log synchronously."); }
+
+    if( cli.mode == MODE_BATCH ){
+        err = batch_run(cli.batchFile, &cli.opts); goto endFn;
+    }else if( cli.mode == MODE_MERGE ){
+        err = merge_run((const char*const*)cli.mergeInputs, cli.mergeInputs_len, cli.opts.file, cli.manifestFile);
+        goto endFn;
+    }else if( cli.mode == MODE_DIFF ){
+        err = diff_run(cli.diffFrom, cli.diffTo, &cli.opts); goto endFn;
+    }
+
+    resclone = gateleenResclone_alloc(&cli.opts);
+    if( resclone == NULL ){
         err = -1; goto endFn; }
 
-    if( resclone->mode == MODE_FETCH ){
-        err = pull(resclone); goto endFn;
-    }else if( resclone->mode == MODE_PUSH ){
-        err = push(resclone); goto endFn;
+    if( cli.mode == MODE_FETCH ){
+        err = gateleenResclone_pull(resclone); goto endFn;
+    }else if( cli.mode == MODE_PUSH ){
+        err = gateleenResclone_push(resclone); goto endFn;
+    }else if( cli.mode == MODE_REPLICATE ){
+        err = gateleenResclone_replicate(resclone); goto endFn;
     }else{
         err = -1; goto endFn;
     }
 
     assert(!"Unreachable");
 endFn:
-    parseArgs(-1, argv, &resclone->mode, &resclone->url, &resclone->filter, &resclone->filter_len,
-        &resclone->isFilterFull, &resclone->file);
-    resclone->mode = MODE_NULL; resclone->url = NULL; resclone->file = NULL;
-    Resclone_free(resclone);
+    gateleenResclone_free(resclone);
+    free(cli.mergeInputs);
+    free(cli.endpoints);
+    log_teardown();
     return err;
 }
 
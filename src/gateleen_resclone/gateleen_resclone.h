@@ -5,10 +5,325 @@
 
 #include "commonbase.h"
 
+#include <stddef.h>
 #include <sys/types.h>
 
 
-/** @return
+/** Handle representing one clone instance. */
+typedef struct GateleenResclone GateleenResclone;
+
+
+/** Archive format written by the default sink. */
+typedef enum GateleenResclone_Format {
+    /** pax (restricted) tar. Keeps Content-Type and headers as xattrs. */
+    GATELEEN_RESCLONE_FORMAT_TAR = 0,
+    /** Zip with each entry deflated on its own. Has a central directory,
+     * so single entries can be extracted cheaply. Drops Content-Type and
+     * headers (push guesses the Content-Type from the name again). */
+    GATELEEN_RESCLONE_FORMAT_ZIP = 1,
+    /** One JSON object per line and resource, with "path", "contentType",
+     * "headers", "size" and the body. Bodies which are JSON on one single
+     * line (no CR or LF, no leading or trailing whitespace) get inlined
+     * verbatim as "json", so they come back byte for byte. All others go
+     * as "base64". For jq and the like. */
+    GATELEEN_RESCLONE_FORMAT_NDJSON = 2,
+    /** Tar as 'GATELEEN_RESCLONE_FORMAT_TAR', compressed as independent zstd
+     * frames, each starting at an entry, plus a seek table. Push decompresses
+     * it with 'parallel' threads, each taking its own range of frames. Any
+     * zstd decoder still reads it as a whole. */
+    GATELEEN_RESCLONE_FORMAT_TAR_ZSTD = 3
+} GateleenResclone_Format;
+
+
+/** Describes one resource (aka archive entry). */
+typedef struct GateleenResclone_Entry {
+    /** Path relative to the root url. */
+    const char *path;
+    /** Count of bytes in the body. */
+    size_t size;
+    /** (optional) Content-Type of the resource. NULL if unknown. */
+    const char *contentType;
+    /** (optional) Further headers of the resource worth to restore on push
+     * (eg expiry), each as "Name: value". */
+    const char *const*headers;
+    size_t headers_len;
+} GateleenResclone_Entry;
+
+
+/**
+ * Receives the entries of a pull. Entries get delivered one after the other
+ * as a 'onEntryBegin', zero or more 'onEntryData' and a 'onEntryEnd' call.
+ * All callbacks return zero on success. Negative values abort the pull.
+ */
+typedef struct GateleenResclone_Sink {
+    void *cls;
+    /** 'entry' (and its strings) only is valid during this call. */
+    ssize_t (*onEntryBegin)( void*cls , const GateleenResclone_Entry*entry );
+    ssize_t (*onEntryData)( void*cls , const char*buf , size_t buf_len );
+    ssize_t (*onEntryEnd)( void*cls );
+    /** (optional) Gets called once after the last entry of a successful
+     * pull. */
+    ssize_t (*onClose)( void*cls );
+} GateleenResclone_Sink;
+
+
+/**
+ * Provides the entries for a push.
+ */
+typedef struct GateleenResclone_Source {
+    void *cls;
+    /** Advances to the next entry and describes it in 'entry'. Strings must
+     * stay valid until the next call.
+     * @return 1 if there's an entry, 0 at end, negative on error. */
+    ssize_t (*nextEntry)( void*cls , GateleenResclone_Entry*entry );
+    /** Reads the body of the current entry.
+     * @return Count of bytes placed in 'buf', 0 at end of body, negative on
+     *      error. */
+    ssize_t (*read)( void*cls , char*buf , size_t buf_cap );
+    /** (optional) Gets called once after the last entry got pushed. */
+    ssize_t (*onClose)( void*cls );
+} GateleenResclone_Source;
+
+
+/** Counters of what a pull or push did so far. */
+typedef struct GateleenResclone_Stats {
+    /** Entries pulled into the sink or pushed from the source. */
+    size_t entries;
+    /** Body bytes of those entries. */
+    size_t bytes;
+    /** Entries which could not be transferred. */
+    size_t failed;
+    /** Entries compared against the target after push (see
+     * 'isVerifyAfterPush'). */
+    size_t verified;
+    /** Of those, entries missing or differing on the target. */
+    size_t mismatched;
+    /** Resources deleted from the target by 'isMirror' (or which would be
+     * by a dry run). */
+    size_t deleted;
+    /** Entries taken from 'cacheDir' as the server confirmed them to be
+     * unchanged. */
+    size_t cached;
+    /** Resources '--replicate' skipped as they did not change since the
+     * previous cycle. */
+    size_t unchanged;
+    /** Most bytes queued for the writer thread at once (see
+     * 'writeQueueSize'). */
+    size_t writeQueuePeak;
+    /** Times the pull had to wait for the writer thread to catch up. */
+    size_t writeQueueWaits;
+    /** Entries (or collections) a deadline or budget left out. Only counted
+     * if listed (see 'missingFile'). */
+    size_t missing;
+    /** Collections skipped as their listing failed (or was no listing).
+     * What is below them is missing from the pull. */
+    size_t skippedListings;
+} GateleenResclone_Stats;
+
+
+/** Options for 'gateleenResclone_alloc'. Zero-initialize, then set what is
+ * needed. Strings get copied. */
+typedef struct GateleenResclone_Opts {
+    /** Root node of remote tree. */
+    const char *url;
+    /** (optional) Same tree as 'url' on further nodes (eg replicas). The
+     * requests of a pull get spread over all of them. Each one goes to the
+     * node with the least requests in flight (weighted by latency). Failing
+     * nodes get ejected for a while and their requests retried elsewhere.
+     * Push only uses 'url'. */
+    const char *const*endpoints;
+    size_t endpoints_len;
+    /** (optional) See '--filter-part' and '--filter-full'. */
+    const char *filter;
+    int isFilterFull;
+    /** (optional) Archive file used by the default sink/source. NULL means
+     * stdout/stdin. */
+    const char *file;
+    /** (optional) Max bytes to use to buffer resources. Zero means
+     * unlimited. */
+    size_t maxMemory;
+    /** (optional) Pull only shard 'shardIdx' of 'shardCount' shards. Zero
+     * 'shardCount' means no sharding. The tree is partitioned by hashing the
+     * first 'shardDepth' path segments (1 if zero). */
+    unsigned shardIdx;
+    unsigned shardCount;
+    unsigned shardDepth;
+    /** (optional) Pull only a sample of the tree. Keeps at most that many
+     * entries (resources and collections) of each listing (or page of it
+     * when paging). Zero means all. */
+    size_t samplePerCollection;
+    /** (optional) Pull only about that fraction (0..1) of the resources.
+     * Collections still get listed. Zero means all. */
+    double sampleRatio;
+    /** (optional) Picks which entries make it into the sample. Same seed and
+     * same tree yield the same sample. */
+    unsigned sampleSeed;
+    /** (optional) Do not descend deeper than that many path segments below
+     * 'url' (1 only pulls the resources directly in it). Zero means
+     * unlimited. */
+    unsigned maxDepth;
+    /** (optional) Stop the traversal (successfully) once that many bytes or
+     * entries got pulled. Zero means unlimited. */
+    size_t maxBytes;
+    size_t maxEntries;
+    /** (optional) Comma separated path patterns (relative to 'url'). Each
+     * segment is a shell wildcard as of fnmatch(3), like
+     * 'houston/server/logs,houston/state-*'. Subtrees matching one get pulled
+     * before the rest, those of the first pattern first. */
+    const char *priority;
+    /** (optional) Stop the traversal (successfully) after that many seconds.
+     * Transfers still running then get cut. Zero means no deadline. */
+    unsigned deadline;
+    /** (optional) File to list the paths a deadline (or budget) left out,
+     * one per line. Collections (ending with '/') are missing with (some of)
+     * their content. NULL logs the first few if a deadline hit. */
+    const char *missingFile;
+    /** (optional) Within each collection, fetch resources whose size is known
+     * from 'cacheDir' largest first. Others follow in path order. */
+    int isLargestFirst;
+    /** (optional) Format the default sink writes. Push detects it by
+     * itself for files. Only NDJSON from stdin needs to be told. */
+    GateleenResclone_Format format;
+    /** (optional) Splits the default tar into volumes of about this many
+     * bytes named 'name.000.tar', 'name.001.tar', ... (derived from 'file').
+     * Zero means one single archive. */
+    size_t volumeSize;
+    /** (optional) Fetch collections expanded this many levels deep. Zero
+     * means one request per resource. Embedded resources get archived
+     * re-serialized as compact JSON without their headers. */
+    unsigned expandLevels;
+    /** (optional) Fetch collection listings in pages of this many entries
+     * (gateleen 'limit'/'offset'). Zero means one request per listing.
+     * Cannot be combined with 'expandLevels'. */
+    size_t pageSize;
+    /** (optional) Ask for expanded collections zipped. Cannot be combined
+     * with 'filter' nor sharding. */
+    int isExpandZip;
+    /** (optional) Resources at least this large get fetched as
+     * 'rangeSegments' concurrent 'Range' requests (4 if zero) where the server
+     * supports it. Zero means one request per resource. */
+    size_t rangeThreshold;
+    unsigned rangeSegments;
+    /** (optional) Directory keeping resource bodies from earlier pulls.
+     * Those get revalidated ('If-None-Match', 'If-Modified-Since') instead
+     * of downloaded again. */
+    const char *cacheDir;
+    /** (optional) Bytes the bodies in 'cacheDir' may take. Least recently
+     * used ones get evicted at the end of a pull. Zero means unlimited. */
+    size_t cacheSize;
+    /** (optional) File in '/etc/mime.types' format. Extends (and
+     * overrides) the built-in mapping used to guess the Content-Type of
+     * pushed entries which do not carry one. */
+    const char *mimeTypesFile;
+    /** (optional) Bytes to queue between the transfers and a dedicated
+     * thread feeding the sink. Zero calls the sink directly from the
+     * transfers. Smaller sizes get raised to 64 KiB. */
+    size_t writeQueueSize;
+    /** (optional) After push, fetch every entry back and compare size and
+     * hash with the archive. Mismatches get reported on stdout and fail the
+     * push. Needs the default source reading 'file'. */
+    int isVerifyAfterPush;
+    /** (optional) Max concurrent requests of the verification. Defaults
+     * to 8. */
+    unsigned verifyParallel;
+    /** (optional) After push, delete resources below 'url' which are not in
+     * the archive. So the target ends up holding exactly the archive. */
+    int isMirror;
+    /** (optional) Max concurrent DELETEs of 'isMirror'. Defaults to 8. */
+    unsigned mirrorParallel;
+    /** (optional) Push only reports what it would upload and delete but
+     * does not change the target. */
+    int isDryRun;
+    /** (optional) Push submits the PUTs to gateleen's queues (header
+     * 'x-queue') instead of waiting for each write. Name of the queues with
+     * '*' replaced by the index of each queue. Without '*' the index gets
+     * appended behind a '-' (unless there is only one queue). Each path
+     * sticks to one queue, so its updates stay in order. */
+    const char *viaQueue;
+    /** (optional) Count of queues to spread the PUTs over. Defaults to 4. */
+    unsigned queueCount;
+    /** (optional) Seconds to wait for the queues to drain once the push is
+     * done. Push fails if they do not. Zero does not wait. */
+    unsigned queueWait;
+    /** (optional) Collection of the queue monitoring API ('<name>' gets
+     * appended). Defaults to '/queuing/queues/' on the host of 'url'. */
+    const char *queueApiUrl;
+    /** (optional) Pull reads gateleen's redis storage directly instead of
+     * going through HTTP. Like
+     * 'redis://[[user]:password@]host[:port][/prefix][?expirable=key]'.
+     * 'prefix' defaults to 'rest-storage:resources' (the whole storage).
+     * A longer one (like 'rest-storage:resources:houston' or
+     * 'rest-storage:resources/houston') pulls that subtree only. Paths get
+     * taken relative to it. 'url' is not needed then. */
+    const char *redisUrl;
+    /** (optional) Where 'gateleenResclone_replicate' copies 'url' to. */
+    const char *replicaUrl;
+    /** (optional) Seconds from the begin of one replication cycle to the
+     * next. Zero starts the next one as soon the previous is done. */
+    unsigned replicaInterval;
+    /** (optional) Stop replication after that many cycles. Zero means
+     * never. */
+    unsigned replicaCycles;
+    /** (optional) File to (atomically) replace with replication metrics in
+     * prometheus text format after each cycle. */
+    const char *metricsFile;
+    /** (optional) Count of volumes to push concurrently. Defaults to 1. A
+     * single zip (or seekable tar.zst) gets pushed by that many readers
+     * instead, each taking every n-th entry (or its own range of frames). */
+    unsigned parallel;
+    /** (optional) Probe the server behind 'url' at the first pull (HTTP
+     * version, keepalive, 'Range', round trip and throughput) and pick
+     * segmented downloads, write queue and the concurrency of the DELETEs
+     * (those of 'replicaUrl') from that. Only options left zero get picked.
+     * Never picks 'expandLevels', as that changes what gets archived. Meant
+     * for pulls. It lists 'url', so it gets skipped with 'pageSize'. */
+    int isAutoTune;
+    /** (optional) Directory keeping the probe results per url, so runs
+     * within a day skip the probe. NULL probes every time. */
+    const char *tuneCacheDir;
+    /** (optional) curl share handle ('CURLSH*') the transfers take DNS
+     * results, connections and TLS sessions from. Must outlive the handle.
+     * Curl does not share connections across threads, so only pass it to
+     * instances used by the same thread. */
+    void *curlShare;
+    /** (optional) Where pulled entries go. Defaults to a tar written to
+     * 'file'. The struct must outlive the handle. */
+    GateleenResclone_Sink *sink;
+    /** (optional) Where pushed entries come from. Defaults to an archive
+     * read from 'file'. The struct must outlive the handle. */
+    GateleenResclone_Source *source;
+} GateleenResclone_Opts;
+
+
+/** @return New handle or NULL on error (reason got logged already). */
+GateleenResclone*
+gateleenResclone_alloc( const GateleenResclone_Opts*opts );
+
+void
+gateleenResclone_free( GateleenResclone* );
+
+/** Downloads the tree below 'url' into the sink.
+ * @return Zero on success, negative values otherwise. */
+ssize_t
+gateleenResclone_pull( GateleenResclone* );
+
+/** Uploads all entries of the source below 'url'.
+ * @return Zero on success, negative values otherwise. */
+ssize_t
+gateleenResclone_push( GateleenResclone* );
+
+/** Keeps 'replicaUrl' in sync with 'url'. Each cycle transfers only those
+ * resources whose ETag changed since the previous cycle and deletes those
+ * which disappeared.
+ * @return Zero after 'replicaCycles' cycles, negative values on error. */
+ssize_t
+gateleenResclone_replicate( GateleenResclone* );
+
+void
+gateleenResclone_getStats( const GateleenResclone* , GateleenResclone_Stats*dst );
+
+/** Runs as the commandline tool would.
+ * @return
  *      Zero on success, negative values otherwise. Positive values are
  *      reserved. */
 ssize_t
@@ -0,0 +1,15 @@
+/* By using this work you agree to the terms and conditions in 'LICENSE.txt' */
+
+/* This */
+#include "hash.h"
+
+
+uint64_t hash_fnv1a64( uint64_t hash , const void*buf_ , size_t buf_len )
+{
+    const unsigned char *buf = buf_;
+    for( size_t i=0 ; i<buf_len ; ++i ){
+        hash ^= buf[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
@@ -0,0 +1,28 @@
+/* By using this work you agree to the terms and conditions in 'LICENSE.txt' */
+
+#ifndef INCGUARD_8a2e4d61c07b4f3e9d15b6a0c3f7e912
+#define INCGUARD_8a2e4d61c07b4f3e9d15b6a0c3f7e912
+
+#include "commonbase.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/** Start value for 'hash_fnv1a64'. */
+#define HASH_FNV1A64_INIT 0xcbf29ce484222325ULL
+
+
+/**
+ * FNV-1a (64 bit). Not cryptographic. But stable across platforms and runs,
+ * which is what we need to partition and compare stuff. Call repeatedly to
+ * hash data arriving in chunks.
+ *
+ * @param hash
+ *      HASH_FNV1A64_INIT for the first chunk. Result of previous call for
+ *      subsequent chunks.
+ */
+uint64_t hash_fnv1a64( uint64_t hash , const void*buf , size_t buf_len );
+
+
+#endif /* INCGUARD_8a2e4d61c07b4f3e9d15b6a0c3f7e912 */
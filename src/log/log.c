@@ -0,0 +1,248 @@
+/* By using this work you agree to the terms and conditions in 'LICENSE.txt' */
+
+/* This */
+#include "log.h"
+
+/* System */
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/* Size of the buffer between producers and the writer thread. */
+#define LOG_RING_CAP (1<<16)
+
+
+static struct {
+    LogLevel level;
+    int isJson;
+    FILE *dst;
+    /* Everything below only is in use if 'isAsync'. */
+    int isAsync;
+    int isStopping;
+    /* Writer is outside the lock writing what it took from the ring. */
+    int isWriting;
+    pthread_t writer;
+    pthread_mutex_t mutex;
+    pthread_cond_t notEmpty;
+    pthread_cond_t notFull;
+    size_t head;
+    size_t len;
+    char ring[LOG_RING_CAP];
+} log_ = {
+    .level = LOG_LVL_INFO,
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .notEmpty = PTHREAD_COND_INITIALIZER,
+    .notFull = PTHREAD_COND_INITIALIZER,
+};
+
+
+static const char* levelTag( LogLevel level ){
+    switch( level ){
+    case LOG_LVL_ERROR: return "[ERROR] ";
+    case LOG_LVL_WARN : return "[WARN ] ";
+    case LOG_LVL_INFO : return "[INFO ] ";
+    default           : return "[DEBUG] ";
+    }
+}
+
+
+static const char* levelName( LogLevel level ){
+    switch( level ){
+    case LOG_LVL_ERROR: return "error";
+    case LOG_LVL_WARN : return "warn";
+    case LOG_LVL_INFO : return "info";
+    default           : return "debug";
+    }
+}
+
+
+static void* writerMain( void*arg ){
+    (void)arg;
+    static char batch[LOG_RING_CAP];
+    pthread_mutex_lock(&log_.mutex);
+    for(;;){
+        while( log_.len == 0 && !log_.isStopping ){
+            pthread_cond_wait(&log_.notEmpty, &log_.mutex); }
+        if( log_.len == 0 ){
+            break; } /* Stopping and nothing left. */
+        // Take everything there is. So lines which arrived meanwhile go out
+        // with one single write.
+        const size_t len = log_.len;
+        const size_t first = (LOG_RING_CAP - log_.head < len) ? LOG_RING_CAP - log_.head : len;
+        memcpy(batch, log_.ring + log_.head, first);
+        memcpy(batch + first, log_.ring, len - first);
+        log_.head = (log_.head + len) % LOG_RING_CAP;
+        log_.len = 0;
+        log_.isWriting = !0;
+        pthread_cond_broadcast(&log_.notFull);
+        pthread_mutex_unlock(&log_.mutex);
+        fwrite(batch, 1, len, log_.dst);
+        fflush(log_.dst);
+        pthread_mutex_lock(&log_.mutex);
+        log_.isWriting = 0;
+        pthread_cond_broadcast(&log_.notFull);
+    }
+    pthread_mutex_unlock(&log_.mutex);
+    return NULL;
+}
+
+
+int log_setup( const LogOpts*opts ){
+    log_teardown();
+    log_.level = opts->level ? opts->level : LOG_LVL_INFO;
+    log_.isJson = opts->isJson;
+    log_.dst = opts->dst ? opts->dst : stderr;
+    if( opts->isAsync ){
+        log_.isStopping = 0;
+        if( pthread_create(&log_.writer, NULL, writerMain, NULL) ){
+            return -1; }
+        log_.isAsync = !0;
+    }
+    return 0;
+}
+
+
+void log_teardown( void ){
+    if( ! log_.isAsync ){
+        return; }
+    pthread_mutex_lock(&log_.mutex);
+    log_.isStopping = !0;
+    pthread_cond_signal(&log_.notEmpty);
+    pthread_mutex_unlock(&log_.mutex);
+    pthread_join(log_.writer, NULL);
+    log_.isAsync = 0;
+}
+
+
+int log_isEnabled( LogLevel level ){
+    return level <= log_.level;
+}
+
+
+/** Appends 'str' as JSON string content (without quotes). */
+static char* jsonEscape( char*dst, const char*str ){
+    for( const unsigned char *it=(const unsigned char*)str ; *it ; ++it ){
+        switch( *it ){
+        case '"' : *dst++ = '\\'; *dst++ = '"'; break;
+        case '\\': *dst++ = '\\'; *dst++ = '\\'; break;
+        case '\n': *dst++ = '\\'; *dst++ = 'n'; break;
+        case '\r': *dst++ = '\\'; *dst++ = 'r'; break;
+        case '\t': *dst++ = '\\'; *dst++ = 't'; break;
+        default:
+            if( *it < 0x20 ){
+                dst += sprintf(dst, "\\u%04x", *it);
+            }else{
+                *dst++ = *it;
+            }
+        }
+    }
+    return dst;
+}
+
+
+/** Formats 'msg' as one complete line.
+ * @return Length of line. */
+static size_t formatLine( char*dst, LogLevel level, const char*msg ){
+    char *it = dst;
+    if( log_.isJson ){
+        struct timespec now;
+        struct tm tm;
+        clock_gettime(CLOCK_REALTIME, &now);
+#ifdef _WIN32
+        tm = *gmtime(&now.tv_sec);
+#else
+        gmtime_r(&now.tv_sec, &tm);
+#endif
+        it += sprintf(it, "{\"time\":\"%04d-%02d-%02dT%02d:%02d:%02d.%03ldZ\",\"level\":\"%s\",\"msg\":\"",
+            tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec,
+            now.tv_nsec / 1000000, levelName(level));
+        it = jsonEscape(it, msg);
+        *it++ = '"'; *it++ = '}';
+    }else{
+        const char *tag = levelTag(level);
+        const size_t tag_len = strlen(tag), msg_len = strlen(msg);
+        memcpy(it, tag, tag_len); it += tag_len;
+        memcpy(it, msg, msg_len); it += msg_len;
+    }
+    *it++ = '\n';
+    *it = '\0';
+    return it - dst;
+}
+
+
+static void emit( const char*line, size_t line_len ){
+    FILE *dst = log_.dst ? log_.dst : stderr;
+    if( ! log_.isAsync ){
+        fwrite(line, 1, line_len, dst);
+        return;
+    }
+    pthread_mutex_lock(&log_.mutex);
+    if( line_len > LOG_RING_CAP ){
+        // Does not fit at all. Write it ourself as soon everything before is
+        // out (not only taken from the ring). Keeps order.
+        while( log_.len > 0 || log_.isWriting ){
+            pthread_cond_wait(&log_.notFull, &log_.mutex); }
+        fwrite(line, 1, line_len, dst);
+    }else{
+        while( LOG_RING_CAP - log_.len < line_len ){
+            pthread_cond_wait(&log_.notFull, &log_.mutex); }
+        const size_t tail = (log_.head + log_.len) % LOG_RING_CAP;
+        const size_t first = (LOG_RING_CAP - tail < line_len) ? LOG_RING_CAP - tail : line_len;
+        memcpy(log_.ring + tail, line, first);
+        memcpy(log_.ring, line + first, line_len - first);
+        log_.len += line_len;
+        pthread_cond_signal(&log_.notEmpty);
+    }
+    pthread_mutex_unlock(&log_.mutex);
+}
+
+
+void log_write( LogLevel level, const char*fmt, ... ){
+    char msgStack[1024], lineStack[2048];
+    char *msg = msgStack, *line = lineStack;
+    va_list args;
+
+    if( ! log_isEnabled(level) ){
+        return; }
+
+    va_start(args, fmt);
+    int msg_len = vsnprintf(msgStack, sizeof msgStack, fmt, args);
+    va_end(args);
+    if( msg_len < 0 ){
+        return; }
+    if( (size_t)msg_len >= sizeof msgStack ){
+        msg = malloc(msg_len +1);
+        if( msg == NULL ){
+            msg = msgStack; /* Log it truncated then. */
+        }else{
+            va_start(args, fmt);
+            vsnprintf(msg, msg_len +1, fmt, args);
+            va_end(args);
+        }
+    }
+    // Worst case is every char escaped as '\u00XX'. Plus timestamp and alike.
+    const size_t line_cap = 6 * strlen(msg) + 128;
+    if( line_cap > sizeof lineStack ){
+        line = malloc(line_cap);
+        if( line == NULL ){
+            goto endFn; }
+    }
+    emit(line, formatLine(line, level, msg));
+endFn:
+    if( msg != msgStack ){ free(msg); }
+    if( line != lineStack ){ free(line); }
+}
+
+
+int log_rateLimit( LogRate*rate, unsigned intervalMs ){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    const long long elapsedMs = (now.tv_sec - rate->last.tv_sec) * 1000LL
+        + (now.tv_nsec - rate->last.tv_nsec) / 1000000;
+    if( (rate->last.tv_sec || rate->last.tv_nsec) && elapsedMs < intervalMs ){
+        return 0; }
+    rate->last = now;
+    return !0;
+}
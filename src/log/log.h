@@ -0,0 +1,64 @@
+/* By using this work you agree to the terms and conditions in 'LICENSE.txt' */
+
+#ifndef INCGUARD_b7e41d0c92a54f6e8d3a1c5f07e6b2d4
+#define INCGUARD_b7e41d0c92a54f6e8d3a1c5f07e6b2d4
+
+#include "commonbase.h"
+
+#include <stdio.h>
+#include <time.h>
+
+
+typedef enum LogLevel {
+    LOG_LVL_ERROR = 1,
+    LOG_LVL_WARN  = 2,
+    LOG_LVL_INFO  = 3,
+    LOG_LVL_DEBUG = 4
+} LogLevel;
+
+
+typedef struct LogOpts {
+    /** Messages above this level get dropped. */
+    LogLevel level;
+    /** One JSON object per line instead of '[LEVEL] msg' lines. */
+    int isJson;
+    /** Hand lines over to a writer thread which writes them in batches. */
+    int isAsync;
+    /** (optional) Where to write to. Defaults to stderr. */
+    FILE *dst;
+} LogOpts;
+
+
+/** State of 'log_rateLimit'. Zero-initialize. */
+typedef struct LogRate {
+    struct timespec last;
+} LogRate;
+
+
+/** Configures logging. Without this, logging is synchronous text to stderr
+ * at info level.
+ * @return 0 on success, negative if writer thread could not be started (log
+ *      stays synchronous then). */
+int log_setup( const LogOpts*opts );
+
+/** Flushes pending lines and stops the writer thread (if any). */
+void log_teardown( void );
+
+/** @return Non-zero if messages of 'level' would get written. Use it to skip
+ *      expensive preparation of messages which get dropped anyway. */
+int log_isEnabled( LogLevel level );
+
+/** Logs a printf-style message. Appends the newline by itself. Thread
+ * safe. */
+void log_write( LogLevel level , const char*fmt , ... )
+#ifndef _WIN32
+    __attribute__((format(printf, 2, 3)))
+#endif
+    ;
+
+/** @return Non-zero if at least 'intervalMs' passed since it last returned
+ *      non-zero (or on first call). */
+int log_rateLimit( LogRate*rate , unsigned intervalMs );
+
+
+#endif /* INCGUARD_b7e41d0c92a54f6e8d3a1c5f07e6b2d4 */
@@ -0,0 +1,256 @@
+/* By using this work you agree to the terms and conditions in 'LICENSE.txt' */
+
+/* This */
+#include "merge.h"
+
+/* System */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Libs */
+#include "archive.h"
+#include "archive_entry.h"
+
+/* Project */
+#include "arena.h"
+#include "hash.h"
+#include "log.h"
+
+
+/* Content-Type plus the headers an entry carries at most. More xattrs than
+ * that are not ours and get left alone. */
+#define XATTRS_MAX 9
+
+
+ssize_t mergeInput_open( MergeInput*input ){
+    input->entry = NULL;
+    input->archive = archive_read_new();
+    if( input->archive == NULL ){
+        log_write(LOG_LVL_ERROR, "%s", "archive_read_new() -> NULL");
+        return -1;
+    }
+    if( archive_read_support_format_all(input->archive)
+        || archive_read_support_filter_all(input->archive)
+        || archive_read_open_filename(input->archive, input->file, 1<<14) )
+    {
+        log_write(LOG_LVL_ERROR, "%s%s%s%s", "Failed to open '", input->file, "': ",
+            archive_error_string(input->archive));
+        return -1;
+    }
+    return 0;
+}
+
+
+ssize_t mergeInput_next( MergeInput*input ){
+    for(;;){
+        int err = archive_read_next_header(input->archive, &input->entry);
+        if( err == ARCHIVE_EOF ){
+            input->entry = NULL; return 0; }
+        if( err != ARCHIVE_OK ){
+            log_write(LOG_LVL_ERROR, "%s%s%s%s", "Failed to read '", input->file, "': ",
+                archive_error_string(input->archive));
+            input->entry = NULL; return -1;
+        }
+        if( archive_entry_filetype(input->entry) == AE_IFREG ){
+            return 0; }
+        /* Only resources are of interest. Skip dirs and alike. */
+    }
+}
+
+
+ssize_t mergeInput_hashBody( MergeInput*input, uint64_t*hash ){
+    char buf[1<<14];
+    for(;;){
+        ssize_t readLen = archive_read_data(input->archive, buf, sizeof buf);
+        if( readLen < 0 ){
+            log_write(LOG_LVL_ERROR, "%s%s%s%s", "Failed to read '", input->file, "': ",
+                archive_error_string(input->archive));
+            return -1;
+        }
+        if( readLen == 0 ){
+            return 0; }
+        *hash = hash_fnv1a64(*hash, buf, readLen);
+    }
+}
+
+
+/** Reading a pax entry yields each xattr twice (from its 'LIBARCHIVE.xattr'
+ * and its 'SCHILY.xattr' record). Keeps one of each, so writing the entry
+ * again does not duplicate them. */
+static ssize_t dedupXattrs( struct archive_entry*entry ){
+    ssize_t err;
+    struct { const char *name; const void *val; size_t val_len; } xattrs[XATTRS_MAX];
+    size_t xattrs_len = 0;
+    char *names[XATTRS_MAX];
+    void *vals[XATTRS_MAX];
+    const char *name;
+    const void *val;
+    size_t val_len;
+    if( archive_entry_xattr_reset(entry) == 0 ){
+        return 0; }
+    while( archive_entry_xattr_next(entry, &name, &val, &val_len) == ARCHIVE_OK ){
+        size_t i;
+        for( i=0 ; i<xattrs_len && strcmp(xattrs[i].name, name) ; ++i );
+        if( i == xattrs_len ){
+            if( xattrs_len >= XATTRS_MAX ){
+                return 0; } /* <- Not ours. Leave it as is. */
+            xattrs_len += 1;
+        }
+        xattrs[i].name = name;
+        xattrs[i].val = val;
+        xattrs[i].val_len = val_len;
+    }
+    // Copy out, as clearing frees the strings we point to.
+    size_t copied = 0;
+    for( ; copied<xattrs_len ; ++copied ){
+        names[copied] = strdup(xattrs[copied].name);
+        vals[copied] = malloc(xattrs[copied].val_len +1);
+        if( names[copied] == NULL || vals[copied] == NULL ){
+            free(names[copied]); free(vals[copied]);
+            err = -ENOMEM; goto endFn;
+        }
+        memcpy(vals[copied], xattrs[copied].val, xattrs[copied].val_len);
+    }
+    archive_entry_xattr_clear(entry);
+    for( size_t i=0 ; i<xattrs_len ; ++i ){
+        archive_entry_xattr_add_entry(entry, names[i], vals[i], xattrs[i].val_len); }
+
+    err = 0;
+endFn:
+    for( size_t i=0 ; i<copied ; ++i ){
+        free(names[i]); free(vals[i]); }
+    return err;
+}
+
+
+ssize_t merge_run( const char*const*files, size_t files_len, const char*file, const char*manifestFile ){
+    ssize_t err;
+    MergeInput *inputs = NULL;
+    struct archive *out = NULL;
+    FILE *manifest = NULL;
+    char *prevPath = NULL;
+    size_t prevPath_cap = 0;
+    char buf[1<<14];
+
+    if( file == NULL && isatty(1) ){
+        log_write(LOG_LVL_ERROR, "%s",
+            "Are you sure you wanna write binary content to tty?");
+        err = -1; goto endFn;
+    }
+
+    inputs = calloc(files_len, sizeof*inputs);
+    if( inputs == NULL ){
+        err = -ENOMEM; goto endFn; }
+    for( size_t i=0 ; i<files_len ; ++i ){
+        MergeInput *input = inputs + i;
+        input->file = files[i];
+        if( mergeInput_open(input) || mergeInput_next(input) ){
+            err = -1; goto endFn; }
+    }
+
+    out = archive_write_new();
+    if( out == NULL ){
+        err = -ENOMEM; goto endFn; }
+    if( archive_write_set_format_pax_restricted(out)
+        || archive_write_open_filename(out, file) )
+    {
+        log_write(LOG_LVL_ERROR, "%s%s", "Failed to setup tar output: ", archive_error_string(out));
+        err = -1; goto endFn;
+    }
+
+    if( manifestFile ){
+        manifest = fopen(manifestFile, "wb");
+        if( manifest == NULL ){
+            log_write(LOG_LVL_ERROR, "%s%s%s%s", "fopen(", manifestFile, "): ", strerror(errno));
+            err = -1; goto endFn;
+        }
+    }
+
+    size_t entries = 0;
+    for(;;){
+        // Pick input with the smallest path. Inputs are few, so a linear scan
+        // is good enough.
+        MergeInput *min = NULL;
+        for( size_t i=0 ; i<files_len ; ++i ){
+            MergeInput *input = inputs + i;
+            if( input->entry == NULL ){ continue; }
+            if( min == NULL ){ min = input; continue; }
+            int cmp = strcmp(archive_entry_pathname(input->entry), archive_entry_pathname(min->entry));
+            if( cmp == 0 ){
+                log_write(LOG_LVL_ERROR, "%s%s%s%s%s%s%s", "'", archive_entry_pathname(input->entry),
+                    "' is in '", min->file, "' and in '", input->file, "'");
+                err = -1; goto endFn;
+            }
+            if( cmp < 0 ){ min = input; }
+        }
+        if( min == NULL ){
+            break; } /* All inputs exhausted. */
+
+        const char *path = archive_entry_pathname(min->entry);
+        const size_t path_len = strlen(path);
+        if( prevPath && strcmp(prevPath, path) >= 0 ){
+            log_write(LOG_LVL_ERROR, "%s%s%s%s%s", "'", min->file,
+                "' is not in path order (at '", path, "'). Only archives written by '--pull' can be merged.");
+            err = -1; goto endFn;
+        }
+        if( memBudget_growBuf(NULL, 0, &prevPath, &prevPath_cap, path_len +1) ){
+            err = -ENOMEM; goto endFn; }
+        memcpy(prevPath, path, path_len +1);
+
+        err = dedupXattrs(min->entry);
+        if( err ){
+            err = -1; goto endFn; }
+        if( archive_write_header(out, min->entry) ){
+            log_write(LOG_LVL_ERROR, "%s%s", "Failed to archive_write_header: ", archive_error_string(out));
+            err = -1; goto endFn;
+        }
+        for(;;){
+            ssize_t readLen = archive_read_data(min->archive, buf, sizeof buf);
+            if( readLen < 0 ){
+                log_write(LOG_LVL_ERROR, "%s%s%s%s", "Failed to read '", min->file, "': ",
+                    archive_error_string(min->archive));
+                err = -1; goto endFn;
+            }
+            if( readLen == 0 ){ break; }
+            if( archive_write_data(out, buf, readLen) != readLen ){
+                log_write(LOG_LVL_ERROR, "%s%s", "Failed to archive_write_data: ", archive_error_string(out));
+                err = -1; goto endFn;
+            }
+        }
+        if( manifest ){
+            fprintf(manifest, "%s\t%lld\t%s\n", prevPath, (long long)archive_entry_size(min->entry), min->file);
+        }
+        entries += 1;
+
+        if( mergeInput_next(min) ){
+            err = -1; goto endFn; }
+    }
+
+    if( archive_write_close(out) ){
+        log_write(LOG_LVL_ERROR, "%s%s", "archive_write_close failed: ", archive_error_string(out));
+        err = -1; goto endFn;
+    }
+    if( manifest ){
+        int ret = fclose(manifest); manifest = NULL;
+        if( ret ){
+            log_write(LOG_LVL_ERROR, "%s%s%s%s", "fclose(", manifestFile, "): ", strerror(errno));
+            err = -1; goto endFn;
+        }
+    }
+    log_write(LOG_LVL_INFO, "%s"FMT_SIZE_T"%s"FMT_SIZE_T"%s", "Merged ", entries, " entries from ",
+        files_len, " archives.");
+
+    err = 0;
+endFn:
+    if( manifest ){ fclose(manifest); }
+    archive_write_free(out);
+    for( size_t i=0 ; inputs && i<files_len ; ++i ){
+        archive_read_free(inputs[i].archive);
+    }
+    free(inputs);
+    free(prevPath);
+    return err;
+}
+
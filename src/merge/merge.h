@@ -0,0 +1,52 @@
+/* By using this work you agree to the terms and conditions in 'LICENSE.txt' */
+
+#ifndef INCGUARD_9930a162cd74471ba18121c25c1440ff
+#define INCGUARD_9930a162cd74471ba18121c25c1440ff
+
+#include "commonbase.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+
+struct archive;
+struct archive_entry;
+
+
+/** An input of '--merge' (or '--diff'). Set 'file', then 'mergeInput_open'.
+ * Release 'archive' by 'archive_read_free' when done. */
+typedef struct MergeInput {
+    const char *file;
+    struct archive *archive;
+    /** Current entry. NULL once input is exhausted. */
+    struct archive_entry *entry;
+} MergeInput;
+
+
+/** Opens 'input->file' (any format and compression libarchive knows).
+ * @return 0 on success, -1 on error (logged). */
+ssize_t mergeInput_open( MergeInput*input );
+
+/** Reads next entry of 'input'. Sets 'entry' to NULL at end. Only yields
+ * regular files.
+ * @return 0 on success, -1 on error (logged). */
+ssize_t mergeInput_next( MergeInput*input );
+
+/** Hashes (the rest of) the body of the current entry of 'input' into
+ * 'hash' (see 'hash_fnv1a64').
+ * @return 0 on success, -1 on error (logged). */
+ssize_t mergeInput_hashBody( MergeInput*input , uint64_t*hash );
+
+/** Combines archives sorted by path (eg of '--shard' pulls) by a k-way merge
+ * into one tar.
+ * @param file
+ *      Tar to write. NULL means stdout.
+ * @param manifestFile
+ *      (optional) Gets one line per entry: path, size and the input it came
+ *      from (tab separated).
+ * @return 0 on success, negative on error (logged). */
+ssize_t merge_run( const char*const*files , size_t files_len , const char*file , const char*manifestFile );
+
+
+#endif /* INCGUARD_9930a162cd74471ba18121c25c1440ff */
@@ -2,260 +2,160 @@
 
 #include "mime.h"
 
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#include "mime_table.h"
+
+
+typedef struct MimeMapEntry {
+    const char *ext;
+    const char *type;
+} MimeMapEntry;
+
+
+struct MimeMap {
+    /** Open addressing. NULL 'ext' marks a free slot. */
+    MimeMapEntry *slots;
+    size_t slots_cap; /* <- Always power of two. */
+    size_t count;
+    /** Keeps all the strings. */
+    char **strs;
+    size_t strs_len;
+};
+
+
+/** @return Length of the lower-cased copy of 'ext' in 'dst' or zero if
+ *      'ext' is too long to be known. */
+static size_t lowerExt( char dst[MIME_EXT_MAX+1], const char*ext ){
+    size_t i;
+    for( i=0 ; ext[i] ; ++i ){
+        if( i >= MIME_EXT_MAX ){ return 0; }
+        dst[i] = tolower((unsigned char)ext[i]);
+    }
+    dst[i] = '\0';
+    return i;
+}
 
 
 const char* fileExtToMime( const char*ext )
 {
-    if( ext[0]=='7' ){
-        if( ext[1]=='z' ){
-            if( ext[2]=='\0' ){
-                return "application/x-7z-compressed";
-            }
-        }
-    }
-    if( ext[0]=='b' ){
-        if( ext[1]=='i' ){
-            if( ext[2]=='n' ){
-                if( ext[3]==0 ){
-                    return "application/octet-stream";
-                }
-            }
-        }
-    }
-    if( ext[0]=='c' ){
-        if( ext[1]=='s' ){
-            if( ext[2]=='s' ){
-                if( ext[3]==0 ){
-                    return "text/css";
-                }
-            }
-            if( ext[2]=='v' ){
-                if( ext[3]==0 ){
-                    return "text/csv";
-                }
-            }
-        }
-    }
-    if( ext[0]=='g' ){
-        if( ext[1]=='i' ){
-            if( ext[2]=='f' ){
-                if( ext[3]==0 ){
-                    return "image/gif";
-                }
-            }
-        }
-        if( ext[1]=='z' ){
-            if( ext[2]==0 ){
-                return "application/gzip";
-            }
-        }
-    }
-    if( ext[0]=='h' ){
-        if( ext[1]=='t' ){
-            if( ext[2]=='m' ){
-                if( ext[3]==0 ){
-                    return "text/html";
-                }
-                if( ext[3]=='l' ){
-                    return "text/html";
-                }
-            }
-        }
-    }
-    if( ext[0]=='i' ){
-        if( ext[1]=='c' ){
-            if( ext[2]=='o' ){
-                if( ext[3]==0 ){
-                    return "image/vnd.microsoft.icon";
-                }
-            }
-        }
-    }
-    if( ext[0]=='j' ){
-        if( ext[1]=='a' ){
-            if( ext[2]=='r' ){
-                if( ext[3]==0 ){
-                    return "application/java-archive";
-                }
-            }
-        }
-        if( ext[1]=='p' ){
-            if( ext[2]=='e' ){
-                if( ext[3]=='g' ){
-                    if( ext[4]==0 ){
-                        return "image/jpeg";
-                    }
-                }
-            }
-            if( ext[2]=='g' ){
-                if( ext[3]==0 ){
-                    return "image/jpeg";
-                }
-            }
-        }
-    }
-    if( ext[0]=='m' ){
-        if( ext[1]=='p' ){
-            if( ext[2]=='3' ){
-                if( ext[3]==0 ){
-                    return "audio/mpeg";
-                }
-            }
-            if( ext[2]=='e' ){
-                if( ext[3]=='g' ){
-                    if( ext[4]==0 ){
-                        return "video/mpeg";
-                    }
-                }
-            }
-        }
-    }
-    if( ext[0]=='o' ){
-        if( ext[1]=='d' ){
-            if( ext[2]=='p' ){
-                if( ext[3]==0 ){
-                    return "application/vnd.oasis.opendocument.presentation";
-                }
-            }
-            if( ext[2]=='s' ){
-                if( ext[3]==0 ){
-                    return "application/vnd.oasis.opendocument.spreadsheet";
-                }
-            }
-            if( ext[2]=='t' ){
-                if( ext[3]==0 ){
-                    return "application/vnd.oasis.opendocument.text";
-                }
-            }
-        }
-    }
-    if( ext[0]=='p' ){
-        if( ext[1]=='d' ){
-            if( ext[2]=='f' ){
-                if( ext[3]==0 ){
-                    return "application/pdf";
-                }
-            }
-        }
-        if( ext[1]=='n' ){
-            if( ext[2]=='g' ){
-                if( ext[3]==0 ){
-                    return "image/png";
-                }
-            }
-        }
-    }
-    if( ext[0]=='s' ){
-        if( ext[1]=='v' ){
-            if( ext[2]=='g' ){
-                if( ext[3]==0 ){
-                    return "image/svg+xml";
-                }
-            }
-        }
-    }
-    if( ext[0]=='t' ){
-        if( ext[1]=='a' ){
-            if( ext[2]=='r' ){
-                if( ext[3]==0 ){
-                    return "application/x-tar";
-                }
-            }
-        }
-        if( ext[1]=='x' ){
-            if( ext[2]=='t' ){
-                if( ext[3]==0 ){
-                    return "text/plain";
-                }
-            }
-        }
-    }
-    if( ext[0]=='j' ){
-        if( ext[1]=='s' ){
-            if( ext[2]==0 ){
-                return "text/javascript";
-            }
-            if( ext[2]=='o' ){
-                if( ext[3]=='n' ){
-                    if( ext[4]==0 ){
-                        return "application/json";
-                    }
-                }
-            }
-        }
-    }
-    if( ext[0]=='w' ){
-        if( ext[1]=='a' ){
-            if( ext[2]=='v' ){
-                if( ext[3]==0 ){
-                    return "audio/wav";
-                }
-            }
-        }
-        if( ext[1]=='e' ){
-            if( ext[2]=='b' ){
-                if( ext[3]=='a' ){
-                    if( ext[4]==0 ){
-                        return "audio/webm";
-                    }
-                }
-                if( ext[3]=='m' ){
-                    if( ext[4]==0 ){
-                        return "video/webm";
-                    }
-                }
-                if( ext[3]=='p' ){
-                    if( ext[4]==0 ){
-                        return "image/webp";
-                    }
-                }
-            }
-        }
-        if( ext[1]=='o' ){
-            if( ext[2]=='f' ){
-                if( ext[3]=='f' ){
-                    if( ext[4]=='\0' ){
-                        return "font/woff";
-                    }
-                    if( ext[4]=='2' ){
-                        if( ext[5]=='\0' ){
-                            return "font/woff2";
-                        }
-                    }
-                }
-            }
-        }
-    }
-    if( ext[0]=='x' ){
-        if( ext[1]=='h' ){
-            if( ext[2]=='t' ){
-                if( ext[3]=='m' ){
-                    if( ext[4]=='l' ){
-                        if( ext[5]=='\0' ){
-                            return "application/xhtml+xml";
-                        }
-                    }
-                }
-            }
-        }
-        if( ext[1]=='m' ){
-            if( ext[2]=='l' ){
-                if( ext[3]==0 ){
-                    return "text/xml";
-                }
-            }
-        }
-    }
-    if( ext[0]=='z' ){
-        if( ext[1]=='i' ){
-            if( ext[2]=='p' ){
-                if( ext[3]=='\0' ){
-                    return "application/zip";
-                }
-            }
-        }
+    char key[MIME_EXT_MAX+1];
+    const size_t key_len = lowerExt(key, ext);
+    if( key_len == 0 ){ return NULL; }
+    const uint32_t bucket = mime_hash(0, key, key_len) & (MIME_TABLE_BUCKETS-1);
+    const uint32_t slot = mime_hash(mimeTable_seeds[bucket], key, key_len) & (MIME_TABLE_SLOTS-1);
+    const struct MimeTableSlot *it = mimeTable_slots + slot;
+    if( it->ext == NULL || strcmp(it->ext, key) ){ return NULL; }
+    return it->type;
+}
+
+
+/** @return Slot of 'ext' (being its own or a free one where it belongs). */
+static MimeMapEntry* mimeMap_slot( const MimeMap*map, const char*ext, size_t ext_len ){
+    const size_t mask = map->slots_cap - 1;
+    for( size_t i = hash_fnv1a64(HASH_FNV1A64_INIT, ext, ext_len) & mask ;; i = (i+1) & mask ){
+        MimeMapEntry *it = map->slots + i;
+        if( it->ext == NULL || !strcmp(it->ext, ext) ){ return it; }
     }
+}
+
+
+static int mimeMap_grow( MimeMap*map ){
+    const size_t cap = map->slots_cap ? map->slots_cap * 2 : 64;
+    MimeMapEntry *old = map->slots;
+    const size_t old_cap = map->slots_cap;
+    map->slots = calloc(cap, sizeof*map->slots);
+    if( map->slots == NULL ){ map->slots = old; return -ENOMEM; }
+    map->slots_cap = cap;
+    for( size_t i=0 ; i<old_cap ; ++i ){
+        if( old[i].ext == NULL ){ continue; }
+        *mimeMap_slot(map, old[i].ext, strlen(old[i].ext)) = old[i];
+    }
+    free(old);
+    return 0;
+}
+
+
+static char* mimeMap_strdup( MimeMap*map, const char*str ){
+    if( (map->strs_len & 63) == 0 ){
+        char **tmp = realloc(map->strs, (map->strs_len + 64) * sizeof*tmp);
+        if( tmp == NULL ){ return NULL; }
+        map->strs = tmp;
+    }
+    char *dup = strdup(str);
+    if( dup == NULL ){ return NULL; }
+    map->strs[map->strs_len++] = dup;
+    return dup;
+}
+
+
+MimeMap* mimeMap_load( const char*file, size_t*errLine )
+{
+    int err;
+    FILE *fd = NULL;
+    MimeMap *map = calloc(1, sizeof*map);
+    if( map == NULL ){ err = ENOMEM; goto fail; }
+    fd = fopen(file, "rb");
+    if( fd == NULL ){ err = errno; goto fail; }
+    char line[4096];
+    for( size_t lineNr=1 ; fgets(line, sizeof line, fd) ; ++lineNr ){
+        char *save, *type = strtok_r(line, " \t\r\n", &save);
+        if( type == NULL || type[0] == '#' ){ continue; }
+        if( strchr(type, '/') == NULL ){
+            if( errLine ){ *errLine = lineNr; }
+            err = EINVAL; goto fail;
+        }
+        type = mimeMap_strdup(map, type);
+        if( type == NULL ){ err = ENOMEM; goto fail; }
+        for( char *ext ; (ext = strtok_r(NULL, " \t\r\n", &save)) ;){
+            char key[MIME_EXT_MAX+1];
+            const size_t key_len = lowerExt(key, ext);
+            if( key_len == 0 ){ continue; /* Cannot be looked up anyway. */ }
+            if( (map->count +1) * 2 > map->slots_cap && mimeMap_grow(map) ){
+                err = ENOMEM; goto fail; }
+            MimeMapEntry *it = mimeMap_slot(map, key, key_len);
+            if( it->ext == NULL ){
+                it->ext = mimeMap_strdup(map, key);
+                if( it->ext == NULL ){ err = ENOMEM; goto fail; }
+                map->count += 1;
+            }
+            it->type = type; /* <- Later lines win. */
+        }
+    }
+    if( ferror(fd) ){ err = errno; goto fail; }
+    fclose(fd);
+    return map;
+fail:
+    if( fd ){ fclose(fd); }
+    mimeMap_free(map);
+    errno = err;
     return NULL;
 }
 
+
+void mimeMap_free( MimeMap*map )
+{
+    if( map == NULL ){ return; }
+    for( size_t i=0 ; i<map->strs_len ; ++i ){ free(map->strs[i]); }
+    free(map->strs);
+    free(map->slots);
+    free(map);
+}
+
+
+const char* mimeMap_lookup( const MimeMap*map, const char*ext )
+{
+    if( map && map->count ){
+        char key[MIME_EXT_MAX+1];
+        const size_t key_len = lowerExt(key, ext);
+        if( key_len ){
+            const MimeMapEntry *it = mimeMap_slot(map, key, key_len);
+            if( it->ext ){ return it->type; }
+        }
+    }
+    return fileExtToMime(ext);
+}
@@ -5,11 +5,50 @@
 
 #include "commonbase.h"
 
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hash.h"
+
+
+/** Longest file extension we map. */
+#define MIME_EXT_MAX 31
+
+
+/** File extension to mime type mapping loaded at runtime. */
+typedef struct MimeMap MimeMap;
+
 
 /**
- * Returns ptr to statically allocated mimetype.
+ * Returns ptr to statically allocated mimetype. NULL if 'ext' is unknown.
+ * Case-insensitive. Backed by a perfect hash table generated from
+ * 'contrib/mime/mime.types'.
  */
 const char* fileExtToMime( const char*ext );
 
 
+/**
+ * Loads a mapping in the format of '/etc/mime.types' ("<type> <ext>..." per
+ * line, '#' starts a comment).
+ *
+ * @return New map or NULL on error (errno set). EINVAL for a malformed line
+ *      (its number then is in 'errLine').
+ */
+MimeMap* mimeMap_load( const char*file , size_t*errLine );
+
+void mimeMap_free( MimeMap* );
+
+/** @return Type for 'ext' from 'map' or else from 'fileExtToMime'. 'map' may
+ *      be NULL. Returned string lives as long as 'map'. */
+const char* mimeMap_lookup( const MimeMap*map , const char*ext );
+
+
+/** Hash of the generated table. Also used by its generator. So changing it
+ * requires to regenerate the table. */
+static inline uint32_t mime_hash( uint32_t seed , const char*ext , size_t ext_len ){
+    const uint64_t h = hash_fnv1a64(HASH_FNV1A64_INIT ^ (seed * 0x9e3779b97f4a7c15ULL), ext, ext_len);
+    return (uint32_t)(h ^ (h >> 32));
+}
+
+
 #endif /* INCGUARD_569e6cc3cc7a72f544dd00fb071f0a17 */
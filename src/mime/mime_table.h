@@ -0,0 +1,108 @@
+/* By using this work you agree to the terms and conditions in 'LICENSE.txt' */
+
+/* GENERATED by 'contrib/mime/mimegen.c' from 'contrib/mime/mime.types'.
+ * Do NOT edit. Use 'make mimetable' instead. */
+
+#ifndef INCGUARD_b7f31e0a5c6d4e2f8a9d03c1e4b56f27
+#define INCGUARD_b7f31e0a5c6d4e2f8a9d03c1e4b56f27
+
+
+#define MIME_TABLE_BUCKETS 64
+#define MIME_TABLE_SLOTS 128
+
+
+static const uint32_t mimeTable_seeds[MIME_TABLE_BUCKETS] = {
+    1, 0, 1, 3, 1, 1, 1, 0, 1, 1, 0, 1,
+    1, 1, 2, 1, 1, 1, 0, 1, 0, 0, 1, 6,
+    0, 1, 0, 1, 2, 3, 1, 3, 1, 2, 2, 2,
+    0, 3, 1, 2, 4, 0, 0, 3, 1, 2, 1, 2,
+    3, 3, 2, 1, 1, 0, 1, 2, 9, 6, 0, 1,
+    1, 3, 0, 0
+};
+
+
+static const struct MimeTableSlot {
+    const char *ext;
+    const char *type;
+} mimeTable_slots[MIME_TABLE_SLOTS] = {
+    [1] = { "conf", "text/plain" },
+    [4] = { "xsl", "application/xml" },
+    [6] = { "odp", "application/vnd.oasis.opendocument.presentation" },
+    [7] = { "opus", "audio/ogg" },
+    [8] = { "xls", "application/vnd.ms-excel" },
+    [9] = { "so", "application/octet-stream" },
+    [10] = { "svg", "image/svg+xml" },
+    [12] = { "js", "text/javascript" },
+    [13] = { "xz", "application/x-xz" },
+    [15] = { "bin", "application/octet-stream" },
+    [18] = { "midi", "audio/midi" },
+    [20] = { "html", "text/html" },
+    [22] = { "gz", "application/gzip" },
+    [25] = { "aac", "audio/aac" },
+    [26] = { "zst", "application/zstd" },
+    [30] = { "jar", "application/java-archive" },
+    [31] = { "ogg", "audio/ogg" },
+    [32] = { "log", "text/plain" },
+    [34] = { "sh", "application/x-sh" },
+    [35] = { "otf", "font/otf" },
+    [36] = { "jpg", "image/jpeg" },
+    [37] = { "map", "application/json" },
+    [41] = { "mid", "audio/midi" },
+    [42] = { "dll", "application/octet-stream" },
+    [43] = { "ttf", "font/ttf" },
+    [44] = { "pptx", "application/vnd.openxmlformats-officedocument.presentationml.presentation" },
+    [45] = { "wav", "audio/wav" },
+    [46] = { "xsd", "application/xml" },
+    [47] = { "jsonld", "application/ld+json" },
+    [49] = { "htm", "text/html" },
+    [51] = { "exe", "application/octet-stream" },
+    [53] = { "zip", "application/zip" },
+    [57] = { "yml", "application/yaml" },
+    [58] = { "ppt", "application/vnd.ms-powerpoint" },
+    [59] = { "ogv", "video/ogg" },
+    [60] = { "gif", "image/gif" },
+    [62] = { "oga", "audio/ogg" },
+    [64] = { "docx", "application/vnd.openxmlformats-officedocument.wordprocessingml.document" },
+    [65] = { "7z", "application/x-7z-compressed" },
+    [66] = { "yaml", "application/yaml" },
+    [68] = { "css", "text/css" },
+    [71] = { "xlsx", "application/vnd.openxmlformats-officedocument.spreadsheetml.sheet" },
+    [73] = { "bmp", "image/bmp" },
+    [74] = { "png", "image/png" },
+    [75] = { "csv", "text/csv" },
+    [76] = { "ods", "application/vnd.oasis.opendocument.spreadsheet" },
+    [80] = { "woff2", "font/woff2" },
+    [81] = { "ini", "text/plain" },
+    [82] = { "wasm", "application/wasm" },
+    [84] = { "avi", "video/x-msvideo" },
+    [88] = { "woff", "font/woff" },
+    [89] = { "json", "application/json" },
+    [90] = { "odt", "application/vnd.oasis.opendocument.text" },
+    [91] = { "txt", "text/plain" },
+    [92] = { "xhtml", "application/xhtml+xml" },
+    [93] = { "pdf", "application/pdf" },
+    [95] = { "xml", "text/xml" },
+    [96] = { "mp3", "audio/mpeg" },
+    [97] = { "bz2", "application/x-bzip2" },
+    [98] = { "ics", "text/calendar" },
+    [102] = { "tar", "application/x-tar" },
+    [104] = { "doc", "application/msword" },
+    [105] = { "mov", "video/quicktime" },
+    [106] = { "avif", "image/avif" },
+    [107] = { "webm", "video/webm" },
+    [109] = { "flac", "audio/flac" },
+    [111] = { "mjs", "application/javascript" },
+    [112] = { "webp", "image/webp" },
+    [113] = { "mp4", "video/mp4" },
+    [114] = { "md", "text/markdown" },
+    [115] = { "rtf", "application/rtf" },
+    [117] = { "jpeg", "image/jpeg" },
+    [118] = { "ico", "image/vnd.microsoft.icon" },
+    [119] = { "weba", "audio/webm" },
+    [120] = { "tif", "image/tiff" },
+    [125] = { "tiff", "image/tiff" },
+    [126] = { "mpeg", "video/mpeg" },
+};
+
+
+#endif /* INCGUARD_b7f31e0a5c6d4e2f8a9d03c1e4b56f27 */
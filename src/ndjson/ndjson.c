@@ -0,0 +1,528 @@
+/* By using this work you agree to the terms and conditions in 'LICENSE.txt' */
+
+/* This */
+#include "ndjson.h"
+
+/* System */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Libs */
+#include <cJSON.h>
+
+/* Project */
+#include "arena.h"
+#include "base64.h"
+#include "log.h"
+
+
+#define NDJSON_OUTBUF_CAP (1<<20)
+/* Headers of an entry to take. Pull never writes more than that. */
+#define NDJSON_HEADERS_MAX 8
+
+
+/** Default sink with '--format ndjson'. Writes one line per entry. */
+struct NdjsonSink {
+    /** NULL means stdout. */
+    const char *file;
+    FILE *out;
+    /** Lines get collected here and written in large blocks. */
+    char *outBuf;
+    size_t outBuf_len;
+    /** Body of current entry. Needs to be complete to tell if it is JSON. */
+    char *body;
+    size_t body_len, body_cap;
+};
+
+
+struct NdjsonSource {
+    /** NULL means stdin. */
+    const char *file;
+    FILE *in;
+    /** Input read ahead. Lines get parsed in place. */
+    char *buf;
+    size_t buf_len, buf_cap, buf_off;
+    int isEof;
+    size_t lineNr;
+    /** Of current entry. */
+    char *path;
+    char *contentType;
+    const char *headers[NDJSON_HEADERS_MAX];
+    size_t headers_len;
+    /** Holds the strings of 'headers'. */
+    char *headersBuf;
+    size_t headersBuf_cap;
+    char *body;
+    size_t body_len, body_cap, body_off;
+};
+
+
+/** Appends to the output. Blocks as large as the buffer bypass it. */
+static ssize_t NdjsonSink_put( NdjsonSink*ndjson, const char*buf, size_t buf_len ){
+    if( ndjson->outBuf_len + buf_len > NDJSON_OUTBUF_CAP ){
+        if( fwrite(ndjson->outBuf, 1, ndjson->outBuf_len, ndjson->out) != ndjson->outBuf_len ){
+            goto fail; }
+        ndjson->outBuf_len = 0;
+        if( buf_len >= NDJSON_OUTBUF_CAP ){
+            if( fwrite(buf, 1, buf_len, ndjson->out) != buf_len ){
+                goto fail; }
+            return 0;
+        }
+    }
+    memcpy(ndjson->outBuf + ndjson->outBuf_len, buf, buf_len);
+    ndjson->outBuf_len += buf_len;
+    return 0;
+fail:
+    log_write(LOG_LVL_ERROR, "%s%s%s%s", "Failed to write '", ndjson->file ? ndjson->file : "<stdout>",
+        "': ", strerror(errno));
+    return -1;
+}
+
+
+static ssize_t NdjsonSink_putStr( NdjsonSink*ndjson, const char*str ){
+    return NdjsonSink_put(ndjson, str, strlen(str));
+}
+
+
+/** Appends 'str' as a JSON string literal. */
+static ssize_t NdjsonSink_putJsonString( NdjsonSink*ndjson, const char*str ){
+    if( NdjsonSink_put(ndjson, "\"", 1) ){
+        return -1; }
+    for( const char*plain=str ;; ){
+        const unsigned char c = *str;
+        if( c == '\0' || c == '"' || c == '\\' || c < 0x20 ){
+            char esc[8];
+            if( NdjsonSink_put(ndjson, plain, str - plain) ){
+                return -1; }
+            if( c == '\0' ){
+                break; }
+            sprintf(esc, c < 0x20 ? "\\u%04x" : "\\%c", c);
+            if( NdjsonSink_putStr(ndjson, esc) ){
+                return -1; }
+            plain = str + 1;
+        }
+        str += 1;
+    }
+    return NdjsonSink_put(ndjson, "\"", 1);
+}
+
+
+static ssize_t NdjsonSink_open( NdjsonSink*ndjson ){
+    if( ndjson->out ){
+        return 0; }
+    ndjson->outBuf = malloc(NDJSON_OUTBUF_CAP);
+    if( ndjson->outBuf == NULL ){
+        return -ENOMEM; }
+    ndjson->out = ndjson->file ? fopen(ndjson->file, "wb") : stdout;
+    if( ndjson->out == NULL ){
+        log_write(LOG_LVL_ERROR, "%s%s%s%s", "Failed to open '", ndjson->file, "': ", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+
+static ssize_t NdjsonSink_onEntryBegin( void*NdjsonSink_, const GateleenResclone_Entry*entry ){
+    NdjsonSink *ndjson = NdjsonSink_;
+    if( NdjsonSink_open(ndjson) ){
+        return -1; }
+    if(    memBudget_growBuf(NULL, 0, &ndjson->body, &ndjson->body_cap, entry->size +1)
+        || NdjsonSink_putStr(ndjson, "{\"path\":")
+        || NdjsonSink_putJsonString(ndjson, entry->path) )
+    {
+        return -1; }
+    ndjson->body_len = 0;
+    if( entry->contentType && (
+           NdjsonSink_putStr(ndjson, ",\"contentType\":")
+        || NdjsonSink_putJsonString(ndjson, entry->contentType) ))
+    {
+        return -1; }
+    for( size_t i=0 ; i<entry->headers_len ; ++i ){
+        if(    NdjsonSink_putStr(ndjson, i ? "," : ",\"headers\":[")
+            || NdjsonSink_putJsonString(ndjson, entry->headers[i]) )
+        {
+            return -1; }
+    }
+    if( entry->headers_len && NdjsonSink_put(ndjson, "]", 1) ){
+        return -1; }
+    return 0;
+}
+
+
+static ssize_t NdjsonSink_onEntryData( void*NdjsonSink_, const char*buf, size_t buf_len ){
+    NdjsonSink *ndjson = NdjsonSink_;
+    if( memBudget_growBuf(NULL, 0, &ndjson->body, &ndjson->body_cap, ndjson->body_len + buf_len +1) ){
+        return -ENOMEM; }
+    memcpy(ndjson->body + ndjson->body_len, buf, buf_len);
+    ndjson->body_len += buf_len;
+    return 0;
+}
+
+
+/** @return Non-zero if the (zero terminated) body is one JSON value which
+ *      can be inlined verbatim. That is on one line and without whitespace
+ *      around it, as push takes the value as is. */
+static int NdjsonSink_isJsonBody( NdjsonSink*ndjson ){
+    static const char ws[] = " \t\r\n";
+    if( ndjson->body_len == 0 || strlen(ndjson->body) != ndjson->body_len
+        || strpbrk(ndjson->body, "\r\n") || strchr(ws, ndjson->body[0])
+        || strchr(ws, ndjson->body[ndjson->body_len-1]) )
+    {
+        return 0;
+    }
+    const char *end;
+    cJSON *json = cJSON_ParseWithOpts(ndjson->body, &end, !0);
+    cJSON_Delete(json);
+    return json != NULL;
+}
+
+
+static ssize_t NdjsonSink_onEntryEnd( void*NdjsonSink_ ){
+    NdjsonSink *ndjson = NdjsonSink_;
+    char num[32];
+    ndjson->body[ndjson->body_len] = '\0';
+    if( NdjsonSink_isJsonBody(ndjson) ){
+        sprintf(num, "%s"FMT_SIZE_T"%s", ",\"size\":", ndjson->body_len, ",\"json\":");
+        if(    NdjsonSink_putStr(ndjson, num)
+            || NdjsonSink_put(ndjson, ndjson->body, ndjson->body_len)
+            || NdjsonSink_put(ndjson, "}\n", 2) )
+        {
+            return -1; }
+        return 0;
+    }
+    sprintf(num, "%s"FMT_SIZE_T"%s", ",\"size\":", ndjson->body_len, ",\"base64\":\"");
+    if( NdjsonSink_putStr(ndjson, num) ){
+        return -1; }
+    // Chunks of a multiple of 3 bytes, so no padding gets in between.
+    char enc[BASE64_ENCODED_LEN(3 * 1024)];
+    for( size_t off=0 ; off < ndjson->body_len ; off += 3 * 1024 ){
+        const size_t len = ndjson->body_len - off < 3 * 1024 ? ndjson->body_len - off : 3 * 1024;
+        if( NdjsonSink_put(ndjson, enc, base64_encode(enc, ndjson->body + off, len)) ){
+            return -1; }
+    }
+    return NdjsonSink_put(ndjson, "\"}\n", 3);
+}
+
+
+static ssize_t NdjsonSink_onClose( void*NdjsonSink_ ){
+    NdjsonSink *ndjson = NdjsonSink_;
+    if( NdjsonSink_open(ndjson) ){
+        return -1; }
+    if(    fwrite(ndjson->outBuf, 1, ndjson->outBuf_len, ndjson->out) != ndjson->outBuf_len
+        || fflush(ndjson->out) )
+    {
+        log_write(LOG_LVL_ERROR, "%s%s%s%s", "Failed to write '", ndjson->file ? ndjson->file : "<stdout>",
+            "': ", strerror(errno));
+        return -1;
+    }
+    ndjson->outBuf_len = 0;
+    return 0;
+}
+
+
+NdjsonSink* ndjsonSink_alloc( const char*file ){
+    NdjsonSink *ndjson = calloc(1, sizeof*ndjson);
+    if( ndjson ){ ndjson->file = file; }
+    return ndjson;
+}
+
+
+void ndjsonSink_free( NdjsonSink*ndjson ){
+    if( ndjson == NULL ){ return; }
+    if( ndjson->out && ndjson->out != stdout ){
+        fclose(ndjson->out); }
+    free(ndjson->outBuf);
+    free(ndjson->body);
+    free(ndjson);
+}
+
+
+GateleenResclone_Sink ndjsonSink_iface( NdjsonSink*ndjson ){
+    return (GateleenResclone_Sink){
+        .cls = ndjson,
+        .onEntryBegin = NdjsonSink_onEntryBegin,
+        .onEntryData = NdjsonSink_onEntryData,
+        .onEntryEnd = NdjsonSink_onEntryEnd,
+        .onClose = NdjsonSink_onClose,
+    };
+}
+
+
+/** @return End of the JSON value starting at 'it' or NULL if it does not
+ *      end before 'end'. Does not validate. Only finds the extent. */
+static char* jsonValueEnd( char*it, const char*end ){
+    if( it >= end ){
+        return NULL; }
+    if( *it == '"' ){
+        for( ++it ; it < end ; ++it ){
+            if( *it == '\\' ){ ++it; }
+            else if( *it == '"' ){ return it + 1; }
+        }
+        return NULL;
+    }
+    if( *it == '{' || *it == '[' ){
+        for( uint_t depth=0 ; it < end ; ){
+            if( *it == '"' ){
+                it = jsonValueEnd(it, end);
+                if( it == NULL ){
+                    return NULL; }
+                continue;
+            }
+            if( *it == '{' || *it == '[' ){ depth += 1; }
+            else if( (*it == '}' || *it == ']') && --depth == 0 ){ return it + 1; }
+            ++it;
+        }
+        return NULL;
+    }
+    while( it < end && !strchr(",}] \t\r\n", *it) ){ ++it; }
+    return it;
+}
+
+
+static char* jsonSkipWs( char*it, const char*end ){
+    while( it < end && (*it == ' ' || *it == '\t' || *it == '\r' || *it == '\n') ){ ++it; }
+    return it;
+}
+
+
+/** Parses the JSON value '[it,end)' with cJSON. Caller owns the result.
+ * Relies on the byte at 'end' to be writable. */
+static cJSON* NdjsonSource_parseValue( char*it, char*end ){
+    const char save = *end;
+    *end = '\0';
+    cJSON *json = cJSON_Parse(it);
+    *end = save;
+    return json;
+}
+
+
+/** @return 1 and the next line (without its '\n'), 0 at end of input,
+ *      negative on error. */
+static ssize_t NdjsonSource_readLine( NdjsonSource*ndjson, char**line, size_t*line_len ){
+    for(;;){
+        char *it = ndjson->buf + ndjson->buf_off;
+        const size_t avail = ndjson->buf_len - ndjson->buf_off;
+        char *nl = avail ? memchr(it, '\n', avail) : NULL;
+        if( nl || (ndjson->isEof && avail) ){
+            *line = it;
+            *line_len = nl ? (size_t)(nl - it) : avail;
+            ndjson->buf_off += *line_len + (nl != NULL);
+            ndjson->lineNr += 1;
+            return 1;
+        }
+        if( ndjson->isEof ){
+            return 0; }
+        if( avail ){
+            memmove(ndjson->buf, it, avail); }
+        ndjson->buf_len = avail;
+        ndjson->buf_off = 0;
+        // Keep one byte spare, so values at the very end can get terminated.
+        if( ndjson->buf_len +1 >= ndjson->buf_cap
+            && memBudget_growBuf(NULL, 0, &ndjson->buf, &ndjson->buf_cap, ndjson->buf_cap ? ndjson->buf_cap * 2 : 1<<20) )
+        {
+            return -ENOMEM; }
+        const size_t readLen = fread(ndjson->buf + ndjson->buf_len, 1,
+            ndjson->buf_cap - ndjson->buf_len -1, ndjson->in);
+        if( readLen == 0 ){
+            if( ferror(ndjson->in) ){
+                log_write(LOG_LVL_ERROR, "%s%s%s%s", "Failed to read '", ndjson->file ? ndjson->file : "<stdin>",
+                    "': ", strerror(errno));
+                return -1;
+            }
+            ndjson->isEof = !0;
+        }
+        ndjson->buf_len += readLen;
+    }
+}
+
+
+/** Takes the members of one line into the current entry.
+ * @return 1 on success, 0 for a blank line, negative on error (logged). */
+static ssize_t NdjsonSource_parseLine( NdjsonSource*ndjson, char*line, size_t line_len ){
+    ssize_t err;
+    const char *reason = NULL;
+    cJSON *json = NULL;
+    char *const end = line + line_len;
+    char *it = jsonSkipWs(line, end);
+    if( it == end ){
+        return 0; }
+    free(ndjson->path); ndjson->path = NULL;
+    free(ndjson->contentType); ndjson->contentType = NULL;
+    ndjson->headers_len = 0;
+    ndjson->body_len = 0;
+    ndjson->body_off = 0;
+    if( *it != '{' ){
+        reason = "Expected an object"; err = -1; goto endFn; }
+    it = jsonSkipWs(it + 1, end);
+    while( it < end && *it != '}' ){
+        char *key = it, *keyEnd = *it == '"' ? jsonValueEnd(it, end) : NULL;
+        if( keyEnd == NULL ){
+            reason = "Expected a key"; err = -1; goto endFn; }
+        it = jsonSkipWs(keyEnd, end);
+        if( it == end || *it != ':' ){
+            reason = "Expected ':'"; err = -1; goto endFn; }
+        char *val = jsonSkipWs(it + 1, end), *valEnd = jsonValueEnd(val, end);
+        if( valEnd == NULL ){
+            reason = "Unterminated value"; err = -1; goto endFn; }
+        const size_t key_len = keyEnd - key;
+        #define NDJSON_KEY_IS( name ) (key_len == sizeof"\"" name "\"" -1 && !memcmp(key, "\"" name "\"", key_len))
+        if( NDJSON_KEY_IS("path") || NDJSON_KEY_IS("contentType") ){
+            json = NdjsonSource_parseValue(val, valEnd);
+            if( ! cJSON_IsString(json) ){
+                reason = "Expected a string"; err = -1; goto endFn; }
+            char **dst = NDJSON_KEY_IS("path") ? &ndjson->path : &ndjson->contentType;
+            free(*dst);
+            *dst = strdup(json->valuestring);
+            if( *dst == NULL ){
+                err = -ENOMEM; goto endFn; }
+            cJSON_Delete(json); json = NULL;
+        }else if( NDJSON_KEY_IS("headers") ){
+            size_t headersBuf_len = 0;
+            json = NdjsonSource_parseValue(val, valEnd);
+            if( ! cJSON_IsArray(json) ){
+                reason = "Expected an array"; err = -1; goto endFn; }
+            for( cJSON*hdr=json->child ; hdr ; hdr=hdr->next ){
+                if( cJSON_IsString(hdr) ){
+                    headersBuf_len += strlen(hdr->valuestring) +1; }
+            }
+            if( memBudget_growBuf(NULL, 0, &ndjson->headersBuf, &ndjson->headersBuf_cap, headersBuf_len +1) ){
+                err = -ENOMEM; goto endFn; }
+            ndjson->headers_len = 0;
+            char *hdrIt = ndjson->headersBuf;
+            for( cJSON*hdr=json->child ; hdr ; hdr=hdr->next ){
+                if( ! cJSON_IsString(hdr) ){
+                    continue; }
+                if( ndjson->headers_len >= NDJSON_HEADERS_MAX ){
+                    log_write(LOG_LVL_WARN, "%s"FMT_SIZE_T"%s", "Headers of line ", ndjson->lineNr,
+                        " dropped. Too many headers.");
+                    break;
+                }
+                const size_t hdr_len = strlen(hdr->valuestring);
+                memcpy(hdrIt, hdr->valuestring, hdr_len +1);
+                ndjson->headers[ndjson->headers_len++] = hdrIt;
+                hdrIt += hdr_len +1;
+            }
+            cJSON_Delete(json); json = NULL;
+        }else if( NDJSON_KEY_IS("json") || NDJSON_KEY_IS("base64") ){
+            const int isBase64 = NDJSON_KEY_IS("base64");
+            if( isBase64 && (*val != '"' || valEnd - val < 2) ){
+                reason = "Expected a string"; err = -1; goto endFn; }
+            if( memBudget_growBuf(NULL, 0, &ndjson->body, &ndjson->body_cap, valEnd - val) ){
+                err = -ENOMEM; goto endFn; }
+            if( isBase64 ){
+                const ssize_t body_len = base64_decode(ndjson->body, val + 1, valEnd - val - 2);
+                if( body_len < 0 ){
+                    reason = "Bad base64"; err = -1; goto endFn; }
+                ndjson->body_len = body_len;
+            }else{
+                // Verbatim. So the body gets pushed byte by byte as pulled.
+                memcpy(ndjson->body, val, valEnd - val);
+                ndjson->body_len = valEnd - val;
+            }
+        }
+        /* else: "size" follows from the body. Others are not ours. */
+        #undef NDJSON_KEY_IS
+        it = jsonSkipWs(valEnd, end);
+        if( it < end && *it == ',' ){
+            it = jsonSkipWs(it + 1, end); }
+        else if( it == end || *it != '}' ){
+            reason = "Expected ',' or '}'"; err = -1; goto endFn; }
+    }
+    if( it == end ){
+        reason = "Unterminated object"; err = -1; goto endFn; }
+    if( ndjson->path == NULL ){
+        reason = "No \"path\""; err = -1; goto endFn; }
+
+    err = 1;
+endFn:
+    if( reason ){
+        log_write(LOG_LVL_ERROR, "%s"FMT_SIZE_T"%s%s%s%s", "Line ", ndjson->lineNr, " of '",
+            ndjson->file ? ndjson->file : "<stdin>", "': ", reason);
+    }
+    cJSON_Delete(json);
+    return err;
+}
+
+
+static ssize_t NdjsonSource_nextEntry( void*NdjsonSource_, GateleenResclone_Entry*dst ){
+    ssize_t err;
+    NdjsonSource *ndjson = NdjsonSource_;
+    if( ndjson->in == NULL ){
+        ndjson->in = ndjson->file ? fopen(ndjson->file, "rb") : stdin;
+        if( ndjson->in == NULL ){
+            log_write(LOG_LVL_ERROR, "%s%s%s%s", "Failed to open '", ndjson->file, "': ", strerror(errno));
+            return -1;
+        }
+    }
+    do{
+        char *line;
+        size_t line_len;
+        err = NdjsonSource_readLine(ndjson, &line, &line_len);
+        if( err <= 0 ){
+            return err; }
+        err = NdjsonSource_parseLine(ndjson, line, line_len);
+        if( err < 0 ){
+            return -1; }
+    }while( err == 0 );
+    dst->path = ndjson->path;
+    dst->size = ndjson->body_len;
+    dst->contentType = ndjson->contentType;
+    dst->headers = ndjson->headers;
+    dst->headers_len = ndjson->headers_len;
+    return 1;
+}
+
+
+static ssize_t NdjsonSource_read( void*NdjsonSource_, char*buf, size_t buf_cap ){
+    NdjsonSource *ndjson = NdjsonSource_;
+    size_t len = ndjson->body_len - ndjson->body_off;
+    if( len > buf_cap ){
+        len = buf_cap; }
+    if( len == 0 ){
+        return 0; }
+    memcpy(buf, ndjson->body + ndjson->body_off, len);
+    ndjson->body_off += len;
+    return len;
+}
+
+
+NdjsonSource* ndjsonSource_alloc( const char*file ){
+    NdjsonSource *ndjson = calloc(1, sizeof*ndjson);
+    if( ndjson ){ ndjson->file = file; }
+    return ndjson;
+}
+
+
+void ndjsonSource_free( NdjsonSource*ndjson ){
+    if( ndjson == NULL ){ return; }
+    if( ndjson->in && ndjson->in != stdin ){
+        fclose(ndjson->in); }
+    free(ndjson->buf);
+    free(ndjson->path);
+    free(ndjson->contentType);
+    free(ndjson->headersBuf);
+    free(ndjson->body);
+    free(ndjson);
+}
+
+
+GateleenResclone_Source ndjsonSource_iface( NdjsonSource*ndjson ){
+    return (GateleenResclone_Source){
+        .cls = ndjson,
+        .nextEntry = NdjsonSource_nextEntry,
+        .read = NdjsonSource_read,
+    };
+}
+
+
+int ndjson_isNdjsonFile( const char*file ){
+    FILE *f = fopen(file, "rb");
+    if( f == NULL ){
+        return 0; }
+    int c;
+    while( (c = getc(f)) == ' ' || c == '\t' || c == '\r' || c == '\n' ){}
+    fclose(f);
+    return c == '{';
+}
@@ -0,0 +1,48 @@
+/* By using this work you agree to the terms and conditions in 'LICENSE.txt' */
+
+#ifndef INCGUARD_340e5820d1c94489a8fbf22233bce301
+#define INCGUARD_340e5820d1c94489a8fbf22233bce301
+
+#include "commonbase.h"
+
+#include "gateleen_resclone.h"
+
+
+/**
+ * '--format ndjson': One JSON object per line and resource, with "path",
+ * "contentType", "headers", "size" and the body. Single line JSON bodies
+ * get inlined verbatim as "json", others go as "base64".
+ */
+typedef struct NdjsonSink NdjsonSink;
+
+/** Reads what 'NdjsonSink' wrote. Line by line, so the input never is in
+ * memory as a whole. */
+typedef struct NdjsonSource NdjsonSource;
+
+
+/** @param file
+ *      File to create (with the first entry or at close). NULL means
+ *      stdout. Must outlive the sink.
+ * @return NULL if out of memory. */
+NdjsonSink* ndjsonSink_alloc( const char*file );
+
+void ndjsonSink_free( NdjsonSink* );
+
+/** @return Sink interface to pass the entries to. */
+GateleenResclone_Sink ndjsonSink_iface( NdjsonSink* );
+
+/** @param file
+ *      File to read. NULL means stdin. Must outlive the source.
+ * @return NULL if out of memory. */
+NdjsonSource* ndjsonSource_alloc( const char*file );
+
+void ndjsonSource_free( NdjsonSource* );
+
+/** @return Source interface to take the entries from. */
+GateleenResclone_Source ndjsonSource_iface( NdjsonSource* );
+
+/** @return Non-zero if 'file' looks like NDJSON (begins with a '{'). */
+int ndjson_isNdjsonFile( const char*file );
+
+
+#endif /* INCGUARD_340e5820d1c94489a8fbf22233bce301 */
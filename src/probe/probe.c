@@ -0,0 +1,337 @@
+/* By using this work you agree to the terms and conditions in 'LICENSE.txt' */
+
+/* This */
+#include "probe.h"
+
+/* System */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef _WIN32
+#   include <io.h> /* <- mkdir */
+#endif
+
+/* Libs */
+#include <curl/curl.h>
+#include <cJSON.h>
+
+/* Project */
+#include "hash.h"
+#include "log.h"
+
+
+#define PROBE_MAGIC "gateleen-resclone-probe 2"
+/* Responses get cut after that many bytes. */
+#define PROBE_BODY_MAX (1<<20)
+/* Smaller responses tell nothing about throughput. */
+#define PROBE_RATE_MIN (64<<10)
+/* How many collections deep to look for a resource to try 'Range' on. */
+#define PROBE_DEPTH_MAX 3
+#define PROBE_TIMEOUT_S 30L
+
+
+typedef struct Probe {
+    CURL *curl;
+    char *buf;
+    size_t buf_len;
+    long rspCode;
+    uint_t requests;
+    /** Body bytes of the response 'bytesPerSec' got measured by. */
+    size_t rateBytes;
+    ProbeProfile *profile;
+} Probe;
+
+
+static size_t onProbeChunk( char*buf, size_t size, size_t count, void*probe_ ){
+    Probe *probe = probe_;
+    const size_t buf_len = size * count;
+    size_t room = PROBE_BODY_MAX - probe->buf_len;
+    if( room > buf_len ){
+        room = buf_len; }
+    memcpy(probe->buf + probe->buf_len, buf, room);
+    probe->buf_len += room;
+    // Returning less than we got aborts the transfer. Enough seen.
+    return room;
+}
+
+
+/** Fetches 'url' into 'probe->buf' (NUL terminated) and accounts what the
+ * transfer tells about the server. */
+static ssize_t probePerform( Probe*probe, const char*url, const char*range ){
+    CURL *curl = probe->curl;
+    probe->buf_len = 0;
+    probe->rspCode = 0;
+    if(    curl_easy_setopt(curl, CURLOPT_URL, url)
+        || curl_easy_setopt(curl, CURLOPT_RANGE, range)
+        || curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 0L)
+        || curl_easy_setopt(curl, CURLOPT_TIMEOUT, PROBE_TIMEOUT_S)
+        || curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, onProbeChunk)
+        || curl_easy_setopt(curl, CURLOPT_WRITEDATA, probe) )
+    {
+        return -1;
+    }
+    const CURLcode cErr = curl_easy_perform(curl);
+    probe->buf[probe->buf_len] = '\0';
+    if( cErr != CURLE_OK && !(cErr == CURLE_WRITE_ERROR && probe->buf_len == PROBE_BODY_MAX) ){
+        log_write(LOG_LVL_WARN, "%s%s%s%s", "Probe '", url, "': ", curl_easy_strerror(cErr));
+        return -1;
+    }
+
+    ProbeProfile *profile = probe->profile;
+    long version = 0, connects = 0;
+    curl_off_t preUs = 0, startUs = 0, totalUs = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &probe->rspCode);
+    curl_easy_getinfo(curl, CURLINFO_HTTP_VERSION, &version);
+    curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &connects);
+    curl_easy_getinfo(curl, CURLINFO_PRETRANSFER_TIME_T, &preUs);
+    curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME_T, &startUs);
+    curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &totalUs);
+    switch( version ){
+        case CURL_HTTP_VERSION_1_0: profile->httpVersion = 10; break;
+        case CURL_HTTP_VERSION_1_1: profile->httpVersion = 11; break;
+        case CURL_HTTP_VERSION_2_0: profile->httpVersion = 20; break;
+        case CURL_HTTP_VERSION_3  : profile->httpVersion = 30; break;
+    }
+    // Only a follow-up request can tell whether the connection got reused.
+    if( probe->requests > 0 && connects == 0 ){
+        profile->isKeepAlive = !0; }
+    const uint64_t rttUs = startUs > preUs ? (uint64_t)(startUs - preUs) : 1;
+    if( probe->requests == 0 || rttUs < profile->rttUs ){
+        profile->rttUs = rttUs; }
+    if( probe->buf_len >= PROBE_RATE_MIN && probe->buf_len > probe->rateBytes && totalUs > startUs ){
+        profile->bytesPerSec = (uint64_t)probe->buf_len * 1000000 / (uint64_t)(totalUs - startUs);
+        probe->rateBytes = probe->buf_len;
+    }
+    probe->requests += 1;
+    return 0;
+}
+
+
+/** Looks up the first resource (or else the first collection) in the
+ * listing in 'probe->buf'.
+ * @return Its name (malloc'ed) or NULL. */
+static char* probePickEntry( Probe*probe, int*isDir ){
+    char *name = NULL;
+    cJSON *root = cJSON_Parse(probe->buf);
+    if( root == NULL || ! cJSON_IsObject(root) || ! cJSON_IsArray(root->child) ){
+        goto endFn; }
+    const char *dirName = NULL;
+    for( cJSON *it = root->child->child ; it ; it = it->next ){
+        if( ! cJSON_IsString(it) || it->valuestring[0] == '\0' ){
+            continue; }
+        const size_t len = strlen(it->valuestring);
+        if( it->valuestring[len-1] != '/' ){
+            name = strdup(it->valuestring);
+            *isDir = 0;
+            goto endFn;
+        }
+        if( dirName == NULL ){
+            dirName = it->valuestring; }
+    }
+    if( dirName ){
+        name = strdup(dirName);
+        *isDir = !0;
+    }
+endFn:
+    cJSON_Delete(root);
+    return name;
+}
+
+
+ssize_t probe_run( const char*url, ProbeProfile*dst ){
+    ssize_t err;
+    Probe probe = { .profile = dst };
+    char *dirUrl = NULL, *name = NULL, *reqUrl = NULL;
+    memset(dst, 0, sizeof*dst);
+    dst->probedAt = time(NULL);
+
+    probe.buf = malloc(PROBE_BODY_MAX +1);
+    probe.curl = curl_easy_init();
+    dirUrl = strdup(url);
+    if( probe.buf == NULL || probe.curl == NULL || dirUrl == NULL ){
+        err = -ENOMEM; goto endFn; }
+
+    // Find a resource to try 'Range' on.
+    int isDir = !0;
+    for( uint_t depth=0 ; depth < PROBE_DEPTH_MAX && isDir ; ++depth ){
+        err = probePerform(&probe, dirUrl, NULL);
+        if( err ){
+            err = -1; goto endFn; }
+        if( depth == 0 && probe.rspCode >= 500 ){
+            // Would not tell what the server can once it is healthy again.
+            log_write(LOG_LVL_WARN, "%s%s%s%ld", "Probe '", dirUrl, "': HTTP ", probe.rspCode);
+            err = -1; goto endFn;
+        }
+        free(name);
+        name = probe.rspCode == 200 ? probePickEntry(&probe, &isDir) : NULL;
+        if( name == NULL ){
+            break; }
+        if( isDir ){
+            char *sub = malloc(strlen(dirUrl) + strlen(name) +1);
+            if( sub == NULL ){
+                err = -ENOMEM; goto endFn; }
+            sprintf(sub, "%s%s", dirUrl, name);
+            free(dirUrl); dirUrl = sub;
+        }
+    }
+    if( name && ! isDir ){
+        reqUrl = malloc(strlen(dirUrl) + strlen(name) +1);
+        if( reqUrl == NULL ){
+            err = -ENOMEM; goto endFn; }
+        sprintf(reqUrl, "%s%s", dirUrl, name);
+        char range[32];
+        sprintf(range, "0-%d", PROBE_BODY_MAX -1);
+        if( probePerform(&probe, reqUrl, range) == 0 ){
+            dst->isRange = probe.rspCode == 206; }
+        free(reqUrl); reqUrl = NULL;
+    }
+
+    err = 0;
+endFn:
+    if( probe.curl ){ curl_easy_cleanup(probe.curl); }
+    free(probe.buf);
+    free(dirUrl);
+    free(name);
+    free(reqUrl);
+    return err;
+}
+
+
+static int makeDir( const char*path ){
+#ifdef _WIN32
+    const int err = mkdir(path);
+#else
+    const int err = mkdir(path, 0777);
+#endif
+    return (err && errno != EEXIST) ? -errno : 0;
+}
+
+
+/** Creates 'dir' including its missing parents. */
+static int makeDirs( const char*dir ){
+    int err;
+    char *path = strdup(dir);
+    if( path == NULL ){
+        return -ENOMEM; }
+    for( char *it = strchr(path +1, '/') ; it ; it = strchr(it +1, '/') ){
+        *it = '\0';
+        err = makeDir(path);
+        *it = '/';
+        if( err ){ goto endFn; }
+    }
+    err = makeDir(path);
+endFn:
+    free(path);
+    return err;
+}
+
+
+/** @return Path of the profile of 'url' (malloc'ed) or NULL if out of
+ *      memory. Like 'dir/https_example.com_443_<hash of url>'. Keyed by the
+ *      whole url, as 'Range' and throughput got measured below it. */
+static char* profilePath( const char*dir, const char*url ){
+    const char *host = strstr(url, "://");
+    const size_t scheme_len = host ? (size_t)(host - url) : 0;
+    host = host ? host + 3 : url;
+    const size_t host_len = strcspn(host, "/?#");
+    const size_t dir_len = strlen(dir);
+    char *path = malloc(dir_len + scheme_len + host_len + 20);
+    if( path == NULL ){
+        return NULL; }
+    char *it = path;
+    memcpy(it, dir, dir_len); it += dir_len;
+    *it++ = '/';
+    memcpy(it, url, scheme_len); it += scheme_len;
+    *it++ = '_';
+    for( size_t i=0 ; i<host_len ; ++i ){
+        const char c = host[i];
+        // Keep it a plain file name, whatever the host part looks like.
+        const int isPlain = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+            || (c >= '0' && c <= '9') || c == '.' || c == '-';
+        *it++ = isPlain ? c : '_';
+    }
+    sprintf(it, "_%016llx", (unsigned long long)hash_fnv1a64(HASH_FNV1A64_INIT, url, strlen(url)));
+    return path;
+}
+
+
+ssize_t probe_load( const char*dir, const char*url, int64_t maxAge, ProbeProfile*dst ){
+    ssize_t err;
+    FILE *f = NULL;
+    char line[128];
+    char *path = profilePath(dir, url);
+    if( path == NULL ){
+        err = -ENOMEM; goto endFn; }
+    f = fopen(path, "rb");
+    if( f == NULL ){
+        err = errno == ENOENT ? 0 : -errno; goto endFn; }
+    if( fgets(line, sizeof line, f) == NULL || strcmp(line, PROBE_MAGIC "\n") ){
+        err = 0; goto endFn; }
+    ProbeProfile profile = {0};
+    long long probedAt = 0;
+    unsigned long long rttUs = 0, bytesPerSec = 0;
+    unsigned httpVersion = 0;
+    int fields = 0;
+    while( fgets(line, sizeof line, f) ){
+        fields += sscanf(line, "probedAt %lld", &probedAt)
+            + sscanf(line, "httpVersion %u", &httpVersion)
+            + sscanf(line, "keepAlive %d", &profile.isKeepAlive)
+            + sscanf(line, "range %d", &profile.isRange)
+            + sscanf(line, "rttUs %llu", &rttUs)
+            + sscanf(line, "bytesPerSec %llu", &bytesPerSec);
+    }
+    if( fields != 6 || probedAt + maxAge < (long long)time(NULL) ){
+        err = 0; goto endFn; }
+    profile.probedAt = probedAt;
+    profile.httpVersion = httpVersion;
+    profile.rttUs = rttUs;
+    profile.bytesPerSec = bytesPerSec;
+    *dst = profile;
+    err = 1;
+endFn:
+    if( f ){ fclose(f); }
+    free(path);
+    return err;
+}
+
+
+ssize_t probe_store( const char*dir, const char*url, const ProbeProfile*profile ){
+    ssize_t err;
+    FILE *f = NULL;
+    char *tmpPath = NULL;
+    char *path = profilePath(dir, url);
+    if( path == NULL ){
+        err = -ENOMEM; goto endFn; }
+    err = makeDirs(dir);
+    if( err ){ goto endFn; }
+    // Write aside and rename. So concurrent runs never see a partial one.
+    // Pid and a stack address keep writers of other processes and threads
+    // (batch jobs probing the same url) apart.
+    tmpPath = malloc(strlen(path) + 64);
+    if( tmpPath == NULL ){
+        err = -ENOMEM; goto endFn; }
+    sprintf(tmpPath, "%s.%ld.%p.tmp", path, (long)getpid(), (void*)&f);
+    f = fopen(tmpPath, "wb");
+    if( f == NULL ){
+        err = -errno; goto endFn; }
+    fprintf(f, "%s\n" "probedAt %lld\n" "httpVersion %u\n" "keepAlive %d\n" "range %d\n"
+        "rttUs %llu\n" "bytesPerSec %llu\n", PROBE_MAGIC,
+        (long long)profile->probedAt, profile->httpVersion, !!profile->isKeepAlive,
+        !!profile->isRange, (unsigned long long)profile->rttUs,
+        (unsigned long long)profile->bytesPerSec);
+    err = fclose(f); f = NULL;
+    if( err ){
+        err = -errno; remove(tmpPath); goto endFn; }
+    if( rename(tmpPath, path) ){
+        err = -errno; remove(tmpPath); goto endFn; }
+    err = 0;
+endFn:
+    if( f ){ fclose(f); remove(tmpPath); }
+    free(tmpPath);
+    free(path);
+    return err;
+}
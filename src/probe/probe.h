@@ -0,0 +1,57 @@
+/* By using this work you agree to the terms and conditions in 'LICENSE.txt' */
+
+#ifndef INCGUARD_7c2f90d4e16b4a3f9e85d0b3a41c6f27
+#define INCGUARD_7c2f90d4e16b4a3f9e85d0b3a41c6f27
+
+#include "commonbase.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+
+/**
+ * What a server (host) is capable of, as found out by a few cheap requests
+ * against a collection on it.
+ *
+ * The probe fetches the collection listing (descending into the first sub
+ * collection until it finds a resource), then asks for the head of that
+ * resource with a 'Range'. It does not read more than the first MiB of any
+ * response.
+ */
+typedef struct ProbeProfile {
+    /** Unix time of the probe. */
+    int64_t probedAt;
+    /** HTTP version of the responses times ten (11, 20, 30). */
+    uint_t httpVersion;
+    /** Server kept the connection open from one request to the next. */
+    int isKeepAlive;
+    /** Server answered a 'Range' with 206. */
+    int isRange;
+    /** Shortest time to the first byte of a response, in microseconds. */
+    uint64_t rttUs;
+    /** Body bytes per second of the largest response. Zero if it was too
+     * small to tell. */
+    uint64_t bytesPerSec;
+} ProbeProfile;
+
+
+/** Probes the collection 'url' (with trailing slash).
+ * @return 0 on success, negative if the server could not be reached or
+ *      answered with 5xx (reason got logged). */
+ssize_t probe_run( const char*url , ProbeProfile*dst );
+
+/** Reads the profile stored for 'url' in 'dir'.
+ * @param maxAge
+ *      Seconds. Older profiles count as missing.
+ * @return 1 if found, 0 if not (or outdated or malformed), negative errno
+ *      on error. */
+ssize_t probe_load( const char*dir , const char*url , int64_t maxAge , ProbeProfile*dst );
+
+/** Stores 'profile' for 'url' in 'dir' (created with its parents if
+ * missing).
+ * @return 0 on success, negative errno on error. */
+ssize_t probe_store( const char*dir , const char*url , const ProbeProfile*profile );
+
+
+#endif /* INCGUARD_7c2f90d4e16b4a3f9e85d0b3a41c6f27 */
@@ -0,0 +1,309 @@
+/* By using this work you agree to the terms and conditions in 'LICENSE.txt' */
+
+/* This */
+#include "redis.h"
+
+/* System */
+#include <errno.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+/* Project */
+#include "log.h"
+
+
+#ifndef MSG_NOSIGNAL
+#   define MSG_NOSIGNAL 0
+#endif
+#define REDIS_RBUF_MIN (64<<10)
+/* Deeper nested replies get rejected. None of the commands we use come
+ * close. */
+#define REDIS_DEPTH_MAX 8
+
+
+struct Redis {
+    int fd;
+    /* Received but not yet consumed replies start at 'rbuf_pos'. */
+    char *rbuf;
+    size_t rbuf_pos;
+    size_t rbuf_len;
+    size_t rbuf_cap;
+    /* Queued commands. */
+    char *wbuf;
+    size_t wbuf_len;
+    size_t wbuf_cap;
+    /* The last reply. Arrays have their elements (recursively) behind. */
+    RedisReply *pool;
+    size_t pool_cap;
+};
+
+
+Redis* redis_connect( const char*host, const char*port ){
+    int err;
+    Redis *redis = NULL;
+    struct addrinfo *addrs = NULL;
+    const struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+
+    redis = calloc(1, sizeof*redis);
+    if( redis == NULL ){
+        log_write(LOG_LVL_ERROR, "%s", "Out of memory");
+        goto fail;
+    }
+    redis->fd = -1;
+    err = getaddrinfo(host, port, &hints, &addrs);
+    if( err ){
+        log_write(LOG_LVL_ERROR, "%s%s%s%s%s%s", "Cannot resolve redis '", host, ":", port, "': ",
+            gai_strerror(err));
+        goto fail;
+    }
+    for( struct addrinfo *it = addrs ; it ; it = it->ai_next ){
+        redis->fd = socket(it->ai_family, it->ai_socktype, it->ai_protocol);
+        if( redis->fd < 0 ){
+            continue; }
+        if( connect(redis->fd, it->ai_addr, it->ai_addrlen) == 0 ){
+            break; }
+        err = errno;
+        close(redis->fd); redis->fd = -1;
+        errno = err;
+    }
+    if( redis->fd < 0 ){
+        log_write(LOG_LVL_ERROR, "%s%s%s%s%s%s", "Cannot connect redis '", host, ":", port, "': ",
+            strerror(errno));
+        goto fail;
+    }
+    freeaddrinfo(addrs);
+    return redis;
+fail:
+    if( addrs ){ freeaddrinfo(addrs); }
+    redis_close(redis);
+    return NULL;
+}
+
+
+void redis_close( Redis*redis ){
+    if( redis == NULL ){
+        return; }
+    if( redis->fd >= 0 ){ close(redis->fd); }
+    free(redis->rbuf);
+    free(redis->wbuf);
+    free(redis->pool);
+    free(redis);
+}
+
+
+static int growBuf( char**buf, size_t*cap, size_t minCap ){
+    if( *cap >= minCap ){
+        return 0; }
+    size_t newCap = *cap ? *cap : 4096;
+    while( newCap < minCap ){ newCap *= 2; }
+    char *tmp = realloc(*buf, newCap);
+    if( tmp == NULL ){
+        return -ENOMEM; }
+    *buf = tmp;
+    *cap = newCap;
+    return 0;
+}
+
+
+ssize_t redis_append( Redis*redis, size_t argc, const char*const*argv, const size_t*argv_len ){
+    size_t need = 24;
+    for( size_t i=0 ; i<argc ; ++i ){
+        need += 24 + (argv_len ? argv_len[i] : strlen(argv[i])); }
+    if( growBuf(&redis->wbuf, &redis->wbuf_cap, redis->wbuf_len + need) ){
+        return -ENOMEM; }
+    char *it = redis->wbuf + redis->wbuf_len;
+    it += sprintf(it, "*%lu\r\n", (unsigned long)argc);
+    for( size_t i=0 ; i<argc ; ++i ){
+        const size_t len = argv_len ? argv_len[i] : strlen(argv[i]);
+        it += sprintf(it, "$%lu\r\n", (unsigned long)len);
+        memcpy(it, argv[i], len); it += len;
+        *it++ = '\r'; *it++ = '\n';
+    }
+    redis->wbuf_len = it - redis->wbuf;
+    return 0;
+}
+
+
+ssize_t redis_flush( Redis*redis ){
+    size_t sent = 0;
+    while( sent < redis->wbuf_len ){
+        const ssize_t n = send(redis->fd, redis->wbuf + sent, redis->wbuf_len - sent, MSG_NOSIGNAL);
+        if( n < 0 && errno == EINTR ){
+            continue; }
+        if( n < 0 ){
+            log_write(LOG_LVL_ERROR, "%s%s", "send(redis): ", strerror(errno));
+            return -1;
+        }
+        sent += n;
+    }
+    redis->wbuf_len = 0;
+    return 0;
+}
+
+
+/** Finds the end of the line at 'buf[pos]'.
+ * @return Offset of its '\r' or SIZE_MAX if not received completely. */
+static size_t lineEnd( const char*buf, size_t buf_len, size_t pos ){
+    for( const char *it = buf + pos ;; ++it ){
+        it = memchr(it, '\r', buf_len - (it - buf));
+        if( it == NULL || it + 1 >= buf + buf_len ){
+            return SIZE_MAX; }
+        if( it[1] == '\n' ){
+            return it - buf; }
+    }
+}
+
+
+/** Checks whether the reply at 'buf[*pos]' got received completely and
+ * counts it (with its nested elements) into '*count'.
+ * @return 1 if complete (and '*pos' behind it), 0 if more is needed, -1 if
+ *      malformed. */
+static int scanReply( const char*buf, size_t buf_len, size_t*pos, size_t*count, int depth ){
+    if( depth > REDIS_DEPTH_MAX ){
+        return -1; }
+    if( *pos >= buf_len ){
+        return 0; }
+    const size_t eol = lineEnd(buf, buf_len, *pos);
+    if( eol == SIZE_MAX ){
+        return 0; }
+    const char type = buf[*pos];
+    long long n = 0;
+    if( type == '$' || type == '*' || type == ':' ){
+        char *end;
+        n = strtoll(buf + *pos + 1, &end, 10);
+        if( end != buf + eol ){
+            return -1; }
+    }
+    *count += 1;
+    size_t next = eol + 2;
+    switch( type ){
+    case '+': case '-': case ':':
+        break;
+    case '$':
+        if( n < -1 ){
+            return -1; }
+        if( n >= 0 ){
+            if( buf_len - next < (size_t)n + 2 ){
+                return 0; }
+            next += n + 2;
+        }
+        break;
+    case '*':
+        if( n < -1 ){
+            return -1; }
+        for( long long i=0 ; i<n ; ++i ){
+            const int ret = scanReply(buf, buf_len, &next, count, depth +1);
+            if( ret <= 0 ){
+                return ret; }
+        }
+        break;
+    default:
+        return -1;
+    }
+    *pos = next;
+    return 1;
+}
+
+
+/** Fills 'dst' from the reply at 'buf[*pos]' (checked by 'scanReply').
+ * Terminates its strings in place. Elements of arrays get taken from
+ * '*next'. */
+static void fillReply( char*buf, size_t buf_len, size_t*pos, RedisReply*dst, RedisReply**next ){
+    const size_t begin = *pos;
+    const size_t eol = lineEnd(buf, buf_len, begin);
+    const char type = buf[begin];
+    memset(dst, 0, sizeof*dst);
+    buf[eol] = '\0';
+    const long long n = (type == '$' || type == '*' || type == ':') ? strtoll(buf + begin + 1, NULL, 10) : 0;
+    *pos = eol + 2;
+    switch( type ){
+    case '+': case '-':
+        dst->type = type == '+' ? REDIS_STATUS : REDIS_ERROR;
+        dst->str = buf + begin + 1;
+        dst->str_len = eol - begin - 1;
+        break;
+    case ':':
+        dst->type = REDIS_INTEGER;
+        dst->integer = n;
+        break;
+    case '$':
+        if( n < 0 ){
+            dst->type = REDIS_NIL; break; }
+        dst->type = REDIS_STRING;
+        dst->str = buf + *pos;
+        dst->str_len = n;
+        buf[*pos + n] = '\0'; /* <- Was the '\r' behind. */
+        *pos += n + 2;
+        break;
+    case '*':
+        if( n < 0 ){
+            dst->type = REDIS_NIL; break; }
+        dst->type = REDIS_ARRAY;
+        RedisReply *elems = *next;
+        *next += n;
+        dst->elems = elems;
+        dst->elems_len = n;
+        for( long long i=0 ; i<n ; ++i ){
+            fillReply(buf, buf_len, pos, elems + i, next); }
+        break;
+    }
+}
+
+
+ssize_t redis_read( Redis*redis, const RedisReply**dst ){
+    for(;;){
+        size_t pos = redis->rbuf_pos, count = 0;
+        const int ret = scanReply(redis->rbuf, redis->rbuf_len, &pos, &count, 0);
+        if( ret < 0 ){
+            log_write(LOG_LVL_ERROR, "%s", "Malformed reply from redis");
+            return -1;
+        }
+        if( ret > 0 ){
+            if( redis->pool_cap < count ){
+                RedisReply *tmp = realloc(redis->pool, count * sizeof*redis->pool);
+                if( tmp == NULL ){
+                    log_write(LOG_LVL_ERROR, "%s", "Out of memory");
+                    return -1;
+                }
+                redis->pool = tmp;
+                redis->pool_cap = count;
+            }
+            size_t fillPos = redis->rbuf_pos;
+            RedisReply *next = redis->pool + 1;
+            fillReply(redis->rbuf, redis->rbuf_len, &fillPos, redis->pool, &next);
+            redis->rbuf_pos = pos;
+            *dst = redis->pool;
+            return 0;
+        }
+        // Need more. Drop what got consumed already first.
+        if( redis->rbuf_pos ){
+            memmove(redis->rbuf, redis->rbuf + redis->rbuf_pos, redis->rbuf_len - redis->rbuf_pos);
+            redis->rbuf_len -= redis->rbuf_pos;
+            redis->rbuf_pos = 0;
+        }
+        if( redis->rbuf_cap - redis->rbuf_len < REDIS_RBUF_MIN / 2
+            && growBuf(&redis->rbuf, &redis->rbuf_cap, redis->rbuf_len + REDIS_RBUF_MIN) )
+        {
+            log_write(LOG_LVL_ERROR, "%s", "Out of memory");
+            return -1;
+        }
+        const ssize_t n = recv(redis->fd, redis->rbuf + redis->rbuf_len,
+            redis->rbuf_cap - redis->rbuf_len, 0);
+        if( n < 0 && errno == EINTR ){
+            continue; }
+        if( n < 0 ){
+            log_write(LOG_LVL_ERROR, "%s%s", "recv(redis): ", strerror(errno));
+            return -1;
+        }
+        if( n == 0 ){
+            log_write(LOG_LVL_ERROR, "%s", "Redis closed the connection");
+            return -1;
+        }
+        redis->rbuf_len += n;
+    }
+}
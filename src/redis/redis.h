@@ -0,0 +1,69 @@
+/* By using this work you agree to the terms and conditions in 'LICENSE.txt' */
+
+#ifndef INCGUARD_41d8e6b2a97f4c05b3e1f8a2c6d09e73
+#define INCGUARD_41d8e6b2a97f4c05b3e1f8a2c6d09e73
+
+#include "commonbase.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+
+/**
+ * Minimal redis client speaking RESP2 over one connection. Made for
+ * pipelining: queue many commands with 'redis_append', send them at once
+ * by 'redis_flush', then take the replies in order by 'redis_read'.
+ *
+ * Not thread safe.
+ */
+typedef struct Redis Redis;
+
+
+typedef enum RedisType {
+    REDIS_NIL     = 0,
+    REDIS_STATUS  = 1,
+    REDIS_ERROR   = 2,
+    REDIS_INTEGER = 3,
+    REDIS_STRING  = 4,
+    REDIS_ARRAY   = 5
+} RedisType;
+
+
+/** One reply (or element of an array reply). */
+typedef struct RedisReply {
+    RedisType type;
+    int64_t integer;
+    /** Text of status, error and string replies. NUL terminated, but may
+     * contain NULs itself. */
+    const char *str;
+    size_t str_len;
+    const struct RedisReply *elems;
+    size_t elems_len;
+} RedisReply;
+
+
+/** @return NULL on error (reason got logged). */
+Redis* redis_connect( const char*host , const char*port );
+
+void redis_close( Redis* );
+
+/** Queues a command. Args are binary safe.
+ * @param argv_len
+ *      Length of each arg. NULL means they are NUL terminated.
+ * @return 0 on success, negative errno on error. */
+ssize_t redis_append( Redis* , size_t argc , const char*const*argv , const size_t*argv_len );
+
+/** Sends all queued commands.
+ * @return 0 on success, negative on error (reason got logged). */
+ssize_t redis_flush( Redis* );
+
+/** Waits for the next reply.
+ * @param dst
+ *      Valid until the next call.
+ * @return 0 on success, negative on error (reason got logged). Error
+ *      replies are a success (of type REDIS_ERROR). */
+ssize_t redis_read( Redis* , const RedisReply**dst );
+
+
+#endif /* INCGUARD_41d8e6b2a97f4c05b3e1f8a2c6d09e73 */
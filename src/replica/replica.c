@@ -0,0 +1,283 @@
+/* By using this work you agree to the terms and conditions in 'LICENSE.txt' */
+
+/* This */
+#include "replica.h"
+
+/* System */
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Project */
+#include "arena.h"
+#include "hash.h"
+#include "log.h"
+
+
+/** What '--replicate' remembers about a resource of the source. */
+typedef struct ReplicaItem {
+    /** Hash of 'path'. Zero marks a free slot. */
+    uint64_t hash;
+    char *path;
+    /** ETag of the copy on the target. NULL if there is no good copy. */
+    char *etag;
+    /** Cycle which listed it last. Zero once forgotten. */
+    uint_t cycle;
+} ReplicaItem;
+
+
+struct Replica {
+    /** Open addressing. Capacity always is a power of two. */
+    ReplicaItem *items;
+    size_t items_len;
+    size_t items_cap;
+    uint_t cycle;
+};
+
+
+static uint64_t replica_hash( const char*path ){
+    const uint64_t hash = hash_fnv1a64(HASH_FNV1A64_INIT, path, strlen(path));
+    return hash ? hash : 1; /* <- Zero marks free slots. */
+}
+
+
+/** @return Slot of 'path'. Either the item or the free slot to place it. */
+static ReplicaItem* replica_slot( Replica*replica, const char*path, uint64_t hash ){
+    const size_t mask = replica->items_cap - 1;
+    for( size_t i = hash & mask ;; i = (i+1) & mask ){
+        ReplicaItem *item = replica->items + i;
+        if( item->hash == 0 || (item->hash == hash && !strcmp(item->path, path)) ){
+            return item; }
+    }
+}
+
+
+/** (Re)builds the table with room for at least 'minCap' items. Drops the
+ * items marked deleted (cycle zero). */
+static ssize_t replica_rehash( Replica*replica, size_t minCap ){
+    ReplicaItem *old = replica->items;
+    const size_t old_cap = replica->items_cap;
+    size_t cap = 1024;
+    while( cap < 2*minCap ){ cap *= 2; } /* <- Load factor at or below 0.5 */
+    replica->items = calloc(cap, sizeof*replica->items);
+    if( replica->items == NULL ){
+        replica->items = old;
+        return -ENOMEM;
+    }
+    replica->items_cap = cap;
+    replica->items_len = 0;
+    for( size_t i=0 ; i<old_cap ; ++i ){
+        if( old[i].hash == 0 ){ continue; }
+        if( old[i].cycle == 0 ){
+            free(old[i].path); free(old[i].etag);
+            continue;
+        }
+        *replica_slot(replica, old[i].path, old[i].hash) = old[i];
+        replica->items_len += 1;
+    }
+    free(old);
+    return 0;
+}
+
+
+static ReplicaItem* replica_find( Replica*replica, const char*path ){
+    if( replica->items_cap == 0 ){
+        return NULL; }
+    ReplicaItem *item = replica_slot(replica, path, replica_hash(path));
+    return item->hash ? item : NULL;
+}
+
+
+/** Replaces 'file' with the metrics of the replication. Failures only get
+ * logged. They do not affect the replication. */
+static void writeMetrics( const char*file, const Replica*replica, const ReplicaCycle*stats,
+    uint_t cyclesFailed, double duration, double lag, time_t lastOk )
+{
+    char *tmpFile = NULL;
+    FILE *f = NULL;
+    const size_t file_len = strlen(file);
+    tmpFile = malloc(file_len + sizeof ".tmp");
+    if( tmpFile == NULL ){
+        log_write(LOG_LVL_WARN, "%s", "Out of memory. Metrics not written.");
+        goto endFn;
+    }
+    sprintf(tmpFile, "%s%s", file, ".tmp");
+    f = fopen(tmpFile, "wb");
+    if( f == NULL ){
+        log_write(LOG_LVL_WARN, "%s%s%s%s", "fopen('", tmpFile, "'): ", strerror(errno));
+        goto endFn;
+    }
+    fprintf(f, "%s%.3f\n",
+        "# HELP gateleen_resclone_replica_lag_seconds Age of the newest source state the target is known to hold.\n"
+        "# TYPE gateleen_resclone_replica_lag_seconds gauge\n"
+        "gateleen_resclone_replica_lag_seconds ", lag);
+    fprintf(f, "%s%lld\n",
+        "# HELP gateleen_resclone_replica_last_success_timestamp_seconds Begin of the last cycle without failures. Zero if none.\n"
+        "# TYPE gateleen_resclone_replica_last_success_timestamp_seconds gauge\n"
+        "gateleen_resclone_replica_last_success_timestamp_seconds ", (long long)lastOk);
+    fprintf(f, "%s%.3f\n",
+        "# HELP gateleen_resclone_replica_cycle_duration_seconds Duration of the last cycle.\n"
+        "# TYPE gateleen_resclone_replica_cycle_duration_seconds gauge\n"
+        "gateleen_resclone_replica_cycle_duration_seconds ", duration);
+    fprintf(f, "%s%u\n%s%u\n",
+        "# HELP gateleen_resclone_replica_cycles_total Cycles run so far.\n"
+        "# TYPE gateleen_resclone_replica_cycles_total counter\n"
+        "gateleen_resclone_replica_cycles_total ", replica->cycle,
+        "# HELP gateleen_resclone_replica_cycles_failed_total Cycles with failures so far.\n"
+        "# TYPE gateleen_resclone_replica_cycles_failed_total counter\n"
+        "gateleen_resclone_replica_cycles_failed_total ", cyclesFailed);
+    fprintf(f, "%s"FMT_SIZE_T"\n%s"FMT_SIZE_T"\n%s"FMT_SIZE_T"\n%s"FMT_SIZE_T"\n%s"FMT_SIZE_T"\n",
+        "# HELP gateleen_resclone_replica_resources Resources of the last cycle by outcome.\n"
+        "# TYPE gateleen_resclone_replica_resources gauge\n"
+        "gateleen_resclone_replica_resources{outcome=\"changed\"} ", stats->changed,
+        "gateleen_resclone_replica_resources{outcome=\"unchanged\"} ", stats->unchanged,
+        "gateleen_resclone_replica_resources{outcome=\"deleted\"} ", stats->deleted,
+        "gateleen_resclone_replica_resources{outcome=\"failed\"} ", stats->failed,
+        "# HELP gateleen_resclone_replica_tracked_resources Resources known from the source.\n"
+        "# TYPE gateleen_resclone_replica_tracked_resources gauge\n"
+        "gateleen_resclone_replica_tracked_resources ", replica->items_len);
+    fprintf(f, "%s"FMT_SIZE_T"\n",
+        "# HELP gateleen_resclone_replica_skipped_listings Collections of the last cycle whose listing failed.\n"
+        "# TYPE gateleen_resclone_replica_skipped_listings gauge\n"
+        "gateleen_resclone_replica_skipped_listings ", stats->skippedListings);
+    if( fclose(f) ){
+        f = NULL;
+        log_write(LOG_LVL_WARN, "%s%s%s%s", "fclose('", tmpFile, "'): ", strerror(errno));
+        goto endFn;
+    }
+    f = NULL;
+    if( rename(tmpFile, file) ){
+        log_write(LOG_LVL_WARN, "%s%s%s%s", "rename('", file, "'): ", strerror(errno));
+        goto endFn;
+    }
+endFn:
+    if( f ){ fclose(f); }
+    free(tmpFile);
+}
+
+
+Replica* replica_alloc( void ){
+    return calloc(1, sizeof(Replica));
+}
+
+
+void replica_free( Replica*replica ){
+    if( replica == NULL ){ return; }
+    for( size_t i=0 ; i<replica->items_cap ; ++i ){
+        free(replica->items[i].path);
+        free(replica->items[i].etag);
+    }
+    free(replica->items);
+    free(replica);
+}
+
+
+ssize_t replica_run( Replica*replica, const ReplicaOpts*opts ){
+    ssize_t err;
+    uint_t cyclesFailed = 0;
+
+    // Lag is the age of the source state the target is known to hold. That
+    // is the begin of the last cycle which went through without failure (or
+    // our start if there was none yet).
+    const time_t startWall = time(NULL);
+    time_t lastOk = 0;
+    for(;;){
+        struct timespec begin, end;
+        ReplicaCycle stats = {0};
+        clock_gettime(CLOCK_MONOTONIC, &begin);
+        const time_t beginWall = time(NULL);
+        replica->cycle += 1;
+        err = opts->runCycle(opts->cls, replica, &stats);
+        const int isOk = !err && stats.failed == 0 && stats.skippedListings == 0;
+        if( isOk ){
+            lastOk = beginWall;
+        }else{
+            cyclesFailed += 1;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        const double duration = (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9;
+        const double lag = difftime(time(NULL), lastOk ? lastOk : startWall);
+        log_write(isOk ? LOG_LVL_INFO : LOG_LVL_WARN,
+            "%s%u%s"FMT_SIZE_T"%s"FMT_SIZE_T"%s"FMT_SIZE_T"%s"FMT_SIZE_T"%s"FMT_SIZE_T"%s%.1f%s%.0f%s",
+            "Replicate cycle ", replica->cycle, err ? " aborted. " : " done. ", stats.changed, " changed, ", stats.unchanged, " unchanged, ", stats.deleted,
+            " deleted, ", stats.failed, " failed, ", stats.skippedListings, " listings skipped, ", duration, "s, lag ", lag, "s");
+        if( opts->metricsFile ){
+            writeMetrics(opts->metricsFile, replica, &stats, cyclesFailed, duration, lag, lastOk); }
+        if( opts->cycles && replica->cycle >= opts->cycles ){
+            break; }
+        // Next cycle starts one interval after this one began.
+        double pause = opts->interval - duration;
+        if( pause > 0 ){
+            struct timespec rem = { .tv_sec = (time_t)pause, .tv_nsec = (long)((pause - (time_t)pause) * 1e9) };
+            while( nanosleep(&rem, &rem) && errno == EINTR );
+        }
+    }
+    return err ? -1 : 0;
+}
+
+
+ssize_t replica_see( Replica*replica, const char*path, const char**etag ){
+    if( 2*(replica->items_len +1) > replica->items_cap && replica_rehash(replica, replica->items_len +1) ){
+        return -ENOMEM; }
+    const uint64_t hash = replica_hash(path);
+    ReplicaItem *item = replica_slot(replica, path, hash);
+    if( item->hash == 0 ){
+        item->path = strdup(path);
+        if( item->path == NULL ){
+            return -ENOMEM; }
+        item->hash = hash;
+        replica->items_len += 1;
+    }
+    item->cycle = replica->cycle;
+    *etag = item->etag;
+    return 0;
+}
+
+
+ssize_t replica_setEtag( Replica*replica, const char*path, const char*etag ){
+    ReplicaItem *item = replica_find(replica, path);
+    if( item == NULL ){
+        return 0; }
+    free(item->etag); item->etag = NULL;
+    if( etag && etag[0] != '\0' ){
+        item->etag = strdup(etag);
+        if( item->etag == NULL ){
+            return -ENOMEM; }
+    }
+    return 0;
+}
+
+
+void replica_forget( Replica*replica, const char*path ){
+    ReplicaItem *item = replica_find(replica, path);
+    if( item ){ item->cycle = 0; } /* <- Gets dropped by the next rehash. */
+}
+
+
+ssize_t replica_gone( Replica*replica, char**dst, size_t*dst_len ){
+    char *gone = NULL;
+    size_t gone_len = 0, gone_cap = 0;
+    for( size_t i=0 ; i<replica->items_cap ; ++i ){
+        const ReplicaItem *item = replica->items + i;
+        if( item->hash == 0 || item->cycle == replica->cycle || item->cycle == 0 ){
+            continue; }
+        const size_t path_len = strlen(item->path);
+        if( memBudget_growBuf(NULL, 0, &gone, &gone_cap, gone_len + path_len +1) ){
+            free(gone);
+            return -ENOMEM;
+        }
+        memcpy(gone + gone_len, item->path, path_len +1);
+        gone_len += path_len +1;
+    }
+    *dst = gone;
+    *dst_len = gone_len;
+    return 0;
+}
+
+
+ssize_t replica_compact( Replica*replica ){
+    return replica_rehash(replica, replica->items_len);
+}
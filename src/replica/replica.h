@@ -0,0 +1,91 @@
+/* By using this work you agree to the terms and conditions in 'LICENSE.txt' */
+
+#ifndef INCGUARD_5751fa5176414063b9710b66cb103435
+#define INCGUARD_5751fa5176414063b9710b66cb103435
+
+#include "commonbase.h"
+
+#include <stddef.h>
+#include <sys/types.h>
+
+
+/**
+ * State of '--replicate' kept from one cycle to the next: The paths the
+ * source had and the ETag of the copy the target holds of each. Plus the
+ * loop running the cycles.
+ *
+ * Not thread safe.
+ */
+typedef struct Replica Replica;
+
+
+/** What one cycle did. */
+typedef struct ReplicaCycle {
+    /** Resources copied to the target. */
+    size_t changed;
+    /** Resources skipped as the source confirmed them unchanged. */
+    size_t unchanged;
+    /** Resources deleted from the target as they disappeared. */
+    size_t deleted;
+    size_t failed;
+    /** Collections whose listing failed. A cycle with any of them does not
+     * tell what disappeared, so it must not delete anything. */
+    size_t skippedListings;
+} ReplicaCycle;
+
+
+typedef struct ReplicaOpts {
+    /** Seconds from the begin of one cycle to the next. Zero starts the next
+     * one as soon the previous is done. */
+    uint_t interval;
+    /** Stop after that many cycles. Zero means never. */
+    uint_t cycles;
+    /** (optional) File to (atomically) replace with metrics in prometheus
+     * text format after each cycle. */
+    const char *metricsFile;
+    /** Runs one cycle. Fills in 'dst' as far as it got, also on failure.
+     * @return 0 on success, negative if the cycle got aborted. */
+    ssize_t (*runCycle)( void*cls , Replica* , ReplicaCycle*dst );
+    void *cls;
+} ReplicaOpts;
+
+
+/** @return NULL if out of memory. */
+Replica* replica_alloc( void );
+
+void replica_free( Replica* );
+
+/** Runs cycles as 'opts' tells. A failing cycle does not stop the loop. The
+ * next one tries again.
+ * @return 0 if the last cycle went through, negative otherwise. */
+ssize_t replica_run( Replica* , const ReplicaOpts*opts );
+
+/** Marks 'path' as still present on the source in the running cycle.
+ * @param etag
+ *      Gets the ETag of the copy on the target. NULL if there is no good
+ *      copy. Valid until the replica gets changed.
+ * @return 0 on success, -ENOMEM. */
+ssize_t replica_see( Replica* , const char*path , const char**etag );
+
+/** Remembers the version the target now has. NULL (or empty) 'etag' means
+ * it has to be copied again next cycle. Ignores unknown paths.
+ * @return 0 on success, -ENOMEM. */
+ssize_t replica_setEtag( Replica* , const char*path , const char*etag );
+
+/** Forgets 'path' once it got deleted from the target. Takes effect with the
+ * next 'replica_compact'. */
+void replica_forget( Replica* , const char*path );
+
+/** Collects the paths earlier cycles saw but the running one did not.
+ * @param dst
+ *      Gets the paths, each zero terminated, one after the other. NULL if
+ *      there are none. Free it when done.
+ * @return 0 on success, -ENOMEM. */
+ssize_t replica_gone( Replica* , char**dst , size_t*dst_len );
+
+/** Drops what 'replica_forget' forgot.
+ * @return 0 on success, -ENOMEM. */
+ssize_t replica_compact( Replica* );
+
+
+#endif /* INCGUARD_5751fa5176414063b9710b66cb103435 */
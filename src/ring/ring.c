@@ -0,0 +1,116 @@
+/* By using this work you agree to the terms and conditions in 'LICENSE.txt' */
+
+/* This */
+#include "ring.h"
+
+/* System */
+#include <stdint.h>
+#include <stdlib.h>
+
+
+/* Every message starts with its length. Marks the rest of the buffer as
+ * unused where a message did not fit in before the end. */
+#define RING_WRAP SIZE_MAX
+#define RING_HDR_SZ sizeof(size_t)
+#define RING_ALIGN( n ) (((n) + (RING_HDR_SZ-1)) & ~(RING_HDR_SZ-1))
+/* Keeps producer and consumer state on different cache lines. */
+#define RING_CACHELINE 64
+
+
+struct Ring {
+    char *buf;
+    size_t cap; /* <- Always power of two. */
+    /* Consumer side. Positions count up forever and get masked on use. */
+    size_t head;
+    size_t peekEnd;
+    char pad1_[RING_CACHELINE];
+    /* Producer side. */
+    size_t tail;
+    size_t reserveBeg;
+    size_t reserveEnd;
+    char pad2_[RING_CACHELINE];
+};
+
+
+Ring* ring_alloc( size_t cap ){
+    Ring *ring = calloc(1, sizeof*ring);
+    if( ring == NULL ){ return NULL; }
+    for( ring->cap=4096 ; ring->cap < cap ; ring->cap *= 2 );
+    ring->buf = malloc(ring->cap);
+    if( ring->buf == NULL ){ free(ring); return NULL; }
+    return ring;
+}
+
+
+void ring_free( Ring*ring ){
+    if( ring == NULL ){ return; }
+    free(ring->buf);
+    free(ring);
+}
+
+
+size_t ring_maxMsgLen( const Ring*ring ){
+    // Worst case a message has to skip almost half of the buffer to not
+    // wrap. Keep it at a quarter so there is room for more than one.
+    return ring->cap / 4 - RING_HDR_SZ;
+}
+
+
+void* ring_reserve( Ring*ring, size_t len ){
+    if( len > ring_maxMsgLen(ring) ){ return NULL; }
+    const size_t need = RING_HDR_SZ + RING_ALIGN(len);
+    const size_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    size_t tail = ring->tail;
+    const size_t pos = tail & (ring->cap - 1);
+    // Positions are aligned. So there is always room for a header before the
+    // end.
+    const size_t skip = (ring->cap - pos < need) ? ring->cap - pos : 0;
+    if( ring->cap - (tail - head) < skip + need ){
+        return NULL; }
+    if( skip ){
+        *(size_t*)(ring->buf + pos) = RING_WRAP;
+        tail += skip;
+    }
+    ring->reserveBeg = tail;
+    ring->reserveEnd = tail + need;
+    *(size_t*)(ring->buf + (tail & (ring->cap - 1))) = len;
+    return ring->buf + (tail & (ring->cap - 1)) + RING_HDR_SZ;
+}
+
+
+void ring_commit( Ring*ring ){
+    // Publishes the payload (and a wrap marker if any) along with it.
+    __atomic_store_n(&ring->tail, ring->reserveEnd, __ATOMIC_RELEASE);
+}
+
+
+void* ring_peek( Ring*ring, size_t*len ){
+    const size_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    size_t head = ring->head;
+    if( head == tail ){ return NULL; }
+    size_t pos = head & (ring->cap - 1);
+    if( *(size_t*)(ring->buf + pos) == RING_WRAP ){
+        head += ring->cap - pos;
+        pos = 0;
+    }
+    *len = *(size_t*)(ring->buf + pos);
+    ring->peekEnd = head + RING_HDR_SZ + RING_ALIGN(*len);
+    return ring->buf + pos + RING_HDR_SZ;
+}
+
+
+void ring_release( Ring*ring ){
+    __atomic_store_n(&ring->head, ring->peekEnd, __ATOMIC_RELEASE);
+}
+
+
+size_t ring_used( const Ring*ring ){
+    const size_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    const size_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    return tail - head;
+}
+
+
+size_t ring_cap( const Ring*ring ){
+    return ring->cap;
+}
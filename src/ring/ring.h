@@ -0,0 +1,54 @@
+/* By using this work you agree to the terms and conditions in 'LICENSE.txt' */
+
+#ifndef INCGUARD_e5a09c3b71d24f8c9b62d7a41f0e38c6
+#define INCGUARD_e5a09c3b71d24f8c9b62d7a41f0e38c6
+
+#include "commonbase.h"
+
+#include <stddef.h>
+
+
+/**
+ * Bounded queue of variable sized messages for exactly one producer thread
+ * and exactly one consumer thread. Lock-free. Messages get written and read
+ * in place, so nothing gets copied but the payload itself.
+ *
+ * Producer: 'ring_reserve', fill in, 'ring_commit'.
+ * Consumer: 'ring_peek', use, 'ring_release'.
+ */
+typedef struct Ring Ring;
+
+
+/** @param cap
+ *      Bytes to allocate. Gets rounded up to a power of two. */
+Ring* ring_alloc( size_t cap );
+
+void ring_free( Ring* );
+
+/** @return Largest message 'ring_reserve' accepts. */
+size_t ring_maxMsgLen( const Ring* );
+
+/** @return Pointer to 'len' bytes to fill in or NULL if there is not enough
+ *      room right now. Nothing is visible to the consumer until
+ *      'ring_commit'. */
+void* ring_reserve( Ring* , size_t len );
+
+/** Publishes the message reserved last. */
+void ring_commit( Ring* );
+
+/** @return Oldest message (and its length in 'len') or NULL if queue is
+ *      empty right now. Stays in queue until 'ring_release'. */
+void* ring_peek( Ring* , size_t*len );
+
+/** Drops the message peeked last. */
+void ring_release( Ring* );
+
+/** @return Bytes currently queued (including overhead). A snapshot only when
+ *      called from other threads. */
+size_t ring_used( const Ring* );
+
+/** @return Allocated capacity in bytes. */
+size_t ring_cap( const Ring* );
+
+
+#endif /* INCGUARD_e5a09c3b71d24f8c9b62d7a41f0e38c6 */
@@ -0,0 +1,330 @@
+/* By using this work you agree to the terms and conditions in 'LICENSE.txt' */
+
+/* This */
+#include "zstdseek.h"
+
+/* System */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Libs */
+#include <zstd.h>
+
+/* Project */
+#include "log.h"
+
+
+/* See "zstd seekable format" in the zstd repo (contrib/seekable_format). */
+#define SKIPPABLE_MAGIC 0x184D2A5E
+#define SEEKABLE_MAGIC 0x8F92EAB1
+/* Number_Of_Frames, Seek_Table_Descriptor, Seekable_Magic_Number. */
+#define FOOTER_SIZE 9
+/* Seek_Table_Descriptor flag saying each entry has a checksum. */
+#define DESCRIPTOR_CHECKSUM 0x80
+
+
+struct ZstdSeekWriter {
+    FILE *out;
+    ZSTD_CCtx *cctx;
+    char *outBuf;
+    size_t outBuf_cap;
+    /* Bytes of the current frame so far. */
+    uint64_t frameIn, frameOut;
+    /* Compressed and decompressed size of each finished frame. */
+    uint32_t *table;
+    size_t table_len, table_cap;
+    /* Some frame does not fit into the table's 32 bit fields. */
+    int isTooLarge;
+};
+
+
+struct ZstdSeekReader {
+    FILE *in;
+    ZSTD_DCtx *dctx;
+    char *inBuf;
+    size_t inBuf_cap;
+    ZSTD_inBuffer input;
+    /* Compressed bytes of the range not read yet. */
+    uint64_t remaining;
+    /* Last hint of the decompressor which made progress. Zero at the end of
+     * a frame. */
+    size_t pending;
+};
+
+
+static void putU32( unsigned char*dst, uint32_t val ){
+    dst[0] = val; dst[1] = val >> 8; dst[2] = val >> 16; dst[3] = val >> 24;
+}
+
+
+static uint32_t getU32( const unsigned char*src ){
+    return src[0] | (uint32_t)src[1] << 8 | (uint32_t)src[2] << 16 | (uint32_t)src[3] << 24;
+}
+
+
+static ssize_t writeOut( ZstdSeekWriter*w, const void*buf, size_t buf_len ){
+    if( fwrite(buf, 1, buf_len, w->out) != buf_len ){
+        log_write(LOG_LVL_ERROR, "%s%s", "zstdseek: Failed to write: ", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+
+/* Runs the compressor until it took all of 'input' (or with ZSTD_e_end
+ * until the frame is complete). */
+static ssize_t compress( ZstdSeekWriter*w, ZSTD_inBuffer*input, ZSTD_EndDirective mode ){
+    for(;;){
+        ZSTD_outBuffer output = { w->outBuf, w->outBuf_cap, 0 };
+        const size_t pending = ZSTD_compressStream2(w->cctx, &output, input, mode);
+        if( ZSTD_isError(pending) ){
+            log_write(LOG_LVL_ERROR, "%s%s", "zstdseek: ", ZSTD_getErrorName(pending));
+            return -1;
+        }
+        if( writeOut(w, w->outBuf, output.pos) ){
+            return -1; }
+        w->frameOut += output.pos;
+        if( mode == ZSTD_e_end ? pending == 0 : input->pos == input->size ){
+            return 0; }
+    }
+}
+
+
+ZstdSeekWriter* zstdseek_writerOpen( const char*file, int level ){
+    ZstdSeekWriter *w = calloc(1, sizeof*w);
+    if( w == NULL ){
+        goto fail; }
+    w->outBuf_cap = ZSTD_CStreamOutSize();
+    w->outBuf = malloc(w->outBuf_cap);
+    w->cctx = ZSTD_createCCtx();
+    if( w->outBuf == NULL || w->cctx == NULL ){
+        goto fail; }
+    if( ZSTD_isError(ZSTD_CCtx_setParameter(w->cctx, ZSTD_c_compressionLevel, level))
+        // Frames get read back as a whole. No need to repeat their size.
+        || ZSTD_isError(ZSTD_CCtx_setParameter(w->cctx, ZSTD_c_contentSizeFlag, 0)) )
+    {
+        goto fail; }
+    w->out = file ? fopen(file, "wb") : stdout;
+    if( w->out == NULL ){
+        log_write(LOG_LVL_ERROR, "%s%s%s%s", "zstdseek: fopen(", file, "): ", strerror(errno));
+        goto fail;
+    }
+    return w;
+fail:
+    if( w ){
+        ZSTD_freeCCtx(w->cctx);
+        free(w->outBuf);
+        free(w);
+    }
+    return NULL;
+}
+
+
+ssize_t zstdseek_write( ZstdSeekWriter*w, const void*buf, size_t buf_len ){
+    ZSTD_inBuffer input = { buf, buf_len, 0 };
+    if( compress(w, &input, ZSTD_e_continue) ){
+        return -1; }
+    w->frameIn += buf_len;
+    return 0;
+}
+
+
+ssize_t zstdseek_cut( ZstdSeekWriter*w, size_t minBytes ){
+    if( w->frameIn == 0 || w->frameIn < minBytes ){
+        return 0; }
+    ZSTD_inBuffer input = { NULL, 0, 0 };
+    if( compress(w, &input, ZSTD_e_end) ){
+        return -1; }
+    if( w->frameIn > UINT32_MAX || w->frameOut > UINT32_MAX ){
+        w->isTooLarge = !0; }
+    if( w->table_len + 2 > w->table_cap ){
+        const size_t cap = w->table_cap ? w->table_cap * 2 : 256;
+        uint32_t *tmp = realloc(w->table, cap * sizeof*tmp);
+        if( tmp == NULL ){
+            return -ENOMEM; }
+        w->table = tmp;
+        w->table_cap = cap;
+    }
+    w->table[w->table_len++] = w->frameOut;
+    w->table[w->table_len++] = w->frameIn;
+    w->frameIn = 0;
+    w->frameOut = 0;
+    return 0;
+}
+
+
+ssize_t zstdseek_writerClose( ZstdSeekWriter*w ){
+    ssize_t err;
+    unsigned char buf[8];
+    if( w == NULL ){
+        return 0; }
+    err = zstdseek_cut(w, 0);
+    if( err ){
+        err = -1; goto endFn; }
+    const size_t frames_len = w->table_len / 2;
+    if( w->isTooLarge || frames_len > UINT32_MAX / 8 ){
+        log_write(LOG_LVL_WARN, "%s", "zstdseek: Frames too large for a seek table. Written without.");
+    }else{
+        putU32(buf, SKIPPABLE_MAGIC);
+        putU32(buf + 4, frames_len * 8 + FOOTER_SIZE);
+        if( writeOut(w, buf, 8) ){
+            err = -1; goto endFn; }
+        for( size_t i=0 ; i<w->table_len ; ++i ){
+            putU32(buf, w->table[i]);
+            if( writeOut(w, buf, 4) ){
+                err = -1; goto endFn; }
+        }
+        putU32(buf, frames_len);
+        buf[4] = 0; /* <- No checksums. */
+        if( writeOut(w, buf, 5) ){
+            err = -1; goto endFn; }
+        putU32(buf, SEEKABLE_MAGIC);
+        if( writeOut(w, buf, 4) ){
+            err = -1; goto endFn; }
+    }
+    if( fflush(w->out) ){
+        log_write(LOG_LVL_ERROR, "%s%s", "zstdseek: Failed to write: ", strerror(errno));
+        err = -1; goto endFn;
+    }
+
+    err = 0;
+endFn:
+    if( w->out != stdout && fclose(w->out) && err == 0 ){
+        log_write(LOG_LVL_ERROR, "%s%s", "zstdseek: Failed to close: ", strerror(errno));
+        err = -1;
+    }
+    ZSTD_freeCCtx(w->cctx);
+    free(w->outBuf);
+    free(w->table);
+    free(w);
+    return err;
+}
+
+
+ssize_t zstdseek_readTable( const char*file, ZstdSeekFrame**frames, size_t*frames_len ){
+    ssize_t err;
+    unsigned char *raw = NULL;
+    ZstdSeekFrame *list = NULL;
+    unsigned char footer[FOOTER_SIZE];
+    FILE *in = fopen(file, "rb");
+    if( in == NULL ){
+        log_write(LOG_LVL_ERROR, "%s%s%s%s", "zstdseek: fopen(", file, "): ", strerror(errno));
+        err = -1; goto endFn;
+    }
+    if(    fseeko(in, 0, SEEK_END) ){
+        err = -1; goto endFn; }
+    const off_t file_len = ftello(in);
+    if(    file_len < 8 + FOOTER_SIZE
+        || fseeko(in, -FOOTER_SIZE, SEEK_END)
+        || fread(footer, 1, FOOTER_SIZE, in) != FOOTER_SIZE
+        || getU32(footer + 5) != SEEKABLE_MAGIC
+        || (footer[4] & ~DESCRIPTOR_CHECKSUM) != 0 )
+    {
+        err = 0; goto endFn; }
+    const uint64_t list_len = getU32(footer);
+    const uint64_t entrySize = footer[4] & DESCRIPTOR_CHECKSUM ? 12 : 8;
+    const uint64_t tableSize = list_len * entrySize + FOOTER_SIZE;
+    if( tableSize + 8 > (uint64_t)file_len ){
+        err = 0; goto endFn; }
+    raw = malloc(8 + tableSize);
+    list = malloc((list_len ? list_len : 1) * sizeof*list);
+    if( raw == NULL || list == NULL ){
+        err = -ENOMEM; goto endFn; }
+    if(    fseeko(in, -(off_t)(tableSize + 8), SEEK_END)
+        || fread(raw, 1, 8 + tableSize, in) != 8 + tableSize
+        || getU32(raw) != SKIPPABLE_MAGIC
+        || getU32(raw + 4) != tableSize )
+    {
+        err = 0; goto endFn; }
+    uint64_t offset = 0;
+    for( uint64_t i=0 ; i<list_len ; ++i ){
+        const unsigned char *it = raw + 8 + i * entrySize;
+        list[i].offset = offset;
+        list[i].compressedSize = getU32(it);
+        list[i].decompressedSize = getU32(it + 4);
+        offset += list[i].compressedSize;
+    }
+    // Frames must cover all of the file up to the table. Otherwise the
+    // offsets would be wrong.
+    if( offset + 8 + tableSize != (uint64_t)file_len ){
+        err = 0; goto endFn; }
+    *frames = list; list = NULL;
+    *frames_len = list_len;
+
+    err = 1;
+endFn:
+    if( in ){ fclose(in); }
+    free(raw);
+    free(list);
+    return err;
+}
+
+
+ZstdSeekReader* zstdseek_readerOpen( const char*file, uint64_t offset, uint64_t length ){
+    ZstdSeekReader *r = calloc(1, sizeof*r);
+    if( r == NULL ){
+        goto fail; }
+    r->inBuf_cap = ZSTD_DStreamInSize();
+    r->inBuf = malloc(r->inBuf_cap);
+    r->dctx = ZSTD_createDCtx();
+    if( r->inBuf == NULL || r->dctx == NULL ){
+        goto fail; }
+    r->in = fopen(file, "rb");
+    if( r->in == NULL || fseeko(r->in, offset, SEEK_SET) ){
+        log_write(LOG_LVL_ERROR, "%s%s%s%s", "zstdseek: open(", file, "): ", strerror(errno));
+        goto fail;
+    }
+    r->remaining = length;
+    return r;
+fail:
+    zstdseek_readerFree(r);
+    return NULL;
+}
+
+
+ssize_t zstdseek_read( ZstdSeekReader*r, void*buf, size_t buf_cap ){
+    for(;;){
+        if( r->input.pos == r->input.size && r->remaining ){
+            const size_t want = r->remaining < r->inBuf_cap ? r->remaining : r->inBuf_cap;
+            const size_t got = fread(r->inBuf, 1, want, r->in);
+            if( got == 0 ){
+                log_write(LOG_LVL_ERROR, "%s", "zstdseek: Unexpected end of file");
+                return -1;
+            }
+            r->remaining -= got;
+            r->input.src = r->inBuf;
+            r->input.size = got;
+            r->input.pos = 0;
+        }
+        ZSTD_outBuffer output = { buf, buf_cap, 0 };
+        const size_t inputPos = r->input.pos;
+        const size_t pending = ZSTD_decompressStream(r->dctx, &output, &r->input);
+        if( ZSTD_isError(pending) ){
+            log_write(LOG_LVL_ERROR, "%s%s", "zstdseek: ", ZSTD_getErrorName(pending));
+            return -1;
+        }
+        if( output.pos || r->input.pos != inputPos ){
+            r->pending = pending; }
+        if( output.pos ){
+            return output.pos; }
+        if( r->input.pos == r->input.size && r->remaining == 0 ){
+            if( r->pending ){
+                log_write(LOG_LVL_ERROR, "%s", "zstdseek: Range ends within a frame");
+                return -1;
+            }
+            return 0;
+        }
+    }
+}
+
+
+void zstdseek_readerFree( ZstdSeekReader*r ){
+    if( r == NULL ){
+        return; }
+    if( r->in ){ fclose(r->in); }
+    ZSTD_freeDCtx(r->dctx);
+    free(r->inBuf);
+    free(r);
+}
@@ -0,0 +1,88 @@
+/* By using this work you agree to the terms and conditions in 'LICENSE.txt' */
+
+#ifndef INCGUARD_cf3112b906785048e2ac33cd279862bf
+#define INCGUARD_cf3112b906785048e2ac33cd279862bf
+
+#include "commonbase.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+
+/**
+ * zstd stream made of independent frames, followed by a seek table in the
+ * zstd "seekable format" (a skippable frame listing the compressed and
+ * decompressed size of each frame). Plain zstd decoders skip that table. So
+ * the result stays an ordinary .zst. Readers knowing the table can
+ * decompress ranges of frames on their own, eg concurrently.
+ *
+ * The caller decides where frames end (see 'zstdseek_cut'). So frames can
+ * start at boundaries meaningful to the content.
+ */
+typedef struct ZstdSeekWriter ZstdSeekWriter;
+
+
+/**
+ * @param file
+ *      File to create. NULL means stdout.
+ * @return
+ *      NULL on error (logged).
+ */
+ZstdSeekWriter* zstdseek_writerOpen( const char*file , int level );
+
+/** @return 0 on success, negative on error (logged). */
+ssize_t zstdseek_write( ZstdSeekWriter* , const void*buf , size_t buf_len );
+
+/** Ends the current frame if it holds at least 'minBytes' (uncompressed).
+ * @return 0 on success, negative on error (logged). */
+ssize_t zstdseek_cut( ZstdSeekWriter* , size_t minBytes );
+
+/** Ends the last frame, appends the seek table and frees the writer. The
+ * table gets omitted (with a warning) if a frame got too large for it.
+ * @return 0 on success, negative on error (logged). */
+ssize_t zstdseek_writerClose( ZstdSeekWriter* );
+
+
+/** One frame as listed in the seek table. */
+typedef struct ZstdSeekFrame {
+    /** Where the frame starts in the file. */
+    uint64_t offset;
+    uint64_t compressedSize;
+    uint64_t decompressedSize;
+} ZstdSeekFrame;
+
+
+/**
+ * Reads the seek table at the end of 'file'.
+ *
+ * @param frames
+ *      Receives the frames in file order. Caller frees it.
+ * @return
+ *      1 if 'file' has a (consistent) seek table, 0 if not, negative on
+ *      error.
+ */
+ssize_t zstdseek_readTable( const char*file , ZstdSeekFrame**frames , size_t*frames_len );
+
+
+/** Decompresses one range of frames. */
+typedef struct ZstdSeekReader ZstdSeekReader;
+
+/**
+ * @param offset
+ *      Where the first frame of the range starts.
+ * @param length
+ *      Compressed bytes of the range.
+ * @return
+ *      NULL on error (logged).
+ */
+ZstdSeekReader* zstdseek_readerOpen( const char*file , uint64_t offset , uint64_t length );
+
+/** @return Count of decompressed bytes placed in 'buf', 0 at end of the
+ *      range, negative on error (logged). */
+ssize_t zstdseek_read( ZstdSeekReader* , void*buf , size_t buf_cap );
+
+void zstdseek_readerFree( ZstdSeekReader* );
+
+
+#endif /* INCGUARD_cf3112b906785048e2ac33cd279862bf */